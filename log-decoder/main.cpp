@@ -0,0 +1,33 @@
+#include <misc/log_decoder.h>
+
+#include <fstream>
+#include <iostream>
+
+
+// prints a binary log that was written with AsyncLoggingOptions::binary_file
+// usage: log-decoder <file>
+int main(int argc, char* argv[]) {
+	if (argc != 2) {
+		std::cerr << "usage: log-decoder <file>" << std::endl;
+		return 1;
+	}
+
+	std::ifstream file{ argv[1], std::ios::binary };
+	if (!file) {
+		std::cerr << "failed to open " << argv[1] << std::endl;
+		return 1;
+	}
+
+	try {
+		// same as basic_ostream_logging()
+		static constexpr const char* prefixes[]{ "info", "success", "warning", "error" };
+
+		for (const auto& record : mango::decode_binary_log(file))
+			std::cout << '[' << prefixes[size_t(record.type)] << "] " << record.text << '\n';
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
\ No newline at end of file
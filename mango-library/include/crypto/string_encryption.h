@@ -2,7 +2,16 @@
 
 #include <string>
 #include <array>
+#include <span>
+#include <ostream>
+#include <cstring>
 #include <algorithm>
+#include <string_view>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define mango_enc_str_sse2
+#endif
 
 #include "compile_time_key.h"
 #include "../misc/misc.h"
@@ -17,8 +26,70 @@
 	return _encrypted_str();\
 })())\
 
+// same as enc_str() but decrypts onto the stack instead of allocating a std::string
+// the plaintext is wiped once it goes out of scope, so use it within a single expression
+// or bind it to a local: const auto name{ enc_str_view("ntdll.dll") };
+#define enc_str_view(str)\
+(([]() {\
+	constexpr mango::EncryptedString<sizeof(str)> _encrypted_str(str);\
+	return _encrypted_str.decrypt();\
+})())\
+
 
 namespace mango { 
+	namespace impl {
+		// volatile so that the compiler can't optimize it away, same as SecureZeroMemory()
+		template <typename T>
+		void secure_wipe(T* const data, const size_t count) noexcept {
+			const auto values{ static_cast<volatile T*>(data) };
+			for (size_t i{ 0 }; i < count; ++i)
+				values[i] = 0;
+		}
+	} // namespace impl
+
+	template <size_t Size>
+	class EncryptedString;
+
+	// a decrypted string that lives on the stack and is wiped in the destructor
+	template <size_t Size>
+	class DecryptedString {
+	public:
+		~DecryptedString() { impl::secure_wipe(this->m_blocks.data(), this->m_blocks.size()); }
+
+		// null-terminated
+		const char* c_str() const noexcept { return reinterpret_cast<const char*>(this->m_blocks.data()); }
+
+		// NOTE: only valid while this is alive
+		std::string_view view() const noexcept { return { this->c_str(), Size - 1 }; }
+		operator std::string_view() const noexcept { return this->view(); }
+
+		// a copy that isn't wiped
+		std::string str() const { return std::string{ this->view() }; }
+
+		size_t size() const noexcept { return Size - 1; }
+
+		friend std::ostream& operator<<(std::ostream& stream, const DecryptedString& str) {
+			return stream << str.view();
+		}
+
+		// prevent copying, there should only ever be one copy of the plaintext
+		DecryptedString(const DecryptedString&) = delete;
+		DecryptedString& operator=(const DecryptedString&) = delete;
+
+	private:
+		friend class EncryptedString<Size>;
+
+		// the blocks are packed in little-endian order, so once they're decrypted they're already the string
+		explicit DecryptedString(const EncryptedString<Size>& encrypted) noexcept {
+			encrypted.dec_blocks(this->m_blocks.data());
+			reinterpret_cast<char*>(this->m_blocks.data())[Size - 1] = '\0';
+		}
+
+	private:
+		// decrypted in place, atleast Size bytes so that there's room for the null terminator
+		std::array<uint64_t, Size / 8 + 1> m_blocks;
+	};
+
 	// compile time block based string encryption
 	template <size_t Size>
 	class EncryptedString {
@@ -41,21 +112,63 @@ namespace mango {
 
 		// decrypt the string
 		std::string operator()() const {
-			const auto size = Size - 1;
-			std::string decrypted_string(size, 0);
-			for (size_t i = 0; i < size; i += 8) {
-				// decrypt the block
-				const auto block = this->dec_block(this->m_data[i / 8], i / 8);
-
-				// unpack the block
-				for (size_t j = 0; j < std::min<size_t>(size - i, 8); ++j)
-					decrypted_string[i + j] = uint8_t(block >> (j * 8));
-			}
+			return this->decrypt().str();
+		}
+
+		// decrypt onto the stack, the plaintext is wiped once the result goes out of scope
+		DecryptedString<Size> decrypt() const noexcept {
+			return DecryptedString<Size>{ *this };
+		}
+
+		// decrypt into a caller-provided buffer (null-terminated)
+		// returns the size of the string, or 0 if the buffer is smaller than Size
+		size_t decrypt(const std::span<char> buffer) const noexcept {
+			if (buffer.size() < Size)
+				return 0;
+
+			const auto decrypted{ this->decrypt() };
+			std::memcpy(buffer.data(), decrypted.c_str(), Size);
+			return Size - 1;
+		}
 
-			return decrypted_string;
+		// decrypt into an array (null-terminated)
+		// NOTE: unlike decrypt(), this isn't wiped
+		std::array<char, Size> decrypt_array() const noexcept {
+			std::array<char, Size> decrypted;
+			this->decrypt(decrypted);
+			return decrypted;
 		}
 
 	private:
+		friend class DecryptedString<Size>;
+
+		// decrypt every block into out
+		void dec_blocks(uint64_t* const out) const noexcept {
+			size_t i = 0;
+
+#ifdef mango_enc_str_sse2
+			// long strings are decrypted 2 blocks at a time, (key + i) and (key * i) are incremented per lane
+			if constexpr (block_count >= 4) {
+				auto add = _mm_set_epi64x(int64_t(this->m_key + 1), int64_t(this->m_key));
+				auto mul = _mm_set_epi64x(int64_t(this->m_key), 0);
+
+				const auto add_step = _mm_set1_epi64x(2);
+				const auto mul_step = _mm_set1_epi64x(int64_t(this->m_key * 2));
+
+				for (; i + 2 <= block_count; i += 2) {
+					const auto blocks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&this->m_data[i]));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi64(_mm_xor_si128(blocks, add), mul));
+
+					add = _mm_add_epi64(add, add_step);
+					mul = _mm_add_epi64(mul, mul_step);
+				}
+			}
+#endif
+
+			for (; i < block_count; ++i)
+				out[i] = this->dec_block(this->m_data[i], i);
+		}
+
 		// decrypt a block
 		constexpr uint64_t dec_block(const uint64_t block, const size_t i) const {
 			return (block ^ (this->m_key + i)) - (this->m_key * i);
@@ -64,8 +177,10 @@ namespace mango {
 		// atleast 1 char
 		static_assert(Size > 1, "Cannot encrypt empty string");
 
+		static constexpr size_t block_count = (Size + 6) / 8;
+
 	private:
-		std::array<uint64_t, (Size + 6) / 8> m_data;
+		std::array<uint64_t, block_count> m_data;
 		const uint64_t m_key;
 	};
 } // namespace mango
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "shellcode.h"
+
+#include <stdint.h>
+#include <vector>
+
+
+namespace mango {
+	// small x86/x64 assembler that sits on top of Shellcode
+	// branches to labels are relaxed (short -> near) and resolved in assemble()
+	// NOTE: operand size is always the native size (eax on x86, rax on x64) unless stated otherwise
+	class Assembler {
+	public:
+		// rax and eax (etc) are the same register, use whichever reads better
+		enum class Reg : uint8_t {
+			rax = 0, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+			r8, r9, r10, r11, r12, r13, r14, r15,
+
+			// x86 names
+			eax = 0, ecx, edx, ebx, esp, ebp, esi, edi
+		};
+
+		// condition codes, the value is the low nibble of the jcc opcode
+		enum class Cond : uint8_t {
+			o = 0x0, no = 0x1, b = 0x2, ae = 0x3, e = 0x4, ne = 0x5, be = 0x6, a = 0x7,
+			s = 0x8, ns = 0x9, p = 0xA, np = 0xB, l = 0xC, ge = 0xD, le = 0xE, g = 0xF,
+
+			// aliases
+			z = e, nz = ne, c = b, nc = ae
+		};
+
+		// a position in the code, create with new_label() and place with bind()
+		struct Label {
+			size_t id = size_t(-1);
+		};
+
+	public:
+		explicit Assembler(const bool is64bit, const size_t reserve = 64);
+
+		// create a label that can be jumped to before or after it is bound
+		Label new_label();
+
+		// place the label at the current position
+		Assembler& bind(const Label label);
+
+		// mov reg, reg
+		Assembler& mov(const Reg dst, const Reg src);
+
+		// mov reg, imm (picks the smallest encoding)
+		Assembler& mov(const Reg dst, const uint64_t imm);
+
+		// push/pop
+		Assembler& push(const Reg reg);
+		Assembler& push(const uint32_t imm);
+		Assembler& pop(const Reg reg);
+
+		// arithmetic (reg, reg) and (reg, imm)
+		Assembler& add(const Reg dst, const Reg src) { return this->alu(AluOp::add, dst, src); }
+		Assembler& add(const Reg dst, const int32_t imm) { return this->alu(AluOp::add, dst, imm); }
+		Assembler& sub(const Reg dst, const Reg src) { return this->alu(AluOp::sub, dst, src); }
+		Assembler& sub(const Reg dst, const int32_t imm) { return this->alu(AluOp::sub, dst, imm); }
+		Assembler& and_(const Reg dst, const Reg src) { return this->alu(AluOp::and_, dst, src); }
+		Assembler& and_(const Reg dst, const int32_t imm) { return this->alu(AluOp::and_, dst, imm); }
+		Assembler& or_(const Reg dst, const Reg src) { return this->alu(AluOp::or_, dst, src); }
+		Assembler& or_(const Reg dst, const int32_t imm) { return this->alu(AluOp::or_, dst, imm); }
+		Assembler& xor_(const Reg dst, const Reg src) { return this->alu(AluOp::xor_, dst, src); }
+		Assembler& xor_(const Reg dst, const int32_t imm) { return this->alu(AluOp::xor_, dst, imm); }
+		Assembler& cmp(const Reg dst, const Reg src) { return this->alu(AluOp::cmp, dst, src); }
+		Assembler& cmp(const Reg dst, const int32_t imm) { return this->alu(AluOp::cmp, dst, imm); }
+
+		// cmp r8, imm8 (eg: cmp al, 0)
+		Assembler& cmp8(const Reg dst, const uint8_t imm);
+
+		// call/jmp to a register
+		Assembler& call(const Reg reg);
+		Assembler& jmp(const Reg reg);
+
+		// call/jmp/jcc to a label
+		Assembler& call(const Label label);
+		Assembler& jmp(const Label label);
+		Assembler& jcc(const Cond cond, const Label label);
+
+		// call/jmp/jcc to an absolute address
+		// rel32 if reachable from the base passed to assemble(), otherwise an absolute (x64) form is used
+		Assembler& call(const uint64_t address);
+		Assembler& jmp(const uint64_t address);
+		Assembler& jcc(const Cond cond, const uint64_t address);
+
+		// always use the absolute form (position independent)
+		// jmp X86:
+		//     push address
+		//     ret
+		// jmp X64:
+		//     jmp qword ptr [rip]
+		//     dq address
+		Assembler& call_abs(const uint64_t address);
+		Assembler& jmp_abs(const uint64_t address);
+
+		// ret or retn
+		Assembler& ret();
+		Assembler& ret(const uint16_t size);
+
+		// anything else, pushed as-is (same rules as Shellcode::push())
+		template <typename ...Args>
+		Assembler& raw(Args&& ...args) {
+			this->m_code.push(std::forward<Args>(args)...);
+			return *this;
+		}
+
+		// resolve every label and branch, base is the address the code will be written to
+		Shellcode assemble(const uint64_t base = 0) const;
+
+		// number of bytes emitted so far, not counting branches
+		size_t size() const noexcept { return this->m_code.size(); }
+
+		// reset (keeps the allocated memory around)
+		void clear() noexcept;
+
+		bool is_64bit() const noexcept { return this->m_is64bit; }
+
+	private:
+		// group 1 opcodes, the value is the /digit in the ModRM
+		enum class AluOp : uint8_t {
+			add = 0, or_ = 1, adc = 2, sbb = 3,
+			and_ = 4, sub = 5, xor_ = 6, cmp = 7
+		};
+
+		enum class BranchType : uint8_t {
+			jmp, jcc, call
+		};
+
+		enum class BranchForm : uint8_t {
+			short_, // rel8
+			near,   // rel32
+			abs     // absolute, through an indirect/push-ret sequence
+		};
+
+		struct Branch {
+			size_t offset;        // position in m_code
+			uint64_t address;     // absolute target, if label is invalid
+			Label label;          // target label
+			BranchType type;
+			BranchForm form;      // the smallest form that could work, assemble() relaxes it
+			Cond cond;
+		};
+
+		struct BoundLabel {
+			size_t offset = size_t(-1); // position in m_code
+			size_t branches = 0;        // number of branches emitted before this label
+		};
+
+	private:
+		Assembler& alu(const AluOp op, const Reg dst, const Reg src);
+		Assembler& alu(const AluOp op, const Reg dst, const int32_t imm);
+
+		// emit a REX prefix if needed (and verify the register can be encoded)
+		void rex(const bool w, const Reg reg, const Reg rm);
+
+		// add a branch to be resolved in assemble()
+		Assembler& branch(const BranchType type, const Cond cond, const Label label);
+		Assembler& branch(const BranchType type, const Cond cond, const uint64_t address, const BranchForm form);
+
+		// size, in bytes, of a branch in a specific form
+		size_t branch_size(const Branch& branch, const BranchForm form) const;
+
+		// write the final bytes for a branch
+		void encode_branch(Shellcode::ShellcodeData& data, const Branch& branch,
+			const BranchForm form, const uint64_t address, const uint64_t target) const;
+
+	private:
+		bool m_is64bit;
+		Shellcode m_code;
+		std::vector<Branch> m_branches;
+		std::vector<BoundLabel> m_labels;
+	};
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "unused_memory.h"
+
+#include <stdint.h>
+#include <set>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <condition_variable>
+
+
+namespace mango {
+	class Process;
+	class LoadedModule;
+
+	// hands out blocks of code caves (see find_code_caves()) so hooks don't end up writing over each other
+	// free blocks are indexed by size (best-fit in O(log n) when there's no address window) and by address
+	// (coalescing, and windows only visit the blocks inside of them, O(log n + k))
+	// every Process has one of these (Process::get_cave_allocator()) which only looks for the caves
+	// of a module the first time something needs memory near it
+	// NOTE: this only keeps track of which bytes are used, the memory protection is left as-is
+	class CaveAllocator {
+	public:
+		CaveAllocator() = default;
+		explicit CaveAllocator(const Process& process, const size_t min_size = 16) {
+			this->setup(process, min_size);
+		}
+
+		// add the code caves of every module in Process::get_modules()
+		void setup(const Process& process, const size_t min_size = 16);
+
+		// add the code caves of a single module (find_code_caves()), does nothing if they were already added
+		// if another thread is adding the same module, this waits for it to finish
+		void add_module(const Process& process, const LoadedModule& module, const size_t min_size = 16);
+
+		// add caves manually, they must not overlap with caves that were already added
+		void add(const MemoryRange& cave);
+		void add(const std::vector<MemoryRange>& caves);
+
+		// the smallest block that fits (best-fit), 0 if no cave is big enough
+		// the whole block must be inside of [min_address, max_address)
+		uintptr_t allocate(const size_t size, const size_t alignment = 1,
+			const uintptr_t min_address = 0, const uintptr_t max_address = UINTPTR_MAX);
+
+		// allocate() within rel32 range of address (for jumps and calls)
+		uintptr_t allocate_near(const uintptr_t address, const size_t size, const size_t alignment = 1);
+
+		// same as above, but the caves of every module that overlaps the window are added first (add_module())
+		uintptr_t allocate(const Process& process, const size_t size, const size_t alignment = 1,
+			const uintptr_t min_address = 0, const uintptr_t max_address = UINTPTR_MAX);
+		uintptr_t allocate_near(const Process& process, const uintptr_t address, const size_t size, const size_t alignment = 1);
+
+		// free a block that was returned by allocate(), it's merged with any neighboring free blocks
+		void free(const uintptr_t address);
+
+		// the total size of every free block
+		size_t get_free_size() const;
+
+		// the size of the biggest free block
+		size_t get_largest_free_block() const;
+
+		// the number of blocks that haven't been freed yet
+		size_t get_allocation_count() const;
+
+		// forget every cave, module, and allocation
+		void clear();
+
+		// prevent copying
+		CaveAllocator(const CaveAllocator&) = delete;
+		CaveAllocator& operator=(const CaveAllocator&) = delete;
+
+	private:
+		// these expect the mutex to be locked already
+		void insert_free_block(const uintptr_t address, const size_t size);
+		void erase_free_block(const std::map<uintptr_t, size_t>::iterator it);
+
+		// take [address, address + size) out of a free block, whatever is left on either side stays free
+		uintptr_t claim_block(const std::map<uintptr_t, size_t>::iterator it, const uintptr_t address, const size_t size);
+
+		// add_module() for every module in the process that overlaps [min_address, max_address)
+		void add_modules(const Process& process, const uintptr_t min_address, const uintptr_t max_address);
+
+	private:
+		enum class ModuleState : uint8_t {
+			none,
+
+			// a thread is looking for the caves without holding the lock
+			adding,
+			added
+		};
+
+		struct Module {
+			size_t size;
+			ModuleState state;
+		};
+
+		// image base -> module, for every module that has been looked at
+		std::map<uintptr_t, Module> m_modules;
+
+		// address -> size
+		std::map<uintptr_t, size_t> m_free_by_address;
+
+		// (size, address)
+		std::set<std::pair<size_t, uintptr_t>> m_free_by_size;
+
+		// address -> size
+		std::unordered_map<uintptr_t, size_t> m_allocations;
+
+		size_t m_free_size = 0;
+
+		mutable std::mutex m_mutex;
+
+		// notified whenever a module stops being ModuleState::adding
+		std::condition_variable m_module_cv;
+	};
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "module_index.h"
+#include "process.h"
+
+#include <string_view>
+#include <vector>
+#include <memory>
+
+
+namespace mango {
+	// hooks exported functions by rewriting their rva in AddressOfFunctions
+	// this only affects lookups made after the hook (GetProcAddress, modules that are loaded later, etc)
+	// rvas can't point more than 4GB past the image, so far away functions go through a small stub near the module
+	class EatHook {
+	public:
+		struct SetupOptions {
+			// whether we should call release in the destructor or not
+			bool auto_release = true;
+		};
+
+	public:
+		EatHook() = default;
+		EatHook(const Process& process, const uintptr_t module_address, const SetupOptions& options = SetupOptions()) { this->setup(process, module_address, options); }
+		EatHook(const Process& process, const void* const module_address, const SetupOptions& options = SetupOptions()) { this->setup(process, module_address, options); }
+		~EatHook() {
+			if (this->m_options.auto_release)
+				this->release();
+		}
+
+		// all hooks will only affect the exports of the specified module
+		void setup(const Process& process, const uintptr_t module_address, const SetupOptions& options = SetupOptions());
+		void setup(const Process& process, const void* const module_address, const SetupOptions& options = SetupOptions()) {
+			this->setup(process, uintptr_t(module_address), options);
+		}
+
+		// unhooks everything and frees the stubs
+		// NOTE: addresses that were resolved while hooked might point to a stub
+		void release();
+
+		// same as setup() return value
+		bool is_valid() const noexcept { return this->m_process != nullptr; }
+
+		// hook a function (returns the original)
+		uintptr_t hook(const std::string_view func_name, const uintptr_t func);
+
+		// wrapper
+		template <typename Ret = uintptr_t, typename Addr = uintptr_t>
+		Ret hook(const std::string_view func_name, const Addr func) {
+			return Ret(hook(func_name, uintptr_t(func)));
+		}
+
+		// unhook, stubs are pointed back to the original in case someone is still using them
+		void unhook(const std::string_view func_name);
+
+		// a more intuitive way to test for validity
+		explicit operator bool() const noexcept { return this->is_valid(); }
+
+		// prevent copying
+		EatHook(const EatHook&) = delete;
+		EatHook& operator=(const EatHook&) = delete;
+
+	private:
+		struct HookedFunc {
+			// the entry in AddressOfFunctions
+			uintptr_t entry;
+
+			// what was in the entry before it was hooked
+			uint32_t original_rva;
+
+			// the function that original_rva points to (after following forwarders)
+			uintptr_t original;
+
+			// 0 if the function was close enough to not need one
+			uintptr_t stub;
+		};
+
+	private:
+		// the address of the entry in AddressOfFunctions, throws if the function isn't exported
+		uintptr_t find_entry(const std::string_view func_name) const;
+
+		// nullptr if not hooked
+		HookedFunc* find_hooked(const uintptr_t entry) noexcept;
+
+		// a stub that jumps to func, within 4GB after the image
+		uintptr_t create_stub(const uintptr_t func);
+
+		// point a stub somewhere else
+		void write_stub(const uintptr_t stub, const uintptr_t func) const;
+
+		// overwrite the entry in AddressOfFunctions
+		void write_rva(const uintptr_t entry, const uint32_t rva) const;
+
+	private:
+		const Process* m_process = nullptr;
+		std::shared_ptr<const ModuleIndex> m_index;
+		std::vector<HookedFunc> m_hooked_funcs;
+		SetupOptions m_options;
+
+		// stubs are carved out of these pages (if there's no code cave in range), and are only freed in release()
+		std::vector<uintptr_t> m_stub_pages;
+		size_t m_stub_offset = 0;
+
+		// stubs that are in code caves, given back to Process::get_cave_allocator() in release()
+		std::vector<uintptr_t> m_cave_stubs;
+	};
+} // namespace mango
\ No newline at end of file
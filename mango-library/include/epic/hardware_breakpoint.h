@@ -5,6 +5,14 @@
 #include "windows_defs.h"
 #include "../misc/error_codes.h"
 
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <optional>
+#include <unordered_set>
+#include <condition_variable>
+
 
 // https://en.wikipedia.org/wiki/X86_debug_register
 namespace mango::hwbp {
@@ -30,6 +38,31 @@ namespace mango::hwbp {
 		Size size = Size::one;
 	};
 
+	// check if a debug register is currently enabled
+	constexpr bool is_enabled(const uint32_t DR7, const size_t index) noexcept {
+		return DR7 & (uint32_t(1) << (index * 2));
+	}
+
+	// DR7 with the debug register enabled, and its type and size set
+	constexpr uint32_t set_DR7(const uint32_t DR7, const size_t index, const Options& options) noexcept {
+		const auto type_size_mask((uint32_t(options.size) << 2) | uint32_t(options.type));
+		return (DR7 & ~uint32_t(0b1111 << (16 + index * 4))) | (type_size_mask << (16 + index * 4)) | (uint32_t(1) << (index * 2));
+	}
+
+	// DR7 with the debug register disabled, and its type and size cleared
+	constexpr uint32_t clear_DR7(const uint32_t DR7, const size_t index) noexcept {
+		return DR7 & ~(uint32_t(1) << (index * 2)) & ~uint32_t(0b1111 << (16 + index * 4));
+	}
+
+	// the first debug register that isn't enabled, 4 if they're all used
+	constexpr size_t find_unused(const uint32_t DR7) noexcept {
+		for (size_t i(0); i < 4; ++i) {
+			if (!is_enabled(DR7, i))
+				return i;
+		}
+		return 4;
+	}
+
 	namespace impl {
 		// sets up DR7 for our use (or throws) and returns which dbg register was used
 		size_t enable_DR7(uint32_t& DR7, const Options& options);
@@ -38,9 +71,6 @@ namespace mango::hwbp {
 		void clear_dreg(uint32_t& DR7, const size_t index);
 	} // namespace impl
 
-	// check if a debug register is currently enabled
-	bool is_enabled(const uint32_t DR7, const size_t index);
-
 	// set a hardware breakpoint using one of the 4 debug registers
 	// will throw an exception if all registers are used
 	// safe to use on current thread (although technically "undefined behavior")
@@ -86,4 +116,107 @@ namespace mango::hwbp {
 
 		context.Dr7 = DR7;
 	}
+
+	// owns the debug registers of every thread in a process
+	// changes are applied to every thread at once (while they're suspended), and threads that are
+	// created later get the breakpoints in refresh() (which can be called periodically with start())
+	// NOTE: debug registers set by anything else (such as hwbp::enable()) are overwritten
+	class Manager {
+	public:
+		struct Breakpoint {
+			uintptr_t address = 0;
+			Options options;
+		};
+
+		// indexed by debug register
+		using Breakpoints = std::array<std::optional<Breakpoint>, 4>;
+
+	public:
+		explicit Manager(const Process& process) : m_process{ &process } {}
+
+		// calls clear(), the threads keep their breakpoints if that fails
+		~Manager() {
+			this->stop();
+
+			try {
+				this->clear();
+			} catch (...) {}
+		}
+
+		// set a hardware breakpoint on every thread, returns which debug register was used
+		// will throw an exception if all registers are used
+		size_t add(const uintptr_t address, const Options& options = Options{});
+
+		// remove every breakpoint on this address from every thread
+		void remove(const uintptr_t address);
+
+		// remove every breakpoint from every thread
+		void clear();
+
+		// apply the breakpoints to threads that were created since the last time
+		void refresh();
+
+		// call refresh() every interval on a background thread
+		void start(const std::chrono::milliseconds interval = std::chrono::milliseconds{ 10 });
+
+		// stop the background thread
+		void stop();
+
+		// indexed by debug register
+		Breakpoints get_breakpoints() const {
+			const std::lock_guard lock{ this->m_mutex };
+			return this->m_breakpoints;
+		}
+
+		// the DR7 value that every thread gets
+		uint32_t get_DR7() const {
+			const std::lock_guard lock{ this->m_mutex };
+			return get_DR7(this->m_breakpoints);
+		}
+
+		// DR7 for these breakpoints
+		static constexpr uint32_t get_DR7(const Breakpoints& breakpoints) noexcept {
+			uint32_t DR7(0);
+			for (size_t i(0); i < breakpoints.size(); ++i) {
+				if (breakpoints[i])
+					DR7 = set_DR7(DR7, i, breakpoints[i]->options);
+			}
+			return DR7;
+		}
+
+		// Ctx must be either CONTEXT or WOW64_CONTEXT
+		template <typename Ctx>
+		static void apply(Ctx& context, const Breakpoints& breakpoints) noexcept {
+			for (size_t i(0); i < breakpoints.size(); ++i) {
+				(&context.Dr0)[i] = breakpoints[i] ?
+					static_cast<decltype(context.Dr0)>(breakpoints[i]->address) : 0;
+			}
+
+			context.Dr6 = 0;
+			context.Dr7 = get_DR7(breakpoints);
+		}
+
+		// prevent copying
+		Manager(const Manager&) = delete;
+		Manager& operator=(const Manager&) = delete;
+
+	private:
+		// set the debug registers of every thread (or just the new ones) in one batch
+		void apply_to_threads(const bool only_new);
+
+	private:
+		const Process* m_process;
+		Breakpoints m_breakpoints{};
+
+		// threads that have the current breakpoints
+		std::unordered_set<uint32_t> m_threads;
+
+		// guards everything above
+		mutable std::mutex m_mutex;
+
+		std::thread m_thread;
+		std::mutex m_thread_mutex;
+		std::condition_variable m_thread_cv;
+		bool m_running = false;
+	};
 } // namespace mango::hwbp
\ No newline at end of file
@@ -0,0 +1,356 @@
+#pragma once
+
+#include "vmt_hook.h"
+#include "iat_hook.h"
+#include "inline_hook.h"
+#include "../misc/error_codes.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+
+namespace mango {
+	namespace impl {
+		template <typename Ret, typename... Args>
+		struct PostCallbackType {
+			using Type = std::function<void(Ret&, Args&...)>;
+		};
+
+		// no return value to pass
+		template <typename... Args>
+		struct PostCallbackType<void, Args...> {
+			using Type = std::function<void(Args&...)>;
+		};
+
+		// generates a stub with the same calling convention as Fn
+		template <typename Fn>
+		struct DispatchTraits;
+
+		// one specialization per calling convention (they're all the same on x64)
+#define mango_dispatch_traits(convention)\
+		template <typename Ret, typename... Args>\
+		struct DispatchTraits<Ret(convention*)(Args...)> {\
+			using Return = Ret;\
+			using PreCallback = std::function<void(Args&...)>;\
+			using PostCallback = typename PostCallbackType<Ret, Args...>::Type;\
+			template <typename Dispatcher, size_t Slot>\
+			static Ret convention stub(Args... args) {\
+				return Dispatcher::s_slots[Slot].load(std::memory_order_acquire)->invoke(args...);\
+			}\
+		};
+
+#ifdef _WIN64
+		mango_dispatch_traits(__cdecl)
+#else
+		mango_dispatch_traits(__cdecl)
+		mango_dispatch_traits(__stdcall)
+		mango_dispatch_traits(__fastcall)
+#endif
+
+#undef mango_dispatch_traits
+	} // namespace impl
+
+	// one hook per target that calls every subscribed callback before and after the original
+	// callbacks can be added or removed while other threads are calling through the hook, without locking
+	// Fn is the function pointer type of the target, for example: int(__fastcall*)(void* ecx, void* edx, int)
+	// NOTE: this only works in the current process (the callbacks are local functions)
+	// NOTE: __thiscall can't be used for free functions, use __fastcall with an unused edx argument instead
+	template <typename Fn>
+	class HookDispatcher {
+	private:
+		using Traits = impl::DispatchTraits<Fn>;
+		using Return = typename Traits::Return;
+
+		template <typename>
+		friend struct impl::DispatchTraits;
+
+	public:
+		using PreCallback = typename Traits::PreCallback;
+		using PostCallback = typename Traits::PostCallback;
+
+		// number of dispatchers that can exist at the same time for each function type
+		static constexpr size_t max_dispatchers = 64;
+
+		// threads are spread over this many reader counters so they don't all contend on one cache line
+		static constexpr size_t reader_shards = 16;
+
+	public:
+		HookDispatcher() { this->reserve_slot(); }
+		~HookDispatcher() {
+			this->release();
+			delete this->m_callbacks.load();
+			s_slots[this->m_slot].store(nullptr, std::memory_order_release);
+		}
+
+		// hook a virtual function with the dispatcher
+		void setup(VmtHook& hook, const size_t index) {
+			this->release();
+			this->m_original = hook.hook(index, this->get_stub());
+			this->m_unhook = [&hook, index]() { hook.unhook(index); };
+		}
+
+		// hook an imported function with the dispatcher
+		void setup(IatHook& hook, const std::string& module_name, const std::string& func_name) {
+			this->release();
+			this->m_original = hook.hook(module_name, func_name, this->get_stub());
+			this->m_unhook = [&hook, module_name, func_name]() { hook.unhook(module_name, func_name); };
+		}
+
+		// inline hook a function with the dispatcher
+		void setup(const Process& process, const uintptr_t target) {
+			this->release();
+			this->m_inline_hook.setup(process, target, this->get_stub());
+			this->m_original = this->m_inline_hook.get_original();
+			this->m_unhook = [this]() { this->m_inline_hook.release(); };
+		}
+
+		// unhook, callbacks are kept
+		// NOTE: make sure no thread is still executing inside the dispatcher
+		void release() {
+			if (!this->m_unhook)
+				return;
+
+			this->m_unhook();
+			this->m_unhook = nullptr;
+			this->m_original = 0;
+		}
+
+		// callbacks with a lower priority are called first, returns an id for remove()
+		size_t add_pre(PreCallback callback, const int priority = 0) {
+			return this->add(std::move(callback), PostCallback{}, priority);
+		}
+		size_t add_post(PostCallback callback, const int priority = 0) {
+			return this->add(PreCallback{}, std::move(callback), priority);
+		}
+
+		// remove a callback that was added with add_pre() or add_post()
+		void remove(const size_t id) {
+			this->update([id](CallbackList& list) {
+				std::erase_if(list.pre, [id](const auto& entry) { return entry.id == id; });
+				std::erase_if(list.post, [id](const auto& entry) { return entry.id == id; });
+			});
+		}
+
+		// the function that the hook points to
+		uintptr_t get_stub() const noexcept {
+			static constexpr auto stubs{ make_stubs(std::make_index_sequence<max_dispatchers>()) };
+			return uintptr_t(stubs[this->m_slot]);
+		}
+
+		// call this to call the original function
+		uintptr_t get_original() const noexcept { return this->m_original; }
+
+		// whether setup() was called (and release() wasn't)
+		bool is_valid() const noexcept { return bool(this->m_unhook); }
+
+		// a more intuitive way to test for validity
+		explicit operator bool() const noexcept { return this->is_valid(); }
+
+		// prevent copying
+		HookDispatcher(const HookDispatcher&) = delete;
+		HookDispatcher& operator=(const HookDispatcher&) = delete;
+
+	private:
+		template <typename Callback>
+		struct Entry {
+			size_t id;
+			int priority;
+			Callback callback;
+		};
+
+		// never modified once published, a new copy is made for every change
+		struct CallbackList {
+			std::vector<Entry<PreCallback>> pre;
+			std::vector<Entry<PostCallback>> post;
+		};
+
+		// a list that was replaced while the epoch was epoch
+		struct RetiredList {
+			size_t epoch;
+			std::unique_ptr<const CallbackList> list;
+		};
+
+		// one counter for even epochs and one for odd epochs
+		struct alignas(64) ReaderCounts {
+			std::atomic<size_t> counts[2]{};
+		};
+
+		// keeps the list that was current when this was constructed alive
+		class ReadLock {
+		public:
+			explicit ReadLock(HookDispatcher& dispatcher) noexcept
+				: m_counter{ dispatcher.enter() }, m_list{ dispatcher.m_callbacks.load() } {}
+			~ReadLock() { this->m_counter->fetch_sub(1); }
+
+			const CallbackList* operator->() const noexcept { return this->m_list; }
+
+			// prevent copying
+			ReadLock(const ReadLock&) = delete;
+			ReadLock& operator=(const ReadLock&) = delete;
+
+		private:
+			std::atomic<size_t>* m_counter;
+			const CallbackList* m_list;
+		};
+
+	private:
+		// called by the stub
+		template <typename... Args>
+		Return invoke(Args&... args) {
+			{
+				const ReadLock list{ *this };
+				for (const auto& entry : list->pre)
+					entry.callback(args...);
+			}
+
+			// the list isn't held while the original runs, it could block for a long time
+			const auto original{ reinterpret_cast<Fn>(this->m_original) };
+
+			if constexpr (std::is_void_v<Return>) {
+				original(args...);
+
+				const ReadLock list{ *this };
+				for (const auto& entry : list->post)
+					entry.callback(args...);
+			} else {
+				auto value{ original(args...) };
+
+				const ReadLock list{ *this };
+				for (const auto& entry : list->post)
+					entry.callback(value, args...);
+
+				return value;
+			}
+		}
+
+		// readers register in the current epoch before loading the list so writers know when old lists can be freed
+		// returns the counter that has to be decremented once the list isn't used anymore
+		std::atomic<size_t>* enter() noexcept {
+			auto& counts{ this->m_readers[get_reader_shard()].counts };
+
+			while (true) {
+				const auto epoch{ this->m_epoch.load() };
+				auto& counter{ counts[epoch & 1] };
+				counter.fetch_add(1);
+
+				// a writer might've already checked this counter and moved on
+				if (this->m_epoch.load() == epoch)
+					return &counter;
+
+				counter.fetch_sub(1);
+			}
+		}
+
+		// whether no reader is registered in an epoch with this parity
+		bool is_quiescent(const size_t parity) const noexcept {
+			return std::all_of(std::begin(this->m_readers), std::end(this->m_readers),
+				[parity](const ReaderCounts& readers) { return readers.counts[parity].load() == 0; });
+		}
+
+		// the reader counter that the calling thread uses
+		static size_t get_reader_shard() noexcept {
+			static thread_local const size_t shard{ s_next_shard.fetch_add(1, std::memory_order_relaxed) % reader_shards };
+			return shard;
+		}
+
+		// add a pre or post callback
+		size_t add(PreCallback pre, PostCallback post, const int priority) {
+			const auto id{ this->m_next_id.fetch_add(1) };
+
+			this->update([&](CallbackList& list) {
+				const auto insert{ [&](auto& entries, auto&& callback) {
+					// after every entry with the same priority, so the order is stable
+					const auto position{ std::upper_bound(entries.begin(), entries.end(), priority,
+						[](const int priority, const auto& entry) { return priority < entry.priority; }) };
+					entries.insert(position, { id, priority, std::move(callback) });
+				} };
+
+				if (pre)
+					insert(list.pre, std::move(pre));
+				if (post)
+					insert(list.post, std::move(post));
+			});
+
+			return id;
+		}
+
+		// copy, modify, then publish the new list (read-copy-update)
+		template <typename Callable>
+		void update(Callable&& callable) {
+			const std::lock_guard lock{ this->m_update_mutex };
+
+			auto list{ std::make_unique<CallbackList>(*this->m_callbacks.load()) };
+			callable(*list);
+
+			this->m_retired.push_back({ this->m_epoch.load(), std::unique_ptr<const CallbackList>{
+				this->m_callbacks.exchange(list.release()) } });
+
+			this->reclaim();
+		}
+
+		// a list that was retired in epoch E can only be used by readers that registered in epoch E or earlier,
+		// so it can be freed once the epoch reaches E + 2
+		// old lists that can't be freed yet are retried on the next update
+		void reclaim() {
+			for (size_t i{ 0 }; i < 2; ++i) {
+				// the next epoch reuses the counter of the previous one, wait until its readers are gone
+				const auto epoch{ this->m_epoch.load() };
+				if (!this->is_quiescent((epoch + 1) & 1))
+					break;
+
+				this->m_epoch.store(epoch + 1);
+			}
+
+			std::erase_if(this->m_retired, [epoch = this->m_epoch.load()](const RetiredList& retired) {
+				return retired.epoch + 2 <= epoch;
+			});
+		}
+
+		// find an unused stub
+		void reserve_slot() {
+			for (size_t i{ 0 }; i < max_dispatchers; ++i) {
+				HookDispatcher* expected{ nullptr };
+				if (s_slots[i].compare_exchange_strong(expected, this)) {
+					this->m_slot = i;
+					return;
+				}
+			}
+
+			throw NoAvailableDispatcherSlots{};
+		}
+
+		template <size_t... Slots>
+		static constexpr auto make_stubs(std::index_sequence<Slots...>) {
+			return std::array<Fn, sizeof...(Slots)>{ &Traits::template stub<HookDispatcher, Slots>... };
+		}
+
+	private:
+		// the stubs have no way to know which dispatcher they belong to, so each one gets its own stub
+		static inline std::atomic<HookDispatcher*> s_slots[max_dispatchers]{};
+
+		size_t m_slot = 0;
+		uintptr_t m_original = 0;
+		std::function<void()> m_unhook;
+		InlineHook m_inline_hook;
+
+		// handed out round-robin by get_reader_shard()
+		static inline std::atomic<size_t> s_next_shard{ 0 };
+
+		std::atomic<const CallbackList*> m_callbacks{ new CallbackList{} };
+		std::atomic<size_t> m_next_id{ 0 };
+
+		// only advanced by writers
+		std::atomic<size_t> m_epoch{ 0 };
+		ReaderCounts m_readers[reader_shards]{};
+
+		// only touched by writers
+		std::mutex m_update_mutex;
+		std::vector<RetiredList> m_retired;
+	};
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "inline_hook.h"
+
+#include <stdint.h>
+#include <array>
+#include <string>
+#include <vector>
+#include <functional>
+
+
+namespace mango {
+	class Process;
+	class VmtHook;
+	class IatHook;
+
+	// hooks a function with a stub that counts calls and times them (with rdtsc) before forwarding to the original
+	// the results live in the target process and can be read at any time without pausing it
+	// NOTE: the return address is replaced while the original runs, so exceptions (or longjmp) can't
+	//       unwind through a profiled function
+	class HookProfiler {
+	public:
+		// threads past this limit are only counted in get_overflow_calls(), see reclaim_slots()
+		static constexpr size_t max_threads = 32;
+
+		// bucket i holds calls that took [2^i, 2^(i+1)) cycles, the last bucket holds everything slower
+		static constexpr size_t histogram_buckets = 32;
+
+		// recursive calls deeper than this are counted but not timed
+		static constexpr size_t max_call_depth = 14;
+
+		struct SetupOptions {
+			// whether we should call release in the destructor or not
+			bool auto_release = true;
+		};
+
+		// NOTE: in a 32bit process, the 64bit counters are updated one half at a time (add, then adc), so a
+		//       value that's read right as its low half overflows can be off by 2^32 until the next call
+		struct Stats {
+			// the thread that made the calls (0 for get_stats())
+			uint64_t tid = 0;
+
+			// every call, including the ones that weren't timed
+			uint64_t calls = 0;
+
+			// sum of every timed call
+			uint64_t total_cycles = 0;
+
+			std::array<uint64_t, histogram_buckets> histogram{};
+		};
+
+	public:
+		HookProfiler() = default;
+		~HookProfiler() {
+			if (this->m_options.auto_release)
+				this->release();
+		}
+
+		// profile a virtual function
+		void setup(VmtHook& hook, const size_t index, const SetupOptions& options = SetupOptions());
+
+		// profile an imported function
+		void setup(IatHook& hook, const std::string& module_name, const std::string& func_name, const SetupOptions& options = SetupOptions());
+
+		// profile any function with an inline hook
+		void setup(const Process& process, const uintptr_t target, const SetupOptions& options = SetupOptions());
+
+		// unhook and free the stub
+		// NOTE: the stub is kept around (leaked) if a profiled call is still in progress
+		void release();
+
+		// every thread combined
+		Stats get_stats() const;
+
+		// one entry for every thread that called the function
+		std::vector<Stats> get_thread_stats() const;
+
+		// give back the slots of threads that exited, returns how many were reclaimed
+		// their stats are kept, call this every so often if threads come and go
+		// NOTE: a new thread that reuses the id of an exited thread before this is called shares its slot
+		size_t reclaim_slots();
+
+		// calls made by threads that didn't get a slot (not timed)
+		uint64_t get_overflow_calls() const;
+
+		// the function that the hook points to
+		uintptr_t get_stub() const noexcept { return this->m_address; }
+
+		// the function that the stub forwards to
+		uintptr_t get_original() const noexcept { return this->m_original; }
+
+		// same as setup() return value
+		bool is_valid() const noexcept { return this->m_process != nullptr; }
+
+		// a more intuitive way to test for validity
+		explicit operator bool() const noexcept { return this->is_valid(); }
+
+		// prevent copying
+		HookProfiler(const HookProfiler&) = delete;
+		HookProfiler& operator=(const HookProfiler&) = delete;
+
+	private:
+		// allocate memory for the stub and its data
+		void allocate_stub(const Process& process, const SetupOptions& options);
+
+		// assemble and write the stub, now that the original is known
+		void write_stub(const uintptr_t original);
+
+		// number of profiled calls that haven't returned yet
+		uint64_t get_calls_in_progress() const;
+
+	private:
+		const Process* m_process = nullptr;
+		SetupOptions m_options;
+		uintptr_t m_address = 0,
+			m_original = 0;
+		std::function<void()> m_unhook;
+		InlineHook m_inline_hook;
+
+		// stats of threads whose slots were reclaimed
+		std::vector<Stats> m_retired_stats;
+	};
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+#include <functional>
+
+
+namespace mango {
+	class Process;
+	class VmtHook;
+	class IatHook;
+	class InlineHook;
+
+	// queues up hook operations and applies them all at once, with the process only being paused once
+	// either every queued operation is applied or none of them are
+	// NOTE: on the current process every other thread is suspended instead, so don't commit while holding
+	//       locks that those threads might need (the heap lock included, if they're hooked)
+	class HookTransaction {
+	public:
+		explicit HookTransaction(const Process& process) : m_process{ &process } {}
+
+		// queue raw bytes to be written, they can't overlap with bytes that are already queued
+		// is_code should be true if threads could be executing the bytes being overwritten
+		HookTransaction& write(const uintptr_t address, const void* const data, const size_t size, const bool is_code = true);
+
+		// wrapper
+		template <typename T>
+		HookTransaction& write(const uintptr_t address, const T& value, const bool is_code = true) {
+			return this->write(address, &value, sizeof(value), is_code);
+		}
+
+		// same as InlineHook::enable() and InlineHook::disable()
+		// use SetupOptions::auto_enable = false so that InlineHook::setup() doesn't write anything
+		HookTransaction& enable(InlineHook& hook);
+		HookTransaction& disable(InlineHook& hook);
+
+		// same as VmtHook::hook() and VmtHook::unhook()
+		uintptr_t hook(VmtHook& hook, const size_t index, const uintptr_t func);
+		HookTransaction& unhook(VmtHook& hook, const size_t index);
+
+		// same as IatHook::hook() and IatHook::unhook()
+		uintptr_t hook(IatHook& hook, const std::string_view module_name, const std::string_view func_name, const uintptr_t func);
+		HookTransaction& unhook(IatHook& hook, const std::string_view module_name, const std::string_view func_name);
+
+		// apply every queued operation
+		void commit();
+
+		// undo everything that was committed
+		void rollback();
+
+		// forget about every operation (doesn't undo anything)
+		void clear() noexcept;
+
+		// number of queued patches
+		size_t size() const noexcept { return this->m_patches.size(); }
+
+		// whether commit() was called (and rollback() wasn't)
+		bool is_committed() const noexcept { return this->m_committed; }
+
+		// prevent copying
+		HookTransaction(const HookTransaction&) = delete;
+		HookTransaction& operator=(const HookTransaction&) = delete;
+
+	private:
+		struct Patch {
+			uintptr_t address;
+			std::vector<uint8_t> bytes,
+				original; // filled in when committed
+			bool is_code;
+		};
+
+	private:
+		// throws if operations can't be queued anymore
+		void verify_not_committed() const;
+
+		// write the new bytes (or the original bytes) of every patch, all or nothing
+		void apply(const bool undo);
+
+	private:
+		const Process* m_process;
+		std::vector<Patch> m_patches;
+
+		// bookkeeping for the hook objects, ran after the patches are written
+		std::vector<std::function<void()>> m_on_commit,
+			m_on_rollback;
+
+		bool m_committed = false;
+	};
+} // namespace mango
\ No newline at end of file
@@ -1,19 +1,17 @@
 #pragma once
 
-#include "loaded_module.h"
+#include "module_index.h"
 #include "process.h"
 
-#include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
+#include <memory>
 
 
 namespace mango {
-	// a bit of overhead but whatever
+	// slots are looked up through a shared ModuleIndex, so hooking a module doesn't copy its whole IAT
 	// module names are case insensitive but not function names
 	class IatHook {
-	private:
-		using HookedFuncs = std::unordered_map<std::string, std::unordered_map<std::string, uintptr_t>>;
-
 	public:
 		struct SetupOptions {
 			// whether we should call release in the destructor or not
@@ -42,16 +40,16 @@ namespace mango {
 		bool is_valid() const noexcept { return this->m_process != nullptr; }
 
 		// hook a function
-		uintptr_t hook(std::string module_name, const std::string& func_name, const uintptr_t func);
+		uintptr_t hook(const std::string_view module_name, const std::string_view func_name, const uintptr_t func);
 
 		// wrapper
 		template <typename Ret = uintptr_t, typename Addr = uintptr_t>
-		Ret hook(const std::string& module_name, const std::string& func_name, const Addr func) {
+		Ret hook(const std::string_view module_name, const std::string_view func_name, const Addr func) {
 			return Ret(hook(module_name, func_name, uintptr_t(func)));
 		}
 
 		// unhook
-		void unhook(std::string module_name, const std::string& func_name);
+		void unhook(const std::string_view module_name, const std::string_view func_name);
 
 		// a more intuitive way to test for validity
 		explicit operator bool() const noexcept { return this->is_valid(); }
@@ -61,13 +59,30 @@ namespace mango {
 		IatHook& operator=(const IatHook&) = delete;
 
 	private:
-		// this does all the heavy lifting
-		uintptr_t hook_internal(const std::string& module_name, const std::string& func_name, const uintptr_t func);
+		friend class HookTransaction;
+		friend class HookProfiler;
+
+		struct HookedFunc {
+			// the IAT entry
+			uintptr_t slot;
+
+			// what was in the slot before it was hooked
+			uintptr_t original;
+		};
+
+		// the address of the IAT slot, throws if the module or function isn't imported
+		uintptr_t find_slot(const std::string_view module_name, const std::string_view func_name) const;
+
+		// nullptr if not hooked
+		HookedFunc* find_hooked(const uintptr_t slot) noexcept;
+
+		// overwrite the IAT slot, returns the previous value
+		uintptr_t hook_internal(const uintptr_t slot, const uintptr_t func);
 
 	private:
 		const Process* m_process = nullptr;
-		LoadedModule::ImportedFuncs m_iat;
-		HookedFuncs m_hooked_funcs;
+		std::shared_ptr<const ModuleIndex> m_index;
+		std::vector<HookedFunc> m_hooked_funcs;
 		SetupOptions m_options;
 	};
 } // namespace mango
\ No newline at end of file
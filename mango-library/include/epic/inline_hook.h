@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+
+namespace mango {
+	class Process;
+
+	// overwrites the start of a function with a jmp to the hook
+	// the overwritten instructions are relocated into a trampoline which can be called to reach the original
+	class InlineHook {
+	public:
+		struct SetupOptions {
+			// whether we should call release in the destructor or not
+			bool auto_release = true;
+
+			// try to place the trampoline in an unused code cave before allocating memory
+			bool use_code_caves = true;
+
+			// write the jmp right away, otherwise enable() (or a HookTransaction) has to be used
+			bool auto_enable = true;
+		};
+
+	public:
+		InlineHook() = default;
+		InlineHook(const Process& process, const uintptr_t target, const uintptr_t hook, const SetupOptions& options = SetupOptions()) {
+			this->setup(process, target, hook, options);
+		}
+		InlineHook(const Process& process, const void* const target, const void* const hook, const SetupOptions& options = SetupOptions()) {
+			this->setup(process, target, hook, options);
+		}
+		~InlineHook() {
+			if (this->m_options.auto_release)
+				this->release();
+		}
+
+		// hook the function at target, the hook is enabled right away unless auto_enable is false
+		void setup(const Process& process, const uintptr_t target, const uintptr_t hook, const SetupOptions& options = SetupOptions());
+		void setup(const Process& process, const void* const target, const void* const hook, const SetupOptions& options = SetupOptions()) {
+			this->setup(process, uintptr_t(target), uintptr_t(hook), options);
+		}
+
+		// unhooks and frees the trampoline
+		// NOTE: make sure no thread is still executing inside the trampoline
+		void release();
+
+		// write or restore the jmp, the trampoline is kept around
+		void enable();
+		void disable();
+
+		// whether the jmp is currently written
+		bool is_enabled() const noexcept { return this->m_enabled; }
+
+		// call this to call the original function
+		uintptr_t get_original() const noexcept { return this->m_trampoline; }
+
+		// wrapper
+		template <typename Ret>
+		Ret get_original() const noexcept {
+			return Ret(this->get_original());
+		}
+
+		// the hooked function
+		uintptr_t get_target() const noexcept { return this->m_target; }
+
+		// same as setup() return value
+		bool is_valid() const noexcept { return this->m_process != nullptr; }
+
+		// a more intuitive way to test for validity
+		explicit operator bool() const noexcept { return this->is_valid(); }
+
+		// prevent copying
+		InlineHook(const InlineHook&) = delete;
+		InlineHook& operator=(const InlineHook&) = delete;
+
+	private:
+		friend class HookTransaction;
+
+		// copy the stolen instructions to the trampoline, fixing up anything relative
+		std::vector<uint8_t> build_trampoline(const uint8_t* const code, const size_t stolen_size) const;
+
+		// find (or allocate) memory within 2GB of the target for the trampoline
+		void allocate_trampoline(const size_t size);
+
+		// write bytes over the start of the function
+		void write_patch(const std::vector<uint8_t>& bytes) const;
+
+	private:
+		const Process* m_process = nullptr;
+		SetupOptions m_options;
+		uintptr_t m_target = 0,
+			m_hook = 0,
+			m_trampoline = 0;
+		bool m_enabled = false,
+			m_is_code_cave = false;
+		std::vector<uint8_t> m_original_bytes,
+			m_patch_bytes;
+	};
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+
+namespace mango {
+	class Process;
+
+	// compares the executable sections of loaded modules against their files on disk
+	// the files are mapped and relocated for the live image base, so anything that's different was patched
+	// results are cached per page, so scanning again only re-reads (and re-compares) pages that could've changed
+	// NOTE: the IAT is ignored if it's inside an executable section, but other loader fixups (such as dynamic
+	//       value relocations) will show up as patches
+	class IntegrityScanner {
+	public:
+		struct Patch {
+			// the first modified instruction
+			uintptr_t address = 0;
+
+			// both are instruction aligned and the same size
+			std::vector<uint8_t> original,
+				current;
+		};
+
+		struct ModuleReport {
+			std::string name;
+			uintptr_t image_base = 0;
+			std::vector<Patch> patches;
+		};
+
+	public:
+		explicit IntegrityScanner(const Process& process) : m_process{ &process } {}
+
+		// scan a single module
+		std::vector<Patch> scan(const uintptr_t image_base);
+
+		// scan every module in Process::get_modules(), only modules with patches are returned
+		std::vector<ModuleReport> scan_all();
+
+		// forget every mapped file and page hash
+		void clear() noexcept { this->m_modules.clear(); }
+
+		// prevent copying
+		IntegrityScanner(const IntegrityScanner&) = delete;
+		IntegrityScanner& operator=(const IntegrityScanner&) = delete;
+
+	private:
+		// a run of modified bytes, relative to the start of the section
+		struct Difference {
+			size_t offset;
+			std::vector<uint8_t> bytes;
+		};
+
+		struct Page {
+			// hash of the page the last time it was compared
+			uint64_t hash = 0;
+			bool compared = false;
+
+			std::vector<Difference> differences;
+		};
+
+		struct Section {
+			uintptr_t address;
+
+			// the relocated bytes from the file
+			std::vector<uint8_t> original;
+
+			// [start, end) ranges that the loader writes to (the IAT)
+			std::vector<std::pair<size_t, size_t>> ignored;
+
+			std::vector<Page> pages;
+		};
+
+		struct Module {
+			uint32_t timestamp;
+			std::vector<Section> sections;
+		};
+
+	private:
+		// map the module's file and copy its executable sections
+		Module load_module(const uintptr_t image_base, const uint32_t timestamp) const;
+
+		// update the differences of every page
+		void scan_section(Section& section) const;
+
+		// turn the differences of every page into instruction aligned patches
+		void collect_patches(const Section& section, std::vector<Patch>& patches) const;
+
+	private:
+		const Process* m_process;
+
+		// image base -> module
+		std::unordered_map<uintptr_t, Module> m_modules;
+	};
+} // namespace mango
\ No newline at end of file
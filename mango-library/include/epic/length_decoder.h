@@ -0,0 +1,462 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// x86/x64 instruction length decoder
+// only cares about where instructions start and end (and where their relative operands are), not what they do
+namespace mango::ild {
+	// which opcode map the instruction belongs to
+	enum class OpcodeMap : uint8_t {
+		primary,  // xx
+		map_0f,   // 0F xx
+		map_0f38, // 0F 38 xx
+		map_0f3a, // 0F 3A xx
+		map_5,    // EVEX map 5
+		map_6,    // EVEX map 6
+		xop_8,    // XOP map 8
+		xop_9,    // XOP map 9
+		xop_a     // XOP map A
+	};
+
+	struct Instruction {
+		// total size in bytes, 0 if the instruction couldn't be decoded
+		uint8_t length = 0;
+
+		// the opcode byte (after any prefixes/escapes) and which map it's from
+		uint8_t opcode = 0;
+		OpcodeMap map = OpcodeMap::primary;
+		uint8_t opcode_offset = 0;
+
+		// 0 if not present
+		uint8_t rex = 0;
+
+		// VEX (C4/C5), EVEX (62), or XOP (8F) encoded
+		bool is_vex = false,
+			is_evex = false,
+			is_xop = false;
+
+		// operand-size (66) and address-size (67) prefixes
+		bool has_opsize_prefix = false,
+			has_addrsize_prefix = false;
+
+		bool has_modrm = false;
+		uint8_t modrm = 0,
+			modrm_offset = 0;
+
+		// displacement in the ModRM/SIB, size is 0 if not present
+		uint8_t disp_offset = 0,
+			disp_size = 0;
+
+		// [rip + disp32], disp_offset points to the disp32
+		bool is_rip_relative = false;
+
+		// immediate operands (both immediates for enter), size is 0 if not present
+		uint8_t imm_offset = 0,
+			imm_size = 0;
+
+		// relative branch operand (jmp, call, jcc, loop, jcxz, xbegin), size is 0 if not present
+		uint8_t rel_offset = 0,
+			rel_size = 0;
+
+		// whether the instruction decoded successfully
+		constexpr bool is_valid() const noexcept { return this->length != 0; }
+		explicit constexpr operator bool() const noexcept { return this->is_valid(); }
+
+		// call rel32
+		constexpr bool is_call() const noexcept {
+			return this->rel_size && this->map == OpcodeMap::primary && this->opcode == 0xE8;
+		}
+
+		// jmp rel8/rel32
+		constexpr bool is_jmp() const noexcept {
+			return this->rel_size && this->map == OpcodeMap::primary && (this->opcode == 0xE9 || this->opcode == 0xEB);
+		}
+
+		// jcc rel8/rel32
+		constexpr bool is_jcc() const noexcept {
+			return this->rel_size && ((this->map == OpcodeMap::primary && (this->opcode & 0xF0) == 0x70) ||
+				(this->map == OpcodeMap::map_0f && (this->opcode & 0xF0) == 0x80));
+		}
+
+		// loop, loope, loopne, jcxz (rel8 only, no near form)
+		constexpr bool is_loop() const noexcept {
+			return this->rel_size && this->map == OpcodeMap::primary && this->opcode >= 0xE0 && this->opcode <= 0xE3;
+		}
+
+		// xbegin rel16/rel32 (C7 F8), the relative operand is the abort handler
+		constexpr bool is_xbegin() const noexcept {
+			return this->rel_size && this->map == OpcodeMap::primary && this->opcode == 0xC7;
+		}
+	};
+
+	namespace impl {
+		// opcode properties
+		enum : uint16_t {
+			none     = 0,
+			modrm    = 1 << 0,  // has a ModRM byte
+			imm8     = 1 << 1,  // ib
+			imm16    = 1 << 2,  // iw
+			immz     = 1 << 3,  // iz (16 or 32 bits depending on the operand size)
+			rel8     = 1 << 4,  // cb
+			relz     = 1 << 5,  // cw/cd
+			special  = 1 << 6,  // handled manually in decode()
+			inv64    = 1 << 7,  // invalid in 64bit mode
+			invalid  = 1 << 8,  // undefined opcode
+			prefix   = 1 << 9   // legacy prefix
+		};
+
+		static constexpr uint16_t M = modrm, I8 = imm8, I16 = imm16, IZ = immz, R8 = rel8, RZ = relz,
+			S = special, X = inv64, U = invalid, P = prefix;
+
+		// one-byte opcode map
+		inline constexpr uint16_t primary_table[256] = {
+			/*        0        1        2        3        4        5        6        7        8        9        A        B        C        D        E        F   */
+			/* 0 */   M,       M,       M,       M,       I8,      IZ,      X,       X,       M,       M,       M,       M,       I8,      IZ,      X,       S,
+			/* 1 */   M,       M,       M,       M,       I8,      IZ,      X,       X,       M,       M,       M,       M,       I8,      IZ,      X,       X,
+			/* 2 */   M,       M,       M,       M,       I8,      IZ,      P,       X,       M,       M,       M,       M,       I8,      IZ,      P,       X,
+			/* 3 */   M,       M,       M,       M,       I8,      IZ,      P,       X,       M,       M,       M,       M,       I8,      IZ,      P,       X,
+			/* 4 */   none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,
+			/* 5 */   none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    none,
+			/* 6 */   X,       X,       M | S,   M,       P,       P,       P,       P,       IZ,      M | IZ,  I8,      M | I8,  none,    none,    none,    none,
+			/* 7 */   R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,
+			/* 8 */   M | I8,  M | IZ,  M|I8|X,  M | I8,  M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M | S,
+			/* 9 */   none,    none,    none,    none,    none,    none,    none,    none,    none,    none,    S | X,   none,    none,    none,    none,    none,
+			/* A */   S,       S,       S,       S,       none,    none,    none,    none,    I8,      IZ,      none,    none,    none,    none,    none,    none,
+			/* B */   I8,      I8,      I8,      I8,      I8,      I8,      I8,      I8,      S,       S,       S,       S,       S,       S,       S,       S,
+			/* C */   M | I8,  M | I8,  I16,     none,    M | S,   M | S,   M | I8,  M | IZ,  S,       none,    I16,     none,    none,    I8,      X,       none,
+			/* D */   M,       M,       M,       M,       I8 | X,  I8 | X,  X,       none,    M,       M,       M,       M,       M,       M,       M,       M,
+			/* E */   R8,      R8,      R8,      R8,      I8,      I8,      I8,      I8,      RZ,      RZ,      S | X,   R8,      none,    none,    none,    none,
+			/* F */   P,       none,    P,       P,       none,    none,    M | S,   M | S,   none,    none,    none,    none,    none,    none,    M,       M
+		};
+
+		// two-byte opcode map (0F xx)
+		inline constexpr uint16_t map_0f_table[256] = {
+			/*        0        1        2        3        4        5        6        7        8        9        A        B        C        D        E        F   */
+			/* 0 */   M,       M,       M,       M,       U,       none,    none,    none,    none,    none,    U,       none,    U,       M,       none,    M | I8,
+			/* 1 */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,
+			/* 2 */   M,       M,       M,       M,       U,       U,       U,       U,       M,       M,       M,       M,       M,       M,       M,       M,
+			/* 3 */   none,    none,    none,    none,    none,    none,    U,       none,    S,       U,       S,       U,       U,       U,       U,       U,
+			/* 4 */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,
+			/* 5 */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,
+			/* 6 */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,
+			/* 7 */   M | I8,  M | I8,  M | I8,  M | I8,  M,       M,       M,       none,    M,       M,       U,       U,       M,       M,       M,       M,
+			/* 8 */   RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,
+			/* 9 */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,
+			/* A */   none,    none,    none,    M,       M | I8,  M,       U,       U,       none,    none,    none,    M,       M | I8,  M,       M,       M,
+			/* B */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M | I8,  M,       M,       M,       M,       M,
+			/* C */   M,       M,       M | I8,  M,       M | I8,  M | I8,  M | I8,  M,       none,    none,    none,    none,    none,    none,    none,    none,
+			/* D */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,
+			/* E */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,
+			/* F */   M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M,       M
+		};
+
+		// the size of an iz/iv immediate
+		constexpr uint8_t immz_size(const bool opsize) {
+			return opsize ? 2 : 4;
+		}
+
+		// flags for an opcode in a VEX/EVEX/XOP map (every one of these has a ModRM)
+		constexpr uint16_t extended_map_flags(const OpcodeMap map, const uint8_t opcode) {
+			switch (map) {
+			case OpcodeMap::map_0f:
+				// vzeroupper/vzeroall
+				if (opcode == 0x77)
+					return none;
+
+				// only the ModRM and imm8 matter here
+				return uint16_t(M | (map_0f_table[opcode] & I8));
+			case OpcodeMap::map_0f3a:
+			case OpcodeMap::xop_8:
+				return M | I8;
+			case OpcodeMap::xop_a:
+				return M | IZ;
+			default:
+				return M;
+			}
+		}
+	} // namespace impl
+
+	// decode a single instruction, size is how many bytes can be safely read
+	constexpr Instruction decode(const uint8_t* const code, const size_t size, const bool is64bit) noexcept {
+		// architectural limit
+		constexpr size_t max_length = 15;
+		const auto limit{ size < max_length ? size : max_length };
+
+		Instruction instruction{};
+		size_t offset{ 0 };
+
+		bool opsize{ false }, addrsize{ false }, repprefix{ false };
+		uint8_t rex{ 0 };
+
+		// legacy prefixes (REX only counts if it's right before the opcode)
+		for (; offset < limit; ++offset) {
+			const auto byte{ code[offset] };
+			if (impl::primary_table[byte] & impl::prefix) {
+				opsize |= (byte == 0x66);
+				addrsize |= (byte == 0x67);
+				repprefix |= (byte == 0xF2 || byte == 0xF3);
+				rex = 0;
+			} else if (is64bit && (byte & 0xF0) == 0x40) {
+				rex = byte;
+			} else {
+				break;
+			}
+		}
+
+		if (offset >= limit)
+			return {};
+
+		const bool rex_w{ (rex & 0b1000) != 0 };
+
+		auto map{ OpcodeMap::primary };
+		auto opcode{ code[offset] };
+		uint16_t flags{ impl::primary_table[opcode] };
+
+		instruction.rex = rex;
+		instruction.has_opsize_prefix = opsize;
+		instruction.has_addrsize_prefix = addrsize;
+
+		// needed for VEX/EVEX/XOP detection in 32bit mode, the prefix is reinterpreted only if mod == 11
+		const auto next_is_mod11{ offset + 1 < limit && (code[offset + 1] & 0xC0) == 0xC0 };
+
+		if (opcode == 0x0F) {
+			// escape to another opcode map
+			if (++offset >= limit)
+				return {};
+
+			opcode = code[offset];
+			if (opcode == 0x38 || opcode == 0x3A) {
+				map = (opcode == 0x38) ? OpcodeMap::map_0f38 : OpcodeMap::map_0f3a;
+				if (++offset >= limit)
+					return {};
+
+				opcode = code[offset];
+				flags = impl::extended_map_flags(map, opcode);
+			} else {
+				// 3DNow! (0F 0F) has its opcode after the ModRM, which is treated as an imm8
+				map = OpcodeMap::map_0f;
+				flags = impl::map_0f_table[opcode];
+			}
+		} else if ((opcode == 0xC4 || opcode == 0xC5) && (is64bit || next_is_mod11)) {
+			// VEX, REX and 66/F2/F3 prefixes aren't allowed
+			if (rex || opsize || repprefix)
+				return {};
+
+			instruction.is_vex = true;
+			if (opcode == 0xC5) {
+				// 2 byte VEX always uses the 0F map
+				map = OpcodeMap::map_0f;
+				offset += 2;
+			} else {
+				if (offset + 1 >= limit)
+					return {};
+
+				const auto mmmmm{ code[offset + 1] & 0b11111 };
+				if (mmmmm < 1 || mmmmm > 3)
+					return {};
+
+				map = OpcodeMap(mmmmm);
+				offset += 3;
+			}
+
+			if (offset >= limit)
+				return {};
+
+			opcode = code[offset];
+			flags = impl::extended_map_flags(map, opcode);
+		} else if (opcode == 0x62 && (is64bit || next_is_mod11)) {
+			// EVEX, 4 bytes long
+			if (rex || opsize || repprefix || offset + 4 >= limit)
+				return {};
+
+			instruction.is_evex = true;
+			switch (code[offset + 1] & 0b111) {
+			case 1: map = OpcodeMap::map_0f; break;
+			case 2: map = OpcodeMap::map_0f38; break;
+			case 3: map = OpcodeMap::map_0f3a; break;
+			case 5: map = OpcodeMap::map_5; break;
+			case 6: map = OpcodeMap::map_6; break;
+			default: return {};
+			}
+
+			offset += 4;
+			opcode = code[offset];
+			flags = impl::extended_map_flags(map, opcode);
+		} else if (opcode == 0x8F && offset + 1 < limit && (code[offset + 1] & 0b11111) >= 8) {
+			// XOP (pop r/m is 8F /0, so any map select >= 8 can't be a pop)
+			if (rex || opsize || repprefix || offset + 3 >= limit)
+				return {};
+
+			instruction.is_xop = true;
+			switch (code[offset + 1] & 0b11111) {
+			case 8: map = OpcodeMap::xop_8; break;
+			case 9: map = OpcodeMap::xop_9; break;
+			case 0xA: map = OpcodeMap::xop_a; break;
+			default: return {};
+			}
+
+			offset += 3;
+			opcode = code[offset];
+			flags = impl::extended_map_flags(map, opcode);
+		}
+
+		if (flags & impl::invalid)
+			return {};
+		if (is64bit && (flags & impl::inv64) && map == OpcodeMap::primary)
+			return {};
+
+		instruction.opcode = opcode;
+		instruction.map = map;
+		instruction.opcode_offset = uint8_t(offset);
+		++offset;
+
+		// ModRM, SIB and displacement
+		if (flags & impl::modrm) {
+			if (offset >= limit)
+				return {};
+
+			const auto modrm{ code[offset] };
+			const auto rm{ modrm & 0b111 };
+
+			// mov to/from control/debug registers ignore mod and always use a register
+			const auto mod{ (map == OpcodeMap::map_0f && (opcode & 0xFC) == 0x20) ? 0b11 : (modrm >> 6) };
+
+			instruction.has_modrm = true;
+			instruction.modrm = modrm;
+			instruction.modrm_offset = uint8_t(offset++);
+
+			uint8_t disp_size{ 0 };
+			if (!is64bit && addrsize) {
+				// 16bit addressing, no SIB
+				if (mod == 0b00 && rm == 0b110)
+					disp_size = 2;
+				else if (mod == 0b01)
+					disp_size = 1;
+				else if (mod == 0b10)
+					disp_size = 2;
+			} else if (mod != 0b11) {
+				// SIB
+				if (rm == 0b100) {
+					if (offset >= limit)
+						return {};
+
+					// [base + index * scale + disp32] with no base
+					if (mod == 0b00 && (code[offset] & 0b111) == 0b101)
+						disp_size = 4;
+
+					++offset;
+				}
+
+				if (mod == 0b00 && rm == 0b101) {
+					disp_size = 4;
+					instruction.is_rip_relative = is64bit;
+				} else if (mod == 0b01) {
+					disp_size = 1;
+				} else if (mod == 0b10) {
+					disp_size = 4;
+				}
+			}
+
+			if (disp_size) {
+				instruction.disp_offset = uint8_t(offset);
+				instruction.disp_size = disp_size;
+				offset += disp_size;
+			}
+		}
+
+		// immediates
+		uint8_t imm_size{ 0 };
+		if (flags & impl::imm8)
+			imm_size += 1;
+		if (flags & impl::imm16)
+			imm_size += 2;
+		if (flags & impl::immz)
+			imm_size += impl::immz_size(opsize);
+
+		if (flags & impl::special) {
+			switch (opcode) {
+			case 0xF6: // test r/m8, imm8 (only /0 and /1)
+				if (((instruction.modrm >> 3) & 0b111) <= 1)
+					imm_size += 1;
+				break;
+			case 0xF7: // test r/m, imm (only /0 and /1)
+				if (((instruction.modrm >> 3) & 0b111) <= 1)
+					imm_size += impl::immz_size(opsize);
+				break;
+			case 0xA0: case 0xA1: case 0xA2: case 0xA3: // mov with moffs
+				if (is64bit)
+					imm_size += addrsize ? 4 : 8;
+				else
+					imm_size += addrsize ? 2 : 4;
+				break;
+			case 0xB8: case 0xB9: case 0xBA: case 0xBB: // mov r, imm
+			case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+				imm_size += rex_w ? 8 : impl::immz_size(opsize);
+				break;
+			case 0x9A: case 0xEA: // far call/jmp ptr16:16/32
+				imm_size += impl::immz_size(opsize) + 2;
+				break;
+			case 0xC8: // enter imm16, imm8
+				imm_size += 3;
+				break;
+			default: // 0F escape, LES/LDS, BOUND, pop r/m
+				break;
+			}
+		}
+
+		// xbegin is mov r/m, imm with a ModRM of F8, except the immediate is relative
+		const bool is_xbegin{ map == OpcodeMap::primary && opcode == 0xC7 && instruction.modrm == 0xF8 };
+		if (is_xbegin)
+			imm_size = 0;
+
+		if (imm_size) {
+			instruction.imm_offset = uint8_t(offset);
+			instruction.imm_size = imm_size;
+			offset += imm_size;
+		}
+
+		// relative operands
+		if (is_xbegin) {
+			instruction.rel_offset = uint8_t(offset);
+			instruction.rel_size = impl::immz_size(opsize);
+			offset += instruction.rel_size;
+		} else if (flags & (impl::rel8 | impl::relz)) {
+			// jmp/call/jcc rel32 ignore the operand-size prefix in 64bit mode
+			const uint8_t rel_size{ (flags & impl::rel8) ? uint8_t(1) :
+				(is64bit ? uint8_t(4) : impl::immz_size(opsize)) };
+
+			instruction.rel_offset = uint8_t(offset);
+			instruction.rel_size = rel_size;
+			offset += rel_size;
+		}
+
+		// ran past the end of the buffer (or the 15 byte limit)
+		if (offset > limit)
+			return {};
+
+		instruction.length = uint8_t(offset);
+		return instruction;
+	}
+
+	// get the length of a single instruction, 0 if invalid
+	constexpr size_t length(const uint8_t* const code, const size_t size, const bool is64bit) noexcept {
+		return decode(code, size, is64bit).length;
+	}
+
+	// how many bytes of whole instructions are needed to cover atleast min_size bytes, 0 if invalid
+	// eg: how many bytes need to be stolen for an inline hook
+	constexpr size_t instruction_boundary(const uint8_t* const code, const size_t size,
+		const size_t min_size, const bool is64bit) noexcept
+	{
+		size_t offset{ 0 };
+		while (offset < min_size) {
+			const auto length{ decode(code + offset, size - offset, is64bit).length };
+			if (!length)
+				return 0;
+			offset += length;
+		}
+		return offset;
+	}
+} // namespace mango::ild
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <unordered_map>
 #include <vector>
 #include <optional>
+#include <memory_resource>
 
 
 namespace mango {
@@ -28,17 +29,32 @@ namespace mango {
 			uint32_t characteristics = 0; // IMAGE_SECTION_HEADER::Characteristics
 		};
 
+		// std::string_view lookups without allocating a string first
+		struct StringHash {
+			using is_transparent = void;
+			size_t operator()(const std::string_view str) const noexcept { return std::hash<std::string_view>{}(str); }
+		};
+
 		// EAT and IAT
-		using ExportedFuncs = std::unordered_map<std::string, PeEntry>;
-		using ImportedFuncs = std::unordered_map<std::string, std::unordered_map<std::string, PeEntry>>;
+		using ExportedFuncs = std::pmr::unordered_map<std::pmr::string, PeEntry, StringHash, std::equal_to<>>;
+		using ImportedFuncs = std::pmr::unordered_map<std::pmr::string, ExportedFuncs, StringHash, std::equal_to<>>;
 
 		// sections
-		using PeSections = std::vector<PeSection>;
+		using PeSections = std::pmr::vector<PeSection>;
 
 	public:
 		LoadedModule() = default; // left in an invalid state
-		LoadedModule(const Process& process, const void* const address) { this->setup(process, address); }
-		LoadedModule(const Process& process, const uintptr_t address) { this->setup(process, address); }
+
+		// the tables are allocated from resource (an Arena for example), which has to outlive this
+		// NOTE: copies use the default resource
+		explicit LoadedModule(std::pmr::memory_resource* const resource)
+			: m_exported_funcs{ resource }, m_imported_funcs{ resource }, m_sections{ resource } {}
+		LoadedModule(const Process& process, const void* const address,
+			std::pmr::memory_resource* const resource = std::pmr::get_default_resource())
+			: LoadedModule{ resource } { this->setup(process, address); }
+		LoadedModule(const Process& process, const uintptr_t address,
+			std::pmr::memory_resource* const resource = std::pmr::get_default_resource())
+			: LoadedModule{ resource } { this->setup(process, address); }
 		LoadedModule(const LoadedModule& other) = default; // copying is allowed
 
 		// setup (parse the pe header mostly)
@@ -56,7 +72,7 @@ namespace mango {
 		// get the size of image
 		size_t get_image_size() const { return this->m_image_size; }
 
-		// section sizes are a multiple of this value
+		// sections are mapped at a multiple of this value (OptionalHeader.SectionAlignment)
 		size_t get_section_alignment() const { return this->m_section_alignment; }
 
 		// get exported functions
@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <string>
 #include <string_view>
+#include <vector>
 
 
 namespace mango {
@@ -14,4 +15,8 @@ namespace mango {
 	// manual map a dll into another process
 	uintptr_t manual_map(const Process& process, const std::string_view dll_path);
 	uintptr_t manual_map(const Process& process, const uint8_t* const image);
+
+	// copy the headers and sections of a raw image to where they'd be in memory, relocated for image_base
+	// the returned buffer is SizeOfImage bytes
+	std::vector<uint8_t> map_image(const uint8_t* const image, const size_t size, const uintptr_t image_base);
 } // namespace mango
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <string_view>
 #include <ostream>
 #include <vector>
+#include <memory_resource>
 
 
 namespace mango::memscn {
@@ -66,6 +67,12 @@ namespace mango::memscn {
 	std::vector<uintptr_t> find(const Process& process, const Pattern& pattern,
 		const std::string_view modulename, const Filter& filter = all_filter);
 
+	// same as above but the results (and the buffer that memory is read into) are allocated from resource
+	std::pmr::vector<uintptr_t> find(const Process& process, const Pattern& pattern,
+		std::pmr::memory_resource* const resource, const Range& range = range_all, const Filter& filter = all_filter);
+	std::pmr::vector<uintptr_t> find(const Process& process, const Pattern& pattern,
+		std::pmr::memory_resource* const resource, const std::string_view modulename, const Filter& filter = all_filter);
+
 	// return the first occurance or 0
 	inline uintptr_t find_first(const Process& process, const Pattern& pattern,
 		const Range& range = range_all, const Filter& filter = all_filter) 
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "../misc/fnv_hash.h"
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <string_view>
+
+
+namespace mango {
+	class Process;
+
+	namespace impl {
+		// fnv1a, optionally lowercase
+		constexpr size_t hash_pe_name(const char* const str, const size_t size, const bool lowercase) noexcept {
+			auto hash = fnv1_offset_v<size_t>;
+			for (size_t i{ 0 }; i < size && str[i]; ++i) {
+				auto c{ str[i] };
+				if (lowercase && c >= 'A' && c <= 'Z')
+					c += 'a' - 'A';
+
+				hash = (hash ^ c) * fnv1_prime_v<size_t>;
+			}
+			return hash;
+		}
+	} // namespace impl
+
+	// a compact index of a module's imports and exports, used by IatHook and EatHook
+	// names are stored as Fnv1a<> hashes (module names are lowercased first, function names are not)
+	// indices are cached per process and module, so every hook on the same module shares one
+	class ModuleIndex {
+	public:
+		struct Import {
+			size_t module_hash,
+				func_hash;
+
+			// rva of the IAT slot
+			uint32_t slot_rva;
+		};
+
+		struct Export {
+			size_t func_hash;
+
+			// rva of the entry in AddressOfFunctions
+			uint32_t table_rva;
+
+			// what the entry was when the index was built (EatHook doesn't change this)
+			uint32_t function_rva;
+		};
+
+	public:
+		// get the cached index of a module, it's rebuilt if a different module was loaded at the same address
+		static std::shared_ptr<const ModuleIndex> get(const Process& process, const uintptr_t image_base);
+
+		// forget every cached index
+		static void clear_cache();
+
+		// same as Fnv1a<>, but at runtime (module names are lowercased first)
+		static size_t hash_module_name(const std::string_view name) noexcept;
+		static size_t hash_func_name(const std::string_view name) noexcept;
+
+		// hash_module_name() at compile time, Fnv1a<> only matches if the name is already lowercase
+		// ModuleIndex::module_hash("Kernel32.dll") == Fnv1a<>("kernel32.dll")
+		template <size_t Size>
+		static consteval size_t module_hash(const char(&name)[Size]) noexcept {
+			return impl::hash_pe_name(name, Size - 1, true);
+		}
+
+		// whether anything is imported from this module
+		bool has_import_module(const size_t module_hash) const noexcept;
+
+		// the address of the IAT slot
+		std::optional<uintptr_t> find_import(const size_t module_hash, const size_t func_hash) const noexcept;
+
+		// the address of the entry in AddressOfFunctions
+		std::optional<uintptr_t> find_export(const size_t func_hash) const noexcept;
+
+		// the exported rva when the index was built, without reading it again (forwarders point into the export directory)
+		std::optional<uint32_t> find_export_rva(const size_t func_hash) const noexcept;
+
+		// image base (passed to get())
+		uintptr_t get_image_base() const noexcept { return this->m_image_base; }
+
+		// SizeOfImage
+		size_t get_image_size() const noexcept { return this->m_image_size; }
+
+		// the export directory [start, end), exported rvas inside this range are forwarders
+		uintptr_t get_export_dir_start() const noexcept { return this->m_export_dir_start; }
+		uintptr_t get_export_dir_end() const noexcept { return this->m_export_dir_end; }
+
+	private:
+		template <bool is64bit>
+		void setup(const Process& process, const uintptr_t image_base);
+
+	private:
+		uintptr_t m_image_base = 0,
+			m_export_dir_start = 0,
+			m_export_dir_end = 0;
+		size_t m_image_size = 0;
+
+		// used to tell if the module at m_image_base is still the same one
+		uint32_t m_timestamp = 0;
+
+		// sorted by module_hash then func_hash
+		std::vector<Import> m_imports;
+
+		// sorted by func_hash
+		std::vector<Export> m_exports;
+	};
+} // namespace mango
\ No newline at end of file
@@ -2,16 +2,22 @@
 
 #include <stdint.h>
 #include <string>
+#include <map>
+#include <memory>
 #include <string_view>
 #include <unordered_map>
 
 #include "windows_defs.h"
 #include "loaded_module.h"
+#include "cave_allocator.h"
 #include "../misc/error_codes.h"
+#include "../misc/expected.h"
 #include "../misc/misc.h"
 
 
 namespace mango {
+	class ModuleIndex;
+
 	class Process {
 	public:
 		struct HandleInfo {
@@ -35,6 +41,9 @@ namespace mango {
 			// the access mask to open the process with
 			ACCESS_MASK handle_access = PROCESS_ALL_ACCESS;
 
+			// remember the results of get_proc_addr(module_hash, func_hash) until the modules are reloaded
+			bool memoize_proc_addrs = false;
+
 			// user-defineable
 			ReadMemoryFunc read_memory_func                  = default_read_memory_func;
 			WriteMemoryFunc write_memory_func                = default_write_memory_func;
@@ -49,6 +58,15 @@ namespace mango {
 		using ProcessModules = std::unordered_map<std::string, LoadedModule>;
 		using ModuleAddressMap = std::unordered_map<std::string, uintptr_t>;
 
+		struct HashedModule {
+			uintptr_t address;
+
+			// built by the first get_proc_addr() on this module, the lookups after that don't read anything
+			mutable std::shared_ptr<const ModuleIndex> index;
+		};
+		using ModuleHashMap = std::unordered_map<size_t, HashedModule>;
+		using ProcAddrMemo = std::map<std::pair<size_t, size_t>, uintptr_t>;
+
 	public:
 		Process() = default; // left in an invalid state
 		explicit Process(const uint32_t pid, const SetupOptions& options = SetupOptions()) {
@@ -117,15 +135,36 @@ namespace mango {
 		// get a list of loaded modules
 		const ProcessModules& get_modules() const noexcept { return this->m_modules; }
 
+		// the base address of every module, even the ones that haven't been loaded yet (defer_module_loading)
+		const ModuleAddressMap& get_module_addresses() const noexcept { return this->m_module_addresses; }
+
+		// code caves shared by every hook in this process, so they don't hand out the same bytes twice
+		CaveAllocator& get_cave_allocator() const {
+			if (!this->m_cave_allocator)
+				throw ProcessNotSetup{};
+
+			return *this->m_cave_allocator;
+		}
+
 		// get a loaded module, case-insensitive (passing "" for name returns the current process module)
 		const LoadedModule* get_module(const std::string_view name = "") const;
 
+		// get the loaded module that contains the address (nullptr if not inside a module)
+		const LoadedModule* get_module_by_addr(const uintptr_t address) const;
+
 		// get the base address of a module
 		uintptr_t get_module_addr(const std::string_view module_name = "") const;
 
 		// this uses the internal list of modules to find the function address
 		uintptr_t get_proc_addr(const std::string_view module_name, const std::string_view func_name) const;
 
+		// same as above but with Fnv1a<> hashes instead of names, so the names never exist at runtime
+		// module hashes are of the lowercase name, ModuleIndex::module_hash() lowercases any other name at compile time
+		// api set names aren't resolved, and exports are looked up once per module (same as LoadedModule)
+		// get_proc_addr(Fnv1a<>("kernel32.dll"), Fnv1a<>("LoadLibraryA")) for example
+		uintptr_t get_module_addr(const size_t module_hash) const;
+		uintptr_t get_proc_addr(const size_t module_hash, const size_t func_hash) const;
+
 		// api name -> dll name
 		std::string resolve_apiset(const std::string_view name) const;
 
@@ -180,6 +219,34 @@ namespace mango {
 			this->write(uintptr_t(address), &value, sizeof(value));
 		}
 
+		// same as read() but returns the NTSTATUS instead of throwing, for code that expects to fail a lot
+		// NOTE: partial copies count as failures, and the current process is read with NtReadVirtualMemory too
+		Expected<void> try_read(const void* const address, void* const buffer, const size_t size) const noexcept;
+		Expected<void> try_read(const uintptr_t address, void* const buffer, const size_t size) const noexcept {
+			return this->try_read(reinterpret_cast<void*>(address), buffer, size);
+		}
+
+		// easy to use wrapper for try_read()
+		template <typename T, typename Addr>
+		Expected<T> try_read(const Addr address) const noexcept {
+			T buffer;
+			if (const auto result{ this->try_read(uintptr_t(address), &buffer, sizeof(buffer)) }; !result)
+				return Unexpected{ result.error() };
+			return buffer;
+		}
+
+		// same as write() but returns the NTSTATUS instead of throwing
+		Expected<void> try_write(void* const address, const void* const buffer, const size_t size) const noexcept;
+		Expected<void> try_write(const uintptr_t address, const void* const buffer, const size_t size) const noexcept {
+			return this->try_write(reinterpret_cast<void*>(address), buffer, size);
+		}
+
+		// easy to use wrapper for try_write()
+		template <typename T, typename Addr>
+		Expected<void> try_write(const Addr address, const T& value) const noexcept {
+			return this->try_write(uintptr_t(address), &value, sizeof(value));
+		}
+
 		// allocate virtual memory in the process (wrapper for VirtualAllocEx)
 		// NOTE: prefer using a ProcessMemoryAllocator instead of this directly
 		void* alloc_virt_mem(const size_t size,
@@ -203,12 +270,24 @@ namespace mango {
 			return this->get_mem_prot(reinterpret_cast<void*>(address));
 		}
 
+		// same as get_mem_prot() but returns the NTSTATUS instead of throwing
+		Expected<uint32_t> try_get_mem_prot(void* const address) const noexcept;
+		Expected<uint32_t> try_get_mem_prot(const uintptr_t address) const noexcept {
+			return this->try_get_mem_prot(reinterpret_cast<void*>(address));
+		}
+
 		// set the protection, returns the old protection
 		uint32_t set_mem_prot(void* address, const size_t size, const uint32_t protection) const;
 		uint32_t set_mem_prot(const uintptr_t address, const size_t size, const uint32_t protection) const {
 			return this->set_mem_prot(reinterpret_cast<void*>(address), size, protection);
 		}
 
+		// same as set_mem_prot() but returns the NTSTATUS instead of throwing
+		Expected<uint32_t> try_set_mem_prot(void* address, const size_t size, const uint32_t protection) const noexcept;
+		Expected<uint32_t> try_set_mem_prot(const uintptr_t address, const size_t size, const uint32_t protection) const noexcept {
+			return this->try_set_mem_prot(reinterpret_cast<void*>(address), size, protection);
+		}
+
 		// wrapper over CreateRemoteThread (waits for the thread to finish execution)
 		void create_remote_thread(void* const address, void* const argument = nullptr) const {
 			this->m_options.create_remote_thread_func(this, address, argument);
@@ -274,6 +353,9 @@ namespace mango {
 		uintptr_t m_peb64_address = 0;
 		SetupOptions m_options;
 		ModuleAddressMap m_module_addresses;
+		ModuleHashMap m_module_hashes; // ModuleIndex::hash_module_name() -> address and index
+		mutable ProcAddrMemo m_proc_addr_memo; // SetupOptions::memoize_proc_addrs
 		mutable ProcessModules m_modules; // mutable for deferred loading
+		std::unique_ptr<CaveAllocator> m_cave_allocator;
 	};
 } // namespace mango
\ No newline at end of file
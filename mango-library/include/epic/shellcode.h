@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <array>
+#include <memory_resource>
 #include <ostream>
 #include <iostream>
 #include <assert.h>
@@ -17,13 +18,18 @@ namespace mango {
 
 	class Shellcode {
 	public:
-		using ShellcodeData = std::vector<uint8_t>;
+		using ShellcodeData = std::pmr::vector<uint8_t>;
 
 	public:
 		Shellcode() = default;
 
+		// the bytes are allocated from resource (an Arena for example), which has to outlive this
+		// NOTE: copies use the default resource, moves keep the resource
+		explicit Shellcode(std::pmr::memory_resource* const resource) : m_data{ resource } {}
+
 		// same as Shellcode s(); s.push(args);
 		template <typename ...Args>
+			requires (!(sizeof...(Args) == 1 && (std::is_convertible_v<Args, std::pmr::memory_resource*> && ...)))
 		explicit Shellcode(Args&& ...args) noexcept { this->push(std::forward<Args>(args)...);  }
 
 		// allow copying
@@ -31,7 +37,7 @@ namespace mango {
 		Shellcode& operator=(Shellcode&) = default;
 
 		// allow moving
-		Shellcode(Shellcode&& other) noexcept { *this = std::move(other); }
+		Shellcode(Shellcode&& other) noexcept : m_data{ std::move(other.m_data) } {}
 		Shellcode& operator=(Shellcode&& other) {
 			this->m_data = std::move(other.m_data);
 			return *this;
@@ -147,9 +153,9 @@ namespace mango {
 		template<class T, std::size_t N>
 		struct is_stdcontainer<std::array<T, N>> : std::true_type {};
 
-		// std::vector
-		template<class T>
-		struct is_stdcontainer<std::vector<T>> : std::true_type {};
+		// std::vector and std::pmr::vector
+		template<class T, class Alloc>
+		struct is_stdcontainer<std::vector<T, Alloc>> : std::true_type {};
 
 	private:
 		ShellcodeData m_data;
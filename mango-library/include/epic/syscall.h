@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <string_view>
 
 
 namespace mango::syscall {
@@ -35,7 +36,7 @@ namespace mango::syscall {
 	} // namespace impl
 
 	// dynamically get the sycall index of a function in ntdll.dll
-	uint32_t index(const std::string& func_name);
+	uint32_t index(const std::string_view func_name);
 
 	// syscall wrapper, based on https://www.unknowncheats.me/forum/c-and-c-/267587-comfy-direct-syscall-caller-x64.html
 	// but adapted to also work with WOW64 processes
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../misc/fnv_hash.h"
+
+#include <stdint.h>
+#include <vector>
+#include <optional>
+#include <string_view>
+
+
+namespace mango {
+	class LoadedModule;
+
+	// the syscall index of every Nt/Zw function in ntdll.dll
+	// the syscall stubs are laid out in order of their index, so the indices come from sorting the Zw* exports
+	// by rva (the stubs themselves are never read, which means hooks don't matter)
+	// lookups are a single probe into a perfect hash table, keyed by Fnv1a<> of the name
+	class SyscallTable {
+	public:
+		SyscallTable() = default;
+
+		// image is either the raw file or an image that's already mapped (where rvas are offsets)
+		SyscallTable(const uint8_t* const image, const size_t size, const bool mapped = false) {
+			this->setup(image, size, mapped);
+		}
+
+		// an ntdll.dll that's loaded in a process
+		explicit SyscallTable(const LoadedModule& ntdll) { this->setup(ntdll); }
+
+		// image is either the raw file or an image that's already mapped (where rvas are offsets)
+		// only the pe header is parsed, so this doesn't need windows or a process
+		void setup(const uint8_t* const image, const size_t size, const bool mapped = false);
+
+		// an ntdll.dll that's loaded in a process
+		void setup(const LoadedModule& ntdll);
+
+		// find(Fnv1a<>("NtClose")) for example
+		std::optional<uint32_t> find(const size_t name_hash) const noexcept;
+
+		// same as find(), but hashes the name at runtime
+		std::optional<uint32_t> find(const std::string_view name) const noexcept {
+			return this->find(size_t(Fnv1a<>(StringWrapper{ name.data(), name.size() })));
+		}
+
+		// same as find(), but throws if it's not a syscall
+		uint32_t get(const size_t name_hash) const;
+		uint32_t get(const std::string_view name) const;
+
+		// the table for the ntdll.dll of the current process (built on first use)
+		static const SyscallTable& current();
+
+		// number of syscalls (not counting Nt and Zw twice)
+		size_t size() const noexcept { return this->m_num_syscalls; }
+
+		// whether setup() succeeded
+		bool is_valid() const noexcept { return !this->m_slots.empty(); }
+
+		// a more intuitive way to test for validity
+		explicit operator bool() const noexcept { return this->is_valid(); }
+
+	private:
+		struct Slot {
+			size_t hash = 0;
+
+			// invalid_index if the slot is empty
+			uint32_t index = invalid_index;
+		};
+
+		// a Zw* export
+		struct Export {
+			uint32_t rva;
+			const char* name;
+			size_t length;
+		};
+
+		static constexpr uint32_t invalid_index = 0xFFFFFFFF;
+
+	private:
+		// sort by rva and build the hash table
+		void build(std::vector<Export>& exports);
+
+	private:
+		size_t m_num_syscalls = 0;
+
+		// hash -> bucket -> seed -> slot
+		std::vector<uint32_t> m_seeds;
+		std::vector<Slot> m_slots;
+	};
+} // namespace mango
\ No newline at end of file
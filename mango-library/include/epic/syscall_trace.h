@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+#include <stddef.h>
+
+
+// the trace rings written by Wow64SyscallHook and the code that reads them
+// nothing here depends on windows, so it can be tested (and benchmarked) anywhere
+namespace mango {
+	// a single syscall, the layout is shared with the Wow64SyscallHook stub
+	struct SyscallTraceRecord {
+		// position in the ring + 1, written last (0 while the record is being written)
+		uint32_t sequence;
+
+		uint32_t syscall_index,
+			return_value,
+			thread_id;
+
+		// rdtsc before and after the syscall
+		uint64_t start_tsc,
+			end_tsc;
+
+		// the first few arguments (whatever is on the stack, for syscalls with less arguments)
+		uint32_t arguments[4];
+	};
+
+	static_assert(sizeof(SyscallTraceRecord) == 0x30);
+
+	// every thread writes to the ring picked by its thread id, producers reserve a record
+	// with lock xadd on head and overwrite the oldest records when the ring is full
+	struct SyscallTraceRing {
+		static constexpr uint32_t count = 16;
+
+		// must be a power of 2
+		static constexpr uint32_t capacity = 2048;
+
+		// the number of records ever reserved (wraps around)
+		uint32_t head;
+
+		// head gets its own cache line
+		uint8_t padding[60];
+
+		SyscallTraceRecord records[capacity];
+
+		// thread ids are multiples of 4
+		static constexpr uint32_t index(const uint32_t thread_id) noexcept {
+			return (thread_id >> 2) & (count - 1);
+		}
+	};
+
+	static_assert(offsetof(SyscallTraceRing, records) == 0x40);
+
+	// reads records out of copies of a single ring, in order
+	class SyscallTraceConsumer {
+	public:
+		// ring is a copy of the ring, head is SyscallTraceRing::head read again after the copy was made
+		// records that could've been overwritten while copying are skipped and counted as dropped
+		// returns the number of records passed to the callback
+		template <typename Callback>
+		size_t consume(const SyscallTraceRing& ring, const uint32_t head, Callback&& callback) {
+			constexpr auto capacity{ SyscallTraceRing::capacity };
+
+			// the producers lapped us
+			if (head - this->m_position > capacity) {
+				this->m_dropped += (head - capacity) - this->m_position;
+				this->m_position = head - capacity;
+			}
+
+			size_t consumed{ 0 };
+			while (int32_t(ring.head - this->m_position) > 0) {
+				const auto& record{ ring.records[this->m_position & (capacity - 1)] };
+
+				// still being written, try again next time
+				if (record.sequence != this->m_position + 1)
+					break;
+
+				callback(record);
+
+				++this->m_position;
+				++consumed;
+			}
+
+			return consumed;
+		}
+
+		// records that were overwritten before they could be read
+		uint64_t get_dropped() const noexcept { return this->m_dropped; }
+
+		// the position of the next record
+		uint32_t get_position() const noexcept { return this->m_position; }
+
+	private:
+		uint32_t m_position = 0;
+		uint64_t m_dropped = 0;
+	};
+
+	// call counts and latency histograms for every syscall
+	class SyscallTraceStats {
+	public:
+		// bucket i holds syscalls that took [2^i, 2^(i+1)) cycles, the last bucket holds everything slower
+		static constexpr size_t histogram_buckets = 32;
+
+		struct Entry {
+			uint64_t count = 0;
+
+			// sum of every syscall
+			uint64_t total_cycles = 0;
+
+			std::array<uint64_t, histogram_buckets> histogram{};
+		};
+
+	public:
+		// add a single syscall
+		void add(const SyscallTraceRecord& record);
+
+		// nullptr if the syscall was never added
+		const Entry* find(const uint32_t syscall_index) const noexcept;
+
+		// indexed by syscall index
+		const std::vector<Entry>& get_entries() const noexcept { return this->m_entries; }
+
+		// every syscall that was added
+		uint64_t get_total_count() const noexcept { return this->m_total_count; }
+
+		// remove everything
+		void clear() noexcept;
+
+		// the histogram bucket of a syscall that took this long
+		static size_t get_bucket(const uint64_t cycles) noexcept;
+
+	private:
+		std::vector<Entry> m_entries;
+		uint64_t m_total_count = 0;
+	};
+} // namespace mango
\ No newline at end of file
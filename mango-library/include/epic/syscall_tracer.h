@@ -0,0 +1,68 @@
+#pragma once
+
+#include "syscall_trace.h"
+
+#include <stdint.h>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+
+namespace mango {
+	class Process;
+	class Wow64SyscallHook;
+
+	// drains the trace rings of a Wow64SyscallHook (on a background thread, or manually with drain())
+	// and aggregates the records into call counts and latency histograms
+	// NOTE: the hook has to outlive the tracer, since the rings are freed in Wow64SyscallHook::release()
+	class SyscallTracer {
+	public:
+		// calls hook.enable_tracing(), which syscalls are traced is still up to the hook
+		explicit SyscallTracer(Wow64SyscallHook& hook);
+
+		// calls stop()
+		~SyscallTracer() { this->stop(); }
+
+		// drain every interval on a background thread
+		void start(const std::chrono::milliseconds interval = std::chrono::milliseconds{ 10 });
+
+		// stop the background thread, then drain whatever is left
+		void stop();
+
+		// read every ring once, returns the number of new records
+		// stops early if the rings can't be read anymore (the process exited, for example)
+		size_t drain();
+
+		// a copy of the stats so far
+		SyscallTraceStats get_stats() const;
+
+		// records that were overwritten before they could be read
+		uint64_t get_dropped() const;
+
+		// prevent copying
+		SyscallTracer(const SyscallTracer&) = delete;
+		SyscallTracer& operator=(const SyscallTracer&) = delete;
+
+	private:
+		const Process* m_process = nullptr;
+		uint32_t m_address = 0;
+
+		// a local copy of the ring that's being drained
+		std::unique_ptr<SyscallTraceRing> m_ring;
+
+		// one for every ring
+		std::array<SyscallTraceConsumer, SyscallTraceRing::count> m_consumers;
+		SyscallTraceStats m_stats;
+
+		// guards everything above (drain() can be called while the thread is running)
+		mutable std::mutex m_mutex;
+
+		std::thread m_thread;
+		std::mutex m_thread_mutex;
+		std::condition_variable m_thread_cv;
+		bool m_running = false;
+	};
+} // namespace mango
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 namespace mango {
 	class Process;
+	class LoadedModule;
 
 	struct MemoryRange {
 		uintptr_t m_address;
@@ -24,4 +25,20 @@ namespace mango {
 
 	// wrapper around find_all_unused_*_memory()
 	uintptr_t find_unused_xr_memory(const Process& process, const size_t size);
+
+	// find code caves in the executable sections of a module without reading the sections:
+	//     section slack (past VirtualSize, up to the section alignment)
+	//     padding between functions (from the exception directory, x64 only)
+	// only the candidate bytes are read, to make sure they're still 0x00 or int3
+	// returned memory ranges are sorted, bigger->smallest
+	std::vector<MemoryRange> find_code_caves(const Process& process, const LoadedModule& module, const size_t min_size = 16);
+
+	// find_code_caves() on every module in Process::get_modules()
+	std::vector<MemoryRange> find_all_code_caves(const Process& process, const size_t min_size = 16);
+
+	namespace impl {
+		// allocate executable memory in the first free region that's within rel32 range of address
+		// for trampolines and stubs that don't fit in a code cave, throws FailedToFindNearbyMemory
+		uintptr_t allocate_near(const Process& process, const uintptr_t address, const size_t size);
+	} // namespace impl
 } // namespace mango
\ No newline at end of file
@@ -21,4 +21,10 @@ namespace mango {
 		using fn = Ret(__thiscall*)(const void*, Args...);
 		return ((*reinterpret_cast<fn* const*>(instance))[index])(instance, args...);
 	}
+
+	// get the size of a vtable in bytes, 0 if it doesn't look like a vtable
+	// cached per process and vtable, until the module that the vtable is in changes
+	// stops at the first entry that doesn't point into an executable section of a loaded module
+	// (or into executable memory, if it isn't in a module that Process knows about)
+	size_t get_vtable_size(const Process& process, const uintptr_t vtable);
 } // namespace mango
\ No newline at end of file
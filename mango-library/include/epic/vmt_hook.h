@@ -66,6 +66,9 @@ namespace mango {
 		VmtHook& operator=(const VmtHook&) = delete;
 
 	private:
+		friend class HookTransaction;
+		friend class HookProfiler;
+
 		// does all the heavy lifting
 		uintptr_t hook_internal(const size_t index, const uintptr_t func);
 
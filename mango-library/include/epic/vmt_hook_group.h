@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+
+namespace mango {
+	class Process;
+
+	// hooks every instance of a class through one shared (reference-counted) copy of its vtable
+	// the shadow table is keyed by the original vtable, so instances of different classes can be mixed
+	class VmtHookGroup {
+	public:
+		struct SetupOptions {
+			// whether we should call release in the destructor or not
+			bool auto_release = true;
+		};
+
+	public:
+		VmtHookGroup() = default;
+		explicit VmtHookGroup(const Process& process, const SetupOptions& options = SetupOptions()) {
+			this->setup(process, options);
+		}
+		~VmtHookGroup() {
+			if (this->m_options.auto_release)
+				this->release();
+		}
+
+		// instances are added with add()
+		void setup(const Process& process, const SetupOptions& options = SetupOptions());
+
+		// restores every instance and frees every shadow table
+		void release();
+
+		// swap the vtables of every instance with one pause of the process (see HookTransaction)
+		// instances that are already in the group are ignored
+		void add(const std::vector<uintptr_t>& instances);
+
+		// wrapper
+		void add(const uintptr_t instance) {
+			this->add(std::vector<uintptr_t>{ instance });
+		}
+
+		// restore the original vtable of every instance, shadow tables are freed once nothing uses them
+		void remove(const std::vector<uintptr_t>& instances);
+
+		// wrapper
+		void remove(const uintptr_t instance) {
+			this->remove(std::vector<uintptr_t>{ instance });
+		}
+
+		// hook a function for every instance that uses this vtable (returns the original)
+		uintptr_t hook(const uintptr_t original_vtable, const size_t index, const uintptr_t func);
+
+		// wrapper
+		template <typename Ret = uintptr_t, typename Addr = uintptr_t>
+		Ret hook(const uintptr_t original_vtable, const size_t index, const Addr func) {
+			return Ret(this->hook(original_vtable, index, uintptr_t(func)));
+		}
+
+		// unhook a previously hooked function
+		void unhook(const uintptr_t original_vtable, const size_t index);
+
+		// the original vtable of an instance in the group (0 if not in the group)
+		uintptr_t get_original_vtable(const uintptr_t instance) const;
+
+		// number of instances in the group
+		size_t size() const noexcept { return this->m_instances.size(); }
+
+		// same as setup() return value
+		bool is_valid() const noexcept { return this->m_process != nullptr; }
+
+		// a more intuitive way to test for validity
+		explicit operator bool() const noexcept { return this->is_valid(); }
+
+		// prevent copying
+		VmtHookGroup(const VmtHookGroup&) = delete;
+		VmtHookGroup& operator=(const VmtHookGroup&) = delete;
+
+	private:
+		struct ShadowTable {
+			// the table that instances point to (the rtti complete locator is right before it)
+			uintptr_t vtable;
+
+			// size in bytes, not including the rtti complete locator
+			size_t size;
+
+			// number of instances using this table
+			size_t references;
+
+			// index -> original function
+			std::unordered_map<size_t, uintptr_t> original_funcs;
+		};
+
+	private:
+		// copy the original vtable into a newly allocated table
+		ShadowTable create_table(const uintptr_t original_vtable) const;
+
+		// free the memory that was allocated in create_table()
+		void free_table(const ShadowTable& table) const;
+
+		// write a single vtable entry
+		void write_entry(const uintptr_t address, const uintptr_t func) const;
+
+	private:
+		const Process* m_process = nullptr;
+		SetupOptions m_options;
+
+		// original vtable -> shadow table
+		std::unordered_map<uintptr_t, ShadowTable> m_tables;
+
+		// instance -> original vtable
+		std::unordered_map<uintptr_t, uintptr_t> m_instances;
+	};
+} // namespace mango
\ No newline at end of file
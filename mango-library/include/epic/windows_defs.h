@@ -257,6 +257,9 @@ namespace mango::windows {
 	static constexpr auto SystemModuleInformation     = SYSTEM_INFORMATION_CLASS(0x0B);
 	static constexpr auto SystemSuperfetchInformation = SYSTEM_INFORMATION_CLASS(0x4F);
 
+	// ntstatus.h conflicts with windows.h
+	static constexpr NTSTATUS StatusUnsuccessful     = NTSTATUS(0xC0000001);
+
 
 	// implemented as direct syscalls
 	NTSTATUS NtReadVirtualMemory(HANDLE hProcess, LPCVOID lpBaseAddress, 
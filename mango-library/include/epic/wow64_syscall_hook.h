@@ -1,6 +1,9 @@
 #pragma once
 
 #include <stdint.h>
+#include <array>
+#include <utility>
+#include <optional>
 
 
 namespace mango {
@@ -8,43 +11,141 @@ namespace mango {
 	class Shellcode;
 
 	// Syscall hooks for Wow64 processes
+	// the stub checks the syscall index against a bitmap in the hook's memory, so only
+	// syscalls that have callbacks leave the fast path (everything else goes straight to the original)
+	// syscalls can also be traced into rings in the target process instead (see SyscallTracer)
+	// NOTE: indices past max_syscalls (win32k syscalls) are never filtered
 	class Wow64SyscallHook {
 	public:
 		// return false to not call the original syscall
 		using Callback = bool(__cdecl*)(const uint32_t syscall_index, uint32_t* const arguments, volatile uint32_t return_value);
 
+		// called after the original syscall, return_value can be modified
+		using PostCallback = void(__cdecl*)(const uint32_t syscall_index, uint32_t* const arguments, uint32_t* const return_value);
+
 		struct SetupOptions {
 			// whether we should call release in the destructor or not
 			bool auto_release = true;
+
+			// how long release() waits for threads that are still inside an intercepted syscall (in milliseconds)
+			uint32_t release_timeout = 100;
 		};
 
+		// one bit per syscall
+		static constexpr uint32_t max_syscalls = 0x1000;
+
+		// the hook's memory:
+		//     stub
+		//     uint32_t bitmap[max_syscalls / 32]
+		//     uint32_t trace_bitmap[max_syscalls / 32]
+		//     uint32_t trace_rings (SyscallTraceRing[SyscallTraceRing::count])
+		//     uint32_t in_flight (threads that will return into the stub)
+		//     uint32_t pre_callbacks[max_syscalls]
+		//     uint32_t post_callbacks[max_syscalls]
+		//     uint8_t argument_counts[max_syscalls]
+		static constexpr uint32_t max_stub_size = 0x200,
+			bitmap_offset = max_stub_size,
+			trace_bitmap_offset = bitmap_offset + max_syscalls / 8,
+			trace_rings_offset = trace_bitmap_offset + max_syscalls / 8,
+			in_flight_offset = trace_rings_offset + 0x40,
+			pre_callbacks_offset = in_flight_offset + 0x40,
+			post_callbacks_offset = pre_callbacks_offset + max_syscalls * 4,
+			argument_counts_offset = post_callbacks_offset + max_syscalls * 4,
+			memory_size = argument_counts_offset + max_syscalls;
+
+		// the number of arguments copied for post callbacks (and tracing), if it couldn't be parsed from the syscall's stub
+		static constexpr uint8_t default_argument_count = 16;
+
 	public:
 		Wow64SyscallHook() = default;
-		Wow64SyscallHook(const Process& process, const uint32_t callback, const SetupOptions& options = SetupOptions()) {
-			this->hook(process, callback, options); 
+		Wow64SyscallHook(const Process& process, const uint32_t callback = 0, const SetupOptions& options = SetupOptions()) {
+			this->hook(process, callback, options);
 		}
 
 		// calls release()
 		~Wow64SyscallHook() {
 			if (this->m_options.auto_release)
-				this->release(); 
+				this->release();
 		}
 
-		// hooks
-		void hook(const Process& process, const uint32_t callback, const SetupOptions& options = SetupOptions());
+		// hooks, if callback isn't 0 it's set as the pre callback of every syscall
+		void hook(const Process& process, const uint32_t callback = 0, const SetupOptions& options = SetupOptions());
 
-		// unhooks
+		// unhooks, then waits (up to SetupOptions::release_timeout) for threads that are still inside an intercepted syscall,
+		// or whose instruction pointer is still inside of the stub
+		// NOTE: if one doesn't return in time (eg: NtWaitForSingleObject), the hook's memory and the trace rings
+		//       are kept around (leaked) since it'll return into the stub
 		void release();
 
+		// set the callbacks of a single syscall (0 for none), takes effect immediately
+		void set_callbacks(const uint32_t syscall_index, const uint32_t pre_callback, const uint32_t post_callback = 0);
+
+		// same as set_callbacks(syscall_index, 0, 0)
+		void remove_callbacks(const uint32_t syscall_index) { this->set_callbacks(syscall_index, 0, 0); }
+
+		// whether the syscall is let through to the callbacks (or traced)
+		bool is_filtered(const uint32_t syscall_index) const noexcept {
+			return syscall_index < max_syscalls && (this->m_bitmap[bitmap_word(syscall_index)] & bitmap_mask(syscall_index));
+		}
+
+		// allocate the trace rings (only done once), returns their address
+		uint32_t enable_tracing();
+
+		// trace a single syscall, takes effect immediately (calls enable_tracing())
+		void set_tracing(const uint32_t syscall_index, const bool enabled);
+
+		// trace every syscall (calls enable_tracing())
+		void set_tracing(const bool enabled);
+
+		// whether the syscall is traced
+		bool is_traced(const uint32_t syscall_index) const noexcept {
+			return syscall_index < max_syscalls && (this->m_trace_bitmap[bitmap_word(syscall_index)] & bitmap_mask(syscall_index));
+		}
+
+		// the address of the hook's memory (see memory_size)
+		uint32_t get_address() const noexcept { return this->m_address; }
+
+		// the address of the trace rings, 0 if tracing was never enabled
+		uint32_t get_trace_address() const noexcept { return this->m_trace_address; }
+
+		// the hooked process
+		const Process* get_process() const noexcept { return this->m_process; }
+
+		// the dword in the bitmap that holds the syscall, and its bit (same as bt [bitmap], index)
+		static constexpr uint32_t bitmap_word(const uint32_t syscall_index) noexcept { return syscall_index / 32; }
+		static constexpr uint32_t bitmap_mask(const uint32_t syscall_index) noexcept { return 1u << (syscall_index % 32); }
+
+		// builds the stub that's written at the start of the hook's memory
+		static Shellcode build_stub(const uint32_t address, const uint32_t original);
+
+		// the syscall index and argument count of an ntdll stub:
+		//     mov eax, index
+		//     ...
+		//     ret argument_count * 4
+		static std::optional<std::pair<uint32_t, uint8_t>> parse_syscall_stub(const uint8_t* const code, const size_t size) noexcept;
+
 	private:
-		// builds the function stub
-		void build_shellcode(const uint32_t callback);
+		// write the argument counts of every ntdll syscall, only needed for post callbacks (and tracing)
+		void write_argument_counts();
+
+		// write a single word of both bitmaps, a syscall is filtered if it has callbacks or is traced
+		void write_bitmaps(const uint32_t word);
 
 	private:
 		const Process* m_process = nullptr;
 		SetupOptions m_options;
 		uint32_t wow64_transition = 0,
 			m_original = 0,
-			m_shellcode_addr = 0;
+			m_address = 0,
+			m_trace_address = 0;
+
+		// copies of the bitmaps in the hook's memory
+		std::array<uint32_t, max_syscalls / 32> m_bitmap{},
+			m_trace_bitmap{};
+
+		// syscalls that have callbacks
+		std::array<uint32_t, max_syscalls / 32> m_callback_bitmap{};
+
+		bool m_wrote_argument_counts = false;
 	};
 } // namespace mango
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory_resource>
+
+
+namespace mango {
+	// a monotonic allocator, allocating is a pointer bump and nothing is freed until reset()
+	// reset() keeps the memory, so running the same work again doesn't allocate anything
+	// NOTE: this is not thread-safe, same as std::pmr::monotonic_buffer_resource
+	class Arena : public std::pmr::memory_resource {
+	public:
+		explicit Arena(const size_t initial_size = 0x1000,
+			std::pmr::memory_resource* const upstream = std::pmr::get_default_resource());
+
+		// calls release()
+		~Arena() override { this->release(); }
+
+		// invalidate every allocation but keep the memory for reuse
+		// if the arena grew, the chunks are replaced by a single one that's big enough for all of it
+		void reset();
+
+		// give every chunk back to upstream
+		void release() noexcept;
+
+		// the number of bytes allocated since the last reset() (including alignment padding)
+		size_t get_used_size() const noexcept { return this->m_used_size; }
+
+		// the total size of every chunk
+		size_t get_capacity() const noexcept { return this->m_capacity; }
+
+		// prevent copying
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+	private:
+		void* do_allocate(const size_t size, const size_t alignment) override;
+		void do_deallocate(void*, size_t, size_t) override {}
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+		// allocate a chunk from upstream and start using it
+		void add_chunk(const size_t size);
+
+	private:
+		// at the start of every chunk
+		struct Chunk {
+			Chunk* next;
+			size_t size;
+		};
+
+		std::pmr::memory_resource* m_upstream = nullptr;
+
+		// the newest chunk is the one being used
+		Chunk* m_chunks = nullptr;
+		uintptr_t m_position = 0,
+			m_end = 0;
+
+		size_t m_initial_size = 0,
+			m_used_size = 0,
+			m_capacity = 0;
+	};
+
+	// fixed-size blocks that are recycled through a free list, anything bigger goes to upstream
+	// useful for node-based containers (std::pmr::map, std::pmr::list, ...) that free a lot
+	// NOTE: this is not thread-safe, same as std::pmr::unsynchronized_pool_resource
+	class Pool : public std::pmr::memory_resource {
+	public:
+		explicit Pool(const size_t block_size, const size_t blocks_per_chunk = 64,
+			std::pmr::memory_resource* const upstream = std::pmr::get_default_resource());
+
+		// calls release()
+		~Pool() override { this->release(); }
+
+		// give every chunk back to upstream (every block is invalidated)
+		void release() noexcept;
+
+		// allocations up to this size come from the pool
+		size_t get_block_size() const noexcept { return this->m_block_size; }
+
+		// prevent copying
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+	private:
+		void* do_allocate(const size_t size, const size_t alignment) override;
+		void do_deallocate(void* const address, const size_t size, const size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+		// every block is aligned to this, anything with a bigger alignment goes to upstream
+		static constexpr size_t block_alignment = alignof(std::max_align_t);
+
+	private:
+		// at the start of every chunk, and inside every free block
+		struct Node {
+			Node* next;
+		};
+
+		std::pmr::memory_resource* m_upstream = nullptr;
+
+		Node* m_chunks = nullptr;
+		Node* m_free_blocks = nullptr;
+
+		size_t m_block_size = 0,
+			m_blocks_per_chunk = 0;
+	};
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "logger.h"
+
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <string_view>
+#include <condition_variable>
+
+
+namespace mango {
+	// a single-producer single-consumer ring of variable sized records
+	// every thread that logs gets its own, so producers never contend with each other
+	class LogRing {
+	public:
+		// what's stored in a record
+		enum class Format : uint8_t {
+			text,
+
+			// a uint32_t format id followed by the arguments, see Logger::log()
+			binary,
+
+			// filler at the end of the buffer, skipped by consume()
+			padding
+		};
+
+		// size is rounded up to a power of 2
+		explicit LogRing(const size_t size);
+
+		// producer side, false if there isn't enough room
+		bool try_push(const LogType type, const Format format, const void* const data, const size_t size) noexcept;
+
+		// consumer side, calls callback(type, format, data, size) for every record
+		// the records are only given back to the producer once every one of them was handled
+		template <typename Callback>
+		size_t consume(Callback&& callback) {
+			auto tail{ this->m_tail.load(std::memory_order_relaxed) };
+			const auto head{ this->m_head.load(std::memory_order_acquire) };
+
+			size_t count{ 0 };
+			while (tail != head) {
+				const auto header{ reinterpret_cast<const Header*>(&this->m_buffer[tail & (this->m_size - 1)]) };
+
+				if (header->format != Format::padding) {
+					callback(LogType(header->type), header->format, header + 1, size_t(header->size));
+					++count;
+				}
+
+				tail += get_record_size(header->size);
+			}
+
+			this->m_tail.store(tail, std::memory_order_release);
+			return count;
+		}
+
+		// the biggest record that can be pushed
+		size_t get_max_record_size() const noexcept { return this->m_size / 4 - sizeof(Header); }
+
+		// nothing left to consume
+		bool is_empty() const noexcept {
+			return this->m_head.load(std::memory_order_acquire) == this->m_tail.load(std::memory_order_acquire);
+		}
+
+		// records that didn't fit
+		uint64_t get_dropped() const noexcept { return this->m_dropped.load(std::memory_order_relaxed); }
+		void add_dropped() noexcept { this->m_dropped.fetch_add(1, std::memory_order_relaxed); }
+
+		// rings of threads that exited are reused by new threads
+		bool try_acquire() noexcept {
+			bool owned{ false };
+			return this->m_owned.compare_exchange_strong(owned, true, std::memory_order_acquire);
+		}
+		void release() noexcept { this->m_owned.store(false, std::memory_order_release); }
+
+	private:
+		// 8 bytes, so that there's always room for a padding record at the end of the buffer
+		struct Header {
+			uint32_t size;
+			uint8_t type;
+			Format format;
+		};
+		static_assert(sizeof(Header) == 8);
+
+		// records are 8 byte aligned so the headers are as well
+		static constexpr size_t get_record_size(const size_t size) noexcept {
+			return (sizeof(Header) + size + 7) & ~size_t(7);
+		}
+
+	private:
+		std::unique_ptr<uint8_t[]> m_buffer;
+		size_t m_size = 0;
+
+		// written by the producer
+		alignas(64) std::atomic<uint64_t> m_head = 0;
+		uint64_t m_cached_tail = 0;
+
+		// written by the consumer
+		alignas(64) std::atomic<uint64_t> m_tail = 0;
+
+		std::atomic<uint64_t> m_dropped = 0;
+
+		// whether a thread is currently using this ring
+		std::atomic<bool> m_owned = true;
+	};
+
+	// the backend of Logger::start_async(), formatted records are pushed into per-thread rings
+	// and a background thread drains them into the logger's channels
+	class AsyncLogger {
+	public:
+		// channels has to outlive this
+		AsyncLogger(const LoggingChannels& channels, const AsyncLoggingOptions& options);
+
+		// calls stop()
+		~AsyncLogger() { this->stop(); }
+
+		// push a record into the calling thread's ring, false if it was dropped
+		bool push(const LogType type, const std::string_view text);
+
+		// same as above but for a record that was written by Logger::log()
+		// unlike text, this is dropped instead of cut off if it's too big for the ring
+		bool push_binary(const LogType type, const void* const data, const size_t size);
+
+		// block until every record that was pushed before this call was delivered
+		void flush();
+
+		// deliver whatever is left and stop the background thread
+		// the thread isn't joined, so this is safe to call while the loader lock is held
+		void stop();
+
+		// records that were dropped because a ring was full
+		uint64_t get_dropped() const;
+
+		// prevent copying
+		AsyncLogger(const AsyncLogger&) = delete;
+		AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+	private:
+		// the ring of the calling thread, created on the first push() from each thread
+		LogRing& get_ring();
+
+		// apply the overflow policy if the record doesn't fit
+		bool push_record(LogRing& ring, const LogType type, const LogRing::Format format, const void* const data, const size_t size);
+
+		// consume every ring once
+		void drain();
+
+		// pass a single record to its channel, or write it to the binary log
+		void deliver(const LogType type, const LogRing::Format format, const void* const data, const size_t size);
+
+		// append an entry to the binary log
+		void write_entry(const impl::BinaryLogEntryKind kind, const LogType type, const void* const data, const size_t size);
+
+	private:
+		const LoggingChannels* m_channels = nullptr;
+		AsyncLoggingOptions m_options;
+
+		// to tell apart loggers in the thread-local ring cache
+		uint64_t m_id = 0;
+
+		// rings are only ever added
+		mutable std::mutex m_rings_mutex;
+		std::vector<std::shared_ptr<LogRing>> m_rings;
+		std::atomic<size_t> m_ring_count = 0;
+
+		// only touched by the background thread
+		std::vector<std::shared_ptr<LogRing>> m_drained_rings;
+
+		// AsyncLoggingOptions::binary_file, and the formats that were already written to it
+		std::ofstream m_binary_file;
+		std::vector<bool> m_written_formats;
+
+		std::thread m_thread;
+		std::thread::id m_thread_id;
+		std::mutex m_thread_mutex;
+		std::condition_variable m_wake_cv,
+			m_flushed_cv;
+		bool m_running = false;
+
+		// set by the background thread once it won't touch this anymore
+		std::atomic<bool> m_exited = false;
+
+		// flush() waits until a drain that started after it was requested has finished
+		uint64_t m_flush_requested = 0,
+			m_flush_completed = 0;
+	};
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stdint.h>
+#include <bit>
+#include <array>
+#include <string>
+#include <ostream>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+#include <type_traits>
+
+
+namespace mango {
+	// the type of every argument in a binary record, so that it can be read back
+	enum class LogArgType : uint8_t {
+		boolean,
+		character,
+		int8,
+		uint8,
+		int16,
+		uint16,
+		int32,
+		uint32,
+		int64,
+		uint64,
+		float32,
+		float64,
+		pointer,
+
+		// prefixed by a uint16_t size
+		string
+	};
+
+	// a description of a Logger::log() call site, every record only stores the id of its format
+	struct LogFormat {
+		std::string_view format;
+		const LogArgType* arg_types;
+		size_t arg_count;
+	};
+
+	// the format that was registered with this id, nullptr if there isn't one
+	const LogFormat* get_log_format(const uint32_t id);
+
+	namespace impl {
+		// a string literal that can be used as a template argument
+		template <size_t Size>
+		struct LogFormatString {
+			consteval LogFormatString(const char(&str)[Size]) { std::copy_n(str, Size, this->data); }
+
+			constexpr std::string_view view() const noexcept { return { this->data, Size - 1 }; }
+
+			// the number of "{}" placeholders, "{{" and "}}" are escaped braces
+			constexpr size_t count_args() const noexcept {
+				size_t count{ 0 };
+				for (size_t i{ 0 }; i + 1 < Size - 1; ++i) {
+					if ((this->data[i] == '{' && this->data[i + 1] == '{') || (this->data[i] == '}' && this->data[i + 1] == '}'))
+						++i;
+					else if (this->data[i] == '{' && this->data[i + 1] == '}')
+						++count, ++i;
+				}
+
+				return count;
+			}
+
+			char data[Size]{};
+		};
+
+		template <typename T>
+		constexpr bool is_log_string = std::is_same_v<T, const char*> || std::is_same_v<T, char*> ||
+			std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+
+		// how an argument is stored
+		template <typename T>
+		consteval LogArgType get_log_arg_type() {
+			if constexpr (std::is_enum_v<T>)
+				return get_log_arg_type<std::underlying_type_t<T>>();
+			else if constexpr (std::is_same_v<T, bool>)
+				return LogArgType::boolean;
+			else if constexpr (std::is_same_v<T, char>)
+				return LogArgType::character;
+			else if constexpr (is_log_string<T>)
+				return LogArgType::string;
+			else if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>)
+				return LogArgType::pointer;
+			else if constexpr (std::is_floating_point_v<T>)
+				return sizeof(T) == 4 ? LogArgType::float32 : LogArgType::float64;
+			else {
+				static_assert(std::is_integral_v<T>, "Unsupported binary log argument.");
+
+				constexpr std::array types{
+					LogArgType::int8, LogArgType::uint8,
+					LogArgType::int16, LogArgType::uint16,
+					LogArgType::int32, LogArgType::uint32,
+					LogArgType::int64, LogArgType::uint64
+				};
+
+				return types[std::bit_width(sizeof(T)) * 2 - 2 + (std::is_unsigned_v<T> ? 1 : 0)];
+			}
+		}
+
+		// the number of bytes that an argument takes up, excluding the contents of strings
+		constexpr size_t get_log_arg_size(const LogArgType type) noexcept {
+			constexpr std::array sizes{ 1, 1, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 8, 2 };
+			return size_t(sizes[size_t(type)]);
+		}
+
+		// copies arguments into a record, the hot path of Logger::log()
+		// strings share the space that's left after every other argument and are cut off
+		class LogArgWriter {
+		public:
+			LogArgWriter(uint8_t* const buffer, const size_t string_budget) noexcept
+				: m_begin{ buffer }, m_position{ buffer }, m_string_budget{ string_budget } {}
+
+			template <typename T>
+			void write(const T& value) noexcept {
+				using Type = std::decay_t<T>;
+
+				if constexpr (std::is_enum_v<Type>)
+					this->write(std::underlying_type_t<Type>(value));
+				else if constexpr (is_log_string<Type>) {
+					if constexpr (std::is_pointer_v<Type>)
+						this->write_string(value ? std::string_view{ value } : std::string_view{ "" });
+					else
+						this->write_string(value);
+				} else if constexpr (std::is_pointer_v<Type> || std::is_null_pointer_v<Type>)
+					this->write_raw(uint64_t(uintptr_t(value)));
+				else if constexpr (std::is_same_v<Type, long double>)
+					this->write_raw(double(value));
+				else
+					this->write_raw(value);
+			}
+
+			// the number of bytes written
+			size_t get_size() const noexcept { return size_t(this->m_position - this->m_begin); }
+
+		private:
+			template <typename T>
+			void write_raw(const T& value) noexcept {
+				std::memcpy(this->m_position, &value, sizeof(value));
+				this->m_position += sizeof(value);
+			}
+
+			void write_string(const std::string_view str) noexcept {
+				const auto size{ uint16_t(std::min({ str.size(), this->m_string_budget, size_t(0xFFFF) })) };
+				this->m_string_budget -= size;
+
+				this->write_raw(size);
+				std::memcpy(this->m_position, str.data(), size);
+				this->m_position += size;
+			}
+
+		private:
+			uint8_t* m_begin = nullptr;
+			uint8_t* m_position = nullptr;
+			size_t m_string_budget = 0;
+		};
+
+		// add a format to the process-wide table, returns its id
+		uint32_t register_log_format(const LogFormat& format);
+
+		// called once per call site
+		template <LogFormatString Format, typename ...Args>
+		uint32_t register_log_format() {
+			static constexpr std::array<LogArgType, sizeof...(Args)> arg_types{ get_log_arg_type<Args>()... };
+			return register_log_format(LogFormat{ Format.view(), arg_types.data(), arg_types.size() });
+		}
+
+		// write the format with every "{}" replaced by the next argument
+		// returns false if the arguments don't match the types
+		bool render_log_args(std::ostream& stream, const std::string_view format,
+			const LogArgType* const arg_types, const size_t arg_count, const uint8_t* data, const size_t size);
+
+		// the layout of a binary log file, see AsyncLoggingOptions::binary_file
+		// a BinaryLogHeader followed by entries, each one a BinaryLogEntry followed by its payload
+		inline constexpr uint64_t binary_log_magic{ 0x474F4C4F474E414D }; // "MANGOLOG"
+
+		inline constexpr uint32_t binary_log_version{ 1 };
+
+		struct BinaryLogHeader {
+			uint64_t magic;
+			uint32_t version;
+			uint32_t reserved;
+		};
+
+		enum class BinaryLogEntryKind : uint16_t {
+			// uint32_t id, uint32_t arg count, the LogArgTypes, and then the format string
+			format,
+
+			// uint32_t id and then the arguments
+			record,
+
+			// text that was already formatted
+			text
+		};
+
+		struct BinaryLogEntry {
+			uint32_t size;
+			BinaryLogEntryKind kind;
+			uint16_t type;
+		};
+	} // namespace impl
+} // namespace mango
\ No newline at end of file
@@ -7,15 +7,15 @@
 
 
 // for passing to our custom exceptions
-#define mango_format_ntstatus(status) enc_str("NTSTATUS = 0x"), std::hex, std::uppercase, status
-#define mango_format_w32status(status) enc_str("Win32 error = 0x"), std::hex, std::uppercase, status
+#define mango_format_ntstatus(status) enc_str_view("NTSTATUS = 0x"), std::hex, std::uppercase, status
+#define mango_format_w32status(status) enc_str_view("Win32 error = 0x"), std::hex, std::uppercase, status
 
 // can't really do this without a macro, oh well
 #define mango_create_error(name, value)\
 class name : public mango::MangoError {\
 public:\
 	template <typename ...Args>\
-	name(Args&& ...info) : mango::MangoError(enc_str(value), ' ', info...) {}\
+	name(Args&& ...info) : mango::MangoError(enc_str_view(value), ' ', info...) {}\
 };
 
 // TODO: refactor exceptions to be more modular + including better debug info (file, line, etc)
@@ -40,11 +40,28 @@ namespace mango {
 	mango_create_error(IoControlFailed, "Call to DeviceIoControl failed.");
 
 	mango_create_error(FunctionAlreadyHooked, "Function is already hooked.");
+	mango_create_error(VtableNotInHookGroup, "No instance in the hook group uses this VTable.");
+	mango_create_error(HookGroupNotSetup, "The hook group has not been setup.");
+	mango_create_error(NoAvailableDispatcherSlots, "All hook dispatchers for this function type are currently used.");
 
 	mango_create_error(CantSetup64From32, "Cant setup a 64bit process from a 32bit process.");
+	mango_create_error(ProcessNotSetup, "The process has not been setup.");
 
 	mango_create_error(NoAvailableDebugRegisters, "All debug registers are currently used.");
 
+	mango_create_error(InvalidAssemblerLabel, "Assembler label is invalid, unbound, or bound more than once.");
+	mango_create_error(InvalidAssemblerRegister, "Register can't be encoded in the current architecture.");
+	mango_create_error(InvalidAssemblerOperand, "Operand doesn't fit in the current architecture.");
+
+	mango_create_error(FailedToDecodeInstruction, "Failed to decode instruction.");
+	mango_create_error(FailedToRelocateInstruction, "Failed to relocate instruction, target is out of range.");
+	mango_create_error(FunctionTooSmallToHook, "Function is too small to be inline hooked.");
+	mango_create_error(FailedToFindNearbyMemory, "Failed to find memory within 2GB of the target address.");
+
+	mango_create_error(ThreadInsidePatchedCode, "A thread is executing inside the bytes being patched.");
+	mango_create_error(HookTransactionAlreadyCommitted, "Hook transaction was already committed.");
+	mango_create_error(HookTransactionOverlappingPatch, "Hook transaction already has a patch at this address.");
+
 	mango_create_error(ApiSetInvalidName, "Provided ApiSet name doesn't begin with \"api-\" or \"ext-\".");
 	mango_create_error(FailedToResolveApiSetName, "Failed to resolve ApiSet name.");
 
@@ -58,7 +75,11 @@ namespace mango {
 	mango_create_error(InvalidFileSize, "Invalid file size.");
 	mango_create_error(InvalidPEHeader, "Invalid PE header.");
 	mango_create_error(InvalidVtableSize, "Invalid VTable size, caused when VTable size is 0.");
+	mango_create_error(InvalidVtableIndex, "VTable index is past the end of the VTable.");
+	mango_create_error(InvalidSyscallIndex, "Syscall index is past the end of the syscall filter.");
+	mango_create_error(InvalidAllocatorAlignment, "Allocator alignment must be a power of 2 and no bigger than a page.");
 	mango_create_error(InvalidConsoleHandle, "Failed to get console handle.");
+	mango_create_error(InvalidBinaryLog, "Not a binary log, or the log is corrupted.");
 
 	mango_create_error(FailedToGetFunctionAddress, "Failed to get function address.");
 	mango_create_error(FailedToCreateRemoteThread, "Failed to create a thread in the process.");
@@ -66,9 +87,16 @@ namespace mango {
 	mango_create_error(FailedToFindModule, "Failed to find module.");
 	mango_create_error(FailedToFindImportModule, "Failed to find imported module in IAT.");
 	mango_create_error(FailedToFindImportFunction, "Failed to find imported function in IAT.");
+	mango_create_error(FailedToFindExportFunction, "Failed to find exported function in EAT.");
+	mango_create_error(FailedToResolveExportForwarder, "Failed to resolve forwarded export (module not loaded, or forwarded by ordinal).");
+	mango_create_error(FailedToFindSyscall, "Failed to find syscall in ntdll.dll.");
+	mango_create_error(FailedToBuildSyscallTable, "Failed to build the syscall table, ntdll.dll has no syscalls or two names have the same hash.");
 	mango_create_error(FailedToResolveImport, "Failed to resolve import when manually mapping image.");
 	mango_create_error(FailedToReadFile, "Failed to read file.");
 	mango_create_error(FailedToWriteFile, "Failed to write file.");
+	mango_create_error(FailedToMapFile, "Failed to map file into memory.");
+	mango_create_error(FailedToOpenLogFile, "Failed to open the binary log file.");
+	mango_create_error(FailedToQueryMappedFileName, "Failed to query the name of a mapped file.");
 	mango_create_error(FailedToVerifyX64Transition, "Failed to verify against Wowx64Transition address.");
 	mango_create_error(FailedToEnumProcesses, "Failed to enumerate all processes.");
 
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <utility>
+#include <type_traits>
+
+
+namespace mango {
+	// why a non-throwing call failed
+	struct Status {
+		// an NTSTATUS, or an errno for things that aren't syscalls
+		int32_t code = 0;
+	};
+
+	// used to construct an Expected that holds an error
+	template <typename E>
+	struct Unexpected {
+		E error;
+	};
+	template <typename E>
+	Unexpected(E) -> Unexpected<E>;
+
+	// either a value or an error, a small std::expected that never allocates
+	// used by the try_*() functions so that failing is cheap (no exceptions or string formatting)
+	template <typename T, typename E = Status>
+	class Expected {
+		static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_copyable_v<E>);
+
+	public:
+		constexpr Expected(const T& value) noexcept : m_value{ value }, m_has_value{ true } {}
+		constexpr Expected(const Unexpected<E>& error) noexcept : m_error{ error.error }, m_has_value{ false } {}
+
+		// whether this holds a value
+		constexpr bool has_value() const noexcept { return this->m_has_value; }
+		constexpr explicit operator bool() const noexcept { return this->m_has_value; }
+
+		// NOTE: only valid if has_value() is true
+		constexpr const T& operator*() const noexcept { return this->m_value; }
+		constexpr const T* operator->() const noexcept { return &this->m_value; }
+
+		// the value, or fallback if this holds an error
+		constexpr T value_or(const T& fallback) const noexcept { return this->m_has_value ? this->m_value : fallback; }
+
+		// NOTE: only valid if has_value() is false
+		constexpr const E& error() const noexcept { return this->m_error; }
+
+	private:
+		union {
+			T m_value;
+			E m_error;
+		};
+
+		bool m_has_value;
+	};
+
+	// same as above but without a value
+	template <typename E>
+	class Expected<void, E> {
+	public:
+		constexpr Expected() noexcept : m_error{}, m_has_value{ true } {}
+		constexpr Expected(const Unexpected<E>& error) noexcept : m_error{ error.error }, m_has_value{ false } {}
+
+		// whether this succeeded
+		constexpr bool has_value() const noexcept { return this->m_has_value; }
+		constexpr explicit operator bool() const noexcept { return this->m_has_value; }
+
+		// NOTE: only valid if has_value() is false
+		constexpr const E& error() const noexcept { return this->m_error; }
+
+	private:
+		E m_error;
+		bool m_has_value;
+	};
+} // namespace mango
\ No newline at end of file
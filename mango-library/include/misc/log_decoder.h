@@ -0,0 +1,21 @@
+#pragma once
+
+#include "logger.h"
+
+#include <string>
+#include <vector>
+#include <istream>
+
+
+namespace mango {
+	// a record that was read from a binary log
+	struct DecodedLogRecord {
+		LogType type;
+		std::string text;
+	};
+
+	// read every record from a binary log (see AsyncLoggingOptions::binary_file)
+	// an entry that was cut off at the end (the process died while writing it) is ignored
+	// throws InvalidBinaryLog if the stream isn't a binary log or if it's corrupted
+	std::vector<DecodedLogRecord> decode_binary_log(std::istream& stream);
+} // namespace mango
\ No newline at end of file
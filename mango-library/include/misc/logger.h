@@ -1,9 +1,46 @@
 #pragma once
 
+#include "binary_log.h"
+
 #include <ostream>
 #include <sstream>
 #include <array>
+#include <string>
+#include <chrono>
+#include <streambuf>
+#include <string_view>
+#include <type_traits>
+
+
+// the lowest LogType that's compiled in, everything below it is removed entirely
+// 0 = info, 1 = success, 2 = warning, 3 = error, 4 = nothing (eg. define it as 2 for release builds)
+#ifndef mango_min_log_level
+#define mango_min_log_level 0
+#endif
+
+// log through the global logger, the arguments are only evaluated if the level is compiled in
+// and there's somewhere to log to, so things like enc_str() cost nothing when logging is disabled
+#define mango_log(type, ...)\
+do {\
+	if constexpr (mango::is_log_level_enabled(mango::LogType::type)) {\
+		if (mango::logger.is_enabled(mango::LogType::type))\
+			mango::logger.dispatch(mango::LogType::type, __VA_ARGS__);\
+	}\
+} while (false)
 
+#define mango_log_info(...) mango_log(info, __VA_ARGS__)
+#define mango_log_success(...) mango_log(success, __VA_ARGS__)
+#define mango_log_warning(...) mango_log(warning, __VA_ARGS__)
+#define mango_log_error(...) mango_log(error, __VA_ARGS__)
+
+// same as above but through Logger::log(), mango_log_binary(info, "hooked {} at {}", name, address)
+#define mango_log_binary(type, format, ...)\
+do {\
+	if constexpr (mango::is_log_level_enabled(mango::LogType::type)) {\
+		if (mango::logger.is_enabled(mango::LogType::type))\
+			mango::logger.log<mango::LogType::type, format>(__VA_ARGS__);\
+	}\
+} while (false)
 
 namespace mango {
 	enum class LogType {
@@ -13,6 +50,11 @@ namespace mango {
 		error
 	};
 
+	// whether this level is compiled in, see mango_min_log_level
+	constexpr bool is_log_level_enabled(const LogType type) noexcept {
+		return size_t(type) >= size_t(mango_min_log_level);
+	}
+
 	// the data is passed in the std::stringstream
 	using LoggingChannel = void(*)(std::ostringstream&&);
 
@@ -36,11 +78,106 @@ namespace mango {
 	//       once the stream dies
 	LoggingChannels basic_ostream_logging(std::ostream& stream);
 
+	class AsyncLogger;
+
+	// what happens when a thread logs faster than the background thread can keep up
+	enum class LogOverflowPolicy {
+		// the record is thrown away and counted, see Logger::get_dropped()
+		drop,
+
+		// wait until there's room (not on the background thread, those are dropped)
+		block
+	};
+
+	struct AsyncLoggingOptions {
+		// the size of every thread's ring, a record can be at most a quarter of this
+		size_t ring_size = 0x10000;
+
+		// how often the background thread wakes up on its own
+		std::chrono::milliseconds flush_interval{ 10 };
+
+		LogOverflowPolicy overflow_policy = LogOverflowPolicy::drop;
+
+		// if set, every record is appended to this file instead of being passed to the channels
+		// Logger::log() records are written unformatted, read them with decode_binary_log()
+		std::string binary_file{};
+	};
+
+	namespace impl {
+		// a streambuf over a fixed buffer, anything that doesn't fit is cut off
+		class LogBuffer : public std::streambuf {
+		public:
+			LogBuffer() noexcept { this->reset(); }
+
+			// start over
+			void reset() noexcept { this->setp(this->m_buffer, this->m_buffer + sizeof(this->m_buffer)); }
+
+			// what was written since the last reset()
+			std::string_view view() const noexcept { return { this->pbase(), size_t(this->pptr() - this->pbase()) }; }
+
+		protected:
+			// full
+			int_type overflow(int_type) override { return traits_type::eof(); }
+
+		private:
+			char m_buffer[0x1000];
+		};
+
+		// used by Logger to format records without allocating when logging asynchronously
+		struct LogFormatter {
+			LogBuffer buffer{};
+			std::ostream stream{ &this->buffer };
+
+			// the stream is in the same state as a new std::ostringstream
+			std::ostream& begin() {
+				this->buffer.reset();
+				this->stream.clear();
+				this->stream.flags(std::ios_base::dec | std::ios_base::skipws);
+				this->stream.precision(6);
+				this->stream.width(0);
+				this->stream.fill(' ');
+				return this->stream;
+			}
+		};
+
+		// one for every thread
+		inline LogFormatter& get_log_formatter() {
+			thread_local LogFormatter formatter{};
+			return formatter;
+		}
+
+		// a lambda (or any other invocable object) that returns what should be logged
+		template <typename T>
+		constexpr bool is_lazy_log_arg = std::is_class_v<T> && std::is_invocable_v<const T&>;
+
+		// call lazy arguments, pass everything else through
+		template <typename T>
+		decltype(auto) eval_log_arg(T&& arg) {
+			if constexpr (is_lazy_log_arg<std::remove_cvref_t<T>>)
+				return arg();
+			else
+				return std::forward<T>(arg);
+		}
+
+		// the type that's actually logged
+		template <typename T>
+		using log_arg_t = std::decay_t<decltype(eval_log_arg(std::declval<const T&>()))>;
+	} // namespace impl
+
 	// logging class for debugging and stuff (can be used to output to console or a file or whatever)
-	// NOTE: this is implementated through stringstreams so this is NOT optimized
+	// NOTE: by default this is implementated through stringstreams and the channels are called on
+	//       the logging thread, use start_async() to move the channels off of the hot path
 	// TODO: add support for multiple concurrent logging channels
 	class Logger {
 	public:
+		Logger() = default;
+
+		// calls stop_async() so nothing that was logged is lost
+		// NOTE: a dll that uses start_async() should call stop_async() itself before it's unloaded (FreeLibrary),
+		//       the global logger is destroyed under the loader lock, after which the background thread
+		//       could still be running code in the dll for a moment
+		~Logger();
+
 		// set logging channels (handlers)
 		// pass nullptr to ignore logs for that specific channel
 		void set_channel(const LogType type, const LoggingChannel channel) noexcept {
@@ -54,33 +191,136 @@ namespace mango {
 
 		// info
 		template <typename ...Args>
-		void info(Args&& ...args) { this->dispatch(LogType::info, std::forward<Args>(args)...); }
+		void info(Args&& ...args) {
+			if constexpr (is_log_level_enabled(LogType::info))
+				this->dispatch(LogType::info, std::forward<Args>(args)...);
+		}
 
 		// success
 		template <typename ...Args>
-		void success(Args&& ...args) { this->dispatch(LogType::success, std::forward<Args>(args)...); }
+		void success(Args&& ...args) {
+			if constexpr (is_log_level_enabled(LogType::success))
+				this->dispatch(LogType::success, std::forward<Args>(args)...);
+		}
 
 		// warning
 		template <typename ...Args>
-		void warning(Args&& ...args) { this->dispatch(LogType::warning, std::forward<Args>(args)...); }
+		void warning(Args&& ...args) {
+			if constexpr (is_log_level_enabled(LogType::warning))
+				this->dispatch(LogType::warning, std::forward<Args>(args)...);
+		}
 
 		// error
 		template <typename ...Args>
-		void error(Args&& ...args) { this->dispatch(LogType::error, std::forward<Args>(args)...); }
+		void error(Args&& ...args) {
+			if constexpr (is_log_level_enabled(LogType::error))
+				this->dispatch(LogType::error, std::forward<Args>(args)...);
+		}
+
+		// whether anything would be done with a record of this type
+		bool is_enabled(const LogType type) const noexcept {
+			return this->m_channels.channels[size_t(type)] || this->m_binary_file;
+		}
 
 		// dispatch the contents to the appropriate channel
+		// lazy arguments (lambdas) are only called if there's a channel for this type:
+		// logger.info("module: ", [&]() { return enc_str("ntdll.dll"); });
 		template <typename ...Args>
 		void dispatch(const LogType type, Args&& ...args) {
-			const auto channel(this->m_channels.channels[size_t(type)]);
-			if (!channel)
+			if (!this->is_enabled(type))
+				return;
+
+			// format into a thread-local buffer, the background thread calls the channel
+			if (this->m_async) {
+				auto& formatter{ impl::get_log_formatter() };
+				(formatter.begin() << ... << impl::eval_log_arg(std::forward<Args>(args)));
+				this->push_async(type, formatter.buffer.view());
 				return;
+			}
 
 			// create a stringstream with the data
 			std::ostringstream ss{};
-			(ss << ... << std::forward<Args>(args));
-			channel(std::move(ss));
+			(ss << ... << impl::eval_log_arg(std::forward<Args>(args)));
+			this->m_channels.channels[size_t(type)](std::move(ss));
+		}
+
+		// binary logging, "{}" is replaced by the next argument ("{{" and "}}" are braces)
+		// the format is registered once per call site and only the raw arguments are copied, the text is
+		// formatted later on the background thread (or by decode_binary_log() with AsyncLoggingOptions::binary_file)
+		// NOTE: the arguments can be arithmetic types, enums, pointers, or strings
+		//       without start_async() this is formatted right away, same as dispatch()
+		//       type is only known at runtime here, use the overload below to compile disabled levels out
+		// logger.log<"hooked {} at {}">(LogType::info, name, address);
+		template <impl::LogFormatString Format, typename ...Args>
+		void log(const LogType type, const Args& ...args) {
+			static_assert(Format.count_args() == sizeof...(Args), "The number of arguments doesn't match the format.");
+
+			if (!is_log_level_enabled(type) || !this->is_enabled(type))
+				return;
+
+			static const auto id{ impl::register_log_format<Format, impl::log_arg_t<Args>...>() };
+
+			// the id and every argument, excluding the contents of strings
+			constexpr auto fixed_size{ sizeof(uint32_t) +
+				(size_t{ 0 } + ... + impl::get_log_arg_size(impl::get_log_arg_type<impl::log_arg_t<Args>>())) };
+			static_assert(fixed_size <= binary_record_size, "Too many arguments.");
+
+			uint8_t record[binary_record_size];
+			impl::LogArgWriter writer{ record, binary_record_size - fixed_size };
+			writer.write(id);
+			(writer.write(impl::eval_log_arg(args)), ...);
+
+			this->push_binary(type, record, writer.get_size());
 		}
+
+		// same as above but the level is a template argument, so nothing is left of it if it isn't compiled in
+		// logger.log<LogType::info, "hooked {} at {}">(name, address);
+		template <LogType Type, impl::LogFormatString Format, typename ...Args>
+		void log(const Args& ...args) {
+			static_assert(Format.count_args() == sizeof...(Args), "The number of arguments doesn't match the format.");
+
+			if constexpr (is_log_level_enabled(Type))
+				this->log<Format>(Type, args...);
+		}
+
+		// records are pushed into per-thread rings and the channels are called from a background thread
+		// NOTE: the channels have to be thread-safe, and a record is at most 0x1000 bytes (the rest is cut off)
+		void start_async(const AsyncLoggingOptions& options = {});
+
+		// deliver every pending record and go back to calling the channels directly
+		// the records are delivered on the calling thread, the background thread is never joined
+		// NOTE: no other thread may be logging while this is called
+		void stop_async();
+
+		// block until every record that was logged before this call was delivered
+		void flush();
+
+		// records that were dropped because of LogOverflowPolicy::drop
+		uint64_t get_dropped() const;
+
+		// whether start_async() was called
+		bool is_async() const noexcept { return this->m_async != nullptr; }
+
+		// prevent copying
+		Logger(const Logger&) = delete;
+		Logger& operator=(const Logger&) = delete;
+
+	private:
+		// so that AsyncLogger doesn't have to be included here
+		void push_async(const LogType type, const std::string_view text);
+
+		// a record that was written by log()
+		void push_binary(const LogType type, const void* const data, const size_t size);
+
+		// the biggest record that log() writes, strings are cut off to fit
+		static constexpr size_t binary_record_size = 0x400;
+
 	private:
 		LoggingChannels m_channels{};
+		// a raw pointer so that the global logger is still constant initialized
+		AsyncLogger* m_async = nullptr;
+
+		// AsyncLoggingOptions::binary_file was set, every record is logged regardless of the channels
+		bool m_binary_file = false;
 	} inline logger;
 } // namespace mango
\ No newline at end of file
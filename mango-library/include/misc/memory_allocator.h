@@ -1,15 +1,25 @@
 #pragma once
 
+#include <stdint.h>
+#include <set>
+#include <map>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <vector>
 #include <functional>
-#include <stack>
+#include <unordered_map>
 
 
 namespace mango {
 	class Process;
 
-	// NOTE: this is NOT fast or optimized, this is just meant to be 
-	// a quick and dirty way to avoid allocating tons of memory pages
-	// when you only actually use a little
+	// a general-purpose heap on top of memory that's allocated in bigger blocks (usually in another process)
+	// - big allocations come from a best-fit free list over 64KB regions, that's merged back together on free()
+	// - small allocations come from size-class slabs (one page each, split into equally sized slots),
+	//   which are carved out of the same regions so a new slab doesn't need its own allocation
+	// all of the bookkeeping is stored locally, the allocated memory itself is never read or written
+	// NOTE: this is not thread-safe, see ConcurrentMemoryAllocator
 	class MemoryAllocator {
 	public:
 		template <typename Allocate, typename Release>
@@ -17,37 +27,191 @@ namespace mango {
 			: m_allocate(std::forward<Allocate>(allocate)),
 			  m_release(std::forward<Release>(release)) {}
 
-		// allocate a block of memory (aligned to a multiple of 8)
+		// allocate a block of memory (aligned to a multiple of 16)
 		uintptr_t allocate(const size_t size);
 
+		// free a block that was returned by allocate(), the memory is reused by later allocations
+		void free(const uintptr_t address);
+
 		// free all memory
 		void release();
 
+		// the total size of the blocks that are currently allocated with the allocate callback
+		size_t get_committed_size() const noexcept { return this->m_committed_size; }
+
+		// the total size of every allocation that hasn't been freed yet (after rounding up)
+		size_t get_used_size() const noexcept { return this->m_used_size; }
+
 	private:
-		uintptr_t allocate_new_block(const size_t size);
+		// 16, 32, 64, ..., 2048
+		static constexpr size_t size_class_count = 8;
+		static constexpr size_t min_size_class = 16;
+		static constexpr size_t max_size_class = min_size_class << (size_class_count - 1);
+
+		static constexpr size_t slab_size = 0x1000;
+		static constexpr size_t region_size = 0x10000;
+
+		struct Slab {
+			uint32_t size_class;
+			uint32_t used;
+
+			// indices of the slots that aren't allocated
+			std::vector<uint16_t> free_slots;
+
+			// which slots are allocated, so that freeing one twice can be ignored
+			std::bitset<slab_size / min_size_class> allocated;
+		};
+
+	private:
+		uintptr_t allocate_small(const size_t size_class);
+		uintptr_t allocate_large(const size_t size);
+
+		void free_small(const std::map<uintptr_t, Slab>::iterator slab, const uintptr_t address);
+		void free_large(const std::unordered_map<uintptr_t, size_t>::iterator allocation);
+
+		// take a block out of the large free list, a new region is allocated if nothing fits
+		uintptr_t allocate_block(const size_t size);
+
+		// give a block back to the large free list, empty regions are released (except for the spare one)
+		void free_block(const uintptr_t address, const size_t size);
+
+		// update both indices of the large free list
+		void insert_free_block(const uintptr_t address, const size_t size);
+		void erase_free_block(const std::map<uintptr_t, size_t>::iterator it);
+
+		// the index of the smallest size class that fits
+		static size_t get_size_class(const size_t size);
 
 		// align value using alignment
 		static size_t align_up(const size_t value, const size_t alignment);
 
 	private:
-		struct AllocationBlock {
+		std::function<uintptr_t(size_t size)> m_allocate;
+		std::function<void(uintptr_t address)> m_release;
+
+		// slab address -> slab
+		std::map<uintptr_t, Slab> m_slabs;
+
+		// slabs that have at least one free slot, for every size class
+		std::array<std::set<uintptr_t>, size_class_count> m_partial_slabs;
+
+		// region address -> region size
+		std::map<uintptr_t, size_t> m_regions;
+
+		// the large free list, indexed by address (for merging) and by size (for best-fit)
+		std::map<uintptr_t, size_t> m_free_by_address;
+		std::set<std::pair<size_t, uintptr_t>> m_free_by_size;
+
+		// address -> size
+		std::unordered_map<uintptr_t, size_t> m_large_allocations;
+
+		// a region that's completely free but kept around so it isn't allocated again right away
+		uintptr_t m_spare_region = 0;
+
+		size_t m_committed_size = 0,
+			m_used_size = 0;
+	};
+
+	// a bump allocator that can be used from multiple threads at the same time without locking
+	// every thread bumps through its own cached block, new blocks are pushed onto a lock-free list
+	// NOTE: memory can only be freed all at once, and release() must not be called while allocating
+	// the allocate callback has to be thread-safe as well
+	class ConcurrentMemoryAllocator {
+	public:
+		template <typename Allocate, typename Release>
+		ConcurrentMemoryAllocator(Allocate&& allocate, Release&& release,
+			const size_t alignment = 16, const size_t block_size = 0x10000)
+			: m_allocate(std::forward<Allocate>(allocate)),
+			  m_release(std::forward<Release>(release)),
+			  m_alignment(alignment), m_block_size(block_size) {
+			this->validate_alignment();
+		}
+
+		// frees the block list, but NOT the memory (call release() for that)
+		~ConcurrentMemoryAllocator();
+
+		// allocate a block of memory (aligned to get_alignment())
+		uintptr_t allocate(const size_t size);
+
+		// free all memory
+		void release();
+
+		struct Stats {
+			// number of allocate() calls
+			uint64_t allocations;
+
+			// the total size of every allocation (after rounding up)
+			uint64_t allocated_size;
+
+			// number of blocks that were allocated with the allocate callback
+			uint64_t blocks;
+
+			// the total size of every block
+			uint64_t committed_size;
+		};
+
+		// a snapshot of the counters since the last release()
+		Stats get_stats() const noexcept;
+
+		// every allocation is aligned to this
+		size_t get_alignment() const noexcept { return this->m_alignment; }
+
+		// prevent copying
+		ConcurrentMemoryAllocator(const ConcurrentMemoryAllocator&) = delete;
+		ConcurrentMemoryAllocator& operator=(const ConcurrentMemoryAllocator&) = delete;
+
+	private:
+		struct Block {
 			uintptr_t address;
 			size_t size;
+			std::atomic<size_t> used;
+
+			// the next block in the list
+			Block* next;
 		};
 
-		static constexpr size_t block_alignment = 0x1000;
+		// one cached block for every thread (threads share one if there are more than this)
+		static constexpr size_t cache_count = 64;
+
+		struct alignas(64) Cache {
+			std::atomic<Block*> block = nullptr;
+		};
+
+	private:
+		// allocate a new block and push it onto the list
+		Block* allocate_block(const size_t size, const size_t used);
+
+		void validate_alignment() const;
 
 	private:
 		std::function<uintptr_t(size_t size)> m_allocate;
 		std::function<void(uintptr_t address)> m_release;
-		std::stack<AllocationBlock> m_alloc_blocks;
-		size_t m_current_block_use = 0;
+
+		size_t m_alignment = 16,
+			m_block_size = 0x10000;
+
+		std::array<Cache, cache_count> m_caches;
+
+		// every block that was allocated
+		std::atomic<Block*> m_blocks = nullptr;
+
+		std::atomic<uint64_t> m_allocations = 0,
+			m_allocated_size = 0,
+			m_block_count = 0,
+			m_committed_size = 0;
 	};
 
 	// allocates RWX memory from a process
 	class ProcessMemoryAllocator : public MemoryAllocator {
 	public:
-		explicit ProcessMemoryAllocator(const mango::Process& process, 
+		explicit ProcessMemoryAllocator(const mango::Process& process,
 			const uint32_t protection = 0x40 /* PAGE_EXECUTE_READWRITE */);
 	};
+
+	// same as above but thread-safe
+	class ConcurrentProcessMemoryAllocator : public ConcurrentMemoryAllocator {
+	public:
+		explicit ConcurrentProcessMemoryAllocator(const mango::Process& process,
+			const uint32_t protection = 0x40 /* PAGE_EXECUTE_READWRITE */, const size_t alignment = 16);
+	};
 } // mango
\ No newline at end of file
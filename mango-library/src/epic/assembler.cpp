@@ -0,0 +1,427 @@
+#include "../../include/epic/assembler.h"
+
+#include "../../include/misc/error_codes.h"
+
+#include <limits>
+
+#undef min
+#undef max
+
+
+namespace mango {
+	namespace impl {
+		// how each type of branch is encoded, indexed by Assembler::BranchType
+		struct BranchEncoding {
+			uint8_t short_opcode; // rel8 opcode (0 if there is no short form)
+			uint8_t near_opcode[2];
+			uint8_t near_opcode_size;
+		};
+
+		// the jcc opcodes get OR'd with the condition code
+		static constexpr BranchEncoding branch_encodings[] = {
+			/* jmp  */ { 0xEB, { 0xE9, 0x00 }, 1 },
+			/* jcc  */ { 0x70, { 0x0F, 0x80 }, 2 },
+			/* call */ { 0x00, { 0xE8, 0x00 }, 1 }
+		};
+
+		// sizes of the absolute forms, indexed by [is64bit][Assembler::BranchType]
+		static constexpr size_t abs_branch_sizes[2][3] = {
+			// push imm32, ret | jncc +6, push imm32, ret | call $+5, add [esp], 10, push imm32, ret
+			{ 6, 8, 15 },
+			// jmp [rip], dq | jncc +14, jmp [rip], dq | call [rip+2], jmp +8, dq
+			{ 14, 16, 16 }
+		};
+
+		constexpr bool fits_int8(const int64_t value) {
+			return value >= std::numeric_limits<int8_t>::min() && value <= std::numeric_limits<int8_t>::max();
+		}
+		constexpr bool fits_int32(const int64_t value) {
+			return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+		}
+
+		constexpr uint8_t modrm(const uint8_t mod, const uint8_t reg, const uint8_t rm) {
+			return uint8_t((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+		}
+	} // namespace impl
+
+	Assembler::Assembler(const bool is64bit, const size_t reserve) : m_is64bit(is64bit) {
+		this->m_code.get_data().reserve(reserve);
+	}
+
+	// create a label that can be jumped to before or after it is bound
+	Assembler::Label Assembler::new_label() {
+		this->m_labels.emplace_back();
+		return Label{ this->m_labels.size() - 1 };
+	}
+
+	// place the label at the current position
+	Assembler& Assembler::bind(const Label label) {
+		if (label.id >= this->m_labels.size())
+			throw InvalidAssemblerLabel{};
+
+		// labels can only be bound once
+		auto& bound{ this->m_labels[label.id] };
+		if (bound.offset != size_t(-1))
+			throw InvalidAssemblerLabel{};
+
+		bound.offset = this->m_code.size();
+		bound.branches = this->m_branches.size();
+		return *this;
+	}
+
+	// mov reg, reg
+	Assembler& Assembler::mov(const Reg dst, const Reg src) {
+		this->rex(this->m_is64bit, src, dst);
+		this->m_code.push(uint8_t(0x89), impl::modrm(0b11, uint8_t(src), uint8_t(dst)));
+		return *this;
+	}
+
+	// mov reg, imm (picks the smallest encoding)
+	Assembler& Assembler::mov(const Reg dst, const uint64_t imm) {
+		if (!this->m_is64bit) {
+			if (imm > std::numeric_limits<uint32_t>::max())
+				throw InvalidAssemblerOperand{};
+
+			// mov r32, imm32
+			this->rex(false, Reg::eax, dst);
+			this->m_code.push(uint8_t(0xB8 + uint8_t(dst)), uint32_t(imm));
+		} else if (imm <= std::numeric_limits<uint32_t>::max()) {
+			// mov r32, imm32 (zero extends)
+			this->rex(false, Reg::rax, dst);
+			this->m_code.push(uint8_t(0xB8 + (uint8_t(dst) & 7)), uint32_t(imm));
+		} else if (impl::fits_int32(int64_t(imm))) {
+			// mov r/m64, imm32 (sign extends)
+			this->rex(true, Reg::rax, dst);
+			this->m_code.push(uint8_t(0xC7), impl::modrm(0b11, 0, uint8_t(dst)), uint32_t(imm));
+		} else {
+			// movabs r64, imm64
+			this->rex(true, Reg::rax, dst);
+			this->m_code.push(uint8_t(0xB8 + (uint8_t(dst) & 7)), imm);
+		}
+
+		return *this;
+	}
+
+	// push/pop
+	Assembler& Assembler::push(const Reg reg) {
+		this->rex(false, Reg::rax, reg);
+		this->m_code.push(uint8_t(0x50 + (uint8_t(reg) & 7)));
+		return *this;
+	}
+	Assembler& Assembler::push(const uint32_t imm) {
+		// NOTE: the immediate is sign extended on x64
+		if (impl::fits_int8(int32_t(imm))) {
+			this->m_code.push(uint8_t(0x6A), uint8_t(imm));
+		} else {
+			this->m_code.push(uint8_t(0x68), imm);
+		}
+		return *this;
+	}
+	Assembler& Assembler::pop(const Reg reg) {
+		this->rex(false, Reg::rax, reg);
+		this->m_code.push(uint8_t(0x58 + (uint8_t(reg) & 7)));
+		return *this;
+	}
+
+	// cmp r8, imm8 (eg: cmp al, 0)
+	Assembler& Assembler::cmp8(const Reg dst, const uint8_t imm) {
+		// cmp al, imm8 has its own short encoding
+		if (dst == Reg::rax) {
+			this->m_code.push(uint8_t(0x3C), imm);
+			return *this;
+		}
+
+		if (this->m_is64bit) {
+			// spl, bpl, sil and dil need an empty REX prefix
+			if (uint8_t(dst) >= 4)
+				this->m_code.push(uint8_t(0x40 | (uint8_t(dst) >= 8 ? 0b0001 : 0)));
+		} else if (uint8_t(dst) >= 4) {
+			// these would be ah, ch, dh, bh
+			throw InvalidAssemblerRegister{};
+		}
+
+		this->m_code.push(uint8_t(0x80), impl::modrm(0b11, 7, uint8_t(dst)), imm);
+		return *this;
+	}
+
+	// call/jmp to a register
+	Assembler& Assembler::call(const Reg reg) {
+		this->rex(false, Reg::rax, reg);
+		this->m_code.push(uint8_t(0xFF), impl::modrm(0b11, 2, uint8_t(reg)));
+		return *this;
+	}
+	Assembler& Assembler::jmp(const Reg reg) {
+		this->rex(false, Reg::rax, reg);
+		this->m_code.push(uint8_t(0xFF), impl::modrm(0b11, 4, uint8_t(reg)));
+		return *this;
+	}
+
+	// call/jmp/jcc to a label
+	Assembler& Assembler::call(const Label label) {
+		return this->branch(BranchType::call, Cond::o, label);
+	}
+	Assembler& Assembler::jmp(const Label label) {
+		return this->branch(BranchType::jmp, Cond::o, label);
+	}
+	Assembler& Assembler::jcc(const Cond cond, const Label label) {
+		return this->branch(BranchType::jcc, cond, label);
+	}
+
+	// call/jmp/jcc to an absolute address
+	Assembler& Assembler::call(const uint64_t address) {
+		return this->branch(BranchType::call, Cond::o, address, BranchForm::near);
+	}
+	Assembler& Assembler::jmp(const uint64_t address) {
+		return this->branch(BranchType::jmp, Cond::o, address, BranchForm::near);
+	}
+	Assembler& Assembler::jcc(const Cond cond, const uint64_t address) {
+		return this->branch(BranchType::jcc, cond, address, BranchForm::near);
+	}
+
+	// always use the absolute form (position independent)
+	Assembler& Assembler::call_abs(const uint64_t address) {
+		return this->branch(BranchType::call, Cond::o, address, BranchForm::abs);
+	}
+	Assembler& Assembler::jmp_abs(const uint64_t address) {
+		return this->branch(BranchType::jmp, Cond::o, address, BranchForm::abs);
+	}
+
+	// ret or retn
+	Assembler& Assembler::ret() {
+		this->m_code.push(uint8_t(0xC3));
+		return *this;
+	}
+	Assembler& Assembler::ret(const uint16_t size) {
+		this->m_code.push(uint8_t(0xC2), size);
+		return *this;
+	}
+
+	// resolve every label and branch, base is the address the code will be written to
+	Shellcode Assembler::assemble(const uint64_t base) const {
+		const auto num_branches{ this->m_branches.size() };
+
+		// every label needs to be bound before we can resolve anything
+		for (const auto& branch : this->m_branches) {
+			if (branch.label.id != size_t(-1) && this->m_labels[branch.label.id].offset == size_t(-1))
+				throw InvalidAssemblerLabel{};
+		}
+
+		// start with the smallest forms and grow them until everything fits
+		std::vector<BranchForm> forms(num_branches);
+		for (size_t i{ 0 }; i < num_branches; ++i)
+			forms[i] = this->m_branches[i].form;
+
+		// growth[i] is how many bytes the first i branches take up
+		std::vector<size_t> growth(num_branches + 1, 0);
+
+		// branches only ever grow so this always terminates
+		for (bool changed{ true }; changed;) {
+			changed = false;
+
+			for (size_t i{ 0 }; i < num_branches; ++i)
+				growth[i + 1] = growth[i] + this->branch_size(this->m_branches[i], forms[i]);
+
+			for (size_t i{ 0 }; i < num_branches; ++i) {
+				const auto& branch{ this->m_branches[i] };
+				if (forms[i] == BranchForm::abs)
+					continue;
+
+				// where the branch ends up, and where it's going
+				const auto end{ base + branch.offset + growth[i + 1] };
+				const auto target{ branch.label.id == size_t(-1) ? branch.address :
+					base + this->m_labels[branch.label.id].offset + growth[this->m_labels[branch.label.id].branches] };
+				const auto displacement{ int64_t(target - end) };
+
+				if (forms[i] == BranchForm::short_ && !impl::fits_int8(displacement)) {
+					forms[i] = BranchForm::near;
+					changed = true;
+				} else if (forms[i] == BranchForm::near && this->m_is64bit && !impl::fits_int32(displacement)) {
+					// rel32 is always reachable on x86 since it wraps around
+					forms[i] = BranchForm::abs;
+					changed = true;
+				}
+			}
+		}
+
+		// one pass to write the final bytes
+		Shellcode shellcode{};
+		auto& data{ shellcode.get_data() };
+		data.reserve(this->m_code.size() + growth[num_branches]);
+
+		const auto& code{ this->m_code.get_data() };
+		size_t copied{ 0 };
+
+		for (size_t i{ 0 }; i < num_branches; ++i) {
+			const auto& branch{ this->m_branches[i] };
+
+			// everything up to the branch
+			data.insert(data.end(), code.begin() + copied, code.begin() + branch.offset);
+			copied = branch.offset;
+
+			const auto target{ branch.label.id == size_t(-1) ? branch.address :
+				base + this->m_labels[branch.label.id].offset + growth[this->m_labels[branch.label.id].branches] };
+
+			this->encode_branch(data, branch, forms[i], base + data.size(), target);
+		}
+
+		// whatever is left after the last branch
+		data.insert(data.end(), code.begin() + copied, code.end());
+		return shellcode;
+	}
+
+	// reset (keeps the allocated memory around)
+	void Assembler::clear() noexcept {
+		this->m_code.clear();
+		this->m_branches.clear();
+		this->m_labels.clear();
+	}
+
+	Assembler& Assembler::alu(const AluOp op, const Reg dst, const Reg src) {
+		// add r/m, r | or r/m, r | ... | cmp r/m, r
+		this->rex(this->m_is64bit, src, dst);
+		this->m_code.push(uint8_t((uint8_t(op) << 3) | 0x01), impl::modrm(0b11, uint8_t(src), uint8_t(dst)));
+		return *this;
+	}
+	Assembler& Assembler::alu(const AluOp op, const Reg dst, const int32_t imm) {
+		this->rex(this->m_is64bit, Reg::rax, dst);
+
+		if (impl::fits_int8(imm)) {
+			// op r/m, imm8 (sign extended)
+			this->m_code.push(uint8_t(0x83), impl::modrm(0b11, uint8_t(op), uint8_t(dst)), uint8_t(imm));
+		} else if (dst == Reg::rax) {
+			// op eax, imm32
+			this->m_code.push(uint8_t((uint8_t(op) << 3) | 0x05), imm);
+		} else {
+			// op r/m, imm32
+			this->m_code.push(uint8_t(0x81), impl::modrm(0b11, uint8_t(op), uint8_t(dst)), imm);
+		}
+
+		return *this;
+	}
+
+	// emit a REX prefix if needed (and verify the register can be encoded)
+	void Assembler::rex(const bool w, const Reg reg, const Reg rm) {
+		const auto extended_reg{ uint8_t(reg) >= 8 },
+			extended_rm{ uint8_t(rm) >= 8 };
+
+		// r8-r15 don't exist on x86
+		if (!this->m_is64bit) {
+			if (extended_reg || extended_rm)
+				throw InvalidAssemblerRegister{};
+			return;
+		}
+
+		const auto prefix{ uint8_t(0x40 | (w << 3) | (extended_reg << 2) | extended_rm) };
+		if (prefix != 0x40)
+			this->m_code.push(prefix);
+	}
+
+	// add a branch to be resolved in assemble()
+	Assembler& Assembler::branch(const BranchType type, const Cond cond, const Label label) {
+		if (label.id >= this->m_labels.size())
+			throw InvalidAssemblerLabel{};
+
+		this->m_branches.push_back(Branch{
+			.offset = this->m_code.size(),
+			.address = 0,
+			.label = label,
+			.type = type,
+			.form = type == BranchType::call ? BranchForm::near : BranchForm::short_,
+			.cond = cond
+		});
+
+		return *this;
+	}
+	Assembler& Assembler::branch(const BranchType type, const Cond cond, const uint64_t address, const BranchForm form) {
+		if (!this->m_is64bit && address > std::numeric_limits<uint32_t>::max())
+			throw InvalidAssemblerOperand{};
+
+		this->m_branches.push_back(Branch{
+			.offset = this->m_code.size(),
+			.address = address,
+			.label = Label{},
+			.type = type,
+			.form = form,
+			.cond = cond
+		});
+
+		return *this;
+	}
+
+	// size, in bytes, of a branch in a specific form
+	size_t Assembler::branch_size(const Branch& branch, const BranchForm form) const {
+		const auto& encoding{ impl::branch_encodings[size_t(branch.type)] };
+
+		switch (form) {
+		case BranchForm::short_:
+			return 2;
+		case BranchForm::near:
+			return encoding.near_opcode_size + size_t(4);
+		default:
+			return impl::abs_branch_sizes[this->m_is64bit][size_t(branch.type)];
+		}
+	}
+
+	// write the final bytes for a branch
+	void Assembler::encode_branch(Shellcode::ShellcodeData& data, const Branch& branch,
+		const BranchForm form, const uint64_t address, const uint64_t target) const
+	{
+		const auto& encoding{ impl::branch_encodings[size_t(branch.type)] };
+
+		// only jcc cares about the condition
+		const auto cond{ branch.type == BranchType::jcc ? uint8_t(branch.cond) : uint8_t(0) };
+
+		const auto push_bytes{ [&](const auto value) {
+			const auto old_size{ data.size() };
+			data.resize(old_size + sizeof(value));
+			std::memcpy(data.data() + old_size, &value, sizeof(value));
+		} };
+
+		if (form == BranchForm::short_) {
+			data.push_back(uint8_t(encoding.short_opcode | cond));
+			push_bytes(int8_t(target - (address + 2)));
+			return;
+		}
+
+		if (form == BranchForm::near) {
+			data.insert(data.end(), encoding.near_opcode, encoding.near_opcode + encoding.near_opcode_size);
+			data.back() |= cond;
+			push_bytes(int32_t(target - (address + encoding.near_opcode_size + 4)));
+			return;
+		}
+
+		// skip over the absolute jmp if the condition is NOT met
+		if (branch.type == BranchType::jcc) {
+			data.push_back(uint8_t(encoding.short_opcode | (cond ^ 1)));
+			data.push_back(uint8_t(this->m_is64bit ? 14 : 6));
+		}
+
+		if (this->m_is64bit) {
+			if (branch.type == BranchType::call) {
+				// call qword ptr [rip + 2]
+				// jmp +8
+				const uint8_t bytes[] = { 0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08 };
+				data.insert(data.end(), std::begin(bytes), std::end(bytes));
+			} else {
+				// jmp qword ptr [rip]
+				const uint8_t bytes[] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+				data.insert(data.end(), std::begin(bytes), std::end(bytes));
+			}
+
+			push_bytes(target);
+		} else {
+			if (branch.type == BranchType::call) {
+				// call +0
+				// add dword ptr [esp], 10 (return address is right after the ret)
+				const uint8_t bytes[] = { 0xE8, 0x00, 0x00, 0x00, 0x00, 0x83, 0x04, 0x24, 0x0A };
+				data.insert(data.end(), std::begin(bytes), std::end(bytes));
+			}
+
+			// push target
+			// ret
+			data.push_back(0x68);
+			push_bytes(uint32_t(target));
+			data.push_back(0xC3);
+		}
+	}
+} // namespace mango
\ No newline at end of file
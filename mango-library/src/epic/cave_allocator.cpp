@@ -0,0 +1,269 @@
+#include "../../include/epic/cave_allocator.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/epic/loaded_module.h"
+
+#include <iterator>
+#include <algorithm>
+
+
+namespace mango {
+	namespace impl {
+		// how far a rel32 can reach, with some room to spare
+		constexpr uintptr_t cave_near_range = 0x7FFF'0000;
+
+		// [min_address, max_address) within rel32 range of address
+		std::pair<uintptr_t, uintptr_t> get_cave_near_window(const uintptr_t address) noexcept {
+			return {
+				address > cave_near_range ? address - cave_near_range : 0,
+				address < UINTPTR_MAX - cave_near_range ? address + cave_near_range : UINTPTR_MAX
+			};
+		}
+	} // namespace impl
+
+	// add the code caves of every module in Process::get_modules()
+	void CaveAllocator::setup(const Process& process, const size_t min_size) {
+		for (const auto& [name, module] : process.get_modules())
+			this->add_module(process, module, min_size);
+	}
+
+	// add the code caves of a single module (find_code_caves()), does nothing if they were already added
+	void CaveAllocator::add_module(const Process& process, const LoadedModule& module, const size_t min_size) {
+		const auto image_base{ module.get_image_base() };
+
+		std::unique_lock lock{ this->m_mutex };
+
+		// another thread is adding them, wait so that they're there once this returns
+		this->m_module_cv.wait(lock, [&]() { return this->m_modules[image_base].state != ModuleState::adding; });
+
+		if (this->m_modules[image_base].state == ModuleState::added)
+			return;
+
+		this->m_modules[image_base] = { module.get_image_size(), ModuleState::adding };
+
+		// reading the caves can take a while, so don't hold the lock for it
+		lock.unlock();
+
+		std::vector<MemoryRange> caves{};
+		try {
+			caves = find_code_caves(process, module, min_size);
+		} catch (...) {
+			// someone else can try again
+			lock.lock();
+			this->m_modules[image_base].state = ModuleState::none;
+			this->m_module_cv.notify_all();
+			throw;
+		}
+
+		lock.lock();
+
+		for (const auto& cave : caves)
+			this->insert_free_block(cave.m_address, cave.m_size);
+
+		// only now, otherwise allocate() could skip this module before its caves are in
+		this->m_modules[image_base].state = ModuleState::added;
+		this->m_module_cv.notify_all();
+	}
+
+	// add caves manually, they must not overlap with caves that were already added
+	void CaveAllocator::add(const MemoryRange& cave) {
+		const std::lock_guard lock{ this->m_mutex };
+		this->insert_free_block(cave.m_address, cave.m_size);
+	}
+	void CaveAllocator::add(const std::vector<MemoryRange>& caves) {
+		const std::lock_guard lock{ this->m_mutex };
+		for (const auto& cave : caves)
+			this->insert_free_block(cave.m_address, cave.m_size);
+	}
+
+	// the smallest block that fits (best-fit), 0 if no cave is big enough
+	uintptr_t CaveAllocator::allocate(const size_t size, const size_t alignment,
+		const uintptr_t min_address, const uintptr_t max_address) {
+
+		if (!size || !alignment || (alignment & (alignment - 1)))
+			return 0;
+
+		// where the allocation would go in a free block, 0 if it doesn't fit
+		const auto fit{ [&](const uintptr_t block_address, const size_t block_size) -> uintptr_t {
+			// padding for alignment
+			const auto address{ (std::max(block_address, min_address) + alignment - 1) & ~(alignment - 1) };
+			if (address < block_address || address - block_address + size > block_size || address + size > max_address)
+				return 0;
+
+			return address;
+		} };
+
+		const std::lock_guard lock{ this->m_mutex };
+
+		// no window, smallest first, blocks that are too small are skipped entirely
+		if (!min_address && max_address == UINTPTR_MAX) {
+			for (auto it{ this->m_free_by_size.lower_bound({ size, 0 }) }; it != this->m_free_by_size.end(); ++it) {
+				if (const auto address{ fit(it->second, it->first) })
+					return this->claim_block(this->m_free_by_address.find(it->second), address, size);
+			}
+
+			return 0;
+		}
+
+		// only the blocks inside of the window, starting with the one that min_address is in
+		auto it{ this->m_free_by_address.upper_bound(min_address) };
+		if (it != this->m_free_by_address.begin()) {
+			if (const auto prev{ std::prev(it) }; prev->first + prev->second > min_address)
+				it = prev;
+		}
+
+		auto best{ this->m_free_by_address.end() };
+		uintptr_t best_address{ 0 };
+
+		for (; it != this->m_free_by_address.end() && it->first < max_address; ++it) {
+			// can't be a better fit
+			if (best != this->m_free_by_address.end() && it->second >= best->second)
+				continue;
+
+			if (const auto address{ fit(it->first, it->second) }) {
+				best = it;
+				best_address = address;
+			}
+		}
+
+		if (!best_address)
+			return 0;
+
+		return this->claim_block(best, best_address, size);
+	}
+
+	// allocate() within rel32 range of address (for jumps and calls)
+	uintptr_t CaveAllocator::allocate_near(const uintptr_t address, const size_t size, const size_t alignment) {
+		const auto [min_address, max_address] { impl::get_cave_near_window(address) };
+		return this->allocate(size, alignment, min_address, max_address);
+	}
+
+	// same as above, but the caves of every module that overlaps the window are added first (add_module())
+	uintptr_t CaveAllocator::allocate(const Process& process, const size_t size, const size_t alignment,
+		const uintptr_t min_address, const uintptr_t max_address) {
+
+		this->add_modules(process, min_address, max_address);
+		return this->allocate(size, alignment, min_address, max_address);
+	}
+	uintptr_t CaveAllocator::allocate_near(const Process& process, const uintptr_t address, const size_t size, const size_t alignment) {
+		const auto [min_address, max_address] { impl::get_cave_near_window(address) };
+		return this->allocate(process, size, alignment, min_address, max_address);
+	}
+
+	// free a block that was returned by allocate(), it's merged with any neighboring free blocks
+	void CaveAllocator::free(const uintptr_t address) {
+		const std::lock_guard lock{ this->m_mutex };
+
+		const auto allocation{ this->m_allocations.find(address) };
+		if (allocation == this->m_allocations.end())
+			return;
+
+		auto start{ address };
+		auto end{ address + allocation->second };
+		this->m_allocations.erase(allocation);
+
+		// the free block right after
+		if (const auto next{ this->m_free_by_address.find(end) }; next != this->m_free_by_address.end()) {
+			end += next->second;
+			this->erase_free_block(next);
+		}
+
+		// the free block right before
+		if (auto prev{ this->m_free_by_address.lower_bound(start) }; prev != this->m_free_by_address.begin()) {
+			if (--prev; prev->first + prev->second == start) {
+				start = prev->first;
+				this->erase_free_block(prev);
+			}
+		}
+
+		this->insert_free_block(start, end - start);
+	}
+
+	// the total size of every free block
+	size_t CaveAllocator::get_free_size() const {
+		const std::lock_guard lock{ this->m_mutex };
+		return this->m_free_size;
+	}
+
+	// the size of the biggest free block
+	size_t CaveAllocator::get_largest_free_block() const {
+		const std::lock_guard lock{ this->m_mutex };
+		return this->m_free_by_size.empty() ? 0 : this->m_free_by_size.rbegin()->first;
+	}
+
+	// the number of blocks that haven't been freed yet
+	size_t CaveAllocator::get_allocation_count() const {
+		const std::lock_guard lock{ this->m_mutex };
+		return this->m_allocations.size();
+	}
+
+	// forget every cave, module, and allocation
+	void CaveAllocator::clear() {
+		const std::lock_guard lock{ this->m_mutex };
+		this->m_free_by_address.clear();
+		this->m_free_by_size.clear();
+		this->m_allocations.clear();
+		this->m_modules.clear();
+		this->m_free_size = 0;
+	}
+
+	// these expect the mutex to be locked already
+	void CaveAllocator::insert_free_block(const uintptr_t address, const size_t size) {
+		if (!size)
+			return;
+
+		this->m_free_by_address[address] = size;
+		this->m_free_by_size.insert({ size, address });
+		this->m_free_size += size;
+	}
+	void CaveAllocator::erase_free_block(const std::map<uintptr_t, size_t>::iterator it) {
+		this->m_free_by_size.erase({ it->second, it->first });
+		this->m_free_size -= it->second;
+		this->m_free_by_address.erase(it);
+	}
+
+	// take [address, address + size) out of a free block, whatever is left on either side stays free
+	uintptr_t CaveAllocator::claim_block(const std::map<uintptr_t, size_t>::iterator it, const uintptr_t address, const size_t size) {
+		const auto [block_address, block_size] { *it };
+		this->erase_free_block(it);
+
+		if (address > block_address)
+			this->insert_free_block(block_address, address - block_address);
+		if (address + size < block_address + block_size)
+			this->insert_free_block(address + size, block_address + block_size - (address + size));
+
+		this->m_allocations[address] = size;
+		return address;
+	}
+
+	// add_module() for every module in the process that overlaps [min_address, max_address)
+	void CaveAllocator::add_modules(const Process& process, const uintptr_t min_address, const uintptr_t max_address) {
+		for (const auto& [name, image_base] : process.get_module_addresses()) {
+			// starts after the window
+			if (image_base >= max_address)
+				continue;
+
+			{
+				const std::lock_guard lock{ this->m_mutex };
+
+				// already added, or known to end before the window
+				if (const auto it{ this->m_modules.find(image_base) }; it != this->m_modules.end() &&
+					(it->second.state == ModuleState::added || image_base + it->second.size <= min_address))
+					continue;
+			}
+
+			// the size is only known once the module is loaded
+			const auto module{ process.get_module(name) };
+			if (!module)
+				continue;
+
+			if (image_base + module->get_image_size() <= min_address) {
+				const std::lock_guard lock{ this->m_mutex };
+				this->m_modules[image_base].size = module->get_image_size();
+				continue;
+			}
+
+			this->add_module(process, *module);
+		}
+	}
+} // namespace mango
\ No newline at end of file
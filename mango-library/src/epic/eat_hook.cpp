@@ -0,0 +1,197 @@
+#include "../../include/epic/eat_hook.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/epic/cave_allocator.h"
+#include "../../include/epic/unused_memory.h"
+#include "../../include/misc/error_codes.h"
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+
+namespace mango {
+	namespace impl {
+		constexpr size_t eat_stub_page_size = 0x1000,
+			eat_stub_size = 0x10;
+
+		// allocate_near() searches 2GB in both directions, so searching from here covers [image_base, image_base + 4GB)
+		constexpr uintptr_t eat_stub_search_offset = 0x7FFF'0000;
+
+		constexpr size_t max_eat_forwarder_length = 0x100,
+			max_eat_forwarder_depth = 8;
+
+		// the function that an exported rva points to, following forwarders ("NTDLL.RtlAllocateHeap") if needed
+		uintptr_t resolve_eat_export(const Process& process, std::shared_ptr<const ModuleIndex> index, uint32_t rva) {
+			for (size_t depth{ 0 }; depth < max_eat_forwarder_depth; ++depth) {
+				const auto address{ index->get_image_base() + rva };
+
+				// rvas outside of the export directory are code
+				if (address < index->get_export_dir_start() || address >= index->get_export_dir_end())
+					return process.is_64bit() ? address : uint32_t(address);
+
+				char buffer[max_eat_forwarder_length]{};
+				const auto size{ std::min(sizeof(buffer) - 1, size_t(index->get_export_dir_end() - address)) };
+				process.read(address, buffer, size);
+
+				// "module.function", or "module.#ordinal" which isn't supported
+				const std::string_view forwarder{ buffer, strnlen(buffer, size) };
+				const auto separator{ forwarder.find_last_of('.') };
+				if (separator == std::string_view::npos || separator + 1 >= forwarder.size() || forwarder[separator + 1] == '#')
+					throw FailedToResolveExportForwarder{};
+
+				const auto module_address{ process.get_module_addr(std::string{ forwarder.substr(0, separator) } + ".dll") };
+				if (!module_address)
+					throw FailedToResolveExportForwarder{};
+
+				index = ModuleIndex::get(process, module_address);
+
+				const auto entry{ index->find_export(ModuleIndex::hash_func_name(forwarder.substr(separator + 1))) };
+				if (!entry)
+					throw FailedToResolveExportForwarder{};
+
+				rva = process.read<uint32_t>(*entry);
+			}
+
+			// forwarders that loop back to themselves
+			throw FailedToResolveExportForwarder{};
+		}
+	} // namespace impl
+
+	// all hooks will only affect the exports of the specified module
+	void EatHook::setup(const Process& process, const uintptr_t module_address, const SetupOptions& options) {
+		this->m_options = options;
+		this->release();
+
+		// shared with every other hook on this module
+		this->m_index = ModuleIndex::get(process, module_address);
+		this->m_process = &process;
+	}
+
+	// unhooks everything and frees the stubs
+	void EatHook::release() {
+		if (!this->m_process)
+			return;
+
+		// unhook every function
+		for (const auto& hooked : this->m_hooked_funcs)
+			this->write_rva(hooked.entry, hooked.original_rva);
+
+		for (const auto page : this->m_stub_pages)
+			this->m_process->free_virt_mem(page);
+		for (const auto stub : this->m_cave_stubs)
+			this->m_process->get_cave_allocator().free(stub);
+
+		this->m_hooked_funcs.clear();
+		this->m_stub_pages.clear();
+		this->m_cave_stubs.clear();
+		this->m_stub_offset = 0;
+		this->m_index = nullptr;
+		this->m_process = nullptr;
+	}
+
+	// hook a function (returns the original)
+	uintptr_t EatHook::hook(const std::string_view func_name, const uintptr_t func) {
+		const auto entry{ this->find_entry(func_name) };
+
+		// make sure not hooked already
+		if (this->find_hooked(entry))
+			throw FunctionAlreadyHooked{};
+
+		const auto image_base{ this->m_index->get_image_base() };
+		const auto original_rva{ this->m_process->read<uint32_t>(entry) };
+
+		// forwarded exports point to a string, not code
+		const auto original{ impl::resolve_eat_export(*this->m_process, this->m_index, original_rva) };
+
+		// rvas wrap around in 32bit processes, so only x64 needs a stub
+		uintptr_t stub{ 0 };
+		if (this->m_process->is_64bit() && (func < image_base || func - image_base > UINT32_MAX))
+			stub = this->create_stub(func);
+
+		this->write_rva(entry, uint32_t((stub ? stub : func) - image_base));
+		this->m_hooked_funcs.push_back({ entry, original_rva, original, stub });
+
+		return original;
+	}
+
+	// unhook, stubs are pointed back to the original in case someone is still using them
+	void EatHook::unhook(const std::string_view func_name) {
+		const auto hooked{ this->find_hooked(this->find_entry(func_name)) };
+		if (!hooked) // not hooked
+			return;
+
+		this->write_rva(hooked->entry, hooked->original_rva);
+		if (hooked->stub)
+			this->write_stub(hooked->stub, hooked->original);
+
+		// order doesn't matter
+		*hooked = this->m_hooked_funcs.back();
+		this->m_hooked_funcs.pop_back();
+	}
+
+	// the address of the entry in AddressOfFunctions, throws if the function isn't exported
+	uintptr_t EatHook::find_entry(const std::string_view func_name) const {
+		if (const auto entry{ this->m_index->find_export(ModuleIndex::hash_func_name(func_name)) })
+			return *entry;
+
+		throw FailedToFindExportFunction{};
+	}
+
+	// nullptr if not hooked
+	EatHook::HookedFunc* EatHook::find_hooked(const uintptr_t entry) noexcept {
+		const auto it{ std::find_if(this->m_hooked_funcs.begin(), this->m_hooked_funcs.end(),
+			[entry](const HookedFunc& hooked) { return hooked.entry == entry; }) };
+		return it == this->m_hooked_funcs.end() ? nullptr : &*it;
+	}
+
+	// a stub that jumps to func, within 4GB after the image
+	uintptr_t EatHook::create_stub(const uintptr_t func) {
+		const auto image_base{ this->m_index->get_image_base() };
+
+		// a code cave in (or near) the module itself, shared with every other hook in the process
+		if (const auto cave{ this->m_process->get_cave_allocator().allocate(*this->m_process,
+			impl::eat_stub_size, impl::eat_stub_size, image_base, image_base + UINT32_MAX) }; cave) {
+			this->m_cave_stubs.push_back(cave);
+			this->write_stub(cave, func);
+			return cave;
+		}
+
+		// current page is full (or there is none yet)
+		if (this->m_stub_pages.empty() || this->m_stub_offset + impl::eat_stub_size > impl::eat_stub_page_size) {
+			this->m_stub_pages.push_back(impl::allocate_near(*this->m_process,
+				image_base + impl::eat_stub_search_offset, impl::eat_stub_page_size));
+			this->m_stub_offset = 0;
+		}
+
+		const auto stub{ this->m_stub_pages.back() + this->m_stub_offset };
+		this->m_stub_offset += impl::eat_stub_size;
+
+		this->write_stub(stub, func);
+		return stub;
+	}
+
+	// point a stub somewhere else
+	void EatHook::write_stub(const uintptr_t stub, const uintptr_t func) const {
+		// jmp qword ptr [rip], with the address right after
+		uint8_t code[impl::eat_stub_size]{ 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+		*reinterpret_cast<uint64_t*>(code + 6) = func;
+
+		// code caves aren't writeable
+		const auto protection{ this->m_process->set_mem_prot(stub, sizeof(code), PAGE_EXECUTE_READWRITE) };
+		this->m_process->write(stub, code, sizeof(code));
+		this->m_process->set_mem_prot(stub, sizeof(code), protection);
+		FlushInstructionCache(this->m_process->get_handle(), reinterpret_cast<void*>(stub), sizeof(code));
+	}
+
+	// overwrite the entry in AddressOfFunctions
+	void EatHook::write_rva(const uintptr_t entry, const uint32_t rva) const {
+		// set page protection to allow writing
+		const auto old_prot{ this->m_process->set_mem_prot(entry, sizeof(uint32_t), PAGE_READWRITE) };
+
+		this->m_process->write<uint32_t>(entry, rva);
+
+		// restore page protection to old value
+		this->m_process->set_mem_prot(entry, sizeof(uint32_t), old_prot);
+	}
+} // namespace mango
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "../../include/epic/hardware_breakpoint.h"
 
+#include "../../include/misc/scope_guard.h"
+
+#include <vector>
+
 
 namespace mango::hwbp {
 	namespace impl {
@@ -65,40 +69,37 @@ namespace mango::hwbp {
 		// sets up DR7 for our use (or throws) and returns which dbg register was used
 		size_t enable_DR7(uint32_t& DR7, const Options& options) {
 			// look for an unused debug register
-			for (size_t i(0); i < 4; ++i) {
-				if (is_enabled(DR7, i))
-					continue;
-
-				// enable this debug register for our use
-				DR7 |= uint32_t(1) << (i * 2);
-
-				// specify the breakpoint size and when it should trigger
-				const auto type_size_mask((uint32_t(options.size) << 2) | uint32_t(options.type));
-				DR7 &= ~uint32_t(0b1111 << (16 + i * 4)); // clear old value
-				DR7 |= type_size_mask << (16 + i * 4);
-
-				return i;
-			}
+			const auto index(find_unused(DR7));
 
 			// gg couldn't find a free debug register to use
-			throw NoAvailableDebugRegisters{};
+			if (index >= 4)
+				throw NoAvailableDebugRegisters{};
+
+			// enable this debug register for our use
+			DR7 = set_DR7(DR7, index, options);
+			return index;
 		}
 
 		// clears out the control settings for that debug register
 		void clear_dreg(uint32_t& DR7, const size_t index) {
-			// disable this debug register
-			DR7 &= ~(uint32_t(1) << (index * 2));
+			DR7 = clear_DR7(DR7, index);
+		}
 
-			// clear out the size/type as well cuz we're nice people
-			DR7 &= ~uint32_t(0b1111 << (16 + index * 4));
+		// set the debug registers without reading the context first, since every one of them is overwritten
+		// returns false instead of throwing, this is called while other threads are suspended
+		template <bool is64bit>
+		bool try_set_breakpoints(const HANDLE thread, const Manager::Breakpoints& breakpoints) noexcept {
+			Context<is64bit> context{ .ContextFlags = is64bit ? CONTEXT_DEBUG_REGISTERS : WOW64_CONTEXT_DEBUG_REGISTERS };
+			Manager::apply(context, breakpoints);
+
+			// SetThreadContext() vs Wow64SetThreadContext()
+			if constexpr (is64bit)
+				return SetThreadContext(thread, &context) != FALSE;
+			else
+				return Wow64SetThreadContext(thread, &context) != FALSE;
 		}
 	} // namespace impl
 
-	// check if a debug register is currently enabled
-	bool is_enabled(const uint32_t DR7, const size_t index) {
-		return DR7 & (uint32_t(1) << (index * 2));
-	}
-
 	// set a hardware breakpoint using one of the 4 debug registers
 	// will throw an exception if all registers are used
 	// safe to use on current thread (although technically "undefined behavior")
@@ -118,4 +119,153 @@ namespace mango::hwbp {
 			impl::remove_hwbp<true>(thread, address) :
 			impl::remove_hwbp<false>(thread, address);
 	}
+
+	// set a hardware breakpoint on every thread, returns which debug register was used
+	// will throw an exception if all registers are used
+	size_t Manager::add(const uintptr_t address, const Options& options) {
+		const std::lock_guard lock{ this->m_mutex };
+
+		auto DR7(get_DR7(this->m_breakpoints));
+		const auto index(impl::enable_DR7(DR7, options));
+
+		this->m_breakpoints[index] = Breakpoint{ address, options };
+
+		// don't keep a breakpoint that didn't get applied
+		try {
+			this->apply_to_threads(false);
+		} catch (...) {
+			this->m_breakpoints[index].reset();
+			throw;
+		}
+
+		return index;
+	}
+
+	// remove every breakpoint on this address from every thread
+	void Manager::remove(const uintptr_t address) {
+		const std::lock_guard lock{ this->m_mutex };
+
+		for (auto& breakpoint : this->m_breakpoints) {
+			if (breakpoint && breakpoint->address == address)
+				breakpoint.reset();
+		}
+
+		this->apply_to_threads(false);
+	}
+
+	// remove every breakpoint from every thread
+	void Manager::clear() {
+		const std::lock_guard lock{ this->m_mutex };
+		this->m_breakpoints = {};
+
+		// no threads have any breakpoints
+		if (this->m_threads.empty())
+			return;
+
+		this->apply_to_threads(false);
+	}
+
+	// apply the breakpoints to threads that were created since the last time
+	void Manager::refresh() {
+		const std::lock_guard lock{ this->m_mutex };
+
+		// new threads start without any breakpoints
+		if (!get_DR7(this->m_breakpoints))
+			return;
+
+		this->apply_to_threads(true);
+	}
+
+	// call refresh() every interval on a background thread
+	void Manager::start(const std::chrono::milliseconds interval) {
+		this->stop();
+
+		this->m_running = true;
+		this->m_thread = std::thread{ [this, interval]() {
+			std::unique_lock lock{ this->m_thread_mutex };
+
+			// wake up early when stop() is called
+			while (!this->m_thread_cv.wait_for(lock, interval, [this]() { return !this->m_running; })) {
+				// threads can exit while we're setting their context, the next refresh will catch up
+				try {
+					this->refresh();
+				} catch (...) {}
+			}
+		} };
+	}
+
+	// stop the background thread
+	void Manager::stop() {
+		if (!this->m_thread.joinable())
+			return;
+
+		{
+			const std::lock_guard lock{ this->m_thread_mutex };
+			this->m_running = false;
+		}
+
+		this->m_thread_cv.notify_one();
+		this->m_thread.join();
+	}
+
+	// set the debug registers of every thread (or just the new ones) in one batch
+	void Manager::apply_to_threads(const bool only_new) {
+		const auto& process{ *this->m_process };
+		const auto current_tid{ process.is_self() ? GetCurrentThreadId() : 0 };
+
+		// threads that exited are forgotten, so their ids can be reused
+		const auto tids{ process.get_threadids() };
+		std::unordered_set<uint32_t> alive(tids.begin(), tids.end());
+		std::erase_if(this->m_threads, [&](const uint32_t tid) { return !alive.contains(tid); });
+
+		// anything that allocates happens before suspending, one of the suspended threads could own the heap lock
+		std::vector<Thread> threads{};
+		threads.reserve(tids.size());
+
+		for (const auto tid : tids) {
+			if (only_new && this->m_threads.contains(tid))
+				continue;
+
+			// the thread might have exited already
+			try {
+				threads.emplace_back(tid, Thread::SetupOptions{
+					.handle_access = THREAD_SUSPEND_RESUME | THREAD_SET_CONTEXT | THREAD_QUERY_INFORMATION });
+			} catch (InvalidThreadHandle&) {}
+		}
+
+		if (threads.empty())
+			return;
+
+		// the threads that got the breakpoints, only added to m_threads after resuming
+		std::vector<uint32_t> applied{};
+		applied.reserve(threads.size());
+
+		// we can't suspend ourself, so suspend every other thread instead
+		for (const auto& thread : threads) {
+			if (thread.get_tid() != current_tid)
+				SuspendThread(thread.get_handle());
+		}
+
+		{
+			const ScopeGuard _resume_guard{ [&]() {
+				for (const auto& thread : threads) {
+					if (thread.get_tid() != current_tid)
+						ResumeThread(thread.get_handle());
+				}
+			} };
+
+			// the same context for every thread
+			for (const auto& thread : threads) {
+				const auto success{ process.is_64bit() ?
+					impl::try_set_breakpoints<true>(thread.get_handle(), this->m_breakpoints) :
+					impl::try_set_breakpoints<false>(thread.get_handle(), this->m_breakpoints) };
+
+				// the thread exited after being listed (if it didn't, refresh() tries again)
+				if (success)
+					applied.push_back(thread.get_tid());
+			}
+		}
+
+		this->m_threads.insert(applied.begin(), applied.end());
+	}
 } // namespace mango::hwbp
\ No newline at end of file
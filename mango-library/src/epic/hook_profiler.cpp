@@ -0,0 +1,553 @@
+#include "../../include/epic/hook_profiler.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/epic/assembler.h"
+#include "../../include/epic/vmt_hook.h"
+#include "../../include/epic/iat_hook.h"
+#include "../../include/misc/scope_guard.h"
+#include "../../include/misc/error_codes.h"
+
+#include <memory>
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+
+
+namespace mango {
+	namespace impl {
+		// the layout of the data that the stub writes to (same for x86 and x64)
+		struct ProfilerSlot {
+			uint64_t owner, // thread id
+				depth,      // number of entries in stack
+				calls,
+				total_cycles;
+			uint64_t histogram[HookProfiler::histogram_buckets];
+
+			// the real return address of every timed call that hasn't returned yet
+			struct {
+				uint64_t return_address,
+					start;
+			} stack[HookProfiler::max_call_depth];
+		};
+
+		struct ProfilerData {
+			uint64_t overflow_calls;
+			uint8_t padding[0x38];
+			ProfilerSlot slots[HookProfiler::max_threads];
+		};
+
+		// the owner of a slot while reclaim_slots() is taking its stats, never matches a thread id
+		constexpr uint64_t profiler_retired_owner = ~uint64_t(0);
+
+		// the slot address is calculated with a shift
+		constexpr uint8_t profiler_slot_shift = 9;
+		static_assert(sizeof(ProfilerSlot) == (1 << profiler_slot_shift));
+
+		// entry stub at the start, the return stub at post_offset, and the data right after the code
+		constexpr size_t profiler_post_offset = 0x400,
+			profiler_code_size = 0x1000;
+
+		using ProfilerReg = Assembler::Reg;
+
+		// op reg, [base + disp32] or op [base + disp32], reg (depending on the opcode)
+		// only rax, rcx, rdx, and rbx are supported, wide means qword on x64
+		void profiler_mem(Assembler& assembler, const bool wide, const std::initializer_list<uint8_t> opcode,
+			const uint8_t reg, const ProfilerReg base, const size_t disp)
+		{
+			if (wide && assembler.is_64bit())
+				assembler.raw(uint8_t(0x48));
+
+			for (const auto byte : opcode)
+				assembler.raw(byte);
+
+			assembler.raw(uint8_t(0x80 | (reg << 3) | uint8_t(base)), uint32_t(disp));
+		}
+
+		// shl (digit 4) or shr (digit 5) reg, count
+		void profiler_shift(Assembler& assembler, const uint8_t digit, const ProfilerReg reg, const uint8_t count) {
+			if (assembler.is_64bit())
+				assembler.raw(uint8_t(0x48));
+
+			assembler.raw(uint8_t(0xC1), uint8_t(0xC0 | (digit << 3) | uint8_t(reg)), count);
+		}
+
+		// qword ptr [base + disp] += 1
+		void profiler_inc64(Assembler& assembler, const ProfilerReg base, const size_t disp) {
+			if (assembler.is_64bit()) {
+				// inc qword ptr [base + disp]
+				profiler_mem(assembler, true, { 0xFF }, 0, base, disp);
+			} else {
+				// add dword ptr [base + disp], 1
+				// adc dword ptr [base + disp + 4], 0
+				// NOTE: not atomic, see the note on HookProfiler::Stats
+				profiler_mem(assembler, false, { 0x83 }, 0, base, disp);
+				assembler.raw(uint8_t(1));
+				profiler_mem(assembler, false, { 0x83 }, 2, base, disp + 4);
+				assembler.raw(uint8_t(0));
+			}
+		}
+
+		// rbx = the slot owned by the current thread, rax = the thread id
+		// jumps to not_found if the thread has no slot (or every slot is taken, if claim is true)
+		// slots can be given back by reclaim_slots(), so claiming is only safe once it's known that the thread has no slot
+		void profiler_find_slot(Assembler& assembler, const uintptr_t slots, const bool claim, const Assembler::Label not_found) {
+			using Reg = ProfilerReg;
+			using Cond = Assembler::Cond;
+
+			const auto ptr_size{ int32_t(assembler.is_64bit() ? 8 : 4) };
+			const auto probe{ assembler.new_label() },
+				next{ assembler.new_label() },
+				found{ assembler.new_label() };
+
+			// TEB::ClientId::UniqueThread
+			if (assembler.is_64bit())
+				assembler.raw("\x65\x48\x8B\x04\x25\x48\x00\x00\x00"); // mov rax, gs:[0x48]
+			else
+				assembler.raw("\x64\xA1\x24\x00\x00\x00"); // mov eax, fs:[0x24]
+
+			// thread ids are a multiple of 4
+			assembler.mov(Reg::rcx, Reg::rax);
+			profiler_shift(assembler, 5, Reg::rcx, 2);
+
+			// number of slots left to check
+			assembler.push(uint32_t(HookProfiler::max_threads));
+
+			assembler.bind(probe)
+				.and_(Reg::rcx, int32_t(HookProfiler::max_threads - 1))
+				.mov(Reg::rbx, Reg::rcx);
+			profiler_shift(assembler, 4, Reg::rbx, profiler_slot_shift);
+			assembler.mov(Reg::rdx, uint64_t(slots))
+				.add(Reg::rbx, Reg::rdx);
+
+			// mov rdx, [rbx + owner]
+			profiler_mem(assembler, true, { 0x8B }, uint8_t(Reg::rdx), Reg::rbx, offsetof(ProfilerSlot, owner));
+			assembler.cmp(Reg::rdx, Reg::rax)
+				.jcc(Cond::e, found);
+
+			if (claim) {
+				assembler.cmp(Reg::rdx, 0)
+					.jcc(Cond::ne, next);
+
+				// lock cmpxchg [rbx + owner], rdx (with rax = 0)
+				assembler.mov(Reg::rdx, Reg::rax)
+					.xor_(Reg::rax, Reg::rax)
+					.raw(uint8_t(0xF0));
+				profiler_mem(assembler, true, { 0x0F, 0xB1 }, uint8_t(Reg::rdx), Reg::rbx, offsetof(ProfilerSlot, owner));
+				assembler.mov(Reg::rax, Reg::rdx)
+					.jcc(Cond::e, found);
+			}
+
+			assembler.bind(next)
+				.add(Reg::rcx, 1)
+				.raw("\xFF\x0C\x24") // dec dword ptr [rsp]
+				.jcc(Cond::ne, probe)
+				.add(Reg::rsp, ptr_size)
+				.jmp(not_found);
+
+			assembler.bind(found)
+				.add(Reg::rsp, ptr_size);
+		}
+
+		// whether a thread that owns a slot is still running (access denied counts as running)
+		bool is_profiled_thread_alive(const Process& process, const uint32_t tid) {
+			const auto handle{ OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, tid) };
+			if (!handle)
+				return GetLastError() != ERROR_INVALID_PARAMETER;
+
+			const ScopeGuard _guard{ &CloseHandle, handle };
+
+			// the id was reused by a thread in another process
+			if (GetProcessIdOfThread(handle) != process.get_pid())
+				return false;
+
+			DWORD exit_code{ 0 };
+			return !GetExitCodeThread(handle, &exit_code) || exit_code == STILL_ACTIVE;
+		}
+
+		// counts the call, then swaps the return address with the post stub (if there's room to remember it)
+		Shellcode profiler_entry_stub(const bool is64bit, const uintptr_t address, const uintptr_t original) {
+			using Reg = ProfilerReg;
+			using Cond = Assembler::Cond;
+
+			const auto data{ address + profiler_code_size };
+			const auto return_address_offset{ uint8_t(is64bit ? 0x28 : 0x14) };
+
+			Assembler assembler{ is64bit };
+			const auto forward{ assembler.new_label() },
+				overflow{ assembler.new_label() },
+				claim{ assembler.new_label() },
+				has_slot{ assembler.new_label() };
+
+			// everything is preserved, some functions take arguments in rax or the flags
+			assembler.raw(uint8_t(0x9C)) // pushf
+				.push(Reg::rax)
+				.push(Reg::rcx)
+				.push(Reg::rdx)
+				.push(Reg::rbx);
+
+			// only claim a slot on the first call from a thread
+			profiler_find_slot(assembler, data + offsetof(ProfilerData, slots), false, claim);
+			assembler.jmp(has_slot)
+				.bind(claim);
+			profiler_find_slot(assembler, data + offsetof(ProfilerData, slots), true, overflow);
+			assembler.bind(has_slot);
+
+			profiler_inc64(assembler, Reg::rbx, offsetof(ProfilerSlot, calls));
+
+			// mov rcx, [rbx + depth]
+			profiler_mem(assembler, true, { 0x8B }, uint8_t(Reg::rcx), Reg::rbx, offsetof(ProfilerSlot, depth));
+			assembler.cmp(Reg::rcx, int32_t(HookProfiler::max_call_depth))
+				.jcc(Cond::ae, forward);
+
+			// rcx = slot + depth * 16
+			profiler_shift(assembler, 4, Reg::rcx, 4);
+			assembler.add(Reg::rcx, Reg::rbx);
+
+			// remember the real return address
+			if (is64bit)
+				assembler.raw("\x48\x8B\x44\x24", return_address_offset); // mov rax, [rsp + 0x28]
+			else
+				assembler.raw("\x8B\x44\x24", return_address_offset); // mov eax, [esp + 0x14]
+			profiler_mem(assembler, true, { 0x89 }, uint8_t(Reg::rax), Reg::rcx, offsetof(ProfilerSlot, stack));
+
+			// return to the post stub instead
+			assembler.mov(Reg::rax, uint64_t(address + profiler_post_offset));
+			if (is64bit)
+				assembler.raw("\x48\x89\x44\x24", return_address_offset); // mov [rsp + 0x28], rax
+			else
+				assembler.raw("\x89\x44\x24", return_address_offset); // mov [esp + 0x14], eax
+
+			// start time
+			assembler.raw("\x0F\x31"); // rdtsc
+			if (is64bit) {
+				profiler_shift(assembler, 4, Reg::rdx, 32);
+				assembler.or_(Reg::rax, Reg::rdx);
+				profiler_mem(assembler, true, { 0x89 }, uint8_t(Reg::rax), Reg::rcx, offsetof(ProfilerSlot, stack) + 8);
+			} else {
+				profiler_mem(assembler, false, { 0x89 }, uint8_t(Reg::eax), Reg::ecx, offsetof(ProfilerSlot, stack) + 8);
+				profiler_mem(assembler, false, { 0x89 }, uint8_t(Reg::edx), Reg::ecx, offsetof(ProfilerSlot, stack) + 12);
+			}
+
+			// add [rbx + depth], 1
+			profiler_mem(assembler, true, { 0x83 }, 0, Reg::rbx, offsetof(ProfilerSlot, depth));
+			assembler.raw(uint8_t(1));
+
+			assembler.bind(forward)
+				.pop(Reg::rbx)
+				.pop(Reg::rdx)
+				.pop(Reg::rcx)
+				.pop(Reg::rax)
+				.raw(uint8_t(0x9D)) // popf
+				.jmp_abs(original);
+
+			// no slot for this thread, just count it
+			assembler.bind(overflow)
+				.mov(Reg::rdx, uint64_t(data + offsetof(ProfilerData, overflow_calls)))
+				.raw(uint8_t(0xF0)); // lock
+			profiler_inc64(assembler, Reg::rdx, 0);
+			assembler.jmp(forward);
+
+			return assembler.assemble(address);
+		}
+
+		// records the time the call took, then returns to the real return address
+		Shellcode profiler_post_stub(const bool is64bit, const uintptr_t address) {
+			using Reg = ProfilerReg;
+			using Cond = Assembler::Cond;
+
+			const auto data{ address - profiler_post_offset + profiler_code_size };
+			const auto return_address_offset{ uint8_t(is64bit ? 0x20 : 0x10) };
+
+			Assembler assembler{ is64bit };
+			const auto has_bucket{ assembler.new_label() },
+				too_slow{ assembler.new_label() },
+				crash{ assembler.new_label() };
+
+			// space for the return address, and the return value
+			assembler.push(Reg::rax)
+				.push(Reg::rax)
+				.push(Reg::rdx)
+				.push(Reg::rcx)
+				.push(Reg::rbx);
+
+			profiler_find_slot(assembler, data + offsetof(ProfilerData, slots), false, crash);
+
+			// sub [rbx + depth], 1
+			profiler_mem(assembler, true, { 0x83 }, 5, Reg::rbx, offsetof(ProfilerSlot, depth));
+			assembler.raw(uint8_t(1));
+
+			// rcx = slot + depth * 16
+			profiler_mem(assembler, true, { 0x8B }, uint8_t(Reg::rcx), Reg::rbx, offsetof(ProfilerSlot, depth));
+			profiler_shift(assembler, 4, Reg::rcx, 4);
+			assembler.add(Reg::rcx, Reg::rbx);
+
+			// elapsed time
+			assembler.raw("\x0F\x31"); // rdtsc
+			if (is64bit) {
+				profiler_shift(assembler, 4, Reg::rdx, 32);
+				assembler.or_(Reg::rax, Reg::rdx);
+
+				// sub rax, [rcx + start]
+				// add [rbx + total_cycles], rax
+				profiler_mem(assembler, true, { 0x2B }, uint8_t(Reg::rax), Reg::rcx, offsetof(ProfilerSlot, stack) + 8);
+				profiler_mem(assembler, true, { 0x01 }, uint8_t(Reg::rax), Reg::rbx, offsetof(ProfilerSlot, total_cycles));
+
+				// the bucket is the highest set bit
+				assembler.raw("\x48\x0F\xBD\xD0") // bsr rdx, rax
+					.jcc(Cond::nz, has_bucket)
+					.xor_(Reg::rdx, Reg::rdx)
+					.bind(has_bucket)
+					.cmp(Reg::rdx, int32_t(HookProfiler::histogram_buckets - 1))
+					.jcc(Cond::a, too_slow);
+			} else {
+				// sub eax, [ecx + start]
+				// sbb edx, [ecx + start + 4]
+				profiler_mem(assembler, false, { 0x2B }, uint8_t(Reg::eax), Reg::ecx, offsetof(ProfilerSlot, stack) + 8);
+				profiler_mem(assembler, false, { 0x1B }, uint8_t(Reg::edx), Reg::ecx, offsetof(ProfilerSlot, stack) + 12);
+
+				// add [ebx + total_cycles], eax
+				// adc [ebx + total_cycles + 4], edx
+				profiler_mem(assembler, false, { 0x01 }, uint8_t(Reg::eax), Reg::ebx, offsetof(ProfilerSlot, total_cycles));
+				profiler_mem(assembler, false, { 0x11 }, uint8_t(Reg::edx), Reg::ebx, offsetof(ProfilerSlot, total_cycles) + 4);
+
+				// the bucket is the highest set bit
+				assembler.cmp(Reg::edx, 0)
+					.jcc(Cond::ne, too_slow)
+					.raw("\x0F\xBD\xD0") // bsr edx, eax
+					.jcc(Cond::nz, has_bucket)
+					.xor_(Reg::edx, Reg::edx)
+					.bind(has_bucket)
+					.cmp(Reg::edx, int32_t(HookProfiler::histogram_buckets - 1))
+					.jcc(Cond::a, too_slow);
+			}
+
+			const auto record{ assembler.new_label() };
+			assembler.jmp(record)
+				.bind(too_slow)
+				.mov(Reg::rdx, uint64_t(HookProfiler::histogram_buckets - 1))
+				.bind(record);
+
+			// histogram[rdx] += 1
+			profiler_shift(assembler, 4, Reg::rdx, 3);
+			assembler.add(Reg::rdx, Reg::rbx);
+			profiler_inc64(assembler, Reg::rdx, offsetof(ProfilerSlot, histogram));
+
+			// mov rax, [rcx + return_address]
+			profiler_mem(assembler, true, { 0x8B }, uint8_t(Reg::rax), Reg::rcx, offsetof(ProfilerSlot, stack));
+			if (is64bit)
+				assembler.raw("\x48\x89\x44\x24", return_address_offset); // mov [rsp + 0x20], rax
+			else
+				assembler.raw("\x89\x44\x24", return_address_offset); // mov [esp + 0x10], eax
+
+			// restore everything, including the return value
+			assembler.pop(Reg::rbx)
+				.pop(Reg::rcx)
+				.pop(Reg::rdx)
+				.pop(Reg::rax)
+				.ret();
+
+			// can't happen, the slot was claimed when the call started
+			assembler.bind(crash)
+				.raw(uint8_t(0xCC));
+
+			return assembler.assemble(address);
+		}
+	} // namespace impl
+
+	// profile a virtual function
+	void HookProfiler::setup(VmtHook& hook, const size_t index, const SetupOptions& options) {
+		this->release();
+
+		const auto& process{ *hook.m_process };
+		this->allocate_stub(process, options);
+
+		ScopeGuard guard{ &HookProfiler::release, this };
+
+		// the stub needs to know the original before anything can call it
+		const auto address{ hook.m_vtable + process.get_ptr_size() * index };
+		this->write_stub(process.is_64bit() ?
+			uintptr_t(process.read<uint64_t>(address)) :
+			uintptr_t(process.read<uint32_t>(address)));
+
+		hook.hook(index, this->m_address);
+		this->m_unhook = [&hook, index]() { hook.unhook(index); };
+
+		guard.cancel();
+	}
+
+	// profile an imported function
+	void HookProfiler::setup(IatHook& hook, const std::string& module_name, const std::string& func_name, const SetupOptions& options) {
+		this->release();
+
+		const auto slot{ hook.find_slot(module_name, func_name) };
+		if (hook.find_hooked(slot))
+			throw FunctionAlreadyHooked{};
+
+		this->allocate_stub(*hook.m_process, options);
+
+		ScopeGuard guard{ &HookProfiler::release, this };
+
+		// the stub needs to know the original before anything can call it
+		this->write_stub(hook.m_process->is_64bit() ?
+			uintptr_t(hook.m_process->read<uint64_t>(slot)) :
+			uintptr_t(hook.m_process->read<uint32_t>(slot)));
+
+		hook.hook(module_name, func_name, this->m_address);
+		this->m_unhook = [&hook, module_name, func_name]() { hook.unhook(module_name, func_name); };
+
+		guard.cancel();
+	}
+
+	// profile any function with an inline hook
+	void HookProfiler::setup(const Process& process, const uintptr_t target, const SetupOptions& options) {
+		this->release();
+		this->allocate_stub(process, options);
+
+		ScopeGuard guard{ &HookProfiler::release, this };
+
+		// the trampoline is the original, so the jmp can only be written once the stub is done
+		this->m_inline_hook.setup(process, target, this->m_address, { .auto_enable = false });
+		this->write_stub(this->m_inline_hook.get_original());
+		this->m_inline_hook.enable();
+
+		this->m_unhook = [this]() { this->m_inline_hook.release(); };
+
+		guard.cancel();
+	}
+
+	// unhook and free the stub
+	void HookProfiler::release() {
+		if (!this->m_process)
+			return;
+
+		if (this->m_unhook) {
+			this->m_unhook();
+			this->m_unhook = nullptr;
+		}
+
+		// calls that are still in progress will return to the stub
+		if (this->get_calls_in_progress() == 0)
+			this->m_process->free_virt_mem(this->m_address);
+
+		this->m_process = nullptr;
+		this->m_address = 0;
+		this->m_original = 0;
+		this->m_retired_stats.clear();
+	}
+
+	// every thread combined
+	HookProfiler::Stats HookProfiler::get_stats() const {
+		Stats total{};
+		for (const auto& stats : this->get_thread_stats()) {
+			total.calls += stats.calls;
+			total.total_cycles += stats.total_cycles;
+
+			for (size_t i{ 0 }; i < histogram_buckets; ++i)
+				total.histogram[i] += stats.histogram[i];
+		}
+
+		return total;
+	}
+
+	// one entry for every thread that called the function
+	std::vector<HookProfiler::Stats> HookProfiler::get_thread_stats() const {
+		// too big for the stack
+		const auto data{ std::make_unique<impl::ProfilerData>() };
+		this->m_process->read(this->m_address + impl::profiler_code_size, data.get(), sizeof(impl::ProfilerData));
+
+		std::vector<Stats> threads{ this->m_retired_stats };
+		for (const auto& slot : data->slots) {
+			if (!slot.owner || slot.owner == impl::profiler_retired_owner)
+				continue;
+
+			Stats stats{ .tid = slot.owner, .calls = slot.calls, .total_cycles = slot.total_cycles };
+			std::copy(std::begin(slot.histogram), std::end(slot.histogram), stats.histogram.begin());
+			threads.push_back(stats);
+		}
+
+		return threads;
+	}
+
+	// give back the slots of threads that exited, returns how many were reclaimed
+	size_t HookProfiler::reclaim_slots() {
+		const auto& process{ *this->m_process };
+		const auto slots{ this->m_address + impl::profiler_code_size + offsetof(impl::ProfilerData, slots) };
+
+		// too big for the stack
+		const auto data{ std::make_unique<impl::ProfilerData>() };
+		process.read(this->m_address + impl::profiler_code_size, data.get(), sizeof(impl::ProfilerData));
+
+		size_t reclaimed{ 0 };
+		for (size_t i{ 0 }; i < max_threads; ++i) {
+			const auto owner{ data->slots[i].owner };
+			if (!owner || owner == impl::profiler_retired_owner || data->slots[i].depth ||
+				impl::is_profiled_thread_alive(process, uint32_t(owner)))
+				continue;
+
+			const auto address{ slots + sizeof(impl::ProfilerSlot) * i };
+
+			// nothing can find the slot while it's retired, so the stats can't change anymore
+			process.write<uint64_t>(address + offsetof(impl::ProfilerSlot, owner), impl::profiler_retired_owner);
+			const auto slot{ std::make_unique<impl::ProfilerSlot>() };
+			process.read(address, slot.get(), sizeof(impl::ProfilerSlot));
+
+			Stats stats{ .tid = owner, .calls = slot->calls, .total_cycles = slot->total_cycles };
+			std::copy(std::begin(slot->histogram), std::end(slot->histogram), stats.histogram.begin());
+			this->m_retired_stats.push_back(stats);
+
+			// clear the stats, and only then let another thread claim it
+			*slot = { .owner = impl::profiler_retired_owner };
+			process.write(address, slot.get(), sizeof(impl::ProfilerSlot));
+			process.write<uint64_t>(address + offsetof(impl::ProfilerSlot, owner), 0);
+
+			++reclaimed;
+		}
+
+		return reclaimed;
+	}
+
+	// calls made by threads that didn't get a slot (not timed)
+	uint64_t HookProfiler::get_overflow_calls() const {
+		return this->m_process->read<uint64_t>(this->m_address +
+			impl::profiler_code_size + offsetof(impl::ProfilerData, overflow_calls));
+	}
+
+	// allocate memory for the stub and its data
+	void HookProfiler::allocate_stub(const Process& process, const SetupOptions& options) {
+		this->m_address = uintptr_t(process.alloc_virt_mem(
+			impl::profiler_code_size + sizeof(impl::ProfilerData), PAGE_EXECUTE_READWRITE));
+
+		this->m_process = &process;
+		this->m_options = options;
+	}
+
+	// assemble and write the stub, now that the original is known
+	void HookProfiler::write_stub(const uintptr_t original) {
+		const auto& process{ *this->m_process };
+
+		const auto entry{ impl::profiler_entry_stub(process.is_64bit(), this->m_address, original) };
+		const auto post{ impl::profiler_post_stub(process.is_64bit(), this->m_address + impl::profiler_post_offset) };
+
+		// both are way smaller than this
+		assert(entry.size() <= impl::profiler_post_offset);
+		assert(impl::profiler_post_offset + post.size() <= impl::profiler_code_size);
+
+		entry.write(process, this->m_address);
+		post.write(process, this->m_address + impl::profiler_post_offset);
+
+		FlushInstructionCache(process.get_handle(), reinterpret_cast<void*>(this->m_address), impl::profiler_code_size);
+		this->m_original = original;
+	}
+
+	// number of profiled calls that haven't returned yet
+	uint64_t HookProfiler::get_calls_in_progress() const {
+		const auto data{ std::make_unique<impl::ProfilerData>() };
+		this->m_process->read(this->m_address + impl::profiler_code_size, data.get(), sizeof(impl::ProfilerData));
+
+		uint64_t calls{ 0 };
+		for (const auto& slot : data->slots)
+			calls += slot.depth;
+
+		return calls;
+	}
+} // namespace mango
\ No newline at end of file
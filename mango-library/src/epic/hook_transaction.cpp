@@ -0,0 +1,424 @@
+#include "../../include/epic/hook_transaction.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/epic/thread.h"
+#include "../../include/epic/vmt_hook.h"
+#include "../../include/epic/iat_hook.h"
+#include "../../include/epic/inline_hook.h"
+#include "../../include/misc/scope_guard.h"
+#include "../../include/misc/error_codes.h"
+
+#include <algorithm>
+
+
+namespace mango {
+	namespace impl {
+		// a run of pages that share the same protection
+		struct ProtectedRange {
+			uintptr_t address;
+			size_t size;
+			uint32_t protection;
+		};
+
+		constexpr size_t transaction_page_size = 0x1000;
+
+		bool is_writeable(const uint32_t protection) {
+			return protection == PAGE_READWRITE || protection == PAGE_EXECUTE_READWRITE;
+		}
+
+		bool is_executable(const uint32_t protection) {
+			return protection == PAGE_EXECUTE || protection == PAGE_EXECUTE_READ ||
+				protection == PAGE_EXECUTE_READWRITE || protection == PAGE_EXECUTE_WRITECOPY;
+		}
+
+		// every page that needs its protection changed, merged into as few ranges as possible
+		template <typename Patches>
+		std::vector<ProtectedRange> coalesce_pages(const Process& process, const Patches& patches) {
+			std::vector<uintptr_t> pages{};
+			for (const auto& patch : patches) {
+				const auto first{ patch.address & ~(transaction_page_size - 1) },
+					last{ (patch.address + patch.bytes.size() - 1) & ~(transaction_page_size - 1) };
+
+				for (auto page{ first }; page <= last; page += transaction_page_size)
+					pages.push_back(page);
+			}
+
+			std::sort(pages.begin(), pages.end());
+			pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+			std::vector<ProtectedRange> ranges{};
+			for (const auto page : pages) {
+				const auto protection{ process.get_mem_prot(page) };
+
+				// nothing to do
+				if (is_writeable(protection))
+					continue;
+
+				// extend the previous range if it's right before this page and has the same protection
+				if (!ranges.empty() && ranges.back().address + ranges.back().size == page &&
+					ranges.back().protection == protection) {
+					ranges.back().size += transaction_page_size;
+				} else {
+					ranges.push_back({ page, transaction_page_size, protection });
+				}
+			}
+
+			return ranges;
+		}
+
+		// the instruction pointer of a suspended thread, doesn't throw since it's called while threads are suspended
+		template <bool is64bit>
+		Expected<uintptr_t> try_get_instruction_pointer(const HANDLE thread) noexcept {
+#ifdef _WIN64
+			// GetThreadContext() vs Wow64GetThreadContext()
+			if constexpr (is64bit) {
+				CONTEXT context{ .ContextFlags = CONTEXT_CONTROL };
+				if (!GetThreadContext(thread, &context))
+					return Unexpected{ Status{ int32_t(GetLastError()) } };
+				return uintptr_t(context.Rip);
+			} else {
+				WOW64_CONTEXT context{ .ContextFlags = WOW64_CONTEXT_CONTROL };
+				if (!Wow64GetThreadContext(thread, &context))
+					return Unexpected{ Status{ int32_t(GetLastError()) } };
+				return uintptr_t(context.Eip);
+			}
+#else
+			// a 32bit process can only be working with other 32bit processes
+			CONTEXT context{ .ContextFlags = CONTEXT_CONTROL };
+			if (!GetThreadContext(thread, &context))
+				return Unexpected{ Status{ int32_t(GetLastError()) } };
+			return uintptr_t(context.Eip);
+#endif
+		}
+
+		// why HookTransaction::apply() failed, only thrown after every thread is resumed
+		// (building an exception allocates, and a suspended thread could own the heap lock)
+		struct ApplyFailure {
+			enum Reason {
+				none,
+				thread_context,
+				thread_inside_patch,
+				protection,
+				read,
+				write
+			} reason = none;
+
+			// GetLastError() for thread_context, an NTSTATUS for everything else
+			int32_t code = 0;
+		};
+
+		[[noreturn]] void throw_apply_failure(const ApplyFailure& failure) {
+			switch (failure.reason) {
+			case ApplyFailure::thread_context:
+				throw FailedToGetThreadContext{ mango_format_w32status(failure.code) };
+			case ApplyFailure::thread_inside_patch:
+				throw ThreadInsidePatchedCode{};
+			case ApplyFailure::protection:
+				throw FailedToSetMemoryProtection{ mango_format_ntstatus(failure.code) };
+			case ApplyFailure::read:
+				throw FailedToReadMemory{ mango_format_ntstatus(failure.code) };
+			default:
+				throw FailedToWriteMemory{ mango_format_ntstatus(failure.code) };
+			}
+		}
+	} // namespace impl
+
+	// queue raw bytes to be written
+	HookTransaction& HookTransaction::write(const uintptr_t address, const void* const data, const size_t size, const bool is_code) {
+		this->verify_not_committed();
+
+		const auto overlaps{ std::any_of(this->m_patches.begin(), this->m_patches.end(), [&](const Patch& patch) {
+			return address < patch.address + patch.bytes.size() && patch.address < address + size;
+		}) };
+
+		// the original bytes of the second one would be the first one's, so it couldn't be rolled back
+		if (overlaps)
+			throw HookTransactionOverlappingPatch{};
+
+		const auto bytes{ static_cast<const uint8_t*>(data) };
+		this->m_patches.push_back({ address, { bytes, bytes + size }, {}, is_code });
+		return *this;
+	}
+
+	// same as InlineHook::enable() and InlineHook::disable()
+	HookTransaction& HookTransaction::enable(InlineHook& hook) {
+		this->verify_not_committed();
+
+		if (!hook.m_process || hook.m_enabled)
+			return *this;
+
+		this->write(hook.m_target, hook.m_patch_bytes.data(), hook.m_patch_bytes.size(), true);
+		this->m_on_commit.push_back([&hook]() { hook.m_enabled = true; });
+		this->m_on_rollback.push_back([&hook]() { hook.m_enabled = false; });
+		return *this;
+	}
+	HookTransaction& HookTransaction::disable(InlineHook& hook) {
+		this->verify_not_committed();
+
+		if (!hook.m_process || !hook.m_enabled)
+			return *this;
+
+		this->write(hook.m_target, hook.m_original_bytes.data(), hook.m_original_bytes.size(), true);
+		this->m_on_commit.push_back([&hook]() { hook.m_enabled = false; });
+		this->m_on_rollback.push_back([&hook]() { hook.m_enabled = true; });
+		return *this;
+	}
+
+	// same as VmtHook::hook() and VmtHook::unhook()
+	uintptr_t HookTransaction::hook(VmtHook& hook, const size_t index, const uintptr_t func) {
+		this->verify_not_committed();
+
+		// if function already hooked
+		if (hook.m_original_funcs.find(index) != hook.m_original_funcs.end())
+			throw FunctionAlreadyHooked{};
+
+		const auto address{ hook.m_vtable + this->m_process->get_ptr_size() * index };
+
+		uintptr_t original{ 0 };
+		if (this->m_process->is_64bit()) {
+			original = uintptr_t(this->m_process->read<uint64_t>(address));
+			this->write<uint64_t>(address, func, false);
+		} else {
+			original = uintptr_t(this->m_process->read<uint32_t>(address));
+			this->write<uint32_t>(address, uint32_t(func), false);
+		}
+
+		this->m_on_commit.push_back([&hook, index, original]() { hook.m_original_funcs[index] = original; });
+		this->m_on_rollback.push_back([&hook, index]() { hook.m_original_funcs.erase(index); });
+		return original;
+	}
+	HookTransaction& HookTransaction::unhook(VmtHook& hook, const size_t index) {
+		this->verify_not_committed();
+
+		const auto it{ hook.m_original_funcs.find(index) };
+		if (it == hook.m_original_funcs.end())
+			return *this;
+
+		const auto address{ hook.m_vtable + this->m_process->get_ptr_size() * index },
+			original{ it->second };
+
+		this->m_process->is_64bit() ?
+			this->write<uint64_t>(address, original, false) :
+			this->write<uint32_t>(address, uint32_t(original), false);
+
+		this->m_on_commit.push_back([&hook, index]() { hook.m_original_funcs.erase(index); });
+		this->m_on_rollback.push_back([&hook, index, original]() { hook.m_original_funcs[index] = original; });
+		return *this;
+	}
+
+	// same as IatHook::hook() and IatHook::unhook()
+	uintptr_t HookTransaction::hook(IatHook& hook, const std::string_view module_name, const std::string_view func_name, const uintptr_t func) {
+		this->verify_not_committed();
+
+		const auto slot{ hook.find_slot(module_name, func_name) };
+
+		// make sure not hooked already
+		if (hook.find_hooked(slot))
+			throw FunctionAlreadyHooked{};
+
+		const auto original{ this->m_process->is_64bit() ?
+			uintptr_t(this->m_process->read<uint64_t>(slot)) :
+			uintptr_t(this->m_process->read<uint32_t>(slot)) };
+
+		this->m_process->is_64bit() ?
+			this->write<uint64_t>(slot, func, false) :
+			this->write<uint32_t>(slot, uint32_t(func), false);
+
+		this->m_on_commit.push_back([&hook, slot, original]() {
+			hook.m_hooked_funcs.push_back({ slot, original });
+		});
+		this->m_on_rollback.push_back([&hook, slot]() {
+			std::erase_if(hook.m_hooked_funcs, [slot](const auto& hooked) { return hooked.slot == slot; });
+		});
+		return original;
+	}
+	HookTransaction& HookTransaction::unhook(IatHook& hook, const std::string_view module_name, const std::string_view func_name) {
+		this->verify_not_committed();
+
+		const auto hooked{ hook.find_hooked(hook.find_slot(module_name, func_name)) };
+		if (!hooked) // not hooked
+			return *this;
+
+		const auto slot{ hooked->slot },
+			original{ hooked->original };
+
+		this->m_process->is_64bit() ?
+			this->write<uint64_t>(slot, original, false) :
+			this->write<uint32_t>(slot, uint32_t(original), false);
+
+		this->m_on_commit.push_back([&hook, slot]() {
+			std::erase_if(hook.m_hooked_funcs, [slot](const auto& hooked) { return hooked.slot == slot; });
+		});
+		this->m_on_rollback.push_back([&hook, slot, original]() {
+			hook.m_hooked_funcs.push_back({ slot, original });
+		});
+		return *this;
+	}
+
+	// apply every queued operation
+	void HookTransaction::commit() {
+		this->verify_not_committed();
+
+		this->apply(false);
+		this->m_committed = true;
+
+		for (const auto& callback : this->m_on_commit)
+			callback();
+	}
+
+	// undo everything that was committed
+	void HookTransaction::rollback() {
+		if (!this->m_committed)
+			return;
+
+		this->apply(true);
+		this->m_committed = false;
+
+		// in reverse, in case the same hook was touched more than once
+		for (auto it{ this->m_on_rollback.rbegin() }; it != this->m_on_rollback.rend(); ++it)
+			(*it)();
+	}
+
+	// forget about every operation (doesn't undo anything)
+	void HookTransaction::clear() noexcept {
+		this->m_patches.clear();
+		this->m_on_commit.clear();
+		this->m_on_rollback.clear();
+		this->m_committed = false;
+	}
+
+	// throws if operations can't be queued anymore
+	void HookTransaction::verify_not_committed() const {
+		if (this->m_committed)
+			throw HookTransactionAlreadyCommitted{};
+	}
+
+	// write the new bytes (or the original bytes) of every patch, all or nothing
+	void HookTransaction::apply(const bool undo) {
+		if (this->m_patches.empty())
+			return;
+
+		const auto& process{ *this->m_process };
+
+		// anything that allocates happens before suspending, one of the suspended threads could own the heap lock
+		std::vector<Thread> threads{};
+		for (const auto tid : process.get_threadids()) {
+			if (process.is_self() && tid == GetCurrentThreadId())
+				continue;
+
+			// the thread might have exited already
+			try {
+				threads.emplace_back(tid, Thread::SetupOptions{
+					.handle_access = THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION });
+			} catch (InvalidThreadHandle&) {}
+		}
+
+		const auto ranges{ impl::coalesce_pages(process, this->m_patches) };
+
+		if (!undo) {
+			for (auto& patch : this->m_patches)
+				patch.original.resize(patch.bytes.size());
+		}
+
+		// the part that runs while every other thread is suspended, nothing in here can throw (see impl::ApplyFailure)
+		const auto apply_suspended{ [&]() noexcept -> impl::ApplyFailure {
+			// make sure nothing is in the middle of executing code that's about to change
+			for (const auto& thread : threads) {
+				// this also makes sure the thread is actually suspended (SuspendThread() is asynchronous)
+				const auto ip{ process.is_64bit() ?
+					impl::try_get_instruction_pointer<true>(thread.get_handle()) :
+					impl::try_get_instruction_pointer<false>(thread.get_handle()) };
+
+				if (!ip)
+					return { impl::ApplyFailure::thread_context, ip.error().code };
+
+				for (const auto& patch : this->m_patches) {
+					// the start is fine, the thread will just run the new instruction
+					if (patch.is_code && *ip > patch.address && *ip < patch.address + patch.bytes.size())
+						return { impl::ApplyFailure::thread_inside_patch };
+				}
+			}
+
+			// one protection change per range instead of per patch
+			size_t protected_ranges{ 0 };
+			const ScopeGuard _protection_guard{ [&]() {
+				for (size_t i{ 0 }; i < protected_ranges; ++i)
+					process.try_set_mem_prot(ranges[i].address, ranges[i].size, ranges[i].protection);
+			} };
+
+			for (; protected_ranges < ranges.size(); ++protected_ranges) {
+				const auto& range{ ranges[protected_ranges] };
+				if (const auto result{ process.try_set_mem_prot(range.address, range.size,
+					impl::is_executable(range.protection) ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE) }; !result)
+				{
+					return { impl::ApplyFailure::protection, result.error().code };
+				}
+			}
+
+			const auto num_patches{ this->m_patches.size() };
+
+			// undo goes in reverse so overlapping patches end up with the right bytes
+			const auto get_patch{ [&](const size_t i) -> Patch& {
+				return this->m_patches[undo ? num_patches - i - 1 : i];
+			} };
+
+			for (size_t written{ 0 }; written < num_patches; ++written) {
+				auto& patch{ get_patch(written) };
+
+				impl::ApplyFailure failure{};
+				if (undo) {
+					if (const auto result{ process.try_write(patch.address, patch.original.data(), patch.original.size()) }; !result)
+						failure = { impl::ApplyFailure::write, result.error().code };
+				} else if (const auto result{ process.try_read(patch.address, patch.original.data(), patch.original.size()) }; !result) {
+					failure = { impl::ApplyFailure::read, result.error().code };
+				} else if (const auto result{ process.try_write(patch.address, patch.bytes.data(), patch.bytes.size()) }; !result) {
+					failure = { impl::ApplyFailure::write, result.error().code };
+				}
+
+				if (failure.reason == impl::ApplyFailure::none)
+					continue;
+
+				// put back whatever was already written
+				while (written--) {
+					const auto& written_patch{ get_patch(written) };
+					const auto& bytes{ undo ? written_patch.bytes : written_patch.original };
+					process.try_write(written_patch.address, bytes.data(), bytes.size());
+				}
+
+				return failure;
+			}
+
+			return {};
+		} };
+
+		// we can't suspend ourself, so suspend every other thread instead
+		if (process.is_self()) {
+			for (const auto& thread : threads)
+				SuspendThread(thread.get_handle());
+		} else {
+			process.suspend();
+		}
+
+		impl::ApplyFailure failure{};
+		{
+			const ScopeGuard _resume_guard{ [&]() {
+				if (process.is_self()) {
+					for (const auto& thread : threads)
+						ResumeThread(thread.get_handle());
+				} else {
+					process.resume();
+				}
+			} };
+
+			failure = apply_suspended();
+		}
+
+		if (failure.reason != impl::ApplyFailure::none)
+			impl::throw_apply_failure(failure);
+
+		for (const auto& patch : this->m_patches) {
+			if (patch.is_code)
+				FlushInstructionCache(process.get_handle(), reinterpret_cast<void*>(patch.address), patch.bytes.size());
+		}
+	}
+} // namespace mango
\ No newline at end of file
@@ -13,11 +13,9 @@ namespace mango {
 		this->m_options = options;
 		this->release();
 
-		// parse pe header
-		if (const LoadedModule pe_header{ process, module_address }; pe_header) {
-			this->m_iat = pe_header.get_imports();
-			this->m_process = &process;
-		}
+		// shared with every other hook on this module
+		this->m_index = ModuleIndex::get(process, module_address);
+		this->m_process = &process;
 	}
 
 	// unhooks everything
@@ -26,82 +24,88 @@ namespace mango {
 			return;
 
 		// unhook every function
-		for (const auto& [module_name, funcs] : this->m_hooked_funcs)
-			for (const auto& [func_name, address] : funcs)
-				this->hook_internal(module_name, func_name, address);
+		for (const auto& [slot, original] : this->m_hooked_funcs)
+			this->hook_internal(slot, original);
 
 		this->m_hooked_funcs.clear();
+		this->m_index = nullptr;
 		this->m_process = nullptr;
 	}
 
 	// hook a function
-	uintptr_t IatHook::hook(std::string module_name, const std::string& func_name, const uintptr_t func) {
-		str_tolower(module_name);
+	uintptr_t IatHook::hook(const std::string_view module_name, const std::string_view func_name, const uintptr_t func) {
+		const auto slot{ this->find_slot(module_name, func_name) };
 
 		// make sure not hooked already
-		if (const auto& functions{ this->m_hooked_funcs.find(module_name) }; functions != this->m_hooked_funcs.end()) {
-			if (functions->second.find(func_name) != functions->second.end())
-				throw FunctionAlreadyHooked{};
-		}
+		if (this->find_hooked(slot))
+			throw FunctionAlreadyHooked{};
 
 		// hook
-		const auto original{ this->hook_internal(module_name, func_name, func) };
-		if (original)
-			return (this->m_hooked_funcs[module_name][func_name] = original);
-		return 0;
+		const auto original{ this->hook_internal(slot, func) };
+		this->m_hooked_funcs.push_back({ slot, original });
+		return original;
 	}
 
 	// unhook
-	void IatHook::unhook(std::string module_name, const std::string& func_name) {
-		str_tolower(module_name);
-
-		const auto& functions{ this->m_hooked_funcs.find(module_name) };
-		if (functions == this->m_hooked_funcs.end()) // not hooked
-			return;
-
-		const auto& func{ functions->second.find(func_name) };
-		if (func == functions->second.end()) // not hooked
+	void IatHook::unhook(const std::string_view module_name, const std::string_view func_name) {
+		const auto hooked{ this->find_hooked(this->find_slot(module_name, func_name)) };
+		if (!hooked) // not hooked
 			return;
 
 		// unhook
-		if (this->hook_internal(module_name, func_name, func->second))
-			functions->second.erase(func);
+		this->hook_internal(hooked->slot, hooked->original);
+
+		// order doesn't matter
+		*hooked = this->m_hooked_funcs.back();
+		this->m_hooked_funcs.pop_back();
 	}
 
-	// this does all the heavy lifting
-	uintptr_t IatHook::hook_internal(const std::string& module_name, const std::string& func_name, const uintptr_t func) {
-		const auto it{ this->m_iat.find(module_name) };
-		if (it == this->m_iat.end())
+	// the address of the IAT slot, throws if the module or function isn't imported
+	uintptr_t IatHook::find_slot(const std::string_view module_name, const std::string_view func_name) const {
+		const auto module_hash{ ModuleIndex::hash_module_name(module_name) };
+
+		if (const auto slot{ this->m_index->find_import(module_hash, ModuleIndex::hash_func_name(func_name)) })
+			return *slot;
+
+		if (!this->m_index->has_import_module(module_hash))
 			throw FailedToFindImportModule{};
 
-		const auto entry{ it->second.find(func_name) };
-		if (entry == it->second.end())
-			throw FailedToFindImportFunction{};
+		throw FailedToFindImportFunction{};
+	}
 
-		// the address of where the virtual function is
-		const auto address{ entry->second.tableaddress };
+	// nullptr if not hooked
+	IatHook::HookedFunc* IatHook::find_hooked(const uintptr_t slot) noexcept {
+		const auto it{ std::find_if(this->m_hooked_funcs.begin(), this->m_hooked_funcs.end(),
+			[slot](const HookedFunc& hooked) { return hooked.slot == slot; }) };
+		return it == this->m_hooked_funcs.end() ? nullptr : &*it;
+	}
 
+	// overwrite the IAT slot, returns the previous value
+	uintptr_t IatHook::hook_internal(const uintptr_t slot, const uintptr_t func) {
 		if (this->m_process->is_64bit()) {
 			// set page protection to allow writing
-			const auto old_prot{ this->m_process->set_mem_prot(address, sizeof(uint64_t), PAGE_READWRITE) };
+			const auto old_prot{ this->m_process->set_mem_prot(slot, sizeof(uint64_t), PAGE_READWRITE) };
 
-			// overwrite
-			this->m_process->write<uint64_t>(address, func);
+			// remember the old value, then overwrite it
+			const auto original{ this->m_process->read<uint64_t>(slot) };
+			this->m_process->write<uint64_t>(slot, func);
 
 			// restore page protection to old value
-			this->m_process->set_mem_prot(address, sizeof(uint64_t), old_prot);
+			this->m_process->set_mem_prot(slot, sizeof(uint64_t), old_prot);
+
+			return uintptr_t(original);
 		} else {
 			// set page protection to allow writing
-			const auto old_prot{ this->m_process->set_mem_prot(address, sizeof(uint32_t), PAGE_READWRITE) };
+			const auto old_prot{ this->m_process->set_mem_prot(slot, sizeof(uint32_t), PAGE_READWRITE) };
 
-			// overwrite
-			this->m_process->write<uint32_t>(address, uint32_t(func));
+			// remember the old value, then overwrite it
+			const auto original{ this->m_process->read<uint32_t>(slot) };
+			this->m_process->write<uint32_t>(slot, uint32_t(func));
 
 			// restore page protection to old value
-			this->m_process->set_mem_prot(address, sizeof(uint32_t), old_prot);
-		}
+			this->m_process->set_mem_prot(slot, sizeof(uint32_t), old_prot);
 
-		// return original
-		return entry->second.address;
+			return uintptr_t(original);
+		}
 	}
 } // namespace mango
\ No newline at end of file
@@ -0,0 +1,316 @@
+#include "../../include/epic/inline_hook.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/epic/assembler.h"
+#include "../../include/epic/length_decoder.h"
+#include "../../include/epic/cave_allocator.h"
+#include "../../include/epic/unused_memory.h"
+#include "../../include/misc/scope_guard.h"
+#include "../../include/misc/error_codes.h"
+
+#include <algorithm>
+
+
+namespace mango {
+	namespace impl {
+		// jmp rel32
+		constexpr size_t inline_hook_patch_size = 5;
+
+		// the most a single relocated instruction can grow by (loop -> loop + jmp + absolute jmp)
+		constexpr size_t max_relocation_growth = 16;
+
+		// size of jmp qword ptr [rip]
+		constexpr size_t abs_jmp_size = 14;
+
+		// how far a rel32 is allowed to reach, with some room to spare
+		constexpr int64_t max_rel32_distance = 0x7FFF'0000;
+
+		// whether a rel32 at from can reach to
+		bool is_reachable(const uint64_t from, const uint64_t to) {
+			const auto distance{ int64_t(to - from) };
+			return distance >= -max_rel32_distance && distance <= max_rel32_distance;
+		}
+
+		// instructions that never fall through to the next one
+		bool is_terminator(const ild::Instruction& instruction) {
+			if (instruction.is_jmp())
+				return true;
+
+			if (instruction.map != ild::OpcodeMap::primary)
+				return false;
+
+			switch (instruction.opcode) {
+			case 0xC2: case 0xC3: // ret
+			case 0xCA: case 0xCB: // retf
+			case 0xCC: // int3
+				return true;
+			case 0xFF: // jmp r/m
+				return ((instruction.modrm >> 3) & 0b111) == 4 || ((instruction.modrm >> 3) & 0b111) == 5;
+			default:
+				return false;
+			}
+		}
+
+		// sign extended relative operand
+		int64_t read_rel(const uint8_t* const code, const ild::Instruction& instruction) {
+			switch (instruction.rel_size) {
+			case 1: return *reinterpret_cast<const int8_t*>(code + instruction.rel_offset);
+			case 2: return *reinterpret_cast<const int16_t*>(code + instruction.rel_offset);
+			default: return *reinterpret_cast<const int32_t*>(code + instruction.rel_offset);
+			}
+		}
+
+		// write over code in our own process without other threads seeing it half-written
+		void write_self(const uintptr_t address, const std::vector<uint8_t>& bytes) {
+			if (bytes.size() <= 8) {
+				// a single locked exchange (atomic even if unaligned)
+				const auto destination{ reinterpret_cast<volatile LONG64*>(address) };
+				for (LONG64 original{ *destination };;) {
+					auto desired{ original };
+					std::memcpy(&desired, bytes.data(), bytes.size());
+
+					const auto previous{ InterlockedCompareExchange64(destination, desired, original) };
+					if (previous == original)
+						break;
+
+					original = previous;
+				}
+			} else {
+				// park anything that reaches the start (jmp $) while the rest gets written
+				const auto start{ reinterpret_cast<volatile SHORT*>(address) };
+				InterlockedExchange16(start, SHORT(0xFEEB));
+
+				std::memcpy(reinterpret_cast<void*>(address + 2), bytes.data() + 2, bytes.size() - 2);
+
+				SHORT first{ 0 };
+				std::memcpy(&first, bytes.data(), sizeof(first));
+				InterlockedExchange16(start, first);
+			}
+		}
+	} // namespace impl
+
+	// hook the function at target, the hook is enabled right away
+	void InlineHook::setup(const Process& process, const uintptr_t target, const uintptr_t hook, const SetupOptions& options) {
+		this->release();
+
+		// enough for any sequence of instructions that covers the patch
+		uint8_t code[impl::inline_hook_patch_size + 14]{};
+		process.read(target, code, sizeof(code));
+
+		// steal whole instructions
+		size_t stolen_size{ 0 }, num_instructions{ 0 };
+		while (stolen_size < impl::inline_hook_patch_size) {
+			const auto instruction{ ild::decode(code + stolen_size, sizeof(code) - stolen_size, process.is_64bit()) };
+			if (!instruction)
+				throw FailedToDecodeInstruction{};
+
+			stolen_size += instruction.length;
+			++num_instructions;
+
+			// the function ends before there's enough room for the jmp
+			if (stolen_size < impl::inline_hook_patch_size && impl::is_terminator(instruction))
+				throw FunctionTooSmallToHook{};
+		}
+
+		this->m_process = &process;
+		this->m_options = options;
+		this->m_target = target;
+		this->m_hook = hook;
+
+		// clean up if anything below fails
+		ScopeGuard guard{ [&]() { this->release(); } };
+
+		// the trampoline needs its final address to relocate anything, so allocate for the worst case
+		this->allocate_trampoline(stolen_size + num_instructions * impl::max_relocation_growth + impl::abs_jmp_size * 2);
+
+		auto trampoline{ this->build_trampoline(code, stolen_size) };
+
+		const auto append{ [&](const Assembler& assembler) {
+			const auto shellcode{ assembler.assemble(this->m_trampoline + trampoline.size()) };
+			trampoline.insert(trampoline.end(), shellcode.get_data().begin(), shellcode.get_data().end());
+		} };
+
+		// jmp back to the rest of the function
+		append(Assembler{ process.is_64bit() }.jmp(target + stolen_size));
+
+		// go through a relay if the hook is out of rel32 range
+		auto destination{ hook };
+		if (process.is_64bit() && !impl::is_reachable(target + impl::inline_hook_patch_size, hook)) {
+			destination = this->m_trampoline + trampoline.size();
+			append(Assembler{ true }.jmp_abs(hook));
+		}
+
+		// code caves aren't writeable
+		const auto protection{ process.set_mem_prot(this->m_trampoline, trampoline.size(), PAGE_EXECUTE_READWRITE) };
+		process.write(this->m_trampoline, trampoline.data(), trampoline.size());
+		process.set_mem_prot(this->m_trampoline, trampoline.size(), protection);
+		FlushInstructionCache(process.get_handle(), reinterpret_cast<void*>(this->m_trampoline), trampoline.size());
+
+		// jmp hook, padded with int3 to the end of the last stolen instruction
+		this->m_original_bytes.assign(code, code + stolen_size);
+		const auto jump{ Assembler{ process.is_64bit() }.jmp(destination).assemble(target) };
+		this->m_patch_bytes.assign(jump.get_data().begin(), jump.get_data().end());
+		this->m_patch_bytes.resize(stolen_size, 0xCC);
+
+		if (options.auto_enable)
+			this->enable();
+
+		guard.cancel();
+	}
+
+	// unhooks and frees the trampoline
+	void InlineHook::release() {
+		if (!this->m_process)
+			return;
+
+		this->disable();
+
+		if (this->m_trampoline) {
+			if (this->m_is_code_cave) {
+				// give the code cave back, whoever gets it next overwrites it
+				this->m_process->get_cave_allocator().free(this->m_trampoline);
+			} else {
+				this->m_process->free_virt_mem(this->m_trampoline);
+			}
+		}
+
+		// reset
+		this->m_process = nullptr;
+		this->m_target = 0;
+		this->m_hook = 0;
+		this->m_trampoline = 0;
+		this->m_is_code_cave = false;
+		this->m_original_bytes.clear();
+		this->m_patch_bytes.clear();
+	}
+
+	// write or restore the jmp, the trampoline is kept around
+	void InlineHook::enable() {
+		if (!this->m_process || this->m_enabled)
+			return;
+
+		this->write_patch(this->m_patch_bytes);
+		this->m_enabled = true;
+	}
+	void InlineHook::disable() {
+		if (!this->m_process || !this->m_enabled)
+			return;
+
+		this->write_patch(this->m_original_bytes);
+		this->m_enabled = false;
+	}
+
+	// copy the stolen instructions to the trampoline, fixing up anything relative
+	std::vector<uint8_t> InlineHook::build_trampoline(const uint8_t* const code, const size_t stolen_size) const {
+		const auto is64bit{ this->m_process->is_64bit() };
+
+		std::vector<uint8_t> trampoline{};
+		for (size_t offset{ 0 }; offset < stolen_size;) {
+			const auto bytes{ code + offset };
+			const auto instruction{ ild::decode(bytes, stolen_size - offset, is64bit) };
+
+			// where the instruction was and where it's going
+			const auto next{ uint64_t(this->m_target + offset + instruction.length) };
+			const auto current{ uint64_t(this->m_trampoline + trampoline.size()) };
+
+			offset += instruction.length;
+
+			if (instruction.rel_size) {
+				auto destination{ next + impl::read_rel(bytes, instruction) };
+				if (!is64bit)
+					destination = uint32_t(destination);
+
+				// jumping back into the stolen bytes
+				if (destination > this->m_target && destination < this->m_target + stolen_size)
+					throw FailedToRelocateInstruction{};
+
+				// xbegin has no absolute form, same instruction with a new abort handler
+				if (instruction.is_xbegin()) {
+					if (instruction.rel_size != 4 || (is64bit && !impl::is_reachable(current + instruction.length, destination)))
+						throw FailedToRelocateInstruction{};
+
+					trampoline.insert(trampoline.end(), bytes, bytes + instruction.length);
+					*reinterpret_cast<int32_t*>(&trampoline[trampoline.size() - instruction.length + instruction.rel_offset]) =
+						int32_t(destination - (current + instruction.length));
+					continue;
+				}
+
+				// the assembler picks rel32 or an absolute form depending on the distance
+				Assembler assembler{ is64bit };
+				if (instruction.is_call()) {
+					assembler.call(destination);
+				} else if (instruction.is_jmp()) {
+					assembler.jmp(destination);
+				} else if (instruction.is_jcc()) {
+					assembler.jcc(Assembler::Cond(instruction.opcode & 0xF), destination);
+				} else {
+					// loop/jcxz only have a rel8 form:
+					//     loop taken
+					//     jmp skip
+					// taken:
+					//     jmp destination
+					// skip:
+					assembler.raw(std::vector<uint8_t>(bytes, bytes + instruction.opcode_offset + 1), uint8_t(2))
+						.raw(uint8_t(0xEB), uint8_t(is64bit ? impl::abs_jmp_size : 6))
+						.jmp_abs(destination);
+				}
+
+				const auto shellcode{ assembler.assemble(current) };
+				trampoline.insert(trampoline.end(), shellcode.get_data().begin(), shellcode.get_data().end());
+			} else if (instruction.is_rip_relative) {
+				const auto destination{ next + *reinterpret_cast<const int32_t*>(bytes + instruction.disp_offset) };
+				if (!impl::is_reachable(current + instruction.length, destination))
+					throw FailedToRelocateInstruction{};
+
+				// same instruction, new displacement
+				trampoline.insert(trampoline.end(), bytes, bytes + instruction.length);
+				*reinterpret_cast<int32_t*>(&trampoline[trampoline.size() - instruction.length + instruction.disp_offset]) =
+					int32_t(destination - (current + instruction.length));
+			} else {
+				trampoline.insert(trampoline.end(), bytes, bytes + instruction.length);
+			}
+		}
+
+		return trampoline;
+	}
+
+	// find (or allocate) memory within 2GB of the target for the trampoline
+	void InlineHook::allocate_trampoline(const size_t size) {
+		const auto is64bit{ this->m_process->is_64bit() };
+
+		// shared with every other hook in the process, only the modules near the target are searched
+		if (this->m_options.use_code_caves) {
+			if (const auto cave{ this->m_process->get_cave_allocator().allocate_near(
+				*this->m_process, this->m_target, size) }; cave) {
+				this->m_trampoline = cave;
+				this->m_is_code_cave = true;
+				return;
+			}
+		}
+
+		// rel32 can reach anywhere on x86
+		this->m_trampoline = is64bit ?
+			impl::allocate_near(*this->m_process, this->m_target, size) :
+			uintptr_t(this->m_process->alloc_virt_mem(size, PAGE_EXECUTE_READWRITE));
+	}
+
+	// write bytes over the start of the function
+	void InlineHook::write_patch(const std::vector<uint8_t>& bytes) const {
+		// the 8 byte exchange might touch a few bytes past the patch
+		const auto size{ std::max<size_t>(bytes.size(), 8) };
+		const auto protection{ this->m_process->set_mem_prot(this->m_target, size, PAGE_EXECUTE_READWRITE) };
+
+		if (this->m_process->is_self()) {
+			impl::write_self(this->m_target, bytes);
+		} else {
+			// nothing can run the function while it's half written
+			this->m_process->suspend();
+			const ScopeGuard _guard{ [&]() { this->m_process->resume(); } };
+
+			this->m_process->write(this->m_target, bytes.data(), bytes.size());
+		}
+
+		this->m_process->set_mem_prot(this->m_target, size, protection);
+		FlushInstructionCache(this->m_process->get_handle(), reinterpret_cast<void*>(this->m_target), bytes.size());
+	}
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,308 @@
+#include "../../include/epic/integrity_scanner.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/epic/loader.h"
+#include "../../include/epic/length_decoder.h"
+#include "../../include/misc/fnv_hash.h"
+#include "../../include/misc/scope_guard.h"
+#include "../../include/misc/error_codes.h"
+
+#include <Psapi.h>
+#include <emmintrin.h>
+
+#include <bit>
+#include <cstring>
+#include <algorithm>
+#include <execution>
+
+#undef min
+#undef max
+
+
+namespace mango {
+	namespace impl {
+		constexpr size_t integrity_page_size = 0x1000;
+
+		// how far back to start decoding from, x86 instructions re-synchronize pretty quickly
+		constexpr size_t integrity_decode_window = 0x20;
+
+		// the first index where a and b are different (or the same, if equal is true), size if there is none
+		template <bool equal>
+		size_t find_first_byte(const uint8_t* const a, const uint8_t* const b, size_t offset, const size_t size) noexcept {
+			// 16 bytes at a time
+			for (; offset + 16 <= size; offset += 16) {
+				const auto result{ _mm_cmpeq_epi8(
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + offset)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + offset))) };
+
+				// one bit per byte that was the same
+				auto mask{ uint32_t(_mm_movemask_epi8(result)) };
+				if constexpr (!equal)
+					mask = ~mask & 0xFFFF;
+
+				if (mask)
+					return offset + std::countr_zero(mask);
+			}
+
+			// the last few bytes
+			for (; offset < size; ++offset) {
+				if ((a[offset] == b[offset]) == equal)
+					return offset;
+			}
+
+			return size;
+		}
+
+		// fnv1a, 8 bytes at a time
+		uint64_t hash_page(const uint8_t* const data, const size_t size) noexcept {
+			auto hash = fnv1_offset_v<uint64_t>;
+
+			size_t i{ 0 };
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+				uint64_t value;
+				std::memcpy(&value, data + i, sizeof(value));
+				hash = (hash ^ value) * fnv1_prime_v<uint64_t>;
+			}
+
+			for (; i < size; ++i)
+				hash = (hash ^ data[i]) * fnv1_prime_v<uint64_t>;
+
+			return hash;
+		}
+
+		// expand [start, end) to start and end on instruction boundaries
+		std::pair<size_t, size_t> align_to_instructions(const uint8_t* const code, const size_t size,
+			const size_t start, const size_t end, const bool is64bit) noexcept
+		{
+			const auto next{ [&](const size_t offset) -> size_t {
+				// treat anything that can't be decoded as a single byte
+				const auto instruction{ ild::decode(code + offset, size - offset, is64bit) };
+				return offset + (instruction ? instruction.length : 1);
+			} };
+
+			// find the instruction that contains start
+			auto current{ start > integrity_decode_window ? start - integrity_decode_window : 0 };
+			for (auto following{ next(current) }; following <= start; following = next(current))
+				current = following;
+
+			const auto aligned_start{ current };
+
+			// and the one that contains the last byte
+			while (current < end)
+				current = next(current);
+
+			return { aligned_start, std::min(current, size) };
+		}
+	} // namespace impl
+
+	// scan a single module
+	std::vector<IntegrityScanner::Patch> IntegrityScanner::scan(const uintptr_t image_base) {
+		const auto dos_header{ this->m_process->read<IMAGE_DOS_HEADER>(image_base) };
+		const auto file_header{ this->m_process->read<IMAGE_FILE_HEADER>(image_base + dos_header.e_lfanew + sizeof(uint32_t)) };
+
+		// map the file again if a different module was loaded here
+		auto it{ this->m_modules.find(image_base) };
+		if (it == this->m_modules.end() || it->second.timestamp != file_header.TimeDateStamp)
+			it = this->m_modules.insert_or_assign(image_base, this->load_module(image_base, file_header.TimeDateStamp)).first;
+
+		// sections don't share anything, so they can all be compared at the same time
+		auto& sections{ it->second.sections };
+		std::for_each(std::execution::par, sections.begin(), sections.end(), [this](Section& section) {
+			this->scan_section(section);
+		});
+
+		std::vector<Patch> patches{};
+		for (const auto& section : sections)
+			this->collect_patches(section, patches);
+
+		return patches;
+	}
+
+	// scan every module in Process::get_modules(), only modules with patches are returned
+	std::vector<IntegrityScanner::ModuleReport> IntegrityScanner::scan_all() {
+		std::vector<ModuleReport> reports{};
+
+		for (const auto& [name, mod] : this->m_process->get_modules()) {
+			try {
+				if (auto patches{ this->scan(mod.get_image_base()) }; !patches.empty())
+					reports.push_back({ name, mod.get_image_base(), std::move(patches) });
+			} catch (const MangoError&) {
+				// no file to compare against (manually mapped, or the file was deleted)
+				continue;
+			}
+		}
+
+		return reports;
+	}
+
+	// map the module's file and copy its executable sections
+	IntegrityScanner::Module IntegrityScanner::load_module(const uintptr_t image_base, const uint32_t timestamp) const {
+		// the file that the image was mapped from, as a device path (\Device\HarddiskVolume1\...)
+		char device_path[MAX_PATH * 2];
+		if (!GetMappedFileNameA(this->m_process->get_handle(), reinterpret_cast<void*>(image_base), device_path, sizeof(device_path)))
+			throw FailedToQueryMappedFileName{ mango_format_w32status(GetLastError()) };
+
+		// device paths can be opened through GLOBALROOT, which also avoids wow64 file system redirection
+		const auto path{ std::string{ enc_str("\\\\?\\GLOBALROOT") } + device_path };
+
+		const auto file_handle{ CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+
+		// invalid handle
+		if (file_handle == INVALID_HANDLE_VALUE)
+			throw InvalidFileHandle{ mango_format_w32status(GetLastError()) };
+
+		// make sure we close the handle!
+		const ScopeGuard _file_guard{ &CloseHandle, file_handle };
+
+		LARGE_INTEGER file_size{};
+		if (!GetFileSizeEx(file_handle, &file_size))
+			throw InvalidFileSize{ mango_format_w32status(GetLastError()) };
+
+		const auto mapping{ CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+		if (!mapping)
+			throw FailedToMapFile{ mango_format_w32status(GetLastError()) };
+
+		const ScopeGuard _mapping_guard{ &CloseHandle, mapping };
+
+		const auto view{ MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) };
+		if (!view)
+			throw FailedToMapFile{ mango_format_w32status(GetLastError()) };
+
+		const ScopeGuard _view_guard{ &UnmapViewOfFile, view };
+
+		// what the image looks like right after being loaded
+		const auto image{ map_image(static_cast<const uint8_t*>(view), size_t(file_size.QuadPart), image_base) };
+		const auto nt_header{ PIMAGE_NT_HEADERS(image.data() + PIMAGE_DOS_HEADER(image.data())->e_lfanew) };
+
+		// the data directories are at a different offset in 32bit images
+		const auto iat_directory{ nt_header->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC ?
+			PIMAGE_NT_HEADERS64(nt_header)->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IAT] :
+			PIMAGE_NT_HEADERS32(nt_header)->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IAT] };
+
+		Module mod{ timestamp };
+
+		const auto section_headers{ IMAGE_FIRST_SECTION(nt_header) };
+		for (size_t i{ 0 }; i < nt_header->FileHeader.NumberOfSections; ++i) {
+			const auto& header{ section_headers[i] };
+			if (!(header.Characteristics & IMAGE_SCN_MEM_EXECUTE) || header.VirtualAddress >= image.size())
+				continue;
+
+			// some linkers leave VirtualSize as 0
+			const auto start{ size_t(header.VirtualAddress) };
+			const auto size{ std::min(size_t(header.Misc.VirtualSize ? header.Misc.VirtualSize : header.SizeOfRawData), image.size() - start) };
+
+			Section section{
+				image_base + start,
+				std::vector<uint8_t>(image.begin() + start, image.begin() + start + size)
+			};
+
+			// the loader fills in the IAT, so it never matches the file
+			const auto iat_start{ std::max(size_t(iat_directory.VirtualAddress), start) },
+				iat_end{ std::min(size_t(iat_directory.VirtualAddress) + iat_directory.Size, start + size) };
+			if (iat_directory.VirtualAddress && iat_start < iat_end)
+				section.ignored.emplace_back(iat_start - start, iat_end - start);
+
+			section.pages.resize((size + impl::integrity_page_size - 1) / impl::integrity_page_size);
+			mod.sections.push_back(std::move(section));
+		}
+
+		return mod;
+	}
+
+	// update the differences of every page
+	void IntegrityScanner::scan_section(Section& section) const {
+		const auto size{ section.original.size() };
+
+		// pages that were never written to are still shared with the file mapping, so they can't have been modified
+		std::vector<PSAPI_WORKING_SET_EX_INFORMATION> working_set(section.pages.size());
+		for (size_t i{ 0 }; i < working_set.size(); ++i)
+			working_set[i].VirtualAddress = reinterpret_cast<void*>(section.address + i * impl::integrity_page_size);
+
+		const auto queried{ QueryWorkingSetEx(this->m_process->get_handle(),
+			working_set.data(), DWORD(working_set.size() * sizeof(working_set[0]))) };
+
+		uint8_t buffer[impl::integrity_page_size];
+		for (size_t i{ 0 }; i < section.pages.size(); ++i) {
+			auto& page{ section.pages[i] };
+
+			const auto offset{ i * impl::integrity_page_size },
+				page_size{ std::min(impl::integrity_page_size, size - offset) };
+			const auto original{ section.original.data() + offset };
+
+			if (queried && working_set[i].VirtualAttributes.Valid && working_set[i].VirtualAttributes.Shared) {
+				page.differences.clear();
+				page.compared = false;
+				continue;
+			}
+
+			// keep the previous results
+			if (!this->m_process->try_read(section.address + offset, buffer, page_size))
+				continue;
+
+			// make the ignored bytes match
+			for (const auto& [start, end] : section.ignored) {
+				const auto first{ std::max(start, offset) },
+					last{ std::min(end, offset + page_size) };
+				if (first < last)
+					std::memcpy(buffer + (first - offset), original + (first - offset), last - first);
+			}
+
+			// nothing changed since the last time it was compared
+			const auto hash{ impl::hash_page(buffer, page_size) };
+			if (page.compared && page.hash == hash)
+				continue;
+
+			page.hash = hash;
+			page.compared = true;
+			page.differences.clear();
+
+			// every run of bytes that don't match
+			for (auto start{ impl::find_first_byte<false>(buffer, original, 0, page_size) }; start < page_size;) {
+				const auto end{ impl::find_first_byte<true>(buffer, original, start, page_size) };
+				page.differences.push_back({ offset + start, std::vector<uint8_t>(buffer + start, buffer + end) });
+				start = impl::find_first_byte<false>(buffer, original, end, page_size);
+			}
+		}
+	}
+
+	// turn the differences of every page into instruction aligned patches
+	void IntegrityScanner::collect_patches(const Section& section, std::vector<Patch>& patches) const {
+		const auto code{ section.original.data() };
+		const auto size{ section.original.size() };
+
+		// [start, end) of the last patch in this section, relative to the section
+		size_t patch_start{ 0 }, patch_end{ 0 };
+		bool has_patch{ false };
+
+		for (const auto& page : section.pages) {
+			for (const auto& difference : page.differences) {
+				const auto [start, end] { impl::align_to_instructions(code, size,
+					difference.offset, difference.offset + difference.bytes.size(), this->m_process->is_64bit()) };
+
+				if (has_patch && start <= patch_end) {
+					// part of the same patch (or the same instruction)
+					if (end > patch_end) {
+						patches.back().original.insert(patches.back().original.end(), code + patch_end, code + end);
+						patches.back().current.insert(patches.back().current.end(), code + patch_end, code + end);
+						patch_end = end;
+					}
+				} else {
+					patches.push_back({
+						section.address + start,
+						std::vector<uint8_t>(code + start, code + end),
+						std::vector<uint8_t>(code + start, code + end)
+					});
+
+					patch_start = start;
+					patch_end = end;
+					has_patch = true;
+				}
+
+				// the modified bytes on top of the original ones
+				std::memcpy(patches.back().current.data() + (difference.offset - patch_start),
+					difference.bytes.data(), difference.bytes.size());
+			}
+		}
+	}
+} // namespace mango
\ No newline at end of file
@@ -16,6 +16,7 @@ namespace mango {
 		// reset
 		m_exported_funcs.clear();
 		m_imported_funcs.clear();
+		m_sections.clear();
 
 		this->m_image_base = address;
 		this->m_is_valid = false; // not valid yet, setup_internal() could throw exceptions
@@ -52,17 +53,17 @@ namespace mango {
 		// make sure the image architecture matches
 		if constexpr (is64bit) {
 			if (nt_header.FileHeader.Machine == IMAGE_FILE_MACHINE_I386)
-				throw UnmatchingImageArchitecture{ enc_str("x86 image detected.") };
+				throw UnmatchingImageArchitecture{ enc_str_view("x86 image detected.") };
 		} else {
 			if (nt_header.FileHeader.Machine == IMAGE_FILE_MACHINE_AMD64)
-				throw UnmatchingImageArchitecture{ enc_str("x64 image detected.") };
+				throw UnmatchingImageArchitecture{ enc_str_view("x64 image detected.") };
 		}
 
 		// size of image
 		this->m_image_size = nt_header.OptionalHeader.SizeOfImage;
 
-		// section sizes are a multiple of this
-		this->m_section_alignment = nt_header.OptionalHeader.FileAlignment;
+		// sections are mapped at a multiple of this (FileAlignment is only for the file on disk)
+		this->m_section_alignment = nt_header.OptionalHeader.SectionAlignment;
 
 		// iterate through each section
 		for (uintptr_t i{ 0 }; i < nt_header.FileHeader.NumberOfSections; ++i) {
@@ -111,7 +112,8 @@ namespace mango {
 			// address of the function
 			const auto addr{ address + process.read<uint32_t>(table_addr) };
 
-			this->m_exported_funcs[name] = PeEntry{ addr, table_addr };
+			// allocated from the same resource as the map, so it isn't copied again
+			this->m_exported_funcs.insert_or_assign(std::pmr::string{ name, this->m_exported_funcs.get_allocator() }, PeEntry{ addr, table_addr });
 		}
 
 		const auto imports_directory{ nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT] };
@@ -139,7 +141,8 @@ namespace mango {
 			str_tolower(module_name);
 
 			// we fill this with entries
-			auto& imported_funcs{ this->m_imported_funcs[module_name] };
+			auto& imported_funcs{ this->m_imported_funcs.try_emplace(
+				std::pmr::string{ module_name, this->m_imported_funcs.get_allocator() }).first->second };
 
 			// iterate through each thunk
 			for (uintptr_t j{ 0 }; true; j += sizeof(ImageThunkData)) {
@@ -156,25 +159,25 @@ namespace mango {
 				func_name[255] = '\0';
 
 				// cache the data
-				imported_funcs[func_name] = PeEntry{
+				imported_funcs.insert_or_assign(std::pmr::string{ func_name, imported_funcs.get_allocator() }, PeEntry{
 					uintptr_t(*thunk),
 					address + iat_entry->FirstThunk + j
-				};
+				});
 			}
 		}
 	}
 
 	// get exported functions
 	std::optional<LoadedModule::PeEntry> LoadedModule::get_export(const std::string_view func_name) const {
-		if (const auto it{ this->m_exported_funcs.find(std::string{ func_name }) }; it != m_exported_funcs.end())
+		if (const auto it{ this->m_exported_funcs.find(func_name) }; it != m_exported_funcs.end())
 			return it->second;
 		return {};
 	}
 
 	// get imported functions
 	std::optional<LoadedModule::PeEntry> LoadedModule::get_import(const std::string_view module_name, const std::string_view func_name) const {	
-		if (const auto it{ m_imported_funcs.find(std::string{ module_name }) }; it != m_imported_funcs.end())
-			if (const auto it2{ it->second.find(std::string{ func_name }) }; it2 != it->second.end())
+		if (const auto it{ m_imported_funcs.find(module_name) }; it != m_imported_funcs.end())
+			if (const auto it2{ it->second.find(func_name) }; it2 != it->second.end())
 				return it2->second;
 		return {};
 	}
@@ -7,9 +7,12 @@
 #include "../../include/misc/scope_guard.h"
 #include "../../include/misc/error_codes.h"
 #include "../../include/misc/memory_allocator.h"
+#include "../../include/misc/fnv_hash.h"
 #include "../../include/crypto/string_encryption.h"
 
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
 
 #undef min
 
@@ -66,45 +69,82 @@ namespace mango {
 		void end_stub() {}
 #endif
 
-		// fix base relocations in the image
+		// fix base relocations in a mapped image
 		template <typename Ptr>
-		void fix_image_relocations(const mango::Process& process, const Ptr module_base, const Ptr delta, const Ptr reloc_dir_addr) {
-			auto base_reloc_addr{ module_base + reloc_dir_addr };
+		void fix_image_relocations(uint8_t* const image, const size_t image_size, const Ptr delta, const IMAGE_DATA_DIRECTORY& reloc_dir) {
+			struct RelocEntry {
+				uint16_t offset : 12,
+					type : 4;
+			};
 
 			// fix up relocations
-			while (true) {
-				const auto base_reloc{ process.read<IMAGE_BASE_RELOCATION>(base_reloc_addr) };
-				if (!base_reloc.VirtualAddress)
-					break;
+			for (size_t offset{ 0 }; offset + sizeof(IMAGE_BASE_RELOCATION) <= reloc_dir.Size;) {
+				if (reloc_dir.VirtualAddress + offset + sizeof(IMAGE_BASE_RELOCATION) > image_size)
+					throw InvalidPEHeader{};
 
-				struct RelocEntry {
-					uint16_t offset : 12,
-						type : 4;
-				};
+				const auto base_reloc{ reinterpret_cast<const IMAGE_BASE_RELOCATION*>(image + reloc_dir.VirtualAddress + offset) };
+				if (!base_reloc->VirtualAddress || base_reloc->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION))
+					break;
 
 				// the IMAGE_BASE_RELOCATION is included in the SizeOfBlock
-				const auto num_entries{ (base_reloc.SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(RelocEntry) };
-				const auto relocations_addr{ base_reloc_addr + sizeof(IMAGE_BASE_RELOCATION) };
+				const auto num_entries{ (base_reloc->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(RelocEntry) };
+				const auto relocations{ reinterpret_cast<const RelocEntry*>(base_reloc + 1) };
+
+				if (reloc_dir.VirtualAddress + offset + base_reloc->SizeOfBlock > image_size)
+					throw InvalidPEHeader{};
 
 				// fix each relocation in the block
 				for (size_t i{ 0 }; i < num_entries; i++) {
-					const auto entry{ process.read<RelocEntry>(relocations_addr + sizeof(RelocEntry) * i) };
-					const auto address{ module_base + base_reloc.VirtualAddress + entry.offset };
-
-					if (entry.type == IMAGE_REL_BASED_HIGHLOW) {
-						const auto value = process.read<uint32_t>(address);
-						process.write(address, uint32_t(value + delta));
-					} else if (entry.type == IMAGE_REL_BASED_DIR64) {
-						const auto value = process.read<uint64_t>(address);
-						process.write(address, uint64_t(value + delta));
+					const auto address{ size_t(base_reloc->VirtualAddress) + relocations[i].offset };
+
+					if (relocations[i].type == IMAGE_REL_BASED_HIGHLOW && address + sizeof(uint32_t) <= image_size) {
+						uint32_t value; std::memcpy(&value, image + address, sizeof(value));
+						value = uint32_t(value + delta);
+						std::memcpy(image + address, &value, sizeof(value));
+					} else if (relocations[i].type == IMAGE_REL_BASED_DIR64 && address + sizeof(uint64_t) <= image_size) {
+						uint64_t value; std::memcpy(&value, image + address, sizeof(value));
+						value = uint64_t(value + delta);
+						std::memcpy(image + address, &value, sizeof(value));
 					}
 				}
 
 				// go to next block
-				base_reloc_addr += base_reloc.SizeOfBlock;
+				offset += base_reloc->SizeOfBlock;
 			}
 		}
 
+		// copy the headers and sections to where they'd be in memory, then relocate
+		template <bool is64bit>
+		std::vector<uint8_t> map_image_internal(const uint8_t* const image, const size_t size, const uintptr_t image_base) {
+			using Ptr = PtrType<is64bit>;
+			using PImageNtHeaders = std::conditional_t<is64bit, PIMAGE_NT_HEADERS64, PIMAGE_NT_HEADERS32>;
+
+			const auto nt_header{ PImageNtHeaders(image + PIMAGE_DOS_HEADER(image)->e_lfanew) };
+			const auto image_size{ size_t(nt_header->OptionalHeader.SizeOfImage) };
+
+			std::vector<uint8_t> mapped(image_size);
+
+			// copy the pe header
+			std::memcpy(mapped.data(), image, std::min({ size_t(nt_header->OptionalHeader.SizeOfHeaders), image_size, size }));
+
+			// copy each section
+			const auto section_headers{ PIMAGE_SECTION_HEADER(nt_header + 1) };
+			for (size_t i{ 0 }; i < nt_header->FileHeader.NumberOfSections; i++) {
+				const auto& section{ section_headers[i] };
+				if (section.VirtualAddress >= image_size || section.PointerToRawData >= size)
+					continue;
+
+				std::memcpy(mapped.data() + section.VirtualAddress, image + section.PointerToRawData, std::min({
+					size_t(section.SizeOfRawData), image_size - section.VirtualAddress, size - section.PointerToRawData }));
+			}
+
+			// fix relocations
+			fix_image_relocations<Ptr>(mapped.data(), image_size, Ptr(image_base) - Ptr(nt_header->OptionalHeader.ImageBase),
+				nt_header->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC]);
+
+			return mapped;
+		}
+
 		// the real "meat" of manual_map()
 		template <bool is64bit>
 		uintptr_t manual_map_internal(const mango::Process& process, const uint8_t* const image) {
@@ -124,29 +164,18 @@ namespace mango {
 			// make sure the image architecture matches
 			if constexpr (is64bit) {
 				if (nt_header->FileHeader.Machine == IMAGE_FILE_MACHINE_I386)
-					throw mango::UnmatchingImageArchitecture{ enc_str("x86 image detected.") };
+					throw mango::UnmatchingImageArchitecture{ enc_str_view("x86 image detected.") };
 			} else {
 				if (nt_header->FileHeader.Machine == IMAGE_FILE_MACHINE_AMD64)
-					throw mango::UnmatchingImageArchitecture{ enc_str("x64 image detected.") };
+					throw mango::UnmatchingImageArchitecture{ enc_str_view("x64 image detected.") };
 			}
 
 			// base address of the module in memory
 			const auto module_base{ uintptr_t(process.alloc_virt_mem(nt_header->OptionalHeader.SizeOfImage, PAGE_EXECUTE_READWRITE)) };
 
-			// copy the pe header to memory
-			process.write(module_base, image, nt_header->OptionalHeader.SizeOfHeaders);
-
-			// copy each section to memory
-			const auto section_headers{ PIMAGE_SECTION_HEADER(nt_header + 1) };
-			for (size_t i{ 0 }; i < nt_header->FileHeader.NumberOfSections; i++) {
-				process.write(module_base + section_headers[i].VirtualAddress,
-					image + section_headers[i].PointerToRawData, section_headers[i].SizeOfRawData);
-			}
-
-			// fix relocations
-			const auto reloc_delta{ Ptr(module_base) - Ptr(nt_header->OptionalHeader.ImageBase) };
-			const auto reloc_dir_addr{ nt_header->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress };
-			fix_image_relocations<Ptr>(process, Ptr(module_base), reloc_delta, reloc_dir_addr);
+			// map and relocate locally, then copy everything over at once
+			const auto mapped{ map_image_internal<is64bit>(image, SIZE_MAX, module_base) };
+			process.write(module_base, mapped.data(), mapped.size());
 
 			// shellcode for the loader thread
 			mango::Shellcode shellcode{};
@@ -293,10 +322,13 @@ namespace mango {
 			}
 
 			// arguments to pass to the loader thread
+			constexpr size_t kernel32_hash{ Fnv1a<>("kernel32.dll") },
+				get_proc_address_hash{ Fnv1a<>("GetProcAddress") },
+				load_library_hash{ Fnv1a<>("LoadLibraryA") };
 			const ManualMapData<Ptr> data{
 				.modulebase     = Ptr(module_base),
-				.getprocaddress = Ptr(process.get_proc_addr(enc_str("kernel32.dll"), enc_str("GetProcAddress"))),
-				.loadlibrary    = Ptr(process.get_proc_addr(enc_str("kernel32.dll"), enc_str("LoadLibraryA")))
+				.getprocaddress = Ptr(process.get_proc_addr(kernel32_hash, get_proc_address_hash)),
+				.loadlibrary    = Ptr(process.get_proc_addr(kernel32_hash, load_library_hash))
 			};
 
 			// allocate and copy the loader data to the process's memory space
@@ -313,7 +345,8 @@ namespace mango {
 
 	// inject a dll into another process (using LoadLibrary)
 	uintptr_t load_library(const Process& process, const std::string_view dll_path) {
-		const auto func_addr{ process.get_proc_addr(enc_str("kernel32.dll"), enc_str("LoadLibraryA")) };
+		constexpr size_t kernel32_hash{ Fnv1a<>("kernel32.dll") }, load_library_hash{ Fnv1a<>("LoadLibraryA") };
+		const auto func_addr{ process.get_proc_addr(kernel32_hash, load_library_hash) };
 		if (!func_addr)
 			throw FailedToGetFunctionAddress{};
 
@@ -399,4 +432,23 @@ namespace mango {
 			impl::manual_map_internal<true>(process, image) :
 			impl::manual_map_internal<false>(process, image);
 	}
+
+	// copy the headers and sections of a raw image to where they'd be in memory, relocated for image_base
+	std::vector<uint8_t> map_image(const uint8_t* const image, const size_t size, const uintptr_t image_base) {
+		const auto dos_header{ PIMAGE_DOS_HEADER(image) };
+		if (size < sizeof(IMAGE_DOS_HEADER) || dos_header->e_magic != IMAGE_DOS_SIGNATURE)
+			throw InvalidPEHeader{};
+
+		if (size_t(dos_header->e_lfanew) + sizeof(IMAGE_NT_HEADERS64) > size)
+			throw InvalidPEHeader{};
+
+		// the optional header magic tells us the architecture
+		const auto nt_header{ PIMAGE_NT_HEADERS32(image + dos_header->e_lfanew) };
+		if (nt_header->Signature != IMAGE_NT_SIGNATURE)
+			throw InvalidPEHeader{};
+
+		return nt_header->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC ?
+			impl::map_image_internal<true>(image, size, image_base) :
+			impl::map_image_internal<false>(image, size, image_base);
+	}
 } // namespace mango
\ No newline at end of file
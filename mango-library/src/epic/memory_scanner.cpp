@@ -28,6 +28,69 @@ namespace {
 
 		return value;
 	}
+
+	// the whole module
+	mango::memscn::Range get_module_range(const mango::Process& process, const std::string_view modulename) {
+		if (const auto m(process.get_module(modulename)); m) {
+			return mango::memscn::Range{
+				.start = m->get_image_base(),
+				.size = m->get_image_size() };
+		}
+
+		throw mango::FailedToFindModule();
+	}
+
+	template <typename Results>
+	void find_matches(const mango::Process& process, const mango::memscn::Pattern& pattern, const mango::memscn::Range& range,
+		const mango::memscn::Filter& filter, Results& matching, std::pmr::memory_resource* const resource)
+	{
+		// to deal with unsigned overflow
+		const auto rangeend = range.start + 
+			std::min(range.size, uintptr_t(-1) - range.start);
+
+		uintptr_t address = range.start;
+
+		// reused for every region, only grows
+		std::pmr::vector<uint8_t> buffer{ resource };
+
+		// iterate through each memory region
+		MEMORY_BASIC_INFORMATION info;
+		while (sizeof(info) == VirtualQueryEx(process.get_handle(),
+			reinterpret_cast<void*>(address), &info, sizeof(info))) 
+		{
+			address = uintptr_t(info.BaseAddress) + info.RegionSize;
+
+			// useless to us, skip
+			if (info.State != MEM_COMMIT || info.Protect & PAGE_GUARD || info.Protect & PAGE_NOACCESS)
+				continue;
+
+			// ignore filtered areas
+			if (!filter(info.Protect))
+				continue;
+
+			const auto blockstart = std::max(uintptr_t(info.BaseAddress), range.start);
+			const auto blocksize = std::min(rangeend, address) - blockstart;
+
+			// impossible for pattern to be in the memory
+			if (blocksize < pattern.size())
+				continue;
+
+			// read the memory (it could've been freed or protected since VirtualQueryEx())
+			if (buffer.size() < blocksize)
+				buffer.resize(blocksize);
+
+			// checking for matching pattern
+			if (process.try_read(blockstart, buffer.data(), blocksize)) {
+				for (uintptr_t i = 0; i < blocksize - pattern.size(); ++i)
+					if (pattern.matches(&buffer[i]))
+						matching.push_back(blockstart + i);
+			}
+
+			// we dont care about anything after this
+			if (address >= rangeend)
+				return;
+		}
+	}
 } // namespace
 
 namespace mango::memscn {
@@ -97,62 +160,28 @@ namespace mango::memscn {
 	std::vector<uintptr_t> find(const Process& process, 
 		const Pattern& pattern, const Range& range, const Filter& filter) 
 	{
-		// to deal with unsigned overflow
-		const auto rangeend = range.start + 
-			std::min(range.size, uintptr_t(-1) - range.start);
-
-		uintptr_t address = range.start;
 		std::vector<uintptr_t> matching;
-
-		// iterate through each memory region
-		MEMORY_BASIC_INFORMATION info;
-		while (sizeof(info) == VirtualQueryEx(process.get_handle(),
-			reinterpret_cast<void*>(address), &info, sizeof(info))) 
-		{
-			address = uintptr_t(info.BaseAddress) + info.RegionSize;
-
-			// useless to us, skip
-			if (info.State != MEM_COMMIT || info.Protect & PAGE_GUARD || info.Protect & PAGE_NOACCESS)
-				continue;
-
-			// ignore filtered areas
-			if (!filter(info.Protect))
-				continue;
-
-			const auto blockstart = std::max(uintptr_t(info.BaseAddress), range.start);
-			const auto blocksize = std::min(rangeend, address) - blockstart;
-
-			// impossible for pattern to be in the memory
-			if (blocksize < pattern.size())
-				continue;
-
-			// read the memory
-			const auto buffer = std::make_unique<uint8_t[]>(blocksize);
-			process.read(blockstart, buffer.get(), blocksize);
-
-			// checking for matching pattern
-			for (uintptr_t i = 0; i < blocksize - pattern.size(); ++i)
-				if (pattern.matches(&buffer[i]))
-					matching.push_back(blockstart + i);
-
-			// we dont care about anything after this
-			if (address >= rangeend)
-				return matching;
-		}
-
+		find_matches(process, pattern, range, filter, matching, std::pmr::get_default_resource());
 		return matching;
 	}
 	std::vector<uintptr_t> find(const Process& process, const Pattern& pattern,
 		const std::string_view modulename, const Filter& filter) 
 	{
-		// scan from the modulebase to the modulebase + size
-		if (const auto m(process.get_module(modulename)); m) {
-			return find(process, pattern, Range{
-				.start = m->get_image_base(),
-				.size = m->get_image_size() }, filter);
-		}
+		return find(process, pattern, get_module_range(process, modulename), filter);
+	}
 
-		throw FailedToFindModule();
+	// same as above but the results (and the buffer that memory is read into) are allocated from resource
+	std::pmr::vector<uintptr_t> find(const Process& process, const Pattern& pattern,
+		std::pmr::memory_resource* const resource, const Range& range, const Filter& filter)
+	{
+		std::pmr::vector<uintptr_t> matching{ resource };
+		find_matches(process, pattern, range, filter, matching, resource);
+		return matching;
+	}
+	std::pmr::vector<uintptr_t> find(const Process& process, const Pattern& pattern,
+		std::pmr::memory_resource* const resource, const std::string_view modulename, const Filter& filter)
+	{
+		return find(process, pattern, resource, get_module_range(process, modulename), filter);
 	}
 
 	// overload << operator
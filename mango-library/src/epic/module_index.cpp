@@ -0,0 +1,256 @@
+#include "../../include/epic/module_index.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/misc/error_codes.h"
+
+#include <map>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+
+#undef min
+
+
+namespace mango {
+	namespace impl {
+		constexpr size_t module_index_page_size = 0x1000;
+
+		// import and export names are longer than this in theory, but never in practice
+		constexpr size_t max_import_name_length = 256;
+
+		// (pid, image base) -> index
+		struct ModuleIndexCache {
+			std::map<std::pair<uint32_t, uintptr_t>, std::shared_ptr<const ModuleIndex>> indices;
+			std::mutex mutex;
+		};
+
+		ModuleIndexCache& get_module_index_cache() {
+			static ModuleIndexCache cache{};
+			return cache;
+		}
+
+		// reads from the image a couple of pages at a time, since names and thunks are packed together
+		// this avoids a read (syscall, for external processes) for every single name
+		class ImageReader {
+		public:
+			ImageReader(const Process& process, const uintptr_t image_base, const size_t image_size)
+				: m_process{ process }, m_image_end{ image_base + image_size } {}
+
+			template <typename T>
+			T read(const uintptr_t address) {
+				T value{};
+				std::memcpy(&value, this->get(address, sizeof(T)), sizeof(T));
+				return value;
+			}
+
+			// hash a null-terminated string
+			size_t hash(const uintptr_t address, const bool lowercase) {
+				const auto size{ std::min(max_import_name_length, this->m_image_end - std::min(address, this->m_image_end)) };
+				return hash_pe_name(reinterpret_cast<const char*>(this->get(address, size)), size, lowercase);
+			}
+
+		private:
+			// make sure [address, address + size) is in the buffer
+			const uint8_t* get(const uintptr_t address, const size_t size) {
+				if (address < this->m_start || address + size > this->m_start + this->m_size) {
+					this->m_start = address & ~(module_index_page_size - 1);
+					this->m_size = std::min(sizeof(this->m_buffer), this->m_image_end - std::min(this->m_start, this->m_image_end));
+
+					// outside of the image
+					if (address + size > this->m_start + this->m_size)
+						throw InvalidPEHeader{};
+
+					this->m_process.read(this->m_start, this->m_buffer, this->m_size);
+				}
+
+				return this->m_buffer + (address - this->m_start);
+			}
+
+		private:
+			const Process& m_process;
+			const uintptr_t m_image_end;
+
+			uintptr_t m_start = 0;
+			size_t m_size = 0;
+			uint8_t m_buffer[module_index_page_size * 2];
+		};
+	} // namespace impl
+
+	// get the cached index of a module, it's rebuilt if a different module was loaded at the same address
+	std::shared_ptr<const ModuleIndex> ModuleIndex::get(const Process& process, const uintptr_t image_base) {
+		auto& cache{ impl::get_module_index_cache() };
+
+		// this is the only read needed if the index is already cached
+		const auto dos_header{ process.read<IMAGE_DOS_HEADER>(image_base) };
+		const auto file_header{ process.read<IMAGE_FILE_HEADER>(image_base + dos_header.e_lfanew + sizeof(uint32_t)) };
+
+		const std::pair key{ process.get_pid(), image_base };
+
+		{
+			const std::lock_guard lock{ cache.mutex };
+
+			if (const auto it{ cache.indices.find(key) }; it != cache.indices.end() && it->second->m_timestamp == file_header.TimeDateStamp)
+				return it->second;
+		}
+
+		auto index{ std::make_shared<ModuleIndex>() };
+		index->m_timestamp = file_header.TimeDateStamp;
+
+		process.is_64bit() ?
+			index->setup<true>(process, image_base) :
+			index->setup<false>(process, image_base);
+
+		const std::lock_guard lock{ cache.mutex };
+		return cache.indices[key] = std::move(index);
+	}
+
+	// forget every cached index
+	void ModuleIndex::clear_cache() {
+		auto& cache{ impl::get_module_index_cache() };
+
+		// hooks that already have an index keep it alive
+		const std::lock_guard lock{ cache.mutex };
+		cache.indices.clear();
+	}
+
+	// same as Fnv1a<>, but at runtime (module names are lowercased first)
+	size_t ModuleIndex::hash_module_name(const std::string_view name) noexcept {
+		return impl::hash_pe_name(name.data(), name.size(), true);
+	}
+	size_t ModuleIndex::hash_func_name(const std::string_view name) noexcept {
+		return impl::hash_pe_name(name.data(), name.size(), false);
+	}
+
+	// whether anything is imported from this module
+	bool ModuleIndex::has_import_module(const size_t module_hash) const noexcept {
+		const auto it{ std::lower_bound(this->m_imports.begin(), this->m_imports.end(), module_hash,
+			[](const Import& entry, const size_t hash) { return entry.module_hash < hash; }) };
+		return it != this->m_imports.end() && it->module_hash == module_hash;
+	}
+
+	// the address of the IAT slot
+	std::optional<uintptr_t> ModuleIndex::find_import(const size_t module_hash, const size_t func_hash) const noexcept {
+		const auto it{ std::lower_bound(this->m_imports.begin(), this->m_imports.end(), std::pair{ module_hash, func_hash },
+			[](const Import& entry, const std::pair<size_t, size_t>& hashes) {
+				return std::pair{ entry.module_hash, entry.func_hash } < hashes;
+			}) };
+
+		if (it == this->m_imports.end() || it->module_hash != module_hash || it->func_hash != func_hash)
+			return {};
+
+		return this->m_image_base + it->slot_rva;
+	}
+
+	// the address of the entry in AddressOfFunctions
+	std::optional<uintptr_t> ModuleIndex::find_export(const size_t func_hash) const noexcept {
+		const auto it{ std::lower_bound(this->m_exports.begin(), this->m_exports.end(), func_hash,
+			[](const Export& entry, const size_t hash) { return entry.func_hash < hash; }) };
+
+		if (it == this->m_exports.end() || it->func_hash != func_hash)
+			return {};
+
+		return this->m_image_base + it->table_rva;
+	}
+
+	// the exported rva when the index was built, without reading it again (forwarders point into the export directory)
+	std::optional<uint32_t> ModuleIndex::find_export_rva(const size_t func_hash) const noexcept {
+		const auto it{ std::lower_bound(this->m_exports.begin(), this->m_exports.end(), func_hash,
+			[](const Export& entry, const size_t hash) { return entry.func_hash < hash; }) };
+
+		if (it == this->m_exports.end() || it->func_hash != func_hash)
+			return {};
+
+		return it->function_rva;
+	}
+
+	template <bool is64bit>
+	void ModuleIndex::setup(const Process& process, const uintptr_t image_base) {
+		// architecture dependent types
+		using ImageNtHeaders = std::conditional_t<is64bit, IMAGE_NT_HEADERS64, IMAGE_NT_HEADERS32>;
+		using ImageThunkData = std::conditional_t<is64bit, uint64_t, uint32_t>;
+		constexpr auto ordinal_flag{ is64bit ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32 };
+
+		const auto dos_header{ process.read<IMAGE_DOS_HEADER>(image_base) };
+		const auto nt_header{ process.read<ImageNtHeaders>(image_base + dos_header.e_lfanew) };
+
+		// not a PE signature
+		if (nt_header.Signature != IMAGE_NT_SIGNATURE)
+			throw InvalidPEHeader{};
+
+		this->m_image_base = image_base;
+		this->m_image_size = nt_header.OptionalHeader.SizeOfImage;
+
+		impl::ImageReader names{ process, image_base, this->m_image_size },
+			thunks{ process, image_base, this->m_image_size };
+
+		// every import descriptor, the last one is zeroed
+		const auto imports_directory{ nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT] };
+		for (uintptr_t i{ 0 }; imports_directory.VirtualAddress && i + sizeof(IMAGE_IMPORT_DESCRIPTOR) <= imports_directory.Size;
+			i += sizeof(IMAGE_IMPORT_DESCRIPTOR)) {
+
+			const auto descriptor{ thunks.read<IMAGE_IMPORT_DESCRIPTOR>(image_base + imports_directory.VirtualAddress + i) };
+			if (!descriptor.Name)
+				break;
+
+			// the names are gone once FirstThunk is resolved
+			if (!descriptor.OriginalFirstThunk)
+				continue;
+
+			const auto module_hash{ names.hash(image_base + descriptor.Name, true) };
+
+			for (uint32_t j{ 0 }; true; j += sizeof(ImageThunkData)) {
+				const auto thunk{ thunks.read<ImageThunkData>(image_base + descriptor.OriginalFirstThunk + j) };
+				if (!thunk)
+					break;
+
+				// no name to hash
+				if (thunk & ordinal_flag)
+					continue;
+
+				// IMAGE_IMPORT_BY_NAME::Name
+				this->m_imports.push_back({
+					module_hash,
+					names.hash(image_base + uintptr_t(thunk) + sizeof(uint16_t), false),
+					descriptor.FirstThunk + j
+				});
+			}
+		}
+
+		// export data directory
+		const auto exports_directory{ nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT] };
+		if (exports_directory.VirtualAddress) {
+			this->m_export_dir_start = image_base + exports_directory.VirtualAddress;
+			this->m_export_dir_end = this->m_export_dir_start + exports_directory.Size;
+
+			const auto ex_dir{ process.read<IMAGE_EXPORT_DIRECTORY>(this->m_export_dir_start) };
+			this->m_exports.reserve(ex_dir.NumberOfNames);
+
+			// AddressOfNames, AddressOfNameOrdinals, and AddressOfFunctions are separate arrays, so they get separate readers
+			impl::ImageReader ordinals{ process, image_base, this->m_image_size },
+				functions{ process, image_base, this->m_image_size };
+
+			for (uint32_t i{ 0 }; i < ex_dir.NumberOfNames; ++i) {
+				const auto name_rva{ thunks.read<uint32_t>(image_base + ex_dir.AddressOfNames + i * 4) };
+				const auto ordinal{ ordinals.read<uint16_t>(image_base + ex_dir.AddressOfNameOrdinals + i * 2) };
+
+				if (ordinal >= ex_dir.NumberOfFunctions)
+					continue;
+
+				const auto table_rva{ uint32_t(ex_dir.AddressOfFunctions + ordinal * 4) };
+				this->m_exports.push_back({
+					names.hash(image_base + name_rva, false),
+					table_rva,
+					functions.read<uint32_t>(image_base + table_rva)
+				});
+			}
+		}
+
+		// sort for binary searching
+		std::sort(this->m_imports.begin(), this->m_imports.end(), [](const Import& left, const Import& right) {
+			return std::pair{ left.module_hash, left.func_hash } < std::pair{ right.module_hash, right.func_hash };
+		});
+		std::sort(this->m_exports.begin(), this->m_exports.end(), [](const Export& left, const Export& right) {
+			return left.func_hash < right.func_hash;
+		});
+	}
+} // namespace mango
\ No newline at end of file
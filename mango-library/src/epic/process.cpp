@@ -7,6 +7,8 @@
 #include <TlHelp32.h>
 
 #include "../../include/epic/shellcode.h"
+#include "../../include/epic/module_index.h"
+#include "../../include/epic/cave_allocator.h"
 
 #include "../../include/misc/scope_guard.h"
 #include "../../include/misc/logger.h"
@@ -63,7 +65,7 @@ namespace mango {
 
 		// get the privilege luid
 		LUID luid{};
-		if (!LookupPrivilegeValueA(0, enc_str("SeDebugPrivilege").c_str(), &luid))
+		if (!LookupPrivilegeValueA(0, enc_str_view("SeDebugPrivilege").c_str(), &luid))
 			throw FailedToGetPrivilegeLUID{ mango_format_w32status(GetLastError()) };
 
 		TOKEN_PRIVILEGES privileges{
@@ -206,6 +208,28 @@ namespace mango {
 		return nullptr;
 	}
 
+	// get the loaded module that contains the address (nullptr if not inside a module)
+	const LoadedModule* Process::get_module_by_addr(const uintptr_t address) const {
+		MEMORY_BASIC_INFORMATION buffer{};
+		if (const auto status{ windows::NtQueryVirtualMemory(this->m_handle, reinterpret_cast<void*>(address),
+			windows::MemoryBasicInformation, &buffer, sizeof(buffer), nullptr) }; NT_ERROR(status))
+		{
+			return nullptr;
+		}
+
+		// the allocation base of an image is the module base
+		if (buffer.Type != MEM_IMAGE)
+			return nullptr;
+
+		for (const auto& [name, base] : this->m_module_addresses) {
+			if (base == uintptr_t(buffer.AllocationBase))
+				return this->get_module(name);
+		}
+
+		// module was loaded after the last call to load_modules()
+		return nullptr;
+	}
+
 	// get the base address of a module
 	uintptr_t Process::get_module_addr(const std::string_view module_name) const {
 		if (const auto mod{ this->get_module(module_name) }; mod)
@@ -226,6 +250,41 @@ namespace mango {
 		return exp->address;
 	}
 
+	// same as above but with Fnv1a<> hashes instead of names
+	uintptr_t Process::get_module_addr(const size_t module_hash) const {
+		if (const auto it{ this->m_module_hashes.find(module_hash) }; it != this->m_module_hashes.end())
+			return it->second.address;
+		return 0;
+	}
+
+	// same as above but with Fnv1a<> hashes instead of names
+	uintptr_t Process::get_proc_addr(const size_t module_hash, const size_t func_hash) const {
+		if (this->m_options.memoize_proc_addrs) {
+			if (const auto it{ this->m_proc_addr_memo.find({ module_hash, func_hash }) }; it != this->m_proc_addr_memo.end())
+				return it->second;
+		}
+
+		const auto module{ this->m_module_hashes.find(module_hash) };
+		if (module == this->m_module_hashes.end())
+			return 0;
+
+		// the export table is already indexed by hash (and shared with EatHook), only the first lookup reads it
+		auto& [module_base, index] { module->second };
+		if (!index)
+			index = ModuleIndex::get(*this, module_base);
+
+		const auto rva{ index->find_export_rva(func_hash) };
+		if (!rva)
+			return 0;
+
+		const auto address{ module_base + *rva };
+
+		if (this->m_options.memoize_proc_addrs)
+			this->m_proc_addr_memo[{ module_hash, func_hash }] = address;
+
+		return address;
+	}
+
 	// api name -> dll name
 	std::string Process::resolve_apiset(const std::string_view name) const {
 		// my implementation of https://lucasg.github.io/2017/10/15/Api-set-resolution/
@@ -241,7 +300,7 @@ namespace mango {
 		if (search_name.size() < 4 ||
 			(*reinterpret_cast<const uint64_t*>(search_name.data()) != 0x2D006900700061 &&
 			 *reinterpret_cast<const uint64_t*>(search_name.data()) != 0x2D007400780065)) {
-			throw ApiSetInvalidName(enc_str("Name = "), '"', name, '"');
+			throw ApiSetInvalidName(enc_str_view("Name = "), '"', name, '"');
 		}
 
 		// api set map addr is stored in the PEB
@@ -286,7 +345,7 @@ namespace mango {
 		}
 
 		// rip
-		throw FailedToResolveApiSetName(enc_str("Name = "), '"', name, '"');
+		throw FailedToResolveApiSetName(enc_str_view("Name = "), '"', name, '"');
 	}
 
 	// get the protection of a page of memory
@@ -300,6 +359,58 @@ namespace mango {
 		return buffer.Protect;
 	}
 
+	// same as get_mem_prot() but returns the NTSTATUS instead of throwing
+	Expected<uint32_t> Process::try_get_mem_prot(void* const address) const noexcept {
+		MEMORY_BASIC_INFORMATION buffer{};
+		if (const auto status{ windows::NtQueryVirtualMemory(this->m_handle, address,
+			windows::MemoryBasicInformation, &buffer, sizeof(buffer), nullptr) }; !NT_SUCCESS(status))
+		{
+			return Unexpected{ Status{ status } };
+		}
+		return uint32_t(buffer.Protect);
+	}
+
+	// same as read() but returns the NTSTATUS instead of throwing, for code that expects to fail a lot
+	Expected<void> Process::try_read(const void* const address, void* const buffer, const size_t size) const noexcept {
+		// custom functions can only fail by throwing
+		if (this->m_options.read_memory_func != default_read_memory_func) {
+			try {
+				this->read(address, buffer, size);
+				return {};
+			} catch (...) {
+				return Unexpected{ Status{ windows::StatusUnsuccessful } };
+			}
+		}
+
+		// memcpy() would crash on bad addresses, even in the current process
+		if (const auto status{ windows::NtReadVirtualMemory(
+			this->m_handle, address, buffer, size, nullptr) }; !NT_SUCCESS(status))
+		{
+			return Unexpected{ Status{ status } };
+		}
+		return {};
+	}
+
+	// same as write() but returns the NTSTATUS instead of throwing
+	Expected<void> Process::try_write(void* const address, const void* const buffer, const size_t size) const noexcept {
+		// custom functions can only fail by throwing
+		if (this->m_options.write_memory_func != default_write_memory_func) {
+			try {
+				this->write(address, buffer, size);
+				return {};
+			} catch (...) {
+				return Unexpected{ Status{ windows::StatusUnsuccessful } };
+			}
+		}
+
+		if (const auto status{ windows::NtWriteVirtualMemory(
+			this->m_handle, address, buffer, size, nullptr) }; !NT_SUCCESS(status))
+		{
+			return Unexpected{ Status{ status } };
+		}
+		return {};
+	}
+
 	// set the protection, returns the old protection
 	uint32_t Process::set_mem_prot(void* address, const size_t size, const uint32_t protection) const {
 		DWORD OldAccessProtection{ 0 }; SIZE_T NumberOfBytesToProtect{ size };
@@ -311,6 +422,17 @@ namespace mango {
 		return OldAccessProtection;
 	}
 
+	// same as set_mem_prot() but returns the NTSTATUS instead of throwing
+	Expected<uint32_t> Process::try_set_mem_prot(void* address, const size_t size, const uint32_t protection) const noexcept {
+		DWORD OldAccessProtection{ 0 }; SIZE_T NumberOfBytesToProtect{ size };
+		if (const auto status{ windows::NtProtectVirtualMemory(this->m_handle, &address,
+			&NumberOfBytesToProtect, protection, &OldAccessProtection) }; !NT_SUCCESS(status))
+		{
+			return Unexpected{ Status{ status } };
+		}
+		return uint32_t(OldAccessProtection);
+	}
+
 	// suspend/resume the process
 	void Process::suspend() const {
 		if (const auto status{ windows::NtSuspendProcess(this->m_handle) }; NT_ERROR(status))
@@ -413,6 +535,8 @@ namespace mango {
 	void Process::query_module_addresses() {
 		// clear any previous module addresses
 		this->m_module_addresses.clear();
+		this->m_module_hashes.clear();
+		this->m_proc_addr_memo.clear();
 
 		const auto callback{ [&](auto name, const auto base) {
 			// remove everything before the filename
@@ -426,6 +550,7 @@ namespace mango {
 
 			str_tolower(name);
 			this->m_module_addresses[name] = uintptr_t(base);
+			this->m_module_hashes[ModuleIndex::hash_module_name(name)] = { uintptr_t(base), nullptr };
 		} };
 
 		if (this->is_64bit()) {
@@ -480,6 +605,9 @@ namespace mango {
 			this->query_module_addresses();
 		}
 
+		// the caves of a module are only searched once a hook needs them
+		this->m_cave_allocator = std::make_unique<CaveAllocator>();
+
 		// no exception was thrown, great
 		_guard.cancel();
 	}
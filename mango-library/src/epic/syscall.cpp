@@ -1,4 +1,5 @@
 #include "../../include/epic/syscall.h"
+#include "../../include/epic/syscall_table.h"
 
 #include "../../include/misc/error_codes.h"
 #include "../../include/crypto/string_encryption.h"
@@ -8,20 +9,12 @@
 
 namespace mango::syscall {
 	// dynamically get the sycall index of a function in ntdll.dll
-	uint32_t index(const std::string& func_name) {
-		static const auto ntdll_handle{ GetModuleHandle(enc_str("ntdll.dll").c_str()) };
-
-		// get the function address
-		const auto func_addr{ reinterpret_cast<uint8_t*>(GetProcAddress(ntdll_handle, func_name.c_str())) };
-		if (!func_addr)
-			throw FailedToGetFunctionAddress{};
-
-		// read the syscall index from the mov eax instruction
-		if constexpr (sizeof(void*) == 8) {
-			return *reinterpret_cast<uint32_t*>(func_addr + 4);
-		} else {
-			return *reinterpret_cast<uint32_t*>(func_addr + 1);
-		}
+	uint32_t index(const std::string_view func_name) {
+		// the table doesn't read the stubs, so this works even if they're hooked
+		if (const auto syscall_index{ SyscallTable::current().find(func_name) })
+			return *syscall_index;
+
+		throw FailedToGetFunctionAddress{};
 	}
 
 #ifndef _WIN64
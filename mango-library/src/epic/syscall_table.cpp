@@ -0,0 +1,248 @@
+#include "../../include/epic/syscall_table.h"
+
+#include "../../include/epic/loaded_module.h"
+#include "../../include/misc/error_codes.h"
+
+#include <Windows.h>
+
+#include <bit>
+#include <cstring>
+#include <algorithm>
+
+#undef min
+#undef max
+
+
+namespace mango {
+	namespace impl {
+		// how many seeds to try for a bucket before giving up
+		constexpr uint32_t max_syscall_table_seed = 0x10000;
+
+		// murmur3 finalizer, the seed picks a different hash function
+		constexpr uint64_t syscall_table_mix(uint64_t key, const uint64_t seed) noexcept {
+			key ^= seed * 0x9E3779B97F4A7C15;
+			key ^= key >> 33;
+			key *= 0xFF51AFD7ED558CCD;
+			key ^= key >> 33;
+			key *= 0xC4CEB9FE1A85EC53;
+			key ^= key >> 33;
+			return key;
+		}
+
+		// rva -> pointer, for images that are either mapped or still in the file layout
+		template <typename T>
+		const T* image_rva_to_ptr(const uint8_t* const image, const size_t size, const bool mapped,
+			const IMAGE_SECTION_HEADER* const sections, const size_t num_sections, const uint32_t rva, const size_t count = 1)
+		{
+			auto offset{ size_t(rva) };
+
+			// find the section that contains it
+			if (!mapped) {
+				const auto section{ std::find_if(sections, sections + num_sections, [rva](const IMAGE_SECTION_HEADER& section) {
+					return rva >= section.VirtualAddress && rva < section.VirtualAddress + std::max(section.Misc.VirtualSize, section.SizeOfRawData);
+				}) };
+
+				if (section == sections + num_sections)
+					throw InvalidPEHeader{};
+
+				offset = rva - section->VirtualAddress + section->PointerToRawData;
+			}
+
+			if (offset + sizeof(T) * count > size)
+				throw InvalidPEHeader{};
+
+			return reinterpret_cast<const T*>(image + offset);
+		}
+	} // namespace impl
+
+	// image is either the raw file or an image that's already mapped (where rvas are offsets)
+	void SyscallTable::setup(const uint8_t* const image, const size_t size, const bool mapped) {
+		const auto dos_header{ reinterpret_cast<const IMAGE_DOS_HEADER*>(image) };
+		if (size < sizeof(IMAGE_DOS_HEADER) || dos_header->e_magic != IMAGE_DOS_SIGNATURE)
+			throw InvalidPEHeader{};
+
+		if (size_t(dos_header->e_lfanew) + sizeof(IMAGE_NT_HEADERS64) > size)
+			throw InvalidPEHeader{};
+
+		const auto nt_header{ reinterpret_cast<const IMAGE_NT_HEADERS32*>(image + dos_header->e_lfanew) };
+		if (nt_header->Signature != IMAGE_NT_SIGNATURE)
+			throw InvalidPEHeader{};
+
+		// the data directories are at a different offset in 64bit images
+		const auto export_directory{ nt_header->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC ?
+			reinterpret_cast<const IMAGE_NT_HEADERS64*>(nt_header)->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT] :
+			nt_header->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT] };
+
+		const auto sections{ IMAGE_FIRST_SECTION(nt_header) };
+		const size_t num_sections{ nt_header->FileHeader.NumberOfSections };
+		if (size_t(reinterpret_cast<const uint8_t*>(sections + num_sections) - image) > size)
+			throw InvalidPEHeader{};
+
+		const auto ex_dir{ impl::image_rva_to_ptr<IMAGE_EXPORT_DIRECTORY>(image, size, mapped, sections, num_sections, export_directory.VirtualAddress, 1) };
+		const auto names{ impl::image_rva_to_ptr<uint32_t>(image, size, mapped, sections, num_sections, ex_dir->AddressOfNames, ex_dir->NumberOfNames) };
+		const auto ordinals{ impl::image_rva_to_ptr<uint16_t>(image, size, mapped, sections, num_sections, ex_dir->AddressOfNameOrdinals, ex_dir->NumberOfNames) };
+		const auto functions{ impl::image_rva_to_ptr<uint32_t>(image, size, mapped, sections, num_sections, ex_dir->AddressOfFunctions, ex_dir->NumberOfFunctions) };
+
+		std::vector<Export> exports{};
+		for (size_t i{ 0 }; i < ex_dir->NumberOfNames; ++i) {
+			const auto name{ impl::image_rva_to_ptr<char>(image, size, mapped, sections, num_sections, names[i], 2) };
+			if (name[0] != 'Z' || name[1] != 'w' || ordinals[i] >= ex_dir->NumberOfFunctions)
+				continue;
+
+			// names are null-terminated somewhere before the end of the image
+			const auto length{ strnlen(name, size - (name - reinterpret_cast<const char*>(image))) };
+			exports.push_back({ functions[ordinals[i]], name, length });
+		}
+
+		this->build(exports);
+	}
+
+	// an ntdll.dll that's loaded in a process
+	void SyscallTable::setup(const LoadedModule& ntdll) {
+		std::vector<Export> exports{};
+		for (const auto& [name, entry] : ntdll.get_exports()) {
+			if (name.starts_with("Zw"))
+				exports.push_back({ uint32_t(entry.address - ntdll.get_image_base()), name.c_str(), name.size() });
+		}
+
+		this->build(exports);
+	}
+
+	// same as find(), but throws if it's not a syscall
+	uint32_t SyscallTable::get(const size_t name_hash) const {
+		if (const auto index{ this->find(name_hash) })
+			return *index;
+
+		throw FailedToFindSyscall{};
+	}
+	uint32_t SyscallTable::get(const std::string_view name) const {
+		if (const auto index{ this->find(name) })
+			return *index;
+
+		throw FailedToFindSyscall{ name };
+	}
+
+	// find(Fnv1a<>("NtClose")) for example
+	std::optional<uint32_t> SyscallTable::find(const size_t name_hash) const noexcept {
+		if (this->m_slots.empty())
+			return {};
+
+		const auto bucket{ impl::syscall_table_mix(name_hash, 0) % this->m_seeds.size() };
+		const auto& slot{ this->m_slots[impl::syscall_table_mix(name_hash, this->m_seeds[bucket]) & (this->m_slots.size() - 1)] };
+
+		if (slot.index == invalid_index || slot.hash != name_hash)
+			return {};
+
+		return slot.index;
+	}
+
+	// the table for the ntdll.dll of the current process (built on first use)
+	const SyscallTable& SyscallTable::current() {
+		static const auto table{ []() {
+			const auto ntdll{ reinterpret_cast<const uint8_t*>(GetModuleHandleA(enc_str_view("ntdll.dll").c_str())) };
+			if (!ntdll)
+				throw FailedToFindModule{};
+
+			const auto dos_header{ reinterpret_cast<const IMAGE_DOS_HEADER*>(ntdll) };
+			const auto nt_header{ reinterpret_cast<const IMAGE_NT_HEADERS*>(ntdll + dos_header->e_lfanew) };
+
+			return SyscallTable{ ntdll, nt_header->OptionalHeader.SizeOfImage, true };
+		}() };
+
+		return table;
+	}
+
+	// sort by rva and build the hash table
+	void SyscallTable::build(std::vector<Export>& exports) {
+		this->m_num_syscalls = 0;
+		this->m_seeds.clear();
+		this->m_slots.clear();
+
+		if (exports.empty())
+			throw FailedToBuildSyscallTable{};
+
+		// the stubs are in order of their syscall index
+		std::sort(exports.begin(), exports.end(), [](const Export& left, const Export& right) {
+			return left.rva < right.rva;
+		});
+
+		// every Zw function has an Nt function with the same index
+		std::vector<Slot> entries{};
+		entries.reserve(exports.size() * 2);
+
+		for (size_t i{ 0 }; i < exports.size(); ++i) {
+			// aliases share a stub
+			if (i > 0 && exports[i].rva != exports[i - 1].rva)
+				++this->m_num_syscalls;
+
+			const auto index{ uint32_t(this->m_num_syscalls) };
+			const std::string_view name{ exports[i].name, exports[i].length };
+
+			char nt_name[256]{ 'N', 't' };
+			const auto nt_length{ std::min(name.size(), sizeof(nt_name)) };
+			std::memcpy(nt_name + 2, name.data() + 2, nt_length - 2);
+
+			entries.push_back({ size_t(Fnv1a<>(StringWrapper{ name.data(), name.size() })), index });
+			entries.push_back({ size_t(Fnv1a<>(StringWrapper{ nt_name, nt_length })), index });
+		}
+
+		++this->m_num_syscalls;
+
+		// hash and displace: keys are grouped into buckets, and each bucket searches for a seed
+		// that sends all of its keys to empty slots (biggest buckets first, while there's the most room)
+		const auto num_buckets{ entries.size() / 2 + 1 };
+		const auto num_slots{ std::bit_ceil(entries.size() + entries.size() / 4) };
+
+		std::vector<std::vector<size_t>> buckets(num_buckets);
+		for (size_t i{ 0 }; i < entries.size(); ++i)
+			buckets[impl::syscall_table_mix(entries[i].hash, 0) % num_buckets].push_back(i);
+
+		std::vector<size_t> order(num_buckets);
+		for (size_t i{ 0 }; i < num_buckets; ++i)
+			order[i] = i;
+
+		std::sort(order.begin(), order.end(), [&](const size_t left, const size_t right) {
+			return buckets[left].size() > buckets[right].size();
+		});
+
+		std::vector<uint32_t> seeds(num_buckets, 0);
+		std::vector<Slot> slots(num_slots);
+		std::vector<size_t> placed{};
+
+		for (const auto bucket : order) {
+			if (buckets[bucket].empty())
+				break;
+
+			bool found{ false };
+			for (uint32_t seed{ 1 }; !found && seed < impl::max_syscall_table_seed; ++seed) {
+				placed.clear();
+
+				for (const auto entry : buckets[bucket]) {
+					const auto slot{ impl::syscall_table_mix(entries[entry].hash, seed) & (num_slots - 1) };
+
+					// taken by another bucket, or by another key in this bucket
+					if (slots[slot].index != invalid_index || std::find(placed.begin(), placed.end(), slot) != placed.end())
+						break;
+
+					placed.push_back(slot);
+				}
+
+				if (placed.size() != buckets[bucket].size())
+					continue;
+
+				for (size_t i{ 0 }; i < placed.size(); ++i)
+					slots[placed[i]] = entries[buckets[bucket][i]];
+
+				seeds[bucket] = seed;
+				found = true;
+			}
+
+			// only happens if two names have the same hash
+			if (!found)
+				throw FailedToBuildSyscallTable{};
+		}
+
+		this->m_seeds = std::move(seeds);
+		this->m_slots = std::move(slots);
+	}
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "../../include/epic/syscall_trace.h"
+
+#include <bit>
+#include <algorithm>
+
+
+namespace mango {
+	// add a single syscall
+	void SyscallTraceStats::add(const SyscallTraceRecord& record) {
+		if (record.syscall_index >= this->m_entries.size())
+			this->m_entries.resize(record.syscall_index + 1);
+
+		const auto cycles{ record.end_tsc - record.start_tsc };
+
+		auto& entry{ this->m_entries[record.syscall_index] };
+		entry.count += 1;
+		entry.total_cycles += cycles;
+		entry.histogram[get_bucket(cycles)] += 1;
+
+		this->m_total_count += 1;
+	}
+
+	// nullptr if the syscall was never added
+	const SyscallTraceStats::Entry* SyscallTraceStats::find(const uint32_t syscall_index) const noexcept {
+		if (syscall_index >= this->m_entries.size() || !this->m_entries[syscall_index].count)
+			return nullptr;
+
+		return &this->m_entries[syscall_index];
+	}
+
+	// remove everything
+	void SyscallTraceStats::clear() noexcept {
+		this->m_entries.clear();
+		this->m_total_count = 0;
+	}
+
+	// the histogram bucket of a syscall that took this long
+	size_t SyscallTraceStats::get_bucket(const uint64_t cycles) noexcept {
+		// the highest set bit
+		return std::min<size_t>(std::max<size_t>(std::bit_width(cycles), 1) - 1, histogram_buckets - 1);
+	}
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "../../include/epic/syscall_tracer.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/epic/wow64_syscall_hook.h"
+
+
+namespace mango {
+	// calls hook.enable_tracing(), which syscalls are traced is still up to the hook
+	SyscallTracer::SyscallTracer(Wow64SyscallHook& hook)
+		: m_process{ hook.get_process() }, m_address{ hook.enable_tracing() }, m_ring{ std::make_unique<SyscallTraceRing>() } {}
+
+	// drain every interval on a background thread
+	void SyscallTracer::start(const std::chrono::milliseconds interval) {
+		this->stop();
+
+		this->m_running = true;
+		this->m_thread = std::thread{ [this, interval]() {
+			std::unique_lock lock{ this->m_thread_mutex };
+
+			// wake up early when stop() is called
+			while (!this->m_thread_cv.wait_for(lock, interval, [this]() { return !this->m_running; }))
+				this->drain();
+		} };
+	}
+
+	// stop the background thread, then drain whatever is left
+	void SyscallTracer::stop() {
+		if (this->m_thread.joinable()) {
+			{
+				const std::lock_guard lock{ this->m_thread_mutex };
+				this->m_running = false;
+			}
+
+			this->m_thread_cv.notify_one();
+			this->m_thread.join();
+		}
+
+		this->drain();
+	}
+
+	// read every ring once, returns the number of new records
+	// this runs on the background thread, so it stops instead of throwing if a read fails
+	size_t SyscallTracer::drain() {
+		// the hook wasn't hooked
+		if (!this->m_address)
+			return 0;
+
+		const std::lock_guard lock{ this->m_mutex };
+
+		size_t consumed{ 0 };
+		for (uint32_t i{ 0 }; i < SyscallTraceRing::count; ++i) {
+			const auto address{ this->m_address + i * sizeof(SyscallTraceRing) };
+
+			// the process exited or the hook was released
+			const auto head{ this->m_process->try_read<uint32_t>(address) };
+			if (!head)
+				break;
+
+			// nothing new since last time
+			if (*head == this->m_consumers[i].get_position())
+				continue;
+
+			if (!this->m_process->try_read(address, this->m_ring.get(), sizeof(SyscallTraceRing)))
+				break;
+
+			// anything older than this could've been overwritten while we were reading
+			const auto new_head{ this->m_process->try_read<uint32_t>(address) };
+			if (!new_head)
+				break;
+
+			consumed += this->m_consumers[i].consume(*this->m_ring, *new_head,
+				[this](const SyscallTraceRecord& record) { this->m_stats.add(record); });
+		}
+
+		return consumed;
+	}
+
+	// a copy of the stats so far
+	SyscallTraceStats SyscallTracer::get_stats() const {
+		const std::lock_guard lock{ this->m_mutex };
+		return this->m_stats;
+	}
+
+	// records that were overwritten before they could be read
+	uint64_t SyscallTracer::get_dropped() const {
+		const std::lock_guard lock{ this->m_mutex };
+
+		uint64_t dropped{ 0 };
+		for (const auto& consumer : this->m_consumers)
+			dropped += consumer.get_dropped();
+
+		return dropped;
+	}
+} // namespace mango
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include "../../include/epic/unused_memory.h"
 
 #include "../../include/epic/process.h"
+#include "../../include/epic/loaded_module.h"
 
+#include <emmintrin.h>
+
+#include <bit>
 #include <algorithm>
 
 
@@ -23,9 +27,10 @@ namespace mango {
 				if (!std::invoke(predicate, mbi))
 					continue;
 
-				// read the entire region
+				// read the entire region (it could've been freed or protected since VirtualQueryEx())
 				const auto buffer{ std::make_unique<uint8_t[]>(mbi.RegionSize) };
-				process.read(address, buffer.get(), mbi.RegionSize);
+				if (!process.try_read(address, buffer.get(), mbi.RegionSize))
+					continue;
 
 				// starting from the end, count how many null bytes
 				size_t num_null_bytes{ 0 };
@@ -50,6 +55,110 @@ namespace mango {
 
 			return unused_memory;
 		}
+
+		// how far a rel32 is allowed to reach, with some room to spare
+		constexpr uintptr_t near_allocation_range = 0x7FFF'0000;
+
+		// IMAGE_RUNTIME_FUNCTION_ENTRY (x64)
+		struct RuntimeFunction {
+			uint32_t begin,
+				end,
+				unwind_info;
+		};
+
+		// candidates that are closer than this are read together
+		constexpr size_t max_cave_read_gap = 0x1000,
+			max_cave_read_size = 0x10000;
+
+		// the number of 0x00 or 0xCC bytes at the start of the buffer
+		size_t count_cave_filler(const uint8_t* const data, const size_t size) noexcept {
+			const auto zero{ _mm_setzero_si128() },
+				int3{ _mm_set1_epi8(char(0xCC)) };
+
+			size_t offset{ 0 };
+			for (; offset + 16 <= size; offset += 16) {
+				const auto block{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)) };
+				const auto mask{ uint32_t(_mm_movemask_epi8(_mm_or_si128(
+					_mm_cmpeq_epi8(block, zero), _mm_cmpeq_epi8(block, int3)))) };
+
+				// the first byte that isn't filler
+				if (mask != 0xFFFF)
+					return offset + std::countr_one(mask);
+			}
+
+			for (; offset < size && (data[offset] == 0x00 || data[offset] == 0xCC); ++offset);
+			return offset;
+		}
+
+		// the gaps between functions in the exception directory, that are inside of an executable section
+		void add_function_gaps(const Process& process, const LoadedModule& module, std::vector<MemoryRange>& candidates, const size_t min_size) {
+			const auto image_base{ module.get_image_base() };
+			const auto dos_header{ process.read<IMAGE_DOS_HEADER>(image_base) };
+			const auto nt_header{ process.read<IMAGE_NT_HEADERS64>(image_base + dos_header.e_lfanew) };
+
+			const auto directory{ nt_header.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION] };
+			if (!directory.VirtualAddress || directory.Size < sizeof(RuntimeFunction))
+				return;
+
+			// the whole table in one read, it's a lot smaller than the code it describes
+			std::vector<RuntimeFunction> functions(directory.Size / sizeof(RuntimeFunction));
+			process.read(image_base + directory.VirtualAddress, functions.data(), functions.size() * sizeof(RuntimeFunction));
+
+			// it should already be sorted, but nothing says it has to be
+			std::sort(functions.begin(), functions.end(), [](const auto& left, const auto& right) {
+				return left.begin < right.begin;
+			});
+
+			const auto is_executable{ [&](const uintptr_t start, const uintptr_t end) {
+				return std::any_of(module.get_sections().begin(), module.get_sections().end(), [&](const auto& section) {
+					return (section.characteristics & IMAGE_SCN_MEM_EXECUTE) &&
+						start >= section.address && end <= section.address + section.virtualsize;
+				});
+			} };
+
+			// chained entries (and funclets) can overlap, so only the furthest end counts
+			uint32_t end{ 0 };
+			for (const auto& function : functions) {
+				if (end && function.begin > end && function.begin - end >= min_size &&
+					is_executable(image_base + end, image_base + function.begin))
+					candidates.push_back({ image_base + end, function.begin - end });
+
+				end = std::max(end, function.end);
+			}
+		}
+
+		// allocate executable memory in the first free region that's within rel32 range of address
+		uintptr_t allocate_near(const Process& process, const uintptr_t address, const size_t size) {
+			SYSTEM_INFO system_info{};
+			GetSystemInfo(&system_info);
+
+			// allocations have to be aligned to this
+			const uintptr_t granularity{ system_info.dwAllocationGranularity };
+
+			const auto min_address{ address > near_allocation_range ? address - near_allocation_range : granularity };
+			const auto max_address{ address + near_allocation_range - size };
+
+			MEMORY_BASIC_INFORMATION mbi{};
+			for (auto current{ min_address }; current < max_address && VirtualQueryEx(process.get_handle(),
+				reinterpret_cast<void*>(current), &mbi, sizeof(mbi)); current = uintptr_t(mbi.BaseAddress) + mbi.RegionSize) {
+
+				if (mbi.State != MEM_FREE)
+					continue;
+
+				const auto region_end{ uintptr_t(mbi.BaseAddress) + mbi.RegionSize };
+				const auto candidate{ (std::max(uintptr_t(mbi.BaseAddress), min_address) + granularity - 1) & ~(granularity - 1) };
+
+				// not enough room
+				if (candidate + size > region_end || candidate > max_address)
+					continue;
+
+				if (const auto allocation{ VirtualAllocEx(process.get_handle(), reinterpret_cast<void*>(candidate),
+					size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE) }; allocation)
+					return uintptr_t(allocation);
+			}
+
+			throw FailedToFindNearbyMemory{};
+		}
 	} // namespace impl
 
 	// find unused memory (executable + readable + writeable) in a process
@@ -86,4 +195,82 @@ namespace mango {
 
 		return unused_memory.front().m_address;
 	}
+
+	// find code caves in the executable sections of a module without reading the sections
+	std::vector<MemoryRange> find_code_caves(const Process& process, const LoadedModule& module, const size_t min_size) {
+		std::vector<MemoryRange> candidates{};
+
+		// the loader zeroes everything past VirtualSize
+		const auto alignment{ module.get_section_alignment() };
+		for (const auto& section : module.get_sections()) {
+			if (!(section.characteristics & IMAGE_SCN_MEM_EXECUTE) || !section.virtualsize || !alignment)
+				continue;
+
+			const auto aligned_size{ (section.virtualsize + alignment - 1) / alignment * alignment };
+			if (aligned_size - section.virtualsize >= min_size)
+				candidates.push_back({ section.address + section.virtualsize, aligned_size - section.virtualsize });
+		}
+
+		if (process.is_64bit())
+			impl::add_function_gaps(process, module, candidates, min_size);
+
+		std::sort(candidates.begin(), candidates.end(), [](const auto& first, const auto& second) {
+			return first.m_address < second.m_address;
+		});
+
+		std::vector<MemoryRange> caves{};
+		std::vector<uint8_t> buffer{};
+
+		// read nearby candidates together instead of one at a time
+		for (size_t first{ 0 }, last{ 0 }; first < candidates.size(); first = last) {
+			const auto start{ candidates[first].m_address };
+			auto end{ start + candidates[first].m_size };
+
+			for (last = first + 1; last < candidates.size(); ++last) {
+				const auto next_end{ candidates[last].m_address + candidates[last].m_size };
+				if (candidates[last].m_address - end > impl::max_cave_read_gap || next_end - start > impl::max_cave_read_size)
+					break;
+
+				end = std::max(end, next_end);
+			}
+
+			// skip the whole chunk if any of it isn't readable
+			buffer.resize(end - start);
+			if (!process.try_read(start, buffer.data(), buffer.size()))
+				continue;
+
+			// only the filler at the start, anything after the first other byte could be in use
+			for (size_t i{ first }; i < last; ++i) {
+				const auto& candidate{ candidates[i] };
+				const auto size{ impl::count_cave_filler(buffer.data() + (candidate.m_address - start), candidate.m_size) };
+
+				if (size >= min_size)
+					caves.push_back({ candidate.m_address, size });
+			}
+		}
+
+		// sort by biggest size
+		std::sort(caves.begin(), caves.end(), [](const auto& first, const auto& second) {
+			return first.m_size > second.m_size;
+		});
+
+		return caves;
+	}
+
+	// find_code_caves() on every module in Process::get_modules()
+	std::vector<MemoryRange> find_all_code_caves(const Process& process, const size_t min_size) {
+		std::vector<MemoryRange> caves{};
+
+		for (const auto& [name, module] : process.get_modules()) {
+			const auto module_caves{ find_code_caves(process, module, min_size) };
+			caves.insert(caves.end(), module_caves.begin(), module_caves.end());
+		}
+
+		// sort by biggest size
+		std::sort(caves.begin(), caves.end(), [](const auto& first, const auto& second) {
+			return first.m_size > second.m_size;
+		});
+
+		return caves;
+	}
 } // namespace mango
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "../../include/epic/vmt_helpers.h"
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <algorithm>
+
+
+namespace mango {
+	namespace impl {
+		constexpr size_t vtable_read_size = 0x1000;
+
+		// PAGE_EXECUTE, PAGE_EXECUTE_READ, PAGE_EXECUTE_READWRITE, PAGE_EXECUTE_WRITECOPY
+		constexpr uint32_t vtable_execute_mask = 0xF0;
+
+		// a range of executable memory [start, end)
+		struct ExecutableRange {
+			uintptr_t start,
+				end;
+		};
+
+		// whether the address is inside an executable section of a loaded module, or in executable memory
+		// outside of one (modules loaded after Process::setup(), or entries that were hooked already)
+		bool is_vtable_entry(const Process& process, std::vector<ExecutableRange>& ranges, const uintptr_t address) {
+			const auto contains{ [&]() {
+				return std::any_of(ranges.begin(), ranges.end(), [address](const ExecutableRange& range) {
+					return address >= range.start && address < range.end;
+				});
+			} };
+
+			// most entries point into the same module so this is usually enough
+			if (contains())
+				return true;
+
+			if (!address)
+				return false;
+
+			const auto mod{ process.get_module_by_addr(address) };
+			if (!mod) {
+				const auto protection{ process.try_get_mem_prot(address) };
+				if (!protection || !(*protection & vtable_execute_mask))
+					return false;
+
+				// the rest of the page is executable too
+				const auto page{ address & ~uintptr_t(vtable_read_size - 1) };
+				ranges.push_back({ page, page + vtable_read_size });
+				return true;
+			}
+
+			for (const auto& section : mod->get_sections()) {
+				if (section.characteristics & IMAGE_SCN_MEM_EXECUTE)
+					ranges.push_back({ section.address, section.address + section.virtualsize });
+			}
+
+			return contains();
+		}
+
+		// read the entries page by page until one of them isn't a function
+		template <typename Ptr>
+		size_t calculate_vtable_size(const Process& process, const uintptr_t vtable) {
+			std::vector<ExecutableRange> ranges{};
+			size_t size{ 0 };
+
+			while (true) {
+				// read up until the end of the page, the next page might not be readable
+				const auto address{ vtable + size };
+				const auto count{ (vtable_read_size - (address & (vtable_read_size - 1))) / sizeof(Ptr) };
+
+				Ptr entries[vtable_read_size / sizeof(Ptr)];
+				if (!process.try_read(address, entries, count * sizeof(Ptr)))
+					return size;
+
+				// the rtti complete locator of the next vtable is in .rdata, so it won't be treated
+				// as a function and will end the table
+				for (size_t i{ 0 }; i < count; ++i) {
+					if (!is_vtable_entry(process, ranges, uintptr_t(entries[i])))
+						return size;
+
+					size += sizeof(Ptr);
+				}
+			}
+		}
+
+		// (pid, vtable) -> size, along with the timestamp of the module that the vtable is in
+		struct VtableSizeCache {
+			struct Entry {
+				uint32_t timestamp;
+				size_t size;
+			};
+
+			std::map<std::pair<uint32_t, uintptr_t>, Entry> sizes;
+			std::mutex mutex;
+		};
+
+		VtableSizeCache& get_vtable_size_cache() {
+			static VtableSizeCache cache{};
+			return cache;
+		}
+
+		// same check as ModuleIndex::get(), nullopt if the headers can't be read
+		std::optional<uint32_t> read_vtable_module_timestamp(const Process& process, const uintptr_t image_base) {
+			const auto dos_header{ process.try_read<IMAGE_DOS_HEADER>(image_base) };
+			if (!dos_header)
+				return std::nullopt;
+
+			const auto file_header{ process.try_read<IMAGE_FILE_HEADER>(image_base + dos_header->e_lfanew + sizeof(uint32_t)) };
+			if (!file_header)
+				return std::nullopt;
+
+			return uint32_t(file_header->TimeDateStamp);
+		}
+	} // namespace impl
+
+	// get the size of a vtable in bytes, 0 if it doesn't look like a vtable (cached per process and vtable)
+	size_t get_vtable_size(const Process& process, const uintptr_t vtable) {
+		auto& cache{ impl::get_vtable_size_cache() };
+
+		// the timestamp of the module that the vtable is in, so that a reloaded module (or a reused pid) isn't trusted
+		std::optional<uint32_t> timestamp{};
+		if (const auto mod{ process.get_module_by_addr(vtable) }; mod)
+			timestamp = impl::read_vtable_module_timestamp(process, mod->get_image_base());
+
+		const std::pair key{ process.get_pid(), vtable };
+
+		if (timestamp) {
+			const std::lock_guard lock{ cache.mutex };
+
+			if (const auto it{ cache.sizes.find(key) }; it != cache.sizes.end() && it->second.timestamp == *timestamp)
+				return it->second.size;
+		}
+
+		const auto size{ process.is_64bit() ?
+			impl::calculate_vtable_size<uint64_t>(process, vtable) :
+			impl::calculate_vtable_size<uint32_t>(process, vtable) };
+
+		// don't cache failures, the module might just not be loaded yet
+		if (size && timestamp) {
+			const std::lock_guard lock{ cache.mutex };
+			cache.sizes[key] = { *timestamp, size };
+		}
+
+		return size;
+	}
+} // namespace mango
@@ -1,6 +1,7 @@
 #include "../../include/epic/vmt_hook.h"
 
 #include "../../include/epic/process.h"
+#include "../../include/epic/vmt_helpers.h"
 #include "../../include/misc/logger.h"
 #include "../../include/misc/error_codes.h"
 
@@ -24,19 +25,8 @@ namespace mango {
 		// else:
 		// just write directly to the current vtable
 		if (options.replace_table) {
-			// attempt to calculate vtable size ourselves (not accurate)
-			try {
-				this->m_vtable_size = 0;
-
-				// keep increasing m_vtable_size until nullptr
-				if (process.is_64bit()) {
-					while (process.read<uint64_t>(this->m_original_vtable + this->m_vtable_size))
-						this->m_vtable_size += 0x8;
-				} else {
-					while (process.read<uint32_t>(this->m_original_vtable + this->m_vtable_size))
-						this->m_vtable_size += 0x4;
-				}
-			} catch (FailedToReadMemory&) {}
+			// attempt to calculate vtable size ourselves (not 100% accurate)
+			this->m_vtable_size = get_vtable_size(process, this->m_original_vtable);
 
 			// if it's 0 then its not a virtual class lmao
 			if (!this->m_vtable_size)
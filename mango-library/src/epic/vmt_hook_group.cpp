@@ -0,0 +1,218 @@
+#include "../../include/epic/vmt_hook_group.h"
+
+#include "../../include/epic/process.h"
+#include "../../include/epic/hook_transaction.h"
+#include "../../include/epic/vmt_helpers.h"
+#include "../../include/misc/scope_guard.h"
+#include "../../include/misc/error_codes.h"
+
+#include <memory>
+
+
+namespace mango {
+	namespace impl {
+		// read a pointer-sized value
+		uintptr_t read_vtable_ptr(const Process& process, const uintptr_t address) {
+			return process.is_64bit() ?
+				uintptr_t(process.read<uint64_t>(address)) :
+				uintptr_t(process.read<uint32_t>(address));
+		}
+
+		// write a pointer-sized value as part of a transaction
+		void write_vtable_ptr(HookTransaction& transaction, const Process& process, const uintptr_t address, const uintptr_t value) {
+			process.is_64bit() ?
+				transaction.write<uint64_t>(address, value) :
+				transaction.write<uint32_t>(address, uint32_t(value));
+		}
+	} // namespace impl
+
+	// instances are added with add()
+	void VmtHookGroup::setup(const Process& process, const SetupOptions& options) {
+		this->release();
+
+		this->m_process = &process;
+		this->m_options = options;
+	}
+
+	// restores every instance and frees every shadow table
+	void VmtHookGroup::release() {
+		if (!this->m_process)
+			return;
+
+		// no need to unhook anything since the instances are getting their original tables back
+		std::vector<uintptr_t> instances{};
+		instances.reserve(this->m_instances.size());
+		for (const auto& [instance, original_vtable] : this->m_instances)
+			instances.push_back(instance);
+
+		// this also frees every shadow table
+		this->remove(instances);
+
+		// reset
+		this->m_tables.clear();
+		this->m_instances.clear();
+		this->m_process = nullptr;
+	}
+
+	// swap the vtables of every instance with one pause of the process (see HookTransaction)
+	void VmtHookGroup::add(const std::vector<uintptr_t>& instances) {
+		if (!this->m_process)
+			throw HookGroupNotSetup{};
+
+		const auto& process{ *this->m_process };
+
+		// instance -> original vtable, for the instances that actually need to be added
+		std::unordered_map<uintptr_t, uintptr_t> added{};
+		for (const auto instance : instances) {
+			if (!this->m_instances.contains(instance) && !added.contains(instance))
+				added[instance] = impl::read_vtable_ptr(process, instance);
+		}
+
+		if (added.empty())
+			return;
+
+		// one table per class, no matter how many instances
+		std::vector<uintptr_t> created{};
+		const ScopeGuard _guard{ [&]() {
+			for (const auto original_vtable : created) {
+				this->free_table(this->m_tables[original_vtable]);
+				this->m_tables.erase(original_vtable);
+			}
+		} };
+
+		for (const auto& [instance, original_vtable] : added) {
+			if (this->m_tables.contains(original_vtable))
+				continue;
+
+			this->m_tables[original_vtable] = this->create_table(original_vtable);
+			created.push_back(original_vtable);
+		}
+
+		// swap every table at once
+		HookTransaction transaction{ process };
+		for (const auto& [instance, original_vtable] : added)
+			impl::write_vtable_ptr(transaction, process, instance, this->m_tables[original_vtable].vtable);
+
+		transaction.commit();
+		created.clear();
+
+		for (const auto& [instance, original_vtable] : added) {
+			this->m_tables[original_vtable].references += 1;
+			this->m_instances[instance] = original_vtable;
+		}
+	}
+
+	// restore the original vtable of every instance, shadow tables are freed once nothing uses them
+	void VmtHookGroup::remove(const std::vector<uintptr_t>& instances) {
+		if (!this->m_process)
+			return;
+
+		const auto& process{ *this->m_process };
+
+		// instance -> original vtable, for the instances that are actually in the group
+		std::unordered_map<uintptr_t, uintptr_t> removed{};
+		for (const auto instance : instances) {
+			if (const auto it{ this->m_instances.find(instance) }; it != this->m_instances.end())
+				removed[instance] = it->second;
+		}
+
+		if (removed.empty())
+			return;
+
+		// swap every table back at once
+		HookTransaction transaction{ process };
+		for (const auto& [instance, original_vtable] : removed)
+			impl::write_vtable_ptr(transaction, process, instance, original_vtable);
+
+		transaction.commit();
+
+		for (const auto& [instance, original_vtable] : removed) {
+			this->m_instances.erase(instance);
+
+			const auto table{ this->m_tables.find(original_vtable) };
+
+			// nothing uses it anymore
+			if (--table->second.references == 0) {
+				this->free_table(table->second);
+				this->m_tables.erase(table);
+			}
+		}
+	}
+
+	// hook a function for every instance that uses this vtable (returns the original)
+	uintptr_t VmtHookGroup::hook(const uintptr_t original_vtable, const size_t index, const uintptr_t func) {
+		const auto it{ this->m_tables.find(original_vtable) };
+		if (it == this->m_tables.end())
+			throw VtableNotInHookGroup{};
+
+		auto& table{ it->second };
+
+		if (index >= table.size / this->m_process->get_ptr_size())
+			throw InvalidVtableIndex{};
+
+		// if function already hooked
+		if (table.original_funcs.contains(index))
+			throw FunctionAlreadyHooked{};
+
+		const auto address{ table.vtable + this->m_process->get_ptr_size() * index };
+		const auto original{ impl::read_vtable_ptr(*this->m_process, address) };
+
+		// one write, no matter how many instances
+		this->write_entry(address, func);
+		return table.original_funcs[index] = original;
+	}
+
+	// unhook a previously hooked function
+	void VmtHookGroup::unhook(const uintptr_t original_vtable, const size_t index) {
+		const auto table{ this->m_tables.find(original_vtable) };
+		if (table == this->m_tables.end())
+			return;
+
+		if (const auto it{ table->second.original_funcs.find(index) }; it != table->second.original_funcs.end()) {
+			this->write_entry(table->second.vtable + this->m_process->get_ptr_size() * index, it->second);
+			table->second.original_funcs.erase(it);
+		}
+	}
+
+	// the original vtable of an instance in the group (0 if not in the group)
+	uintptr_t VmtHookGroup::get_original_vtable(const uintptr_t instance) const {
+		const auto it{ this->m_instances.find(instance) };
+		return it == this->m_instances.end() ? 0 : it->second;
+	}
+
+	// copy the original vtable into a newly allocated table
+	VmtHookGroup::ShadowTable VmtHookGroup::create_table(const uintptr_t original_vtable) const {
+		const auto& process{ *this->m_process };
+		const auto ptr_size{ process.get_ptr_size() };
+
+		// attempt to calculate vtable size ourselves (not 100% accurate)
+		ShadowTable table{ .vtable = 0, .size = get_vtable_size(process, original_vtable), .references = 0 };
+
+		// if it's 0 then its not a virtual class lmao
+		if (!table.size)
+			throw InvalidVtableSize{};
+
+		// copy the old values to the new table (and the rtti complete locator)
+		const auto contents{ std::make_unique<uint8_t[]>(table.size + ptr_size) };
+		process.read(original_vtable - ptr_size, contents.get(), table.size + ptr_size);
+
+		const auto address{ uintptr_t(process.alloc_virt_mem(table.size + ptr_size)) };
+		process.write(address, contents.get(), table.size + ptr_size);
+
+		table.vtable = address + ptr_size;
+		return table;
+	}
+
+	// free the memory that was allocated in create_table()
+	void VmtHookGroup::free_table(const ShadowTable& table) const {
+		this->m_process->free_virt_mem(table.vtable - this->m_process->get_ptr_size());
+	}
+
+	// write a single vtable entry
+	void VmtHookGroup::write_entry(const uintptr_t address, const uintptr_t func) const {
+		// the shadow table is allocated as PAGE_READWRITE, no need to change protection
+		this->m_process->is_64bit() ?
+			this->m_process->write<uint64_t>(address, func) :
+			this->m_process->write<uint32_t>(address, uint32_t(func));
+	}
+} // namespace mango
\ No newline at end of file
@@ -5,7 +5,7 @@
 
 
 #define SYSCALL_WRAPPER(name, ...)\
-	static const auto _syscall_index_ ## name = syscall::index(enc_str(#name));\
+	static const auto _syscall_index_ ## name = syscall::index(enc_str_view(#name));\
 	return syscall::call<NTSTATUS>(_syscall_index_ ## name, __VA_ARGS__);
 
 
@@ -1,13 +1,60 @@
 #include "../../include/epic/wow64_syscall_hook.h"
 
 #include "../../include/epic/process.h"
+#include "../../include/epic/thread.h"
 #include "../../include/misc/error_codes.h"
+#include "../../include/misc/scope_guard.h"
+#include "../../include/misc/fnv_hash.h"
 #include "../../include/epic/shellcode.h"
-#include "../../include/epic/shellcode_wrappers.h"
+#include "../../include/epic/assembler.h"
+#include "../../include/epic/length_decoder.h"
+#include "../../include/epic/syscall_trace.h"
 
+#include <vector>
+#include <cstring>
+
+
+namespace mango::impl {
+	// whether any thread's (32bit) instruction pointer is inside of [begin, end)
+	// threads are suspended one at a time, and nothing is allocated while one is
+	bool is_thread_inside_wow64_stub(const Process& process, const uint32_t begin, const uint32_t end) {
+		for (const auto tid : process.get_threadids()) {
+			if (process.is_self() && tid == GetCurrentThreadId())
+				continue;
+
+			// the thread might have exited already
+			Thread thread{};
+			try {
+				thread.setup(tid, { .handle_access = THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT });
+			} catch (InvalidThreadHandle&) {
+				continue;
+			}
+
+			if (SuspendThread(thread.get_handle()) == DWORD(-1))
+				continue;
+
+			const ScopeGuard _resume_guard{ [&]() { ResumeThread(thread.get_handle()); } };
+
+			// this also makes sure the thread is actually suspended (SuspendThread() is asynchronous)
+#ifdef _WIN64
+			WOW64_CONTEXT context{ .ContextFlags = WOW64_CONTEXT_CONTROL };
+			const auto success{ Wow64GetThreadContext(thread.get_handle(), &context) };
+#else
+			CONTEXT context{ .ContextFlags = CONTEXT_CONTROL };
+			const auto success{ GetThreadContext(thread.get_handle(), &context) };
+#endif
+
+			// can't tell, so assume the worst
+			if (!success || (context.Eip >= begin && context.Eip < end))
+				return true;
+		}
+
+		return false;
+	}
+} // namespace mango::impl
 
 namespace mango {
-	// hooks
+	// hooks, if callback isn't 0 it's set as the pre callback of every syscall
 	void Wow64SyscallHook::hook(const Process& process, const uint32_t callback, const SetupOptions& options) {
 		this->release();
 
@@ -16,27 +63,44 @@ namespace mango {
 			throw NotWow64Process{};
 
 		// ntdll.dll:Wow64Transition
-		this->wow64_transition = uint32_t(process.get_proc_addr(
-			enc_str("ntdll.dll"), enc_str("Wow64Transition")));
+		constexpr size_t ntdll_hash{ Fnv1a<>("ntdll.dll") }, wow64_transition_hash{ Fnv1a<>("Wow64Transition") };
+		this->wow64_transition = uint32_t(process.get_proc_addr(ntdll_hash, wow64_transition_hash));
 
 		// older versions of windows maybe?
 		if (!this->wow64_transition)
 			throw FailedToVerifyX64Transition{};
 
-		this->m_process = &process;
-		this->m_options = options;
-
 		// so we can write
 		const auto protection{ process.set_mem_prot(this->wow64_transition, 4, PAGE_EXECUTE_READWRITE) };
 
 		// store original address
 		this->m_original = process.read<uint32_t>(this->wow64_transition);
 
-		// build the hook stub
-		this->build_shellcode(callback);
+		// the stub followed by the (zeroed) bitmap and callback tables
+		this->m_address = uint32_t(uintptr_t(process.alloc_virt_mem(memory_size, PAGE_EXECUTE_READWRITE)));
+		build_stub(this->m_address, this->m_original).write(process, this->m_address);
+
+		this->m_bitmap.fill(0);
+		this->m_trace_bitmap.fill(0);
+		this->m_callback_bitmap.fill(0);
+		this->m_trace_address = 0;
+		this->m_wrote_argument_counts = false;
+
+		// every syscall goes to the same callback
+		if (callback) {
+			const std::vector<uint32_t> callbacks(max_syscalls, callback);
+			process.write(this->m_address + pre_callbacks_offset, callbacks.data(), callbacks.size() * 4);
+
+			this->m_bitmap.fill(0xFFFFFFFF);
+			this->m_callback_bitmap.fill(0xFFFFFFFF);
+			process.write(this->m_address + bitmap_offset, this->m_bitmap.data(), sizeof(this->m_bitmap));
+		}
+
+		this->m_process = &process;
+		this->m_options = options;
 
 		// hook
-		process.write<uint32_t>(this->wow64_transition, this->m_shellcode_addr);
+		process.write<uint32_t>(this->wow64_transition, this->m_address);
 
 		// restore old protection
 		process.set_mem_prot(this->wow64_transition, 4, protection);
@@ -48,47 +112,387 @@ namespace mango {
 		if (!this->m_process)
 			return;
 
+		const auto& process{ *this->m_process };
+
 		// restore to original
-		const auto protection = this->m_process->set_mem_prot(this->wow64_transition, 4, PAGE_READWRITE);
-		this->m_process->write<uint32_t>(this->wow64_transition, this->m_original);
-		this->m_process->set_mem_prot(this->wow64_transition, 4, protection);
+		const auto protection = process.set_mem_prot(this->wow64_transition, 4, PAGE_READWRITE);
+		process.write<uint32_t>(this->wow64_transition, this->m_original);
+		process.set_mem_prot(this->wow64_transition, 4, protection);
+
+		// threads that are inside a syscall still return into the stub, make sure they skip everything
+		this->m_bitmap.fill(0);
+		this->m_trace_bitmap.fill(0);
+		this->m_callback_bitmap.fill(0);
+		process.write(this->m_address + bitmap_offset, this->m_bitmap.data(), sizeof(this->m_bitmap));
+		process.write(this->m_address + trace_bitmap_offset, this->m_trace_bitmap.data(), sizeof(this->m_trace_bitmap));
 
-		// no need anymore
-		Shellcode::free(*this->m_process, this->m_shellcode_addr);
+		// pre_callbacks and post_callbacks are right after each other
+		const std::vector<uint32_t> callbacks(max_syscalls * 2, 0);
+		process.write(this->m_address + pre_callbacks_offset, callbacks.data(), callbacks.size() * 4);
+
+		// the stub (and the trace rings) can only be freed once nothing will return into it
+		// in_flight doesn't count a thread that's right before the lock inc or right after the lock dec,
+		// so every thread's instruction pointer is checked as well once it reaches 0
+		bool in_flight{ true };
+		for (uint32_t waited{ 0 }; ; ++waited) {
+			const auto count{ process.try_read<uint32_t>(this->m_address + in_flight_offset) };
+			in_flight = count && (*count != 0 ||
+				impl::is_thread_inside_wow64_stub(process, this->m_address, this->m_address + max_stub_size));
+
+			if (!in_flight || waited >= this->m_options.release_timeout)
+				break;
+
+			Sleep(1);
+		}
+
+		if (!in_flight) {
+			process.free_virt_mem(this->m_address);
+			if (this->m_trace_address)
+				process.free_virt_mem(this->m_trace_address);
+		}
 
 		// we're all done
 		this->m_process = nullptr;
 	}
 
-	// builds the function stub
-	void Wow64SyscallHook::build_shellcode(const uint32_t callback) {
-		this->m_shellcode_addr = uint32_t(Shellcode(
-			// store the syscall index
-			"\x50", // push eax
-
-			// push arguments to our callback
-			"\x68\x00\x00\x00\x00", // push 0x00000000
-			"\x54", // push esp
-			"\x80\x04\x24\x10", // add byte ptr [esp], 10h
-			"\x50", // push eax
-
-			// call our callback
-			"\xBA", callback, // mov edx, callback
-			"\xFF\xD2", // call edx
-			"\x83\xC4\x08", // add esp, 0x8
-			"\x5A", // pop edx
-
-			// dont call original if returned false
-			"\x3C\x00", // cmp al, 0
-			"\x0F\x85\x04\x00\x00\x00", // jne 4
-			"\x89\xD0", // mov eax, edx
-			"\x5A", // pop edx (for the syscall)
-			shw::ret(),
-
-			// restore the syscall
-			"\x58", // pop eax
-			"\xBA", this->m_original, // mov edx, m_original
-			"\xFF\xE2" // jmp edx
-		).allocate_and_write(*this->m_process));
+	// set the callbacks of a single syscall (0 for none), takes effect immediately
+	void Wow64SyscallHook::set_callbacks(const uint32_t syscall_index, const uint32_t pre_callback, const uint32_t post_callback) {
+		if (syscall_index >= max_syscalls)
+			throw InvalidSyscallIndex{};
+
+		// not hooked
+		if (!this->m_process)
+			return;
+
+		// the stub copies this many arguments before calling the original
+		if (post_callback && !this->m_wrote_argument_counts)
+			this->write_argument_counts();
+
+		const auto word{ bitmap_word(syscall_index) };
+
+		// the stub also checks for null callbacks, but there's no reason to let it get that far
+		if (!pre_callback && !post_callback) {
+			this->m_callback_bitmap[word] &= ~bitmap_mask(syscall_index);
+			this->write_bitmaps(word);
+		}
+
+		this->m_process->write<uint32_t>(this->m_address + pre_callbacks_offset + syscall_index * 4, pre_callback);
+		this->m_process->write<uint32_t>(this->m_address + post_callbacks_offset + syscall_index * 4, post_callback);
+
+		// only set the bit once the callbacks are written
+		if (pre_callback || post_callback) {
+			this->m_callback_bitmap[word] |= bitmap_mask(syscall_index);
+			this->write_bitmaps(word);
+		}
+	}
+
+	// allocate the trace rings (only done once), returns their address
+	uint32_t Wow64SyscallHook::enable_tracing() {
+		// not hooked
+		if (!this->m_process)
+			return 0;
+
+		if (this->m_trace_address)
+			return this->m_trace_address;
+
+		// the stub copies this many arguments before calling the original
+		if (!this->m_wrote_argument_counts)
+			this->write_argument_counts();
+
+		// zeroed, which is an empty ring
+		this->m_trace_address = uint32_t(uintptr_t(this->m_process->alloc_virt_mem(
+			sizeof(SyscallTraceRing) * SyscallTraceRing::count, PAGE_READWRITE)));
+
+		this->m_process->write<uint32_t>(this->m_address + trace_rings_offset, this->m_trace_address);
+		return this->m_trace_address;
+	}
+
+	// trace a single syscall, takes effect immediately (calls enable_tracing())
+	void Wow64SyscallHook::set_tracing(const uint32_t syscall_index, const bool enabled) {
+		if (syscall_index >= max_syscalls)
+			throw InvalidSyscallIndex{};
+
+		// not hooked
+		if (!this->enable_tracing())
+			return;
+
+		const auto word{ bitmap_word(syscall_index) };
+
+		if (enabled)
+			this->m_trace_bitmap[word] |= bitmap_mask(syscall_index);
+		else
+			this->m_trace_bitmap[word] &= ~bitmap_mask(syscall_index);
+
+		this->write_bitmaps(word);
+	}
+
+	// trace every syscall (calls enable_tracing())
+	void Wow64SyscallHook::set_tracing(const bool enabled) {
+		// not hooked
+		if (!this->enable_tracing())
+			return;
+
+		this->m_trace_bitmap.fill(enabled ? 0xFFFFFFFF : 0);
+		for (size_t i{ 0 }; i < this->m_bitmap.size(); ++i)
+			this->m_bitmap[i] = this->m_callback_bitmap[i] | this->m_trace_bitmap[i];
+
+		// the trace bitmap first, the stub checks it again anyways
+		this->m_process->write(this->m_address + trace_bitmap_offset, this->m_trace_bitmap.data(), sizeof(this->m_trace_bitmap));
+		this->m_process->write(this->m_address + bitmap_offset, this->m_bitmap.data(), sizeof(this->m_bitmap));
+	}
+
+	// write a single word of both bitmaps, a syscall is filtered if it has callbacks or is traced
+	void Wow64SyscallHook::write_bitmaps(const uint32_t word) {
+		this->m_bitmap[word] = this->m_callback_bitmap[word] | this->m_trace_bitmap[word];
+
+		this->m_process->write<uint32_t>(this->m_address + trace_bitmap_offset + word * 4, this->m_trace_bitmap[word]);
+		this->m_process->write<uint32_t>(this->m_address + bitmap_offset + word * 4, this->m_bitmap[word]);
+	}
+
+	// builds the stub that's written at the start of the hook's memory
+	Shellcode Wow64SyscallHook::build_stub(const uint32_t address, const uint32_t original) {
+		using Reg = Assembler::Reg;
+		using Cond = Assembler::Cond;
+
+		Assembler assembler{ false };
+		const auto call_original{ assembler.new_label() },
+			check_post{ assembler.new_label() },
+			continue_pre{ assembler.new_label() },
+			copy_arguments{ assembler.new_label() },
+			copied_arguments{ assembler.new_label() },
+			wrap_original{ assembler.new_label() },
+			leave_original{ assembler.new_label() },
+			skip_trace{ assembler.new_label() },
+			skip_post{ assembler.new_label() };
+
+		// the fast path, not in the bitmap
+		assembler.cmp(Reg::eax, int32_t(max_syscalls))
+			.jcc(Cond::ae, call_original)
+			.raw("\x0F\xA3\x05", address + bitmap_offset) // bt dword ptr [bitmap], eax
+			.jcc(Cond::nc, call_original);
+
+		// everything past here can return into the stub, release() waits until this is 0
+		assembler.raw("\xF0\xFF\x05", address + in_flight_offset); // lock inc dword ptr [in_flight]
+
+		// pre callback
+		assembler.raw("\x8B\x14\x85", address + pre_callbacks_offset) // mov edx, [pre_callbacks + eax * 4]
+			.raw("\x85\xD2") // test edx, edx
+			.jcc(Cond::z, check_post);
+
+		// store the syscall index
+		assembler.push(Reg::eax);
+
+		// push arguments to our callback
+		assembler.push(uint32_t(0)) // return value
+			.push(Reg::esp)
+			.raw("\x83\x04\x24\x10") // add dword ptr [esp], 0x10 (pointer to the syscall arguments)
+			.push(Reg::eax);
+
+		// call our callback
+		assembler.call(Reg::edx)
+			.add(Reg::esp, 0x8)
+			.pop(Reg::edx);
+
+		// dont call original if returned false
+		assembler.cmp8(Reg::eax, 0)
+			.jcc(Cond::ne, continue_pre)
+			.mov(Reg::eax, Reg::edx)
+			.pop(Reg::edx) // (for the syscall)
+			.raw("\xF0\xFF\x0D", address + in_flight_offset) // lock dec dword ptr [in_flight]
+			.ret();
+
+		// restore the syscall
+		assembler.bind(continue_pre)
+			.pop(Reg::eax);
+
+		// post callback or tracing
+		assembler.bind(check_post)
+			.raw("\x8B\x14\x85", address + post_callbacks_offset) // mov edx, [post_callbacks + eax * 4]
+			.raw("\x85\xD2") // test edx, edx
+			.jcc(Cond::nz, wrap_original)
+			.raw("\x0F\xA3\x05", address + trace_bitmap_offset) // bt dword ptr [trace_bitmap], eax
+			.jcc(Cond::nc, leave_original);
+
+		// ebx = syscall index, ecx = argument count
+		assembler.bind(wrap_original)
+			.push(Reg::ebx)
+			.push(Reg::esi)
+			.mov(Reg::ebx, Reg::eax)
+			.raw("\x0F\x31") // rdtsc
+			.push(Reg::edx)
+			.push(Reg::eax)
+			.raw("\x0F\xB6\x8B", address + argument_counts_offset) // movzx ecx, byte ptr [argument_counts + ebx]
+			.mov(Reg::esi, Reg::ecx);
+
+		// copy the arguments so the original returns to us instead of ntdll
+		// every push moves esp down, so the last argument that's left is always at [esp + ecx * 4 + 0x14]
+		assembler.bind(copy_arguments)
+			.raw("\x85\xF6") // test esi, esi
+			.jcc(Cond::z, copied_arguments)
+			.raw("\xFF\x74\x8C\x14") // push dword ptr [esp + ecx * 4 + 0x14]
+			.sub(Reg::esi, 1)
+			.jmp(copy_arguments);
+
+		// the argument count takes the place of the return address into the caller
+		assembler.bind(copied_arguments)
+			.push(Reg::ecx)
+			.mov(Reg::eax, Reg::ebx)
+			.mov(Reg::edx, original)
+			.call(Reg::edx);
+
+		// remove the copied arguments
+		assembler.pop(Reg::ecx)
+			.raw("\x8D\x24\x8C"); // lea esp, [esp + ecx * 4]
+
+		// [esp] = end tsc, [esp + 0x8] = return value, [esp + 0xC] = start tsc, [esp + 0x24] = syscall arguments
+		assembler.push(Reg::eax)
+			.raw("\x0F\x31") // rdtsc
+			.push(Reg::edx)
+			.push(Reg::eax)
+			.raw("\x0F\xA3\x1D", address + trace_bitmap_offset) // bt dword ptr [trace_bitmap], ebx
+			.jcc(Cond::nc, skip_trace);
+
+		// ecx = the thread's ring, esi = thread id
+		assembler.raw("\x64\x8B\x0D\x24\x00\x00\x00") // mov ecx, fs:[0x24] (TEB::ClientId::UniqueThread)
+			.mov(Reg::esi, Reg::ecx)
+			.raw("\xC1\xE9\x02") // shr ecx, 2
+			.and_(Reg::ecx, int32_t(SyscallTraceRing::count - 1))
+			.raw("\x69\xC9", uint32_t(sizeof(SyscallTraceRing))) // imul ecx, ecx, sizeof(SyscallTraceRing)
+			.raw("\x03\x0D", address + trace_rings_offset); // add ecx, [trace_rings]
+
+		// reserve a record, edx = position in the ring
+		assembler.mov(Reg::edx, 1)
+			.raw("\xF0\x0F\xC1\x11") // lock xadd [ecx], edx
+			.mov(Reg::eax, Reg::edx)
+			.and_(Reg::eax, int32_t(SyscallTraceRing::capacity - 1))
+			.raw("\x69\xC0", uint32_t(sizeof(SyscallTraceRecord))) // imul eax, eax, sizeof(SyscallTraceRecord)
+			.raw("\x8D\x8C\x01", uint32_t(offsetof(SyscallTraceRing, records))); // lea ecx, [ecx + eax + records]
+
+		// invalidate the record while it's being written
+		assembler.raw("\xC7\x01", uint32_t(0)) // mov dword ptr [ecx], 0
+			.raw("\x89\x59", uint8_t(offsetof(SyscallTraceRecord, syscall_index))) // mov [ecx + syscall_index], ebx
+			.raw("\x89\x71", uint8_t(offsetof(SyscallTraceRecord, thread_id))); // mov [ecx + thread_id], esi
+
+		// mov eax, [esp + stack_offset]
+		// mov [ecx + record_offset], eax
+		const auto copy_dword{ [&](const uint8_t stack_offset, const size_t record_offset) {
+			assembler.raw("\x8B\x44\x24", stack_offset)
+				.raw("\x89\x41", uint8_t(record_offset));
+		} };
+
+		copy_dword(0x08, offsetof(SyscallTraceRecord, return_value));
+		copy_dword(0x0C, offsetof(SyscallTraceRecord, start_tsc));
+		copy_dword(0x10, offsetof(SyscallTraceRecord, start_tsc) + 4);
+		copy_dword(0x00, offsetof(SyscallTraceRecord, end_tsc));
+		copy_dword(0x04, offsetof(SyscallTraceRecord, end_tsc) + 4);
+
+		for (uint8_t i{ 0 }; i < 4; ++i)
+			copy_dword(0x24 + i * 4, offsetof(SyscallTraceRecord, arguments) + i * 4);
+
+		// the record is complete
+		assembler.add(Reg::edx, 1)
+			.raw("\x89\x11"); // mov [ecx], edx
+
+		// pop the tsc values and the return value
+		assembler.bind(skip_trace)
+			.add(Reg::esp, 0x8)
+			.pop(Reg::eax)
+			.add(Reg::esp, 0x8);
+
+		// push arguments to our callback
+		assembler.push(Reg::eax) // return value
+			.push(Reg::esp)
+			.push(Reg::esp)
+			.raw("\x83\x04\x24\x18") // add dword ptr [esp], 0x18 (pointer to the syscall arguments)
+			.push(Reg::ebx);
+
+		// it could've been removed during the syscall
+		assembler.raw("\x8B\x14\x9D", address + post_callbacks_offset) // mov edx, [post_callbacks + ebx * 4]
+			.raw("\x85\xD2") // test edx, edx
+			.jcc(Cond::z, skip_post)
+			.call(Reg::edx);
+
+		assembler.bind(skip_post)
+			.add(Reg::esp, 0xC)
+			.pop(Reg::eax)
+			.pop(Reg::esi)
+			.pop(Reg::ebx)
+			.raw("\xF0\xFF\x0D", address + in_flight_offset) // lock dec dword ptr [in_flight]
+			.ret();
+
+		// filtered, but nothing to do after the syscall
+		assembler.bind(leave_original)
+			.raw("\xF0\xFF\x0D", address + in_flight_offset); // lock dec dword ptr [in_flight]
+
+		// not hooked
+		assembler.bind(call_original)
+			.mov(Reg::edx, original)
+			.jmp(Reg::edx);
+
+		return assembler.assemble(address);
+	}
+
+	// the syscall index and argument count of an ntdll stub
+	std::optional<std::pair<uint32_t, uint8_t>> Wow64SyscallHook::parse_syscall_stub(const uint8_t* const code, const size_t size) noexcept {
+		// mov eax, imm32
+		if (size < 5 || code[0] != 0xB8)
+			return {};
+
+		uint32_t syscall_index{};
+		std::memcpy(&syscall_index, code + 1, 4);
+
+		// the ret should only be a couple of instructions away
+		for (size_t offset{ 5 }, i{ 0 }; offset < size && i < 8; ++i) {
+			const auto instruction{ ild::decode(code + offset, size - offset, false) };
+			if (!instruction)
+				return {};
+
+			if (instruction.map == ild::OpcodeMap::primary) {
+				// ret
+				if (instruction.opcode == 0xC3)
+					return std::pair{ syscall_index, uint8_t(0) };
+
+				// ret imm16
+				if (instruction.opcode == 0xC2) {
+					uint16_t bytes{};
+					std::memcpy(&bytes, code + offset + instruction.imm_offset, 2);
+					return std::pair{ syscall_index, uint8_t(bytes / 4) };
+				}
+			}
+
+			offset += instruction.length;
+		}
+
+		return {};
+	}
+
+	// write the argument counts of every ntdll syscall, only needed for post callbacks
+	void Wow64SyscallHook::write_argument_counts() {
+		const auto ntdll{ this->m_process->get_module(enc_str_view("ntdll.dll")) };
+		if (!ntdll)
+			throw FailedToFindModule{};
+
+		// one read instead of one per syscall
+		std::vector<uint8_t> image(ntdll->get_image_size());
+		this->m_process->read(ntdll->get_image_base(), image.data(), image.size());
+
+		std::array<uint8_t, max_syscalls> counts{};
+		counts.fill(default_argument_count);
+
+		for (const auto& [name, entry] : ntdll->get_exports()) {
+			// Nt* exports that aren't syscalls have no Zw* alias
+			if (name.size() < 2 || name[0] != 'Z' || name[1] != 'w')
+				continue;
+
+			const auto offset{ entry.address - ntdll->get_image_base() };
+			if (offset >= image.size())
+				continue;
+
+			if (const auto stub{ parse_syscall_stub(image.data() + offset, image.size() - offset) }; stub && stub->first < max_syscalls)
+				counts[stub->first] = stub->second;
+		}
+
+		this->m_process->write(this->m_address + argument_counts_offset, counts.data(), counts.size());
+		this->m_wrote_argument_counts = true;
 	}
 } // namespace mango
\ No newline at end of file
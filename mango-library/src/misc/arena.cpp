@@ -0,0 +1,128 @@
+#include "../../include/misc/arena.h"
+
+#include <utility>
+#include <algorithm>
+
+
+namespace mango::impl {
+	// alignment has to be a power of 2
+	constexpr uintptr_t arena_align_up(const uintptr_t value, const size_t alignment) noexcept {
+		return (value + alignment - 1) & ~uintptr_t(alignment - 1);
+	}
+} // namespace mango::impl
+
+namespace mango {
+	Arena::Arena(const size_t initial_size, std::pmr::memory_resource* const upstream)
+		: m_upstream{ upstream }, m_initial_size{ std::max<size_t>(initial_size, 0x40) } {}
+
+	// invalidate every allocation but keep the memory for reuse
+	// if the arena grew, the chunks are replaced by a single one that's big enough for all of it
+	void Arena::reset() {
+		if (!this->m_chunks)
+			return;
+
+		this->m_used_size = 0;
+
+		// only one chunk, just start over
+		if (!this->m_chunks->next) {
+			this->m_position = uintptr_t(this->m_chunks) + impl::arena_align_up(sizeof(Chunk), alignof(std::max_align_t));
+			return;
+		}
+
+		const auto capacity{ this->m_capacity };
+		this->release();
+		this->add_chunk(capacity);
+	}
+
+	// give every chunk back to upstream
+	void Arena::release() noexcept {
+		constexpr auto header_size{ impl::arena_align_up(sizeof(Chunk), alignof(std::max_align_t)) };
+
+		while (this->m_chunks) {
+			const auto chunk{ std::exchange(this->m_chunks, this->m_chunks->next) };
+			this->m_upstream->deallocate(chunk, header_size + chunk->size, alignof(std::max_align_t));
+		}
+
+		this->m_position = this->m_end = 0;
+		this->m_used_size = this->m_capacity = 0;
+	}
+
+	void* Arena::do_allocate(const size_t size, const size_t alignment) {
+		auto address{ impl::arena_align_up(this->m_position, alignment) };
+
+		// doesn't fit, the chunks grow geometrically
+		if (!this->m_chunks || address > this->m_end || size > this->m_end - address) {
+			this->add_chunk(std::max(size + alignment, this->m_chunks ? this->m_chunks->size * 2 : this->m_initial_size));
+			address = impl::arena_align_up(this->m_position, alignment);
+		}
+
+		this->m_used_size += address + size - this->m_position;
+		this->m_position = address + size;
+		return reinterpret_cast<void*>(address);
+	}
+
+	// allocate a chunk from upstream and start using it
+	void Arena::add_chunk(const size_t size) {
+		constexpr auto header_size{ impl::arena_align_up(sizeof(Chunk), alignof(std::max_align_t)) };
+
+		const auto chunk{ static_cast<Chunk*>(this->m_upstream->allocate(header_size + size, alignof(std::max_align_t))) };
+		chunk->next = this->m_chunks;
+		chunk->size = size;
+
+		this->m_chunks = chunk;
+		this->m_position = uintptr_t(chunk) + header_size;
+		this->m_end = this->m_position + size;
+		this->m_capacity += size;
+	}
+
+	Pool::Pool(const size_t block_size, const size_t blocks_per_chunk, std::pmr::memory_resource* const upstream)
+		: m_upstream{ upstream },
+		  m_block_size{ impl::arena_align_up(std::max(block_size, sizeof(Node)), block_alignment) },
+		  m_blocks_per_chunk{ std::max<size_t>(blocks_per_chunk, 1) } {}
+
+	// give every chunk back to upstream (every block is invalidated)
+	void Pool::release() noexcept {
+		constexpr auto header_size{ impl::arena_align_up(sizeof(Node), block_alignment) };
+
+		while (this->m_chunks) {
+			const auto chunk{ std::exchange(this->m_chunks, this->m_chunks->next) };
+			this->m_upstream->deallocate(chunk, header_size + this->m_block_size * this->m_blocks_per_chunk, block_alignment);
+		}
+
+		this->m_free_blocks = nullptr;
+	}
+
+	void* Pool::do_allocate(const size_t size, const size_t alignment) {
+		if (size > this->m_block_size || alignment > block_alignment)
+			return this->m_upstream->allocate(size, alignment);
+
+		// no free blocks left, allocate another chunk of them
+		if (!this->m_free_blocks) {
+			constexpr auto header_size{ impl::arena_align_up(sizeof(Node), block_alignment) };
+
+			const auto chunk{ static_cast<Node*>(this->m_upstream->allocate(
+				header_size + this->m_block_size * this->m_blocks_per_chunk, block_alignment)) };
+			chunk->next = this->m_chunks;
+			this->m_chunks = chunk;
+
+			// in reverse so that the lowest blocks are used first
+			const auto blocks{ reinterpret_cast<uint8_t*>(chunk) + header_size };
+			for (size_t i{ this->m_blocks_per_chunk }; i > 0; --i) {
+				const auto block{ reinterpret_cast<Node*>(blocks + (i - 1) * this->m_block_size) };
+				block->next = this->m_free_blocks;
+				this->m_free_blocks = block;
+			}
+		}
+
+		return std::exchange(this->m_free_blocks, this->m_free_blocks->next);
+	}
+
+	void Pool::do_deallocate(void* const address, const size_t size, const size_t alignment) {
+		if (size > this->m_block_size || alignment > block_alignment)
+			return this->m_upstream->deallocate(address, size, alignment);
+
+		const auto block{ static_cast<Node*>(address) };
+		block->next = this->m_free_blocks;
+		this->m_free_blocks = block;
+	}
+} // namespace mango
\ No newline at end of file
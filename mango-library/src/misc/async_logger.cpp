@@ -0,0 +1,318 @@
+#include "../../include/misc/async_logger.h"
+
+#include "../../include/misc/error_codes.h"
+
+#include <bit>
+#include <cstring>
+#include <sstream>
+#include <Windows.h>
+
+
+namespace mango::impl {
+	// the rings that the current thread is using, one for every AsyncLogger
+	// the loggers own them, so ring is only valid while the weak reference hasn't expired
+	struct ThreadLogRing {
+		uint64_t id;
+		LogRing* ring;
+		std::weak_ptr<LogRing> owner;
+	};
+
+	struct ThreadLogRings {
+		std::vector<ThreadLogRing> rings;
+
+		// the thread exited, let another thread have them
+		~ThreadLogRings() {
+			for (const auto& entry : this->rings) {
+				if (const auto ring{ entry.owner.lock() })
+					ring->release();
+			}
+		}
+	};
+
+	thread_local ThreadLogRings thread_log_rings{};
+} // namespace mango::impl
+
+namespace mango {
+	// size is rounded up to a power of 2
+	LogRing::LogRing(const size_t size)
+		: m_size{ std::bit_ceil(std::max<size_t>(size, 0x100)) } {
+		this->m_buffer = std::make_unique<uint8_t[]>(this->m_size);
+	}
+
+	// producer side, false if there isn't enough room
+	bool LogRing::try_push(const LogType type, const Format format, const void* const data, const size_t size) noexcept {
+		if (size > this->get_max_record_size())
+			return false;
+
+		const auto record_size{ get_record_size(size) };
+		auto head{ this->m_head.load(std::memory_order_relaxed) };
+
+		// records are never split, so skip whatever is left at the end if it's too small
+		const auto contiguous{ this->m_size - (head & (this->m_size - 1)) };
+		const auto needed{ record_size + (contiguous < record_size ? contiguous : 0) };
+
+		// only look at the consumer's tail when the cached one says we're full
+		if (this->m_size - (head - this->m_cached_tail) < needed) {
+			this->m_cached_tail = this->m_tail.load(std::memory_order_acquire);
+			if (this->m_size - (head - this->m_cached_tail) < needed)
+				return false;
+		}
+
+		if (contiguous < record_size) {
+			*reinterpret_cast<Header*>(&this->m_buffer[head & (this->m_size - 1)]) = {
+				.size = uint32_t(contiguous - sizeof(Header)),
+				.type = uint8_t(type),
+				.format = Format::padding
+			};
+
+			head += contiguous;
+		}
+
+		const auto header{ reinterpret_cast<Header*>(&this->m_buffer[head & (this->m_size - 1)]) };
+		*header = { .size = uint32_t(size), .type = uint8_t(type), .format = format };
+		std::memcpy(header + 1, data, size);
+
+		this->m_head.store(head + record_size, std::memory_order_release);
+		return true;
+	}
+
+	// channels has to outlive this
+	AsyncLogger::AsyncLogger(const LoggingChannels& channels, const AsyncLoggingOptions& options)
+		: m_channels{ &channels }, m_options{ options } {
+		static std::atomic<uint64_t> next_id{ 1 };
+		this->m_id = next_id.fetch_add(1, std::memory_order_relaxed);
+
+		if (!options.binary_file.empty()) {
+			this->m_binary_file.open(options.binary_file, std::ios::binary | std::ios::trunc);
+			if (!this->m_binary_file)
+				throw FailedToOpenLogFile{ options.binary_file };
+
+			const impl::BinaryLogHeader header{ .magic = impl::binary_log_magic, .version = impl::binary_log_version };
+			this->m_binary_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		}
+
+		this->m_running = true;
+		this->m_thread = std::thread{ [this]() {
+			std::unique_lock lock{ this->m_thread_mutex };
+
+			while (this->m_running) {
+				this->m_wake_cv.wait_for(lock, this->m_options.flush_interval);
+
+				// every record that was pushed before this point will be delivered by this drain
+				const auto flush_requested{ this->m_flush_requested };
+
+				lock.unlock();
+				this->drain();
+				lock.lock();
+
+				this->m_flush_completed = flush_requested;
+				this->m_flushed_cv.notify_all();
+			}
+
+			// stop() doesn't join, so nothing can be touched after this
+			lock.unlock();
+			this->m_exited.store(true, std::memory_order_release);
+		} };
+
+		this->m_thread_id = this->m_thread.get_id();
+	}
+
+	// push a record into the calling thread's ring, false if it was dropped
+	bool AsyncLogger::push(const LogType type, const std::string_view text) {
+		auto& ring{ this->get_ring() };
+
+		// too big for the ring, cut it off
+		const auto size{ std::min(text.size(), ring.get_max_record_size()) };
+
+		return this->push_record(ring, type, LogRing::Format::text, text.data(), size);
+	}
+
+	// same as above but for a record that was written by Logger::log()
+	// unlike text, this is dropped instead of cut off if it's too big for the ring
+	bool AsyncLogger::push_binary(const LogType type, const void* const data, const size_t size) {
+		auto& ring{ this->get_ring() };
+
+		if (size > ring.get_max_record_size()) {
+			ring.add_dropped();
+			return false;
+		}
+
+		return this->push_record(ring, type, LogRing::Format::binary, data, size);
+	}
+
+	// block until every record that was pushed before this call was delivered
+	void AsyncLogger::flush() {
+		std::unique_lock lock{ this->m_thread_mutex };
+		if (!this->m_running)
+			return;
+
+		const auto request{ ++this->m_flush_requested };
+		this->m_wake_cv.notify_one();
+
+		this->m_flushed_cv.wait(lock, [&]() { return !this->m_running || this->m_flush_completed >= request; });
+	}
+
+	// deliver whatever is left and stop the background thread
+	void AsyncLogger::stop() {
+		if (!this->m_thread.joinable())
+			return;
+
+		const auto thread_handle{ HANDLE(this->m_thread.native_handle()) };
+
+		// the thread was already killed (ExitProcess), it might've been holding the mutex
+		if (WaitForSingleObject(thread_handle, 0) == WAIT_TIMEOUT) {
+			{
+				const std::lock_guard lock{ this->m_thread_mutex };
+				this->m_running = false;
+			}
+
+			this->m_wake_cv.notify_one();
+
+			// join() would deadlock under the loader lock (static destructors of a dll), since the thread
+			// can't exit until it's released, so only wait until it's out of the loop
+			while (!this->m_exited.load(std::memory_order_acquire) && WaitForSingleObject(thread_handle, 1) == WAIT_TIMEOUT);
+		}
+
+		this->m_thread.detach();
+
+		// anything that was pushed while the thread was stopping
+		this->drain();
+		this->m_flushed_cv.notify_all();
+	}
+
+	// records that were dropped because a ring was full
+	uint64_t AsyncLogger::get_dropped() const {
+		const std::lock_guard lock{ this->m_rings_mutex };
+
+		uint64_t dropped{ 0 };
+		for (const auto& ring : this->m_rings)
+			dropped += ring->get_dropped();
+
+		return dropped;
+	}
+
+	// the ring of the calling thread, created on the first push() from each thread
+	LogRing& AsyncLogger::get_ring() {
+		auto& cached{ impl::thread_log_rings.rings };
+		for (const auto& entry : cached) {
+			if (entry.id == this->m_id)
+				return *entry.ring;
+		}
+
+		// forget the rings of loggers that were destroyed, ids are never reused
+		std::erase_if(cached, [](const impl::ThreadLogRing& entry) { return entry.owner.expired(); });
+
+		const std::lock_guard lock{ this->m_rings_mutex };
+
+		// reuse the ring of a thread that exited
+		std::shared_ptr<LogRing> ring{};
+		for (const auto& existing : this->m_rings) {
+			if (existing->try_acquire()) {
+				ring = existing;
+				break;
+			}
+		}
+
+		if (!ring) {
+			ring = std::make_shared<LogRing>(this->m_options.ring_size);
+			this->m_rings.push_back(ring);
+			this->m_ring_count.store(this->m_rings.size(), std::memory_order_release);
+		}
+
+		cached.push_back({ .id = this->m_id, .ring = ring.get(), .owner = ring });
+		return *ring;
+	}
+
+	// apply the overflow policy if the record doesn't fit
+	bool AsyncLogger::push_record(LogRing& ring, const LogType type, const LogRing::Format format, const void* const data, const size_t size) {
+		if (ring.try_push(type, format, data, size))
+			return true;
+
+		// the background thread can't wait for itself
+		if (this->m_options.overflow_policy == LogOverflowPolicy::block && std::this_thread::get_id() != this->m_thread_id) {
+			do {
+				this->m_wake_cv.notify_one();
+				std::this_thread::yield();
+			} while (!ring.try_push(type, format, data, size));
+
+			return true;
+		}
+
+		ring.add_dropped();
+		return false;
+	}
+
+	// consume every ring once
+	void AsyncLogger::drain() {
+		// new rings were added since last time
+		if (this->m_ring_count.load(std::memory_order_acquire) != this->m_drained_rings.size()) {
+			const std::lock_guard lock{ this->m_rings_mutex };
+			this->m_drained_rings = this->m_rings;
+		}
+
+		for (const auto& ring : this->m_drained_rings) {
+			ring->consume([this](const LogType type, const LogRing::Format format, const void* const data, const size_t size) {
+				this->deliver(type, format, data, size);
+			});
+		}
+
+		if (this->m_binary_file.is_open())
+			this->m_binary_file.flush();
+	}
+
+	// pass a single record to its channel, or write it to the binary log
+	void AsyncLogger::deliver(const LogType type, const LogRing::Format format, const void* const data, const size_t size) {
+		if (this->m_binary_file.is_open()) {
+			if (format == LogRing::Format::text)
+				return this->write_entry(impl::BinaryLogEntryKind::text, type, data, size);
+
+			uint32_t id{ 0 };
+			std::memcpy(&id, data, sizeof(id));
+
+			// the first record of every format is preceded by the format itself
+			if (id >= this->m_written_formats.size() || !this->m_written_formats[id]) {
+				const auto log_format{ get_log_format(id) };
+				const auto arg_count{ uint32_t(log_format->arg_count) };
+
+				std::string payload(sizeof(id) + sizeof(arg_count), '\0');
+				std::memcpy(payload.data(), &id, sizeof(id));
+				std::memcpy(payload.data() + sizeof(id), &arg_count, sizeof(arg_count));
+				payload.append(reinterpret_cast<const char*>(log_format->arg_types), arg_count);
+				payload.append(log_format->format);
+
+				this->write_entry(impl::BinaryLogEntryKind::format, type, payload.data(), payload.size());
+
+				this->m_written_formats.resize(std::max<size_t>(this->m_written_formats.size(), id + 1));
+				this->m_written_formats[id] = true;
+			}
+
+			return this->write_entry(impl::BinaryLogEntryKind::record, type, data, size);
+		}
+
+		const auto channel{ this->m_channels->channels[size_t(type)] };
+		if (!channel)
+			return;
+
+		std::ostringstream ss{};
+		if (format == LogRing::Format::text)
+			ss << std::string_view{ static_cast<const char*>(data), size };
+		else {
+			uint32_t id{ 0 };
+			std::memcpy(&id, data, sizeof(id));
+
+			// the formatting that Logger::log() skipped
+			const auto log_format{ get_log_format(id) };
+			impl::render_log_args(ss, log_format->format, log_format->arg_types, log_format->arg_count,
+				static_cast<const uint8_t*>(data) + sizeof(id), size - sizeof(id));
+		}
+
+		channel(std::move(ss));
+	}
+
+	// append an entry to the binary log
+	void AsyncLogger::write_entry(const impl::BinaryLogEntryKind kind, const LogType type, const void* const data, const size_t size) {
+		const impl::BinaryLogEntry entry{ .size = uint32_t(size), .kind = kind, .type = uint16_t(type) };
+		this->m_binary_file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+		this->m_binary_file.write(static_cast<const char*>(data), std::streamsize(size));
+	}
+} // namespace mango
@@ -0,0 +1,125 @@
+#include "../../include/misc/binary_log.h"
+
+#include <mutex>
+#include <deque>
+
+
+namespace mango::impl {
+	// the process-wide format table, the index is the id
+	// a deque so that the pointers returned by get_log_format() stay valid
+	struct LogFormatTable {
+		std::mutex mutex;
+		std::deque<LogFormat> formats;
+	};
+
+	// constructed on first use, call sites can log during static initialization
+	LogFormatTable& get_log_format_table() {
+		static LogFormatTable table{};
+		return table;
+	}
+
+	// read a trivially copyable value from a record, false if there isn't enough left
+	template <typename T>
+	bool read_log_arg(const uint8_t*& data, const uint8_t* const end, T& value) noexcept {
+		if (size_t(end - data) < sizeof(T))
+			return false;
+
+		std::memcpy(&value, data, sizeof(T));
+		data += sizeof(T);
+		return true;
+	}
+
+	// read a single argument and write it the same way operator<< would have
+	bool render_log_arg(std::ostream& stream, const LogArgType type, const uint8_t*& data, const uint8_t* const end) {
+		const auto render{ [&]<typename T>(T value) {
+			if (!read_log_arg(data, end, value))
+				return false;
+
+			stream << value;
+			return true;
+		} };
+
+		switch (type) {
+		case LogArgType::boolean: return render(bool{});
+		case LogArgType::character: return render(char{});
+		case LogArgType::int8: return render(int8_t{});
+		case LogArgType::uint8: return render(uint8_t{});
+		case LogArgType::int16: return render(int16_t{});
+		case LogArgType::uint16: return render(uint16_t{});
+		case LogArgType::int32: return render(int32_t{});
+		case LogArgType::uint32: return render(uint32_t{});
+		case LogArgType::int64: return render(int64_t{});
+		case LogArgType::uint64: return render(uint64_t{});
+		case LogArgType::float32: return render(float{});
+		case LogArgType::float64: return render(double{});
+		case LogArgType::pointer: {
+			uint64_t address{ 0 };
+			if (!read_log_arg(data, end, address))
+				return false;
+
+			stream << reinterpret_cast<const void*>(uintptr_t(address));
+			return true;
+		}
+		case LogArgType::string: {
+			uint16_t size{ 0 };
+			if (!read_log_arg(data, end, size) || size_t(end - data) < size)
+				return false;
+
+			stream << std::string_view{ reinterpret_cast<const char*>(data), size };
+			data += size;
+			return true;
+		}
+		}
+
+		return false;
+	}
+
+	// add a format to the process-wide table, returns its id
+	uint32_t register_log_format(const LogFormat& format) {
+		auto& table{ get_log_format_table() };
+
+		const std::lock_guard lock{ table.mutex };
+		table.formats.push_back(format);
+		return uint32_t(table.formats.size() - 1);
+	}
+
+	// write the format with every "{}" replaced by the next argument
+	// returns false if the arguments don't match the types
+	bool render_log_args(std::ostream& stream, const std::string_view format,
+		const LogArgType* const arg_types, const size_t arg_count, const uint8_t* data, const size_t size)
+	{
+		const auto end{ data + size };
+
+		size_t arg{ 0 };
+		for (size_t i{ 0 }; i < format.size(); ++i) {
+			// escaped braces
+			if (i + 1 < format.size() && format[i] == format[i + 1] && (format[i] == '{' || format[i] == '}')) {
+				stream << format[i++];
+				continue;
+			}
+
+			if (format[i] != '{' || i + 1 >= format.size() || format[i + 1] != '}') {
+				stream << format[i];
+				continue;
+			}
+
+			if (arg >= arg_count || !render_log_arg(stream, arg_types[arg++], data, end))
+				return false;
+
+			++i;
+		}
+
+		// every argument was used, and nothing else is left
+		return arg == arg_count && data == end;
+	}
+} // namespace mango::impl
+
+namespace mango {
+	// the format that was registered with this id, nullptr if there isn't one
+	const LogFormat* get_log_format(const uint32_t id) {
+		auto& table{ impl::get_log_format_table() };
+
+		const std::lock_guard lock{ table.mutex };
+		return id < table.formats.size() ? &table.formats[id] : nullptr;
+	}
+} // namespace mango
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "../../include/misc/log_decoder.h"
+
+#include "../../include/misc/binary_log.h"
+#include "../../include/misc/error_codes.h"
+
+#include <sstream>
+#include <cstring>
+#include <unordered_map>
+
+
+namespace mango::impl {
+	// a format that was read from the log, the LogFormat points into this
+	struct DecodedLogFormat {
+		std::string format;
+		std::vector<LogArgType> arg_types;
+	};
+
+	// parse the payload of a BinaryLogEntryKind::format entry
+	DecodedLogFormat decode_log_format(const std::string_view payload, uint32_t& id) {
+		uint32_t arg_count{ 0 };
+		if (payload.size() < sizeof(id) + sizeof(arg_count))
+			throw InvalidBinaryLog{};
+
+		std::memcpy(&id, payload.data(), sizeof(id));
+		std::memcpy(&arg_count, payload.data() + sizeof(id), sizeof(arg_count));
+
+		const auto types{ payload.substr(sizeof(id) + sizeof(arg_count)) };
+		if (types.size() < arg_count)
+			throw InvalidBinaryLog{};
+
+		DecodedLogFormat format{ .format = std::string{ types.substr(arg_count) } };
+		for (size_t i{ 0 }; i < arg_count; ++i) {
+			if (uint8_t(types[i]) > uint8_t(LogArgType::string))
+				throw InvalidBinaryLog{};
+
+			format.arg_types.push_back(LogArgType(types[i]));
+		}
+
+		return format;
+	}
+} // namespace mango::impl
+
+namespace mango {
+	// read every record from a binary log (see AsyncLoggingOptions::binary_file)
+	// an entry that was cut off at the end (the process died while writing it) is ignored
+	// throws InvalidBinaryLog if the stream isn't a binary log or if it's corrupted
+	std::vector<DecodedLogRecord> decode_binary_log(std::istream& stream) {
+		impl::BinaryLogHeader header{};
+		if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+			header.magic != impl::binary_log_magic || header.version != impl::binary_log_version)
+			throw InvalidBinaryLog{};
+
+		std::unordered_map<uint32_t, impl::DecodedLogFormat> formats{};
+		std::vector<DecodedLogRecord> records{};
+
+		// reused for every entry
+		std::string payload{};
+		std::ostringstream text{};
+
+		impl::BinaryLogEntry entry{};
+		while (stream.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+			payload.resize(entry.size);
+			if (!stream.read(payload.data(), entry.size))
+				break;
+
+			if (entry.type > uint16_t(LogType::error))
+				throw InvalidBinaryLog{};
+
+			switch (entry.kind) {
+			case impl::BinaryLogEntryKind::format: {
+				uint32_t id{ 0 };
+				auto format{ impl::decode_log_format(payload, id) };
+				formats.insert_or_assign(id, std::move(format));
+				break;
+			}
+			case impl::BinaryLogEntryKind::record: {
+				uint32_t id{ 0 };
+				if (entry.size < sizeof(id))
+					throw InvalidBinaryLog{};
+
+				std::memcpy(&id, payload.data(), sizeof(id));
+
+				// every format is written before the first record that uses it
+				const auto format{ formats.find(id) };
+				if (format == formats.end())
+					throw InvalidBinaryLog{};
+
+				text.str({});
+				if (!impl::render_log_args(text, format->second.format, format->second.arg_types.data(),
+					format->second.arg_types.size(), reinterpret_cast<const uint8_t*>(payload.data()) + sizeof(id), entry.size - sizeof(id)))
+					throw InvalidBinaryLog{};
+
+				records.push_back({ LogType(entry.type), text.str() });
+				break;
+			}
+			case impl::BinaryLogEntryKind::text:
+				records.push_back({ LogType(entry.type), payload });
+				break;
+			default:
+				throw InvalidBinaryLog{};
+			}
+		}
+
+		return records;
+	}
+} // namespace mango
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "../../include/misc/logger.h"
 
+#include "../../include/misc/async_logger.h"
 #include "../../include/misc/error_codes.h"
 
+#include <cstring>
+#include <utility>
 #include <iostream>
 #include <Windows.h>
 
@@ -83,4 +86,60 @@ namespace mango {
 			}
 		};
 	}
+
+	// calls stop_async() so nothing that was logged is lost
+	Logger::~Logger() {
+		this->stop_async();
+	}
+
+	// records are pushed into per-thread rings and the channels are called from a background thread
+	void Logger::start_async(const AsyncLoggingOptions& options) {
+		this->stop_async();
+		this->m_async = new AsyncLogger{ this->m_channels, options };
+		this->m_binary_file = !options.binary_file.empty();
+	}
+
+	// deliver every pending record and go back to calling the channels directly
+	void Logger::stop_async() {
+		if (!this->m_async)
+			return;
+
+		// delivers whatever is left
+		this->m_async->stop();
+		delete std::exchange(this->m_async, nullptr);
+		this->m_binary_file = false;
+	}
+
+	// block until every record that was logged before this call was delivered
+	void Logger::flush() {
+		if (this->m_async)
+			this->m_async->flush();
+	}
+
+	// records that were dropped because of LogOverflowPolicy::drop
+	uint64_t Logger::get_dropped() const {
+		return this->m_async ? this->m_async->get_dropped() : 0;
+	}
+
+	void Logger::push_async(const LogType type, const std::string_view text) {
+		this->m_async->push(type, text);
+	}
+
+	// a record that was written by log()
+	void Logger::push_binary(const LogType type, const void* const data, const size_t size) {
+		if (this->m_async) {
+			this->m_async->push_binary(type, data, size);
+			return;
+		}
+
+		uint32_t id{ 0 };
+		std::memcpy(&id, data, sizeof(id));
+		const auto format{ get_log_format(id) };
+
+		// not async, format it right away
+		std::ostringstream ss{};
+		impl::render_log_args(ss, format->format, format->arg_types, format->arg_count,
+			static_cast<const uint8_t*>(data) + sizeof(id), size - sizeof(id));
+		this->m_channels.channels[size_t(type)](std::move(ss));
+	}
 } // namespace mango
\ No newline at end of file
@@ -1,43 +1,222 @@
 #include "../../include/misc/memory_allocator.h"
 
 #include "../../include/epic/process.h"
+#include "../../include/misc/error_codes.h"
+
+#include <bit>
+#include <utility>
+#include <algorithm>
 
 
 namespace mango {
-	// allocate a block of memory
+	// allocate a block of memory (aligned to a multiple of 16)
 	uintptr_t MemoryAllocator::allocate(const size_t size) {
-		if (this->m_alloc_blocks.empty())
-			return this->allocate_new_block(size);
+		if (size <= max_size_class)
+			return this->allocate_small(this->get_size_class(size));
+		return this->allocate_large(size);
+	}
 
-		// not enough free space in the current block
-		const auto& block = this->m_alloc_blocks.top();
-		if (this->m_current_block_use + size >= block.size)
-			return this->allocate_new_block(size);
+	// free a block that was returned by allocate(), the memory is reused by later allocations
+	void MemoryAllocator::free(const uintptr_t address) {
+		if (const auto allocation{ this->m_large_allocations.find(address) }; allocation != this->m_large_allocations.end())
+			return this->free_large(allocation);
 
-		const auto address(block.address + this->m_current_block_use);
-		this->m_current_block_use += this->align_up(size, 8);
-		return address;
+		// the slab that this address is in
+		auto slab{ this->m_slabs.upper_bound(address) };
+		if (slab == this->m_slabs.begin())
+			return;
+
+		if (--slab; address < slab->first + slab_size)
+			this->free_small(slab, address);
 	}
 
 	// free all memory
 	void MemoryAllocator::release() {
-		while (!this->m_alloc_blocks.empty()) {
-			this->m_release(this->m_alloc_blocks.top().address);
-			this->m_alloc_blocks.pop();
+		// slabs are inside of the regions
+		for (const auto& [address, size] : this->m_regions)
+			this->m_release(address);
+
+		this->m_slabs.clear();
+		for (auto& partial_slabs : this->m_partial_slabs)
+			partial_slabs.clear();
+
+		this->m_regions.clear();
+		this->m_free_by_address.clear();
+		this->m_free_by_size.clear();
+		this->m_large_allocations.clear();
+		this->m_spare_region = 0;
+
+		this->m_committed_size = 0;
+		this->m_used_size = 0;
+	}
+
+	uintptr_t MemoryAllocator::allocate_small(const size_t size_class) {
+		const auto slot_size{ min_size_class << size_class };
+		auto& partial_slabs{ this->m_partial_slabs[size_class] };
+
+		// every slab is full, carve a new one out of a region
+		if (partial_slabs.empty()) {
+			const auto address{ this->allocate_block(slab_size) };
+
+			Slab slab{ .size_class = uint32_t(size_class), .used = 0, .free_slots = {}, .allocated = {} };
+
+			// in reverse so that the lowest slots are used first
+			slab.free_slots.resize(slab_size / slot_size);
+			for (size_t i{ 0 }; i < slab.free_slots.size(); ++i)
+				slab.free_slots[i] = uint16_t(slab.free_slots.size() - i - 1);
+
+			this->m_slabs.emplace(address, std::move(slab));
+			partial_slabs.insert(address);
 		}
+
+		// lowest address first
+		const auto address{ *partial_slabs.begin() };
+		auto& slab{ this->m_slabs.find(address)->second };
+
+		const auto slot{ slab.free_slots.back() };
+		slab.free_slots.pop_back();
+		slab.allocated.set(slot);
+		slab.used += 1;
+
+		// no more free slots
+		if (slab.free_slots.empty())
+			partial_slabs.erase(partial_slabs.begin());
+
+		this->m_used_size += slot_size;
+		return address + slot * slot_size;
 	}
 
-	uintptr_t MemoryAllocator::allocate_new_block(const size_t size) {
-		const auto aligned_size(this->align_up(size, 8));
+	uintptr_t MemoryAllocator::allocate_large(const size_t size) {
+		const auto aligned_size{ this->align_up(size, min_size_class) };
+		const auto address{ this->allocate_block(aligned_size) };
 
-		this->m_current_block_use = aligned_size;
-		const auto block_size(this->align_up(aligned_size, this->block_alignment));
+		this->m_large_allocations[address] = aligned_size;
+		this->m_used_size += aligned_size;
+		return address;
+	}
 
-		// allocate a block of memory
-		return this->m_alloc_blocks.emplace(AllocationBlock{
-			.address = this->m_allocate(block_size),
-			.size = block_size
-		}).address;
+	void MemoryAllocator::free_small(const std::map<uintptr_t, Slab>::iterator slab, const uintptr_t address) {
+		auto& [slab_address, data] { *slab };
+
+		const auto slot_size{ min_size_class << data.size_class };
+		if ((address - slab_address) % slot_size)
+			return;
+
+		// already freed
+		const auto slot{ (address - slab_address) / slot_size };
+		if (!data.allocated.test(slot))
+			return;
+
+		data.allocated.reset(slot);
+
+		auto& partial_slabs{ this->m_partial_slabs[data.size_class] };
+
+		// the slab was full, it can be used again
+		if (data.free_slots.empty())
+			partial_slabs.insert(slab_address);
+
+		data.free_slots.push_back(uint16_t(slot));
+		data.used -= 1;
+		this->m_used_size -= slot_size;
+
+		// give empty slabs back, unless it's the only one left for this size class
+		if (data.used || partial_slabs.size() <= 1)
+			return;
+
+		partial_slabs.erase(slab_address);
+		this->free_block(slab_address, slab_size);
+		this->m_slabs.erase(slab);
+	}
+
+	void MemoryAllocator::free_large(const std::unordered_map<uintptr_t, size_t>::iterator allocation) {
+		const auto [address, size] { *allocation };
+
+		this->m_used_size -= size;
+		this->m_large_allocations.erase(allocation);
+		this->free_block(address, size);
+	}
+
+	// take a block out of the large free list, a new region is allocated if nothing fits
+	uintptr_t MemoryAllocator::allocate_block(const size_t size) {
+		// the smallest free block that fits (best-fit)
+		auto block{ this->m_free_by_size.lower_bound({ size, 0 }) };
+
+		// nothing is big enough, allocate a new region
+		if (block == this->m_free_by_size.end()) {
+			const auto new_size{ this->align_up(std::max(size, region_size), slab_size) };
+			const auto new_address{ this->m_allocate(new_size) };
+			this->m_committed_size += new_size;
+
+			this->m_regions[new_address] = new_size;
+			this->insert_free_block(new_address, new_size);
+			block = this->m_free_by_size.find({ new_size, new_address });
+		}
+
+		const auto [block_size, address] { *block };
+		this->erase_free_block(this->m_free_by_address.find(address));
+
+		// the rest stays free
+		if (block_size > size)
+			this->insert_free_block(address + size, block_size - size);
+
+		// the spare region is being used again
+		if (address == this->m_spare_region)
+			this->m_spare_region = 0;
+
+		return address;
+	}
+
+	// give a block back to the large free list, empty regions are released (except for the spare one)
+	void MemoryAllocator::free_block(const uintptr_t address, const size_t size) {
+		auto start{ address };
+		auto end{ address + size };
+
+		// blocks are only merged within the same region
+		const auto region{ std::prev(this->m_regions.upper_bound(start)) };
+		const auto region_end{ region->first + region->second };
+
+		// the free block right after
+		if (const auto next{ this->m_free_by_address.find(end) }; next != this->m_free_by_address.end() && end < region_end) {
+			end += next->second;
+			this->erase_free_block(next);
+		}
+
+		// the free block right before
+		if (auto prev{ this->m_free_by_address.lower_bound(start) }; prev != this->m_free_by_address.begin()) {
+			if (--prev; prev->first >= region->first && prev->first + prev->second == start) {
+				start = prev->first;
+				this->erase_free_block(prev);
+			}
+		}
+
+		// the whole region is free, keep one around and give the rest back
+		if (start == region->first && end == region_end) {
+			if (this->m_spare_region && this->m_spare_region != start) {
+				this->m_release(start);
+				this->m_committed_size -= region->second;
+				this->m_regions.erase(region);
+				return;
+			}
+
+			this->m_spare_region = start;
+		}
+
+		this->insert_free_block(start, end - start);
+	}
+
+	// update both indices of the large free list
+	void MemoryAllocator::insert_free_block(const uintptr_t address, const size_t size) {
+		this->m_free_by_address[address] = size;
+		this->m_free_by_size.insert({ size, address });
+	}
+	void MemoryAllocator::erase_free_block(const std::map<uintptr_t, size_t>::iterator it) {
+		this->m_free_by_size.erase({ it->second, it->first });
+		this->m_free_by_address.erase(it);
+	}
+
+	// the index of the smallest size class that fits
+	size_t MemoryAllocator::get_size_class(const size_t size) {
+		return std::bit_width((std::max<size_t>(size, 1) - 1) / min_size_class);
 	}
 
 	// align value using alignment
@@ -47,8 +226,106 @@ namespace mango {
 		return ((value - 1) / alignment + 1) * alignment;
 	}
 
+	// frees the block list, but NOT the memory (call release() for that)
+	ConcurrentMemoryAllocator::~ConcurrentMemoryAllocator() {
+		for (auto block{ this->m_blocks.load() }; block;)
+			delete std::exchange(block, block->next);
+	}
+
+	// allocate a block of memory (aligned to get_alignment())
+	uintptr_t ConcurrentMemoryAllocator::allocate(const size_t size) {
+		const auto aligned_size{ (std::max<size_t>(size, 1) + this->m_alignment - 1) & ~(this->m_alignment - 1) };
+
+		this->m_allocations.fetch_add(1, std::memory_order_relaxed);
+		this->m_allocated_size.fetch_add(aligned_size, std::memory_order_relaxed);
+
+		// too big to share a block with anything else
+		if (aligned_size > this->m_block_size / 4)
+			return this->allocate_block(aligned_size, aligned_size)->address;
+
+		// assigned once per thread, so threads don't fight over the same cache line
+		static std::atomic<size_t> next_index{ 0 };
+		thread_local const auto index{ next_index.fetch_add(1, std::memory_order_relaxed) };
+
+		auto& cache{ this->m_caches[index % cache_count].block };
+		auto block{ cache.load(std::memory_order_acquire) };
+
+		if (block) {
+			// bump, unless someone else (sharing this cache) got there first
+			auto used{ block->used.load(std::memory_order_relaxed) };
+			while (used + aligned_size <= block->size) {
+				if (block->used.compare_exchange_weak(used, used + aligned_size, std::memory_order_relaxed))
+					return block->address + used;
+			}
+		}
+
+		// the cached block is full, whatever is left in it is wasted
+		const auto new_block{ this->allocate_block(this->m_block_size, aligned_size) };
+
+		// if another thread replaced the block in the meantime, keep theirs
+		cache.compare_exchange_strong(block, new_block, std::memory_order_acq_rel);
+		return new_block->address;
+	}
+
+	// free all memory
+	void ConcurrentMemoryAllocator::release() {
+		for (auto& cache : this->m_caches)
+			cache.block.store(nullptr, std::memory_order_relaxed);
+
+		for (auto block{ this->m_blocks.exchange(nullptr) }; block;) {
+			this->m_release(block->address);
+			delete std::exchange(block, block->next);
+		}
+
+		this->m_allocations = 0;
+		this->m_allocated_size = 0;
+		this->m_block_count = 0;
+		this->m_committed_size = 0;
+	}
+
+	// a snapshot of the counters since the last release()
+	ConcurrentMemoryAllocator::Stats ConcurrentMemoryAllocator::get_stats() const noexcept {
+		return {
+			.allocations = this->m_allocations.load(std::memory_order_relaxed),
+			.allocated_size = this->m_allocated_size.load(std::memory_order_relaxed),
+			.blocks = this->m_block_count.load(std::memory_order_relaxed),
+			.committed_size = this->m_committed_size.load(std::memory_order_relaxed)
+		};
+	}
+
+	// allocate a new block and push it onto the list
+	ConcurrentMemoryAllocator::Block* ConcurrentMemoryAllocator::allocate_block(const size_t size, const size_t used) {
+		const auto block_size{ (size + 0xFFF) & ~size_t(0xFFF) };
+
+		const auto block{ new Block{
+			.address = this->m_allocate(block_size),
+			.size = block_size,
+			.used = used,
+			.next = this->m_blocks.load(std::memory_order_relaxed)
+		} };
+
+		// nodes are never popped while allocating, so there's no ABA problem here
+		while (!this->m_blocks.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed));
+
+		this->m_block_count.fetch_add(1, std::memory_order_relaxed);
+		this->m_committed_size.fetch_add(block_size, std::memory_order_relaxed);
+		return block;
+	}
+
+	void ConcurrentMemoryAllocator::validate_alignment() const {
+		// the blocks themselves are only page aligned
+		if (!this->m_alignment || (this->m_alignment & (this->m_alignment - 1)) || this->m_alignment > 0x1000)
+			throw InvalidAllocatorAlignment{};
+	}
+
 	ProcessMemoryAllocator::ProcessMemoryAllocator(const mango::Process& process, const uint32_t protection)
 		: MemoryAllocator(
 			[=, &process](const size_t size) { return uintptr_t(process.alloc_virt_mem(size, protection)); },
 			[&](const uintptr_t address) { process.free_virt_mem(address); }) {}
+
+	ConcurrentProcessMemoryAllocator::ConcurrentProcessMemoryAllocator(const mango::Process& process,
+		const uint32_t protection, const size_t alignment)
+		: ConcurrentMemoryAllocator(
+			[=, &process](const size_t size) { return uintptr_t(process.alloc_virt_mem(size, protection)); },
+			[&](const uintptr_t address) { process.free_virt_mem(address); }, alignment) {}
 } // namespace mango
\ No newline at end of file
@@ -2,19 +2,37 @@
 
 #include <epic/process.h>
 #include <epic/vmt_hook.h>
+#include <epic/vmt_hook_group.h>
 #include <epic/iat_hook.h>
+#include <epic/eat_hook.h>
+#include <epic/inline_hook.h>
+#include <epic/hook_transaction.h>
+#include <epic/hook_dispatcher.h>
+#include <epic/hook_profiler.h>
+#include <epic/integrity_scanner.h>
 #include <epic/wow64_syscall_hook.h>
+#include <epic/syscall_tracer.h>
 #include <epic/shellcode.h>
+#include <epic/assembler.h>
+#include <epic/length_decoder.h>
 #include <epic/loader.h>
 #include <epic/loaded_module.h>
 #include <epic/memory_scanner.h>
 #include <epic/syscall.h>
+#include <epic/syscall_table.h>
 #include <epic/vmt_helpers.h>
 #include <epic/hardware_breakpoint.h>
+#include <epic/unused_memory.h>
+#include <epic/cave_allocator.h>
+#include <epic/module_index.h>
 
 #include <misc/misc.h>
 #include <misc/unit_test.h>
 #include <misc/scope_guard.h>
+#include <misc/memory_allocator.h>
+#include <misc/arena.h>
+#include <misc/logger.h>
+#include <misc/log_decoder.h>
 #include <misc/error_codes.h>
 
 #include <crypto/string_encryption.h>
@@ -22,6 +40,12 @@
 #include <Psapi.h>
 #include <string>
 #include <iomanip>
+#include <numeric>
+#include <algorithm>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
 
 
 void test_process(mango::Process& process) {
@@ -123,9 +147,21 @@ void test_process(mango::Process& process) {
 	unit_test.expect_value(process.get_mem_prot(example_value), PAGE_READONLY);
 	unit_test.expect_value(process.set_mem_prot(example_value, 4, PAGE_READWRITE), PAGE_READONLY);
 
+	// non-throwing versions
+	unit_test.expect_nonzero(process.try_write(example_value, 420));
+	unit_test.expect_value(*process.try_read<int>(example_value), 420);
+	unit_test.expect_value(*process.try_get_mem_prot(example_value), PAGE_READWRITE);
+
 	// free memory
 	process.free_virt_mem(example_value);
 
+	// the memory is gone now, these fail instead of throwing
+	unit_test.expect_zero(process.try_read<int>(example_value));
+	unit_test.expect_zero(process.try_write(example_value, 69));
+	unit_test.expect_value(process.try_read<int>(example_value).value_or(-1), -1);
+	unit_test.expect_nonzero(process.try_read<int>(example_value).error().code);
+	unit_test.expect_zero(process.try_read<int>(uintptr_t(0)));
+
 	// remote threads
 	unit_test.expect_custom([&]() {
 		static bool did_thread_run;
@@ -141,6 +177,38 @@ void test_process(mango::Process& process) {
 	});
 }
 
+void test_hash_resolution(mango::Process& process) {
+	mango::UnitTest unit_test{ "Hash Resolution" };
+
+	const auto load_library{ uintptr_t(GetProcAddress(GetModuleHandleA("kernel32.dll"), "LoadLibraryA")) };
+
+	// same results as the string overloads
+	unit_test.expect_value(process.get_module_addr(mango::Fnv1a<>("kernel32.dll")), process.get_module_addr("kernel32.dll"));
+	unit_test.expect_value(process.get_proc_addr(mango::Fnv1a<>("kernel32.dll"), mango::Fnv1a<>("LoadLibraryA")), load_library);
+	unit_test.expect_value(process.get_proc_addr(mango::Fnv1a<>("kernel32.dll"), mango::Fnv1a<>("LoadLibraryA")),
+		process.get_proc_addr("kernel32.dll", "LoadLibraryA"));
+
+	// module hashes are of the lowercase name, module_hash() lowercases at compile time, function names are as is
+	unit_test.expect_value(process.get_proc_addr(mango::ModuleIndex::module_hash("KERNEL32.DLL"),
+		mango::Fnv1a<>("LoadLibraryA")), load_library);
+	unit_test.expect_zero(process.get_module_addr(mango::Fnv1a<>("KERNEL32.DLL")));
+	unit_test.expect_zero(process.get_proc_addr(mango::Fnv1a<>("kernel32.dll"), mango::Fnv1a<>("loadlibrarya")));
+
+	// unknown modules and functions
+	unit_test.expect_zero(process.get_module_addr(mango::Fnv1a<>("not_a_module.dll")));
+	unit_test.expect_zero(process.get_proc_addr(mango::Fnv1a<>("not_a_module.dll"), mango::Fnv1a<>("LoadLibraryA")));
+	unit_test.expect_zero(process.get_proc_addr(mango::Fnv1a<>("kernel32.dll"), mango::Fnv1a<>("NotAFunction")));
+
+	// memoized results are the same as the first lookup
+	mango::Process::SetupOptions options{};
+	options.memoize_proc_addrs = true;
+
+	const auto memo_process{ mango::Process::current(options) };
+	unit_test.expect_value(memo_process.get_proc_addr(mango::Fnv1a<>("kernel32.dll"), mango::Fnv1a<>("LoadLibraryA")), load_library);
+	unit_test.expect_value(memo_process.get_proc_addr(mango::Fnv1a<>("kernel32.dll"), mango::Fnv1a<>("LoadLibraryA")), load_library);
+	unit_test.expect_zero(memo_process.get_proc_addr(mango::Fnv1a<>("kernel32.dll"), mango::Fnv1a<>("NotAFunction")));
+}
+
 void test_vmt_hooks(mango::Process& process) {
 	mango::UnitTest unit_test{ "VmtHook" };
 
@@ -181,6 +249,21 @@ void test_vmt_hooks(mango::Process& process) {
 
 	const auto original_vtable{ process.read<uintptr_t>(example_instance.get()) };
 
+	// ExampleClass has 2 virtual functions
+	unit_test.expect_value(mango::get_vtable_size(process, original_vtable), 2 * sizeof(void*));
+
+	// not a vtable
+	unit_test.expect_zero(mango::get_vtable_size(process, uintptr_t(example_instance.get())));
+
+	// an entry that was already hooked into allocated memory doesn't end the table
+	{
+		const auto stub{ process.alloc_virt_mem(0x1000, PAGE_EXECUTE_READWRITE) };
+		const mango::ScopeGuard _stub_guard{ [&]() { process.free_virt_mem(stub); } };
+
+		const uintptr_t hooked_table[]{ process.read<uintptr_t>(original_vtable), uintptr_t(stub), 0 };
+		unit_test.expect_value(mango::get_vtable_size(process, uintptr_t(hooked_table)), 2 * sizeof(void*));
+	}
+
 	vmt_hook.hook<uintptr_t>(1, hooked_func);
 
 	// make sure we're replacing the table and not the table contents
@@ -223,6 +306,124 @@ void test_vmt_hooks(mango::Process& process) {
 	unit_test.expect_zero(vmt_hook.is_valid());
 }
 
+void test_vmt_hook_group(mango::Process& process) {
+	mango::UnitTest unit_test{ "VmtHookGroup" };
+
+	class ExampleClass {
+	public:
+		virtual void example_func1() {}
+		virtual int example_func2() {
+			return 1234'5678;
+		}
+	};
+
+	class OtherClass {
+	public:
+		virtual int example_func() {
+			return 1111;
+		}
+	};
+
+	const auto hooked_func{ static_cast<int(__fastcall*)(void*, void*)>([](void* ecx, void*) -> int {
+		return 8765'4321;
+	}) };
+
+	std::vector<std::unique_ptr<ExampleClass>> example_instances{};
+	std::vector<uintptr_t> instances{};
+	for (size_t i{ 0 }; i < 100; ++i) {
+		example_instances.push_back(std::make_unique<ExampleClass>());
+		instances.push_back(uintptr_t(example_instances.back().get()));
+	}
+
+	const auto other_instance{ std::make_unique<OtherClass>() };
+	const auto original_vtable{ process.read<uintptr_t>(example_instances.front().get()) },
+		other_vtable{ process.read<uintptr_t>(other_instance.get()) };
+
+	mango::VmtHookGroup hook_group{};
+
+	// not setup yet
+	unit_test.expect_zero(hook_group);
+	unit_test.expect_zero(hook_group.is_valid());
+
+	// can't add instances before setup()
+	unit_test.expect_custom([&]() {
+		try {
+			hook_group.add(instances.front());
+			return false;
+		} catch (mango::HookGroupNotSetup&) {
+			return true;
+		}
+	});
+
+	hook_group.setup(process);
+	hook_group.add(instances);
+	hook_group.add(uintptr_t(other_instance.get()));
+
+	// adding the same instance twice does nothing
+	hook_group.add(instances.front());
+
+	unit_test.expect_nonzero(hook_group);
+	unit_test.expect_value(hook_group.size(), size_t(101));
+	unit_test.expect_value(hook_group.get_original_vtable(instances.front()), original_vtable);
+
+	// every instance of the same class shares one table
+	unit_test.expect_custom([&]() {
+		const auto shadow_vtable{ process.read<uintptr_t>(instances.front()) };
+		if (shadow_vtable == original_vtable)
+			return false;
+
+		for (const auto instance : instances) {
+			if (process.read<uintptr_t>(instance) != shadow_vtable)
+				return false;
+		}
+
+		return process.read<uintptr_t>(other_instance.get()) != shadow_vtable;
+	});
+
+	// can only hook classes that are in the group
+	unit_test.expect_custom([&]() {
+		try {
+			hook_group.hook(0x1234, 1, hooked_func);
+			return false;
+		} catch (mango::VtableNotInHookGroup&) {
+			return true;
+		}
+	});
+
+	const auto original{ mango::get_vfunc<uintptr_t>(process, example_instances.front().get(), 1) };
+	unit_test.expect_value(hook_group.hook(original_vtable, 1, hooked_func), original);
+
+	// one write hooks every instance
+	unit_test.expect_custom([&]() {
+		for (const auto& instance : example_instances) {
+			if (instance->example_func2() != 8765'4321)
+				return false;
+		}
+		return true;
+	});
+
+	// different class, different table
+	unit_test.expect_value(other_instance->example_func(), 1111);
+
+	// removed instances get their original table back
+	hook_group.remove(instances.back());
+	unit_test.expect_value(example_instances.back()->example_func2(), 1234'5678);
+	unit_test.expect_value(process.read<uintptr_t>(instances.back()), original_vtable);
+	unit_test.expect_value(example_instances.front()->example_func2(), 8765'4321);
+
+	hook_group.unhook(original_vtable, 1);
+	unit_test.expect_value(example_instances.front()->example_func2(), 1234'5678);
+
+	hook_group.release();
+
+	// calling release multiple times is safe
+	hook_group.release();
+
+	unit_test.expect_zero(hook_group);
+	unit_test.expect_value(process.read<uintptr_t>(instances.front()), original_vtable);
+	unit_test.expect_value(process.read<uintptr_t>(other_instance.get()), other_vtable);
+}
+
 void test_iat_hooks(mango::Process& process) {
 	// full optimization on x86 seems to use direct calls to imported functions (not sure tho)
 	if (sizeof(void*) == 4)
@@ -302,13 +503,518 @@ void test_iat_hooks(mango::Process& process) {
 	unit_test.expect_zero(iat_hook.is_valid());
 }
 
+void test_eat_hooks(mango::Process& process) {
+	mango::UnitTest unit_test{ "EatHook" };
+
+	using Func = BOOL(WINAPI*)();
+
+	const auto hooked_func{ static_cast<Func>([]() -> BOOL {
+		return 69;
+	}) };
+
+	const auto kernel32{ GetModuleHandleA("kernel32.dll") };
+
+	mango::EatHook eat_hook{};
+
+	// not setup yet
+	unit_test.expect_zero(eat_hook);
+
+	eat_hook.setup(process, kernel32);
+	unit_test.expect_nonzero(eat_hook);
+
+	const auto original{ uintptr_t(GetProcAddress(kernel32, "IsDebuggerPresent")) };
+
+	// hook() returns the original, verify this
+	unit_test.expect_value(eat_hook.hook("IsDebuggerPresent", hooked_func), original);
+
+	// function doesn't exist
+	unit_test.expect_custom([&]() {
+		try {
+			eat_hook.hook("123ABC", 0x69);
+			return false;
+		} catch (mango::FailedToFindExportFunction&) {
+			return true;
+		}
+	});
+
+	// can't hook the same function twice
+	unit_test.expect_custom([&]() {
+		try {
+			eat_hook.hook("IsDebuggerPresent", 0x69);
+			return false;
+		} catch (mango::FunctionAlreadyHooked&) {
+			return true;
+		}
+	});
+
+	// might be a stub if kernel32 is too far away, so check what it does instead of the address
+	const auto resolved{ reinterpret_cast<Func>(GetProcAddress(kernel32, "IsDebuggerPresent")) };
+	unit_test.expect_value(resolved(), hooked_func());
+
+	eat_hook.unhook("IsDebuggerPresent");
+
+	// not hooked anymore
+	unit_test.expect_value(uintptr_t(GetProcAddress(kernel32, "IsDebuggerPresent")), original);
+
+	// stubs are pointed back to the original after unhooking
+	if (resolved != hooked_func)
+		unit_test.expect_value(resolved(), IsDebuggerPresent());
+
+	// forwarded exports (kernel32!HeapAlloc -> ntdll!RtlAllocateHeap) return the function they forward to
+	unit_test.expect_value(eat_hook.hook("HeapAlloc", hooked_func),
+		uintptr_t(GetProcAddress(GetModuleHandleA("ntdll.dll"), "RtlAllocateHeap")));
+	eat_hook.unhook("HeapAlloc");
+
+	eat_hook.release();
+
+	// not in a valid state anymore
+	unit_test.expect_zero(eat_hook);
+}
+
+// used by test_inline_hooks()
+static volatile int inline_hook_counter{ 0 };
+__declspec(noinline) int inline_hook_target(const int value) {
+	inline_hook_counter += value;
+	return inline_hook_counter * 2;
+}
+
+void test_inline_hooks(mango::Process& process) {
+	mango::UnitTest unit_test{ "InlineHook" };
+
+	using Func = int(*)(int);
+
+	// so the hook can call the original
+	static Func original{ nullptr };
+
+	const auto hooked_func{ static_cast<Func>([](const int value) -> int {
+		return original(value) + 1000;
+	}) };
+
+	mango::InlineHook inline_hook{};
+
+	// not setup yet
+	unit_test.expect_zero(inline_hook);
+	unit_test.expect_zero(inline_hook.is_valid());
+
+	inline_hook_counter = 0;
+	unit_test.expect_value(inline_hook_target(1), 2);
+
+	inline_hook.setup(process, uintptr_t(&inline_hook_target), uintptr_t(hooked_func));
+	original = inline_hook.get_original<Func>();
+
+	// setup and enabled right away
+	unit_test.expect_nonzero(inline_hook);
+	unit_test.expect_nonzero(inline_hook.is_enabled());
+	unit_test.expect_value(inline_hook.get_target(), uintptr_t(&inline_hook_target));
+
+	// hooked, the original still runs through the trampoline
+	unit_test.expect_value(inline_hook_target(1), 1004);
+
+	inline_hook.disable();
+
+	// not hooked anymore
+	unit_test.expect_zero(inline_hook.is_enabled());
+	unit_test.expect_value(inline_hook_target(1), 6);
+
+	const auto trampoline{ inline_hook.get_original() };
+	inline_hook.enable();
+
+	// re-enabling doesn't need a new trampoline
+	unit_test.expect_value(inline_hook_target(1), 1008);
+	unit_test.expect_value(inline_hook.get_original(), trampoline);
+
+	inline_hook.release();
+
+	// calling release multiple times is safe
+	inline_hook.release();
+
+	// released, no longer valid
+	unit_test.expect_value(inline_hook_target(1), 10);
+	unit_test.expect_zero(inline_hook);
+	unit_test.expect_zero(inline_hook.is_valid());
+
+	// xor eax, eax; ret
+	unit_test.expect_custom([&]() {
+		const auto address{ mango::Shellcode{ "\x31\xC0\xC3" }.allocate_and_write(process) };
+		const mango::ScopeGuard _guard{ &mango::Shellcode::free, std::ref(process), address };
+
+		try {
+			inline_hook.setup(process, address, uintptr_t(hooked_func));
+			return false;
+		} catch (mango::FunctionTooSmallToHook&) {
+			return true;
+		}
+	});
+
+	// the rest relies on the x64 calling convention and rip-relative addressing
+	if (sizeof(void*) == 4)
+		return;
+
+	// relocated jcc rel8
+	{
+		// cmp ecx, 0
+		// je skip
+		// mov eax, 1
+		// ret
+		// skip:
+		// mov eax, 2
+		// ret
+		const auto address{ mango::Shellcode{ "\x83\xF9\x00\x74\x06\xB8\x01\x00\x00\x00\xC3\xB8\x02\x00\x00\x00\xC3" }
+			.allocate_and_write(process) };
+		const mango::ScopeGuard _guard{ &mango::Shellcode::free, std::ref(process), address };
+
+		inline_hook.setup(process, address, uintptr_t(hooked_func));
+		original = inline_hook.get_original<Func>();
+
+		unit_test.expect_value(reinterpret_cast<Func>(address)(0), 1002);
+		unit_test.expect_value(reinterpret_cast<Func>(address)(1), 1001);
+
+		inline_hook.release();
+	}
+
+	// relocated rip-relative displacement
+	{
+		// mov eax, dword ptr [rip + 1]
+		// ret
+		// dd 0x1234
+		const auto address{ mango::Shellcode{ "\x8B\x05\x01\x00\x00\x00\xC3\x34\x12\x00\x00" }
+			.allocate_and_write(process) };
+		const mango::ScopeGuard _guard{ &mango::Shellcode::free, std::ref(process), address };
+
+		inline_hook.setup(process, address, uintptr_t(hooked_func));
+		original = inline_hook.get_original<Func>();
+
+		unit_test.expect_value(reinterpret_cast<Func>(address)(0), 0x1234 + 1000);
+
+		inline_hook.release();
+	}
+}
+
+void test_hook_transaction(mango::Process& process) {
+	mango::UnitTest unit_test{ "HookTransaction" };
+
+	class ExampleClass {
+	public:
+		virtual int example_func() {
+			return 1234'5678;
+		}
+	};
+
+	using Func = int(*)();
+
+	const auto hooked_func{ static_cast<Func>([]() -> int {
+		return 2;
+	}) };
+	const auto hooked_vfunc{ static_cast<int(__fastcall*)(void*, void*)>([](void* ecx, void*) -> int {
+		return 8765'4321;
+	}) };
+
+	// mov eax, 1
+	// ret
+	const auto address{ mango::Shellcode{ "\xB8\x01\x00\x00\x00\xC3" }.allocate_and_write(process) };
+	const mango::ScopeGuard _guard{ &mango::Shellcode::free, std::ref(process), address };
+
+	const auto example_instance{ std::make_unique<ExampleClass>() };
+	static volatile int example_value{ 0 };
+
+	mango::InlineHook inline_hook{ process, address, uintptr_t(hooked_func), { .auto_enable = false } };
+	mango::VmtHook vmt_hook{ process, example_instance.get() };
+
+	// nothing is written until commit()
+	unit_test.expect_zero(inline_hook.is_enabled());
+	unit_test.expect_value(reinterpret_cast<Func>(address)(), 1);
+
+	mango::HookTransaction transaction{ process };
+	transaction.enable(inline_hook);
+	const auto original{ transaction.hook(vmt_hook, 0, uintptr_t(hooked_vfunc)) };
+	transaction.write<int>(uintptr_t(&example_value), 1234, false);
+
+	// the same bytes can't be queued twice
+	unit_test.expect_custom([&]() {
+		try {
+			transaction.write<short>(uintptr_t(&example_value) + 2, 0, false);
+			return false;
+		} catch (mango::HookTransactionOverlappingPatch&) {
+			return true;
+		}
+	});
+
+	unit_test.expect_value(transaction.size(), size_t(3));
+	unit_test.expect_zero(transaction.is_committed());
+	unit_test.expect_value(original, mango::get_vfunc<uintptr_t>(process, example_instance.get(), 0));
+
+	// still nothing written
+	unit_test.expect_value(reinterpret_cast<Func>(address)(), 1);
+	unit_test.expect_value(example_instance->example_func(), 1234'5678);
+	unit_test.expect_value(int(example_value), 0);
+
+	transaction.commit();
+
+	// everything applied at once
+	unit_test.expect_nonzero(transaction.is_committed());
+	unit_test.expect_nonzero(inline_hook.is_enabled());
+	unit_test.expect_value(reinterpret_cast<Func>(address)(), 2);
+	unit_test.expect_value(example_instance->example_func(), 8765'4321);
+	unit_test.expect_value(int(example_value), 1234);
+
+	// can't queue anything once committed
+	unit_test.expect_custom([&]() {
+		try {
+			transaction.write<int>(uintptr_t(&example_value), 0);
+			return false;
+		} catch (mango::HookTransactionAlreadyCommitted&) {
+			return true;
+		}
+	});
+
+	// hook objects know about the hooks
+	unit_test.expect_custom([&]() {
+		try {
+			vmt_hook.hook(0, uintptr_t(hooked_vfunc));
+			return false;
+		} catch (mango::FunctionAlreadyHooked&) {
+			return true;
+		}
+	});
+
+	transaction.rollback();
+
+	// everything restored
+	unit_test.expect_zero(transaction.is_committed());
+	unit_test.expect_zero(inline_hook.is_enabled());
+	unit_test.expect_value(reinterpret_cast<Func>(address)(), 1);
+	unit_test.expect_value(example_instance->example_func(), 1234'5678);
+	unit_test.expect_value(int(example_value), 0);
+
+	// rolling back twice does nothing
+	transaction.rollback();
+	unit_test.expect_value(int(example_value), 0);
+}
+
+void test_hook_dispatcher(mango::Process& process) {
+	mango::UnitTest unit_test{ "HookDispatcher" };
+
+	class ExampleClass {
+	public:
+		virtual int example_func(const int value) {
+			return value * 2;
+		}
+	};
+
+	using Func = int(__fastcall*)(void*, void*, int);
+
+	const auto example_instance{ std::make_unique<ExampleClass>() };
+	mango::VmtHook vmt_hook{ process, example_instance.get() };
+	mango::HookDispatcher<Func> dispatcher{};
+
+	// not setup yet
+	unit_test.expect_zero(dispatcher);
+
+	dispatcher.setup(vmt_hook, 0);
+
+	// the stub is what's in the vtable
+	unit_test.expect_nonzero(dispatcher);
+	unit_test.expect_value(mango::get_vfunc<uintptr_t>(process, example_instance.get(), 0), dispatcher.get_stub());
+
+	// no callbacks, just calls the original
+	unit_test.expect_value(example_instance->example_func(5), 10);
+
+	// pre callbacks can change the arguments
+	const auto id{ dispatcher.add_pre([](void*&, void*&, int& value) { value += 1; }) };
+	unit_test.expect_value(example_instance->example_func(5), 12);
+
+	// post callbacks run in order of priority
+	dispatcher.add_post([](int& ret, void*&, void*&, int&) { ret += 100; }, 1);
+	dispatcher.add_post([](int& ret, void*&, void*&, int&) { ret *= 2; }, 0);
+	unit_test.expect_value(example_instance->example_func(5), 124);
+
+	dispatcher.remove(id);
+	unit_test.expect_value(example_instance->example_func(5), 120);
+
+	// another dispatcher with the same function type gets a different stub
+	unit_test.expect_custom([&]() {
+		mango::HookDispatcher<Func> other{};
+		return other.get_stub() != dispatcher.get_stub();
+	});
+
+	dispatcher.release();
+
+	// unhooked
+	unit_test.expect_zero(dispatcher);
+	unit_test.expect_value(example_instance->example_func(5), 10);
+}
+
+void test_hook_profiler(mango::Process& process) {
+	mango::UnitTest unit_test{ "HookProfiler" };
+
+	class ExampleClass {
+	public:
+		virtual int example_func(const int value) {
+			return value * 2;
+		}
+	};
+
+	const auto example_instance{ std::make_unique<ExampleClass>() };
+	mango::VmtHook vmt_hook{ process, example_instance.get() };
+	mango::HookProfiler profiler{};
+
+	// not setup yet
+	unit_test.expect_zero(profiler);
+
+	profiler.setup(vmt_hook, 0);
+
+	// the stub is what's in the vtable
+	unit_test.expect_nonzero(profiler);
+	unit_test.expect_value(mango::get_vfunc<uintptr_t>(process, example_instance.get(), 0), profiler.get_stub());
+
+	// nothing called yet
+	unit_test.expect_zero(profiler.get_stats().calls);
+	unit_test.expect_zero(profiler.get_thread_stats().size());
+
+	// the original still runs
+	for (int i{ 0 }; i < 100; ++i)
+		unit_test.expect_value(example_instance->example_func(i), i * 2);
+
+	const auto stats{ profiler.get_stats() };
+
+	// every call was counted and timed
+	unit_test.expect_value(stats.calls, uint64_t(100));
+	unit_test.expect_nonzero(stats.total_cycles);
+	unit_test.expect_value(std::accumulate(stats.histogram.begin(), stats.histogram.end(), uint64_t(0)), uint64_t(100));
+	unit_test.expect_zero(profiler.get_overflow_calls());
+
+	// only this thread called it
+	const auto thread_stats{ profiler.get_thread_stats() };
+	unit_test.expect_value(thread_stats.size(), size_t(1));
+	unit_test.expect_custom([&]() {
+		return !thread_stats.empty() && thread_stats[0].tid == GetCurrentThreadId() && thread_stats[0].calls == 100;
+	});
+
+	// slots of threads that exited are given back, without losing their stats
+	unit_test.expect_zero(profiler.reclaim_slots());
+	for (size_t i{ 0 }; i < mango::HookProfiler::max_threads + 8; ++i) {
+		std::thread{ [&]() { example_instance->example_func(1); } }.join();
+		unit_test.expect_value(profiler.reclaim_slots(), size_t(1));
+	}
+
+	unit_test.expect_zero(profiler.get_overflow_calls());
+	unit_test.expect_value(profiler.get_stats().calls, uint64_t(100 + mango::HookProfiler::max_threads + 8));
+	unit_test.expect_value(profiler.get_thread_stats().size(), mango::HookProfiler::max_threads + 9);
+
+	profiler.release();
+
+	// unhooked
+	unit_test.expect_zero(profiler);
+	unit_test.expect_value(example_instance->example_func(5), 10);
+}
+
+void test_integrity_scanner(mango::Process& process) {
+	mango::UnitTest unit_test{ "IntegrityScanner" };
+
+	mango::IntegrityScanner scanner{ process };
+
+	const auto is_patched{ [&]() {
+		const auto patches{ scanner.scan(process.get_module_addr()) };
+		return std::any_of(patches.begin(), patches.end(), [](const auto& patch) {
+			return patch.address <= uintptr_t(&inline_hook_target) &&
+				patch.address + patch.current.size() > uintptr_t(&inline_hook_target);
+		});
+	} };
+
+	// nothing hooked yet
+	unit_test.expect_zero(is_patched());
+
+	mango::InlineHook inline_hook{};
+	inline_hook.setup(process, uintptr_t(&inline_hook_target), uintptr_t(&inline_hook_target) + 1);
+
+	// the jmp was found
+	unit_test.expect_nonzero(is_patched());
+
+	// instruction aligned, starting at the function
+	unit_test.expect_custom([&]() {
+		const auto patches{ scanner.scan(process.get_module_addr()) };
+		return std::any_of(patches.begin(), patches.end(), [](const auto& patch) {
+			return patch.address == uintptr_t(&inline_hook_target) && patch.current.size() >= 5 &&
+				patch.current[0] == 0xE9 && patch.original.size() == patch.current.size();
+		});
+	});
+
+	inline_hook.release();
+
+	// restored, the page is still private but its hash changed
+	unit_test.expect_zero(is_patched());
+}
+
+void test_syscall_table(mango::Process& process) {
+	mango::UnitTest unit_test{ "SyscallTable" };
+
+	const auto& table{ mango::SyscallTable::current() };
+	unit_test.expect_nonzero(table);
+
+	// read the index from the mov eax, imm32 in the stub
+	const auto read_index{ [](const char* const name) {
+		const auto stub{ reinterpret_cast<const uint8_t*>(GetProcAddress(GetModuleHandleA("ntdll.dll"), name)) };
+		return *reinterpret_cast<const uint32_t*>(stub + (sizeof(void*) == 8 ? 4 : 1));
+	} };
+
+	// Nt and Zw are the same
+	unit_test.expect_value(table.get(mango::Fnv1a<>("NtReadVirtualMemory")), read_index("NtReadVirtualMemory"));
+	unit_test.expect_value(table.get(mango::Fnv1a<>("ZwReadVirtualMemory")), read_index("NtReadVirtualMemory"));
+	unit_test.expect_value(table.get("NtClose"), read_index("NtClose"));
+
+	// not syscalls
+	unit_test.expect_zero(table.find(mango::Fnv1a<>("RtlAllocateHeap")).has_value());
+	unit_test.expect_zero(table.find("NtThisDoesNotExist").has_value());
+
+	// same result when built from the export table of a loaded module
+	const mango::SyscallTable module_table{ *process.get_module("ntdll.dll") };
+	unit_test.expect_value(module_table.size(), table.size());
+	unit_test.expect_value(module_table.get("NtClose"), table.get("NtClose"));
+
+	// syscall::index() uses the table
+	unit_test.expect_value(mango::syscall::index("NtClose"), read_index("NtClose"));
+}
+
 void test_syscall_hooks(mango::Process& process) {
+	mango::UnitTest unit_test{ "Wow64SyscallHook" };
+
+	using Hook = mango::Wow64SyscallHook;
+
+	// bt [bitmap], index
+	unit_test.expect_value(Hook::bitmap_word(0x3F), 1);
+	unit_test.expect_value(Hook::bitmap_mask(0x3F), 0x80000000);
+	unit_test.expect_value(Hook::bitmap_mask(0x40), 1);
+
+	// mov eax, 0x3F; mov edx, 0x77C3C2B0; call edx; ret 0x14
+	{
+		const uint8_t code[]{ 0xB8, 0x3F, 0x00, 0x00, 0x00, 0xBA, 0xB0, 0xC2, 0xC3, 0x77, 0xFF, 0xD2, 0xC2, 0x14, 0x00 };
+		const auto stub{ Hook::parse_syscall_stub(code, sizeof(code)) };
+		unit_test.expect_custom([&]() { return stub && stub->first == 0x3F && stub->second == 5; });
+		unit_test.expect_custom([&]() { return !Hook::parse_syscall_stub(code + 1, sizeof(code) - 1); });
+	}
+
+	// the fast path and the original at the end
+	{
+		const auto stub{ Hook::build_stub(0x10000000, 0x11223344) };
+		const auto& data{ stub.get_data() };
+
+		unit_test.expect_custom([&]() { return data.size() <= Hook::max_stub_size; });
+		unit_test.expect_custom([&]() {
+			return std::vector<uint8_t>(data.begin(), data.begin() + 16) == std::vector<uint8_t>{
+				0x3D, 0x00, 0x10, 0x00, 0x00, 0x73, 0x7B, 0x0F, 0xA3, 0x05, 0x00, 0x01, 0x00, 0x10, 0x73, 0x72
+			};
+		});
+		unit_test.expect_custom([&]() {
+			return std::vector<uint8_t>(data.end() - 7, data.end()) == std::vector<uint8_t>{
+				0xBA, 0x44, 0x33, 0x22, 0x11, 0xFF, 0xE2
+			};
+		});
+	}
+
 	// only works on wow64 process
 	if (sizeof(void*) != 4)
 		return;
 
-	mango::UnitTest unit_test{ "Wow64SyscallHook" };
-
 	const auto syscall_callback{ static_cast<bool(*)(const uint32_t, uint32_t* const, volatile uint32_t)>(
 		[](const uint32_t syscall_index, uint32_t* const arguments, volatile uint32_t return_value) {
 		if (syscall_index == mango::syscall::index("NtReadVirtualMemory")) {
@@ -319,12 +1025,117 @@ void test_syscall_hooks(mango::Process& process) {
 		return true;
 	}) };
 
-	mango::Wow64SyscallHook syscall_hook{ process, uint32_t(uintptr_t(syscall_callback)) };
+	// every syscall goes to the callback
+	{
+		Hook syscall_hook{ process, uint32_t(uintptr_t(syscall_callback)) };
+
+		// overwrite the value in the syscall_callback
+		int value{ 69 };
+		ReadProcessMemory(process.get_handle(), &value, 0, 0, 0);
+		unit_test.expect_value(value, 420);
+	}
+
+	// only NtReadVirtualMemory and NtClose go to the callbacks
+	Hook syscall_hook{ process };
+	const auto read_index{ mango::syscall::index("NtReadVirtualMemory") },
+		close_index{ mango::syscall::index("NtClose") };
+
+	syscall_hook.set_callbacks(read_index, uint32_t(uintptr_t(syscall_callback)));
+	unit_test.expect_nonzero(syscall_hook.is_filtered(read_index));
+	unit_test.expect_zero(syscall_hook.is_filtered(close_index));
 
-	// overwrite the value in the syscall_callback
 	int value{ 69 };
 	ReadProcessMemory(process.get_handle(), &value, 0, 0, 0);
 	unit_test.expect_value(value, 420);
+
+	// back to the original
+	syscall_hook.remove_callbacks(read_index);
+	unit_test.expect_zero(syscall_hook.is_filtered(read_index));
+
+	value = 69;
+	ReadProcessMemory(process.get_handle(), &value, 0, 0, 0);
+	unit_test.expect_value(value, 69);
+
+	// closing an invalid handle succeeds
+	const auto post_callback{ static_cast<void(*)(const uint32_t, uint32_t* const, uint32_t* const)>(
+		[](const uint32_t, uint32_t* const arguments, uint32_t* const return_value) {
+		if (arguments[0] == 0x1234)
+			*return_value = 0;
+	}) };
+
+	syscall_hook.set_callbacks(close_index, 0, uint32_t(uintptr_t(post_callback)));
+	unit_test.expect_nonzero(CloseHandle(HANDLE(0x1234)));
+
+	syscall_hook.remove_callbacks(close_index);
+	unit_test.expect_zero(CloseHandle(HANDLE(0x1234)));
+}
+
+void test_syscall_tracer(mango::Process& process) {
+	mango::UnitTest unit_test{ "SyscallTracer" };
+
+	// write records the same way the stub does
+	const auto ring{ std::make_unique<mango::SyscallTraceRing>() };
+	const auto produce{ [&](const uint32_t count) {
+		for (uint32_t i{ 0 }; i < count; ++i) {
+			auto& record{ ring->records[ring->head & (mango::SyscallTraceRing::capacity - 1)] };
+			record = { ring->head + 1, 5, 0, 4, 0, i };
+			ring->head += 1;
+		}
+	} };
+
+	mango::SyscallTraceConsumer consumer{};
+	mango::SyscallTraceStats stats{};
+	const auto add{ [&](const mango::SyscallTraceRecord& record) { stats.add(record); } };
+
+	produce(100);
+	unit_test.expect_value(consumer.consume(*ring, ring->head, add), 100);
+	unit_test.expect_zero(consumer.consume(*ring, ring->head, add));
+
+	// a record that's still being written stops the consumer
+	produce(10);
+	ring->records[105].sequence = 0;
+	unit_test.expect_value(consumer.consume(*ring, ring->head, add), 5);
+	ring->records[105].sequence = 106;
+	unit_test.expect_value(consumer.consume(*ring, ring->head, add), 5);
+
+	// lapped
+	produce(mango::SyscallTraceRing::capacity + 10);
+	unit_test.expect_value(consumer.consume(*ring, ring->head, add), mango::SyscallTraceRing::capacity);
+	unit_test.expect_value(consumer.get_dropped(), 10);
+
+	unit_test.expect_nonzero(stats.find(5));
+	unit_test.expect_zero(stats.find(4));
+	unit_test.expect_value(stats.find(5)->count, stats.get_total_count());
+	unit_test.expect_value(stats.find(5)->count, 110 + mango::SyscallTraceRing::capacity);
+	unit_test.expect_value(mango::SyscallTraceStats::get_bucket(0), 0);
+	unit_test.expect_value(mango::SyscallTraceStats::get_bucket(1023), 9);
+	unit_test.expect_value(mango::SyscallTraceStats::get_bucket(uint64_t(-1)), mango::SyscallTraceStats::histogram_buckets - 1);
+
+	// only works on wow64 process
+	if (sizeof(void*) != 4)
+		return;
+
+	mango::Wow64SyscallHook syscall_hook{ process };
+	const auto close_index{ mango::syscall::index("NtClose") };
+
+	mango::SyscallTracer tracer{ syscall_hook };
+	syscall_hook.set_tracing(close_index, true);
+	unit_test.expect_nonzero(syscall_hook.is_traced(close_index));
+	unit_test.expect_nonzero(syscall_hook.is_filtered(close_index));
+
+	// the tracer thread isn't closing handles
+	tracer.start();
+	for (size_t i{ 0 }; i < 100; ++i)
+		CloseHandle(HANDLE(0x1234));
+	tracer.stop();
+
+	const auto traced{ tracer.get_stats() };
+	unit_test.expect_nonzero(traced.find(close_index));
+	unit_test.expect_custom([&]() { return traced.find(close_index) && traced.find(close_index)->count == 100; });
+	unit_test.expect_zero(tracer.get_dropped());
+
+	syscall_hook.set_tracing(close_index, false);
+	unit_test.expect_zero(syscall_hook.is_filtered(close_index));
 }
 
 // not much to test, mostly just makes sure that all the cancer template stuff compiles
@@ -366,6 +1177,519 @@ void test_shellcode(mango::Process& process) {
 	shellcode.free(process, address);
 }
 
+void test_memory_allocator(mango::Process& process) {
+	mango::UnitTest unit_test{ "MemoryAllocator" };
+
+	mango::ProcessMemoryAllocator allocator{ process };
+	const mango::ScopeGuard _guard{ &mango::ProcessMemoryAllocator::release, std::ref(allocator) };
+
+	// same size class
+	const auto first{ allocator.allocate(20) };
+	const auto second{ allocator.allocate(32) };
+	unit_test.expect_value(second - first, 32);
+	unit_test.expect_zero(first % 16);
+
+	// slabs of other size classes come out of the same region
+	const auto other{ allocator.allocate(1000) };
+	unit_test.expect_value(allocator.get_committed_size(), 0x10000);
+	allocator.free(other);
+
+	// the memory is actually usable
+	process.write<uint32_t>(second, 69);
+	unit_test.expect_value(process.read<uint32_t>(second), 69);
+
+	// freed slots are reused
+	allocator.free(first);
+	unit_test.expect_value(allocator.allocate(24), first);
+
+	// freeing a slot twice is ignored, it's still only handed out once
+	const auto twice{ allocator.allocate(16) };
+	allocator.free(twice);
+	allocator.free(twice);
+	const auto reused{ allocator.allocate(16) };
+	const auto next{ allocator.allocate(16) };
+	unit_test.expect_value(reused, twice);
+	unit_test.expect_custom([&]() { return next != twice; });
+	allocator.free(reused);
+	allocator.free(next);
+
+	// big allocations are reused as well
+	const auto large{ allocator.allocate(0x5000) };
+	unit_test.expect_nonzero(large);
+	allocator.free(large);
+	unit_test.expect_value(allocator.allocate(0x4000), large);
+	allocator.free(large);
+
+	// allocating and freeing over and over shouldn't commit any more memory
+	const auto committed{ allocator.get_committed_size() };
+	for (size_t i{ 0 }; i < 1000; ++i) {
+		const auto small{ allocator.allocate(i % 2048 + 1) };
+		const auto big{ allocator.allocate(0x3000 + i) };
+		allocator.free(small);
+		allocator.free(big);
+	}
+	unit_test.expect_custom([&]() { return allocator.get_committed_size() <= committed + 0x8000; });
+
+	allocator.free(first);
+	allocator.free(second);
+	unit_test.expect_zero(allocator.get_used_size());
+
+	// everything is gone
+	allocator.release();
+	unit_test.expect_zero(allocator.get_committed_size());
+
+	// allocate from a few threads at once
+	mango::ConcurrentProcessMemoryAllocator concurrent_allocator{ process, 0x40, 32 };
+	const mango::ScopeGuard _concurrent_guard{ &mango::ConcurrentProcessMemoryAllocator::release, std::ref(concurrent_allocator) };
+
+	std::vector<std::vector<uintptr_t>> addresses(4);
+	std::vector<std::thread> threads{};
+	for (size_t i{ 0 }; i < addresses.size(); ++i) {
+		threads.emplace_back([&, i]() {
+			for (size_t j{ 0 }; j < 1000; ++j)
+				addresses[i].push_back(concurrent_allocator.allocate(j % 64 + 1));
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	// every allocation is aligned and none of them overlap
+	std::vector<uintptr_t> all_addresses{};
+	for (const auto& thread_addresses : addresses)
+		all_addresses.insert(all_addresses.end(), thread_addresses.begin(), thread_addresses.end());
+	std::sort(all_addresses.begin(), all_addresses.end());
+
+	unit_test.expect_custom([&]() {
+		for (size_t i{ 0 }; i < all_addresses.size(); ++i) {
+			if (all_addresses[i] % 32 || (i > 0 && all_addresses[i] - all_addresses[i - 1] < 32))
+				return false;
+		}
+		return true;
+	});
+
+	// sizes are rounded up to the alignment
+	uint64_t allocated_size{ 0 };
+	for (size_t j{ 0 }; j < 1000; ++j)
+		allocated_size += (j % 64 + 32) / 32 * 32;
+
+	const auto stats{ concurrent_allocator.get_stats() };
+	unit_test.expect_value(stats.allocations, 4000);
+	unit_test.expect_value(stats.allocated_size, 4 * allocated_size);
+	unit_test.expect_nonzero(stats.blocks);
+
+	// not a power of 2
+	unit_test.expect_custom([&]() {
+		try {
+			mango::ConcurrentProcessMemoryAllocator invalid_allocator{ process, 0x40, 24 };
+		} catch (mango::InvalidAllocatorAlignment&) {
+			return true;
+		}
+		return false;
+	});
+}
+
+void test_arena(mango::Process& process) {
+	mango::UnitTest unit_test{ "Arena" };
+
+	mango::Arena arena{};
+
+	// parse, scan, and assemble without touching the heap
+	for (size_t i{ 0 }; i < 2; ++i) {
+		const auto capacity{ arena.get_capacity() };
+
+		{
+			const mango::LoadedModule ntdll{ process, process.get_module_addr("ntdll.dll"), &arena };
+			unit_test.expect_value(ntdll.get_exports().size(), process.get_module("ntdll.dll")->get_exports().size());
+			unit_test.expect_value(ntdll.get_export("NtClose")->address, process.get_proc_addr("ntdll.dll", "NtClose"));
+
+			const auto matches{ mango::memscn::find(process, mango::memscn::Pattern{ "4D 5A" }, &arena, "ntdll.dll") };
+			unit_test.expect_custom([&]() { return !matches.empty() && matches.front() == ntdll.get_image_base(); });
+
+			mango::Shellcode shellcode{ &arena };
+			shellcode.push(uint32_t(69));
+			unit_test.expect_value(shellcode.get_data().get_allocator().resource(), &arena);
+		}
+
+		unit_test.expect_nonzero(arena.get_used_size());
+		arena.reset();
+		unit_test.expect_zero(arena.get_used_size());
+
+		// the second time around everything fits already
+		if (i > 0)
+			unit_test.expect_value(arena.get_capacity(), capacity);
+	}
+
+	// freed blocks are reused
+	mango::Pool pool{ 32 };
+	const auto block{ pool.allocate(24) };
+	pool.deallocate(block, 24);
+	unit_test.expect_value(pool.allocate(32), block);
+	unit_test.expect_value(pool.get_block_size(), 32);
+}
+
+// records from every thread are delivered in the background
+void test_async_logger(mango::Process&) {
+	mango::UnitTest unit_test{ "AsyncLogger" };
+
+	static std::atomic<size_t> delivered{ 0 };
+	static std::atomic<bool> formatted{ true };
+
+	mango::Logger logger{};
+	logger.set_channel(mango::LogType::info, [](std::ostringstream&& ss) {
+		if (ss.view() != "record 0x45")
+			formatted = false;
+		++delivered;
+	});
+
+	// nothing is dropped while blocking
+	logger.start_async({ .overflow_policy = mango::LogOverflowPolicy::block });
+	unit_test.expect_nonzero(logger.is_async());
+
+	std::vector<std::thread> threads{};
+	for (size_t i{ 0 }; i < 4; ++i) {
+		threads.emplace_back([&]() {
+			for (size_t j{ 0 }; j < 1000; ++j)
+				logger.info("record 0x", std::hex, 69);
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	logger.flush();
+	unit_test.expect_value(delivered.load(), 4000);
+	unit_test.expect_zero(logger.get_dropped());
+	unit_test.expect_nonzero(formatted.load());
+
+	// a tiny ring fills up before the background thread wakes up
+	delivered = 0;
+	logger.start_async({ .ring_size = 0x100, .flush_interval = std::chrono::milliseconds{ 1000 } });
+	for (size_t i{ 0 }; i < 100; ++i)
+		logger.info("record 0x", std::hex, 69);
+
+	const auto dropped{ logger.get_dropped() };
+	unit_test.expect_nonzero(dropped);
+
+	// stopping delivers everything that wasn't dropped
+	logger.stop_async();
+	unit_test.expect_value(delivered.load() + dropped, 100);
+	unit_test.expect_zero(logger.is_async());
+}
+
+// formats are registered once and the arguments are formatted later
+void test_binary_logger(mango::Process&) {
+	mango::UnitTest unit_test{ "BinaryLogger" };
+
+	static std::vector<std::string> delivered{};
+
+	mango::Logger logger{};
+	logger.set_channel(mango::LogType::info, [](std::ostringstream&& ss) {
+		delivered.push_back(ss.str());
+	});
+
+	const auto log{ [&](const int value) {
+		logger.log<"{} + {} = {{{}}}">(mango::LogType::info, value, 0.5, "sum");
+	} };
+
+	// formatted right away
+	log(1);
+	unit_test.expect_custom([&]() { return delivered.size() == 1 && delivered.back() == "1 + 0.5 = {sum}"; });
+
+	// formatted by the background thread
+	logger.start_async();
+	log(2);
+	logger.flush();
+	unit_test.expect_custom([&]() { return delivered.size() == 2 && delivered.back() == "2 + 0.5 = {sum}"; });
+
+	// written as is and decoded later
+	const auto path{ (std::filesystem::temp_directory_path() / "mango-binary-log.bin").string() };
+	logger.start_async({ .binary_file = path });
+	log(3);
+	logger.warning("text");
+	log(4);
+	logger.stop_async();
+
+	{
+		std::ifstream file{ path, std::ios::binary };
+		const auto records{ mango::decode_binary_log(file) };
+
+		unit_test.expect_value(records.size(), 3);
+		unit_test.expect_custom([&]() {
+			return records.size() == 3 && records[0].text == "3 + 0.5 = {sum}" &&
+				records[1].type == mango::LogType::warning && records[1].text == "text" && records[2].text == "4 + 0.5 = {sum}";
+		});
+
+		// nothing was passed to the channels
+		unit_test.expect_value(delivered.size(), 2);
+	}
+
+	std::filesystem::remove(path);
+
+	// not a binary log
+	std::istringstream garbage{ "not a binary log" };
+	unit_test.expect_custom([&]() {
+		try {
+			mango::decode_binary_log(garbage);
+			return false;
+		} catch (const mango::InvalidBinaryLog&) {
+			return true;
+		}
+	});
+}
+
+// lazy arguments are only evaluated when there's a channel to log to
+void test_logger_filtering(mango::Process&) {
+	mango::UnitTest unit_test{ "LoggerFiltering" };
+
+	static size_t delivered{ 0 };
+
+	size_t evaluated{ 0 };
+	const auto lazy{ [&]() { ++evaluated; return "lazy"; } };
+
+	mango::Logger logger{};
+	logger.info("nothing to log to ", lazy);
+	logger.log<"nothing to log to {}">(mango::LogType::info, lazy);
+	logger.log<mango::LogType::info, "nothing to log to {}">(lazy);
+	unit_test.expect_zero(evaluated);
+
+	logger.set_channel(mango::LogType::info, [](std::ostringstream&& ss) {
+		if (ss.view() == "logged lazy")
+			++delivered;
+	});
+
+	logger.info("logged ", lazy);
+	logger.log<"logged {}">(mango::LogType::info, lazy);
+	logger.log<mango::LogType::info, "logged {}">(lazy);
+
+	// unless info was compiled out
+	if constexpr (mango::is_log_level_enabled(mango::LogType::info)) {
+		unit_test.expect_value(evaluated, 3);
+		unit_test.expect_value(delivered, 3);
+	} else
+		unit_test.expect_zero(evaluated);
+
+	unit_test.expect_zero(logger.is_enabled(mango::LogType::error));
+}
+
+// compare the assembled bytes to known-good encodings
+void test_assembler(mango::Process& process) {
+	mango::UnitTest unit_test{ "Assembler" };
+
+	using Reg = mango::Assembler::Reg;
+	using Cond = mango::Assembler::Cond;
+
+	const auto matches{ [](const mango::Shellcode& shellcode, const std::vector<uint8_t>& expected) {
+		return std::equal(shellcode.get_data().begin(), shellcode.get_data().end(), expected.begin(), expected.end());
+	} };
+
+	// the Wow64SyscallHook stub
+	{
+		mango::Assembler assembler{ false };
+		const auto label{ assembler.new_label() };
+
+		assembler.push(Reg::eax).push(uint32_t(0)).push(Reg::esp).raw("\x83\x04\x24\x10").push(Reg::eax)
+			.mov(Reg::edx, 0x12345678).call(Reg::edx).add(Reg::esp, 8).pop(Reg::edx)
+			.cmp8(Reg::eax, 0).jcc(Cond::ne, label).mov(Reg::eax, Reg::edx).pop(Reg::edx).ret()
+			.bind(label).pop(Reg::eax).mov(Reg::edx, 0x11223344).jmp(Reg::edx);
+
+		unit_test.expect_custom([&]() {
+			return matches(assembler.assemble(), {
+				0x50, 0x6A, 0x00, 0x54, 0x83, 0x04, 0x24, 0x10, 0x50, 0xBA, 0x78, 0x56, 0x34, 0x12,
+				0xFF, 0xD2, 0x83, 0xC4, 0x08, 0x5A, 0x3C, 0x00, 0x75, 0x04, 0x89, 0xD0, 0x5A, 0xC3,
+				0x58, 0xBA, 0x44, 0x33, 0x22, 0x11, 0xFF, 0xE2
+			});
+		});
+	}
+
+	// x64 registers and immediates
+	{
+		mango::Assembler assembler{ true };
+		assembler.mov(Reg::rax, Reg::r9).mov(Reg::r10, 0x1234).mov(Reg::r11, uint64_t(-16))
+			.mov(Reg::rcx, 0x1234'5678'9ABC).push(Reg::r12).pop(Reg::r13).add(Reg::rax, 0x1000)
+			.sub(Reg::rsp, 0x28).cmp(Reg::r8, Reg::rcx).cmp8(Reg::rsi, 5).call(Reg::r11);
+
+		unit_test.expect_custom([&]() {
+			return matches(assembler.assemble(), {
+				0x4C, 0x89, 0xC8, 0x41, 0xBA, 0x34, 0x12, 0x00, 0x00, 0x49, 0xC7, 0xC3, 0xF0, 0xFF, 0xFF, 0xFF,
+				0x48, 0xB9, 0xBC, 0x9A, 0x78, 0x56, 0x34, 0x12, 0x00, 0x00, 0x41, 0x54, 0x41, 0x5D,
+				0x48, 0x05, 0x00, 0x10, 0x00, 0x00, 0x48, 0x83, 0xEC, 0x28, 0x49, 0x39, 0xC8,
+				0x40, 0x80, 0xFE, 0x05, 0x41, 0xFF, 0xD3
+			});
+		});
+	}
+
+	// short jumps get relaxed into near jumps when the target is too far away
+	{
+		mango::Assembler assembler{ true };
+		const auto top{ assembler.new_label() }, bottom{ assembler.new_label() };
+
+		assembler.bind(top).jcc(Cond::e, bottom).jmp(top);
+		for (size_t i{ 0 }; i < 160; ++i)
+			assembler.raw("\x90");
+		assembler.bind(bottom).jcc(Cond::l, top).ret();
+
+		const auto shellcode{ assembler.assemble(0x1000) };
+		unit_test.expect_value(shellcode.size(), 6 + 2 + 160 + 6 + 1);
+
+		// je bottom (near)
+		unit_test.expect_value(shellcode.get_data()[1], uint8_t(0x84));
+		unit_test.expect_value(*reinterpret_cast<const int32_t*>(&shellcode.get_data()[2]), 162);
+
+		// jmp top (short)
+		unit_test.expect_value(shellcode.get_data()[6], uint8_t(0xEB));
+		unit_test.expect_value(int8_t(shellcode.get_data()[7]), int8_t(-8));
+	}
+
+	// absolute targets, rel32 when reachable
+	{
+		mango::Assembler assembler{ true };
+		assembler.jmp(0x7FF0'0000'0000).call(0x2000).call_abs(0x1122'3344'5566'7788);
+
+		unit_test.expect_custom([&]() {
+			return matches(assembler.assemble(0x1000), {
+				0xFF, 0x25, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF0, 0x7F, 0x00, 0x00,
+				0xE8, 0xED, 0x0F, 0x00, 0x00,
+				0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11
+			});
+		});
+	}
+
+	// unbound labels can't be resolved
+	unit_test.expect_custom([&]() {
+		try {
+			mango::Assembler assembler{ false };
+			assembler.jmp(assembler.new_label()).assemble();
+			return false;
+		} catch (mango::InvalidAssemblerLabel&) {
+			return true;
+		}
+	});
+
+	// r8-r15 don't exist on x86
+	unit_test.expect_custom([&]() {
+		try {
+			mango::Assembler{ false }.push(Reg::r8);
+			return false;
+		} catch (mango::InvalidAssemblerRegister&) {
+			return true;
+		}
+	});
+}
+
+void test_length_decoder(mango::Process& process) {
+	mango::UnitTest unit_test{ "LengthDecoder" };
+
+	const auto length{ [](const std::vector<uint8_t>& code, const bool is64bit) {
+		return mango::ild::length(code.data(), code.size(), is64bit);
+	} };
+
+	// usable at compile-time
+	static constexpr uint8_t constexpr_code[]{ 0x48, 0x8B, 0x05, 0x00, 0x00, 0x00, 0x00 };
+	static_assert(mango::ild::decode(constexpr_code, sizeof(constexpr_code), true).is_rip_relative);
+
+	// prefixes, REX, ModRM/SIB, displacements and immediates
+	unit_test.expect_value(length({ 0x90 }, true), 1);
+	unit_test.expect_value(length({ 0x48, 0x89, 0x5C, 0x24, 0x08 }, true), 5);
+	unit_test.expect_value(length({ 0x48, 0x81, 0xEC, 0x00, 0x01, 0x00, 0x00 }, true), 7);
+	unit_test.expect_value(length({ 0x66, 0x81, 0x38, 0x4D, 0x5A }, true), 5);
+	unit_test.expect_value(length({ 0x48, 0xB8, 1, 2, 3, 4, 5, 6, 7, 8 }, true), 10);
+	unit_test.expect_value(length({ 0xB8, 1, 2, 3, 4 }, true), 5);
+	unit_test.expect_value(length({ 0xF6, 0x05, 0, 0, 0, 0, 0x01 }, true), 7);
+	unit_test.expect_value(length({ 0xF7, 0xD8 }, true), 2);
+	unit_test.expect_value(length({ 0xC8, 0x10, 0x00, 0x01 }, false), 4);
+	unit_test.expect_value(length({ 0xA1, 1, 2, 3, 4, 5, 6, 7, 8 }, true), 9);
+	unit_test.expect_value(length({ 0xA1, 1, 2, 3, 4 }, false), 5);
+	unit_test.expect_value(length({ 0x67, 0x8B, 0x46, 0x10 }, false), 4);
+	unit_test.expect_value(length({ 0x64, 0xA1, 0x30, 0x00, 0x00, 0x00 }, false), 6);
+	unit_test.expect_value(length({ 0x66, 0x0F, 0x3A, 0x0F, 0xC1, 0x08 }, true), 6);
+
+	// VEX, EVEX
+	unit_test.expect_value(length({ 0xC5, 0xF8, 0x77 }, true), 3);
+	unit_test.expect_value(length({ 0xC5, 0xFD, 0x70, 0xC1, 0x1B }, true), 5);
+	unit_test.expect_value(length({ 0xC4, 0xE2, 0x7D, 0x18, 0x05, 0, 0, 0, 0 }, true), 9);
+	unit_test.expect_value(length({ 0x62, 0xF1, 0x7C, 0x48, 0x10, 0x44, 0x24, 0x01 }, true), 8);
+
+	// LES/LDS/BOUND on x86 when the ModRM isn't a register
+	unit_test.expect_value(length({ 0xC4, 0x06 }, false), 2);
+	unit_test.expect_value(length({ 0x62, 0x45, 0x08 }, false), 3);
+
+	// invalid in 64bit mode, or truncated
+	unit_test.expect_zero(length({ 0x60 }, true));
+	unit_test.expect_zero(length({ 0x48, 0x8B }, true));
+	unit_test.expect_zero(length({ 0xE8, 0x00, 0x00 }, true));
+	unit_test.expect_zero(length(std::vector<uint8_t>(16, 0x66), true));
+
+	// 66/F2/F3 aren't allowed before VEX/EVEX
+	unit_test.expect_zero(length({ 0xF3, 0xC5, 0xF8, 0x77 }, true));
+	unit_test.expect_zero(length({ 0xF2, 0x62, 0xF1, 0x7C, 0x48, 0x10, 0x44, 0x24, 0x01 }, true));
+
+	// relative operands
+	{
+		const std::vector<uint8_t> code{ 0x0F, 0x85, 0x10, 0x00, 0x00, 0x00 };
+		const auto instruction{ mango::ild::decode(code.data(), code.size(), true) };
+		unit_test.expect_custom([&]() {
+			return instruction.is_jcc() && instruction.rel_offset == 2 && instruction.rel_size == 4;
+		});
+	}
+	{
+		const std::vector<uint8_t> code{ 0xE3, 0x10 };
+		const auto instruction{ mango::ild::decode(code.data(), code.size(), false) };
+		unit_test.expect_custom([&]() {
+			return instruction.is_loop() && instruction.rel_offset == 1 && instruction.rel_size == 1;
+		});
+	}
+
+	// xbegin's operand is relative, mov r/m, imm with any other ModRM isn't
+	{
+		const std::vector<uint8_t> code{ 0xC7, 0xF8, 0x10, 0x00, 0x00, 0x00 };
+		const auto instruction{ mango::ild::decode(code.data(), code.size(), true) };
+		unit_test.expect_custom([&]() {
+			return instruction.is_xbegin() && instruction.rel_offset == 2 && instruction.rel_size == 4 && !instruction.imm_size;
+		});
+	}
+	unit_test.expect_custom([&]() {
+		const std::vector<uint8_t> code{ 0xC7, 0xC0, 0x10, 0x00, 0x00, 0x00 };
+		const auto instruction{ mango::ild::decode(code.data(), code.size(), true) };
+		return !instruction.is_xbegin() && instruction.imm_size == 4 && instruction.length == 6;
+	});
+
+	// rip-relative with a trailing immediate (cmp dword ptr [rip + x], 1)
+	{
+		const std::vector<uint8_t> code{ 0x83, 0x3D, 0x10, 0x20, 0x30, 0x40, 0x01 };
+		const auto instruction{ mango::ild::decode(code.data(), code.size(), true) };
+		unit_test.expect_custom([&]() {
+			return instruction.is_rip_relative && instruction.disp_offset == 2 &&
+				instruction.imm_offset == 6 && instruction.length == 7;
+		});
+	}
+
+	// not rip-relative on x86
+	unit_test.expect_custom([&]() {
+		const std::vector<uint8_t> code{ 0x8B, 0x05, 0x10, 0x20, 0x30, 0x40 };
+		return !mango::ild::decode(code.data(), code.size(), false).is_rip_relative;
+	});
+
+	// whole instructions covering atleast 5 bytes: push rbp; mov rbp, rsp; sub rsp, 0x20
+	{
+		const std::vector<uint8_t> code{ 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20 };
+		unit_test.expect_value(mango::ild::instruction_boundary(code.data(), code.size(), 5, true), 8);
+	}
+
+	// every instruction boundary in assembled code
+	{
+		using Reg = mango::Assembler::Reg;
+
+		mango::Assembler assembler{ true };
+		const auto label{ assembler.new_label() };
+		assembler.push(Reg::r12).mov(Reg::rcx, 0x1234'5678'9ABC).cmp(Reg::r8, 0x1000)
+			.jcc(mango::Assembler::Cond::e, label).call(Reg::rcx).bind(label).pop(Reg::r12).ret();
+
+		const auto shellcode{ assembler.assemble() };
+		const auto& data{ shellcode.get_data() };
+		unit_test.expect_value(mango::ild::instruction_boundary(data.data(), data.size(), data.size(), true), data.size());
+	}
+}
+
 void test_loaded_module(mango::Process& process) {
 	mango::UnitTest unit_test{ "LoadedModule" };
 
@@ -382,6 +1706,134 @@ void test_loaded_module(mango::Process& process) {
 	unit_test.expect_nonzero(loaded_module.is_valid());
 }
 
+void test_code_caves(mango::Process& process) {
+	mango::UnitTest unit_test{ "CodeCaves" };
+
+	const auto ntdll{ process.get_module("ntdll.dll") };
+	unit_test.expect_nonzero(ntdll);
+
+	const auto caves{ mango::find_code_caves(process, *ntdll, 16) };
+
+	// there's always int3 padding between functions
+	if (process.is_64bit())
+		unit_test.expect_nonzero(caves.size());
+
+	// biggest first, every byte is either 0x00 or int3
+	unit_test.expect_custom([&]() {
+		return std::is_sorted(caves.begin(), caves.end(), [](const auto& first, const auto& second) {
+			return first.m_size > second.m_size;
+		});
+	});
+	unit_test.expect_custom([&]() {
+		return std::all_of(caves.begin(), caves.end(), [&](const mango::MemoryRange& cave) {
+			std::vector<uint8_t> bytes(cave.m_size);
+			process.read(cave.m_address, bytes.data(), bytes.size());
+
+			return cave.m_size >= 16 && cave.m_address >= ntdll->get_image_base() &&
+				cave.m_address + cave.m_size <= ntdll->get_image_base() + ntdll->get_image_size() &&
+				std::all_of(bytes.begin(), bytes.end(), [](const uint8_t b) { return b == 0x00 || b == 0xCC; });
+		});
+	});
+
+	// the slack after every executable section is reported in full, up to the section alignment (not FileAlignment)
+	unit_test.expect_value(ntdll->get_section_alignment(), 0x1000);
+	unit_test.expect_custom([&]() {
+		return std::all_of(ntdll->get_sections().begin(), ntdll->get_sections().end(), [&](const auto& section) {
+			if (!(section.characteristics & IMAGE_SCN_MEM_EXECUTE) || !section.virtualsize)
+				return true;
+
+			const auto end{ section.address + section.virtualsize };
+			const auto slack{ ((end + 0xFFF) & ~uintptr_t(0xFFF)) - end };
+			if (slack < 16)
+				return true;
+
+			return std::any_of(caves.begin(), caves.end(), [&](const mango::MemoryRange& cave) {
+				return cave.m_address == end && cave.m_size == slack;
+			});
+		});
+	});
+
+	// at least one of them should be bigger than 0x200, which FileAlignment would've cut off
+	unit_test.expect_custom([&]() {
+		return std::any_of(caves.begin(), caves.end(), [](const mango::MemoryRange& cave) { return cave.m_size > 0x200; });
+	});
+
+	unit_test.expect_custom([&]() { return mango::find_all_code_caves(process, 16).size() >= caves.size(); });
+}
+
+void test_cave_allocator(mango::Process& process) {
+	mango::UnitTest unit_test{ "CaveAllocator" };
+
+	mango::CaveAllocator allocator{};
+	allocator.add({ { 0x10000, 100 }, { 0x20000, 40 }, { 0x30000, 64 } });
+	unit_test.expect_value(allocator.get_free_size(), 204);
+
+	// best-fit
+	const auto first{ allocator.allocate(30) };
+	unit_test.expect_value(first, 0x20000);
+
+	// the leftover 10 bytes are too small
+	const auto second{ allocator.allocate(16, 16) };
+	unit_test.expect_value(second, 0x30000);
+
+	// aligned, the padding in front stays free
+	const auto third{ allocator.allocate(12, 32) };
+	unit_test.expect_value(third, 0x30020);
+	const auto fourth{ allocator.allocate(40, 32) };
+	unit_test.expect_value(fourth, 0x10000);
+
+	// nothing is big enough
+	unit_test.expect_zero(allocator.allocate(100));
+
+	// outside of the range
+	unit_test.expect_zero(allocator.allocate(8, 1, 0x40000));
+	unit_test.expect_value(allocator.allocate_near(uintptr_t(0x7FFF0000) + 0x30010, 8), 0x30010);
+
+	unit_test.expect_value(allocator.get_allocation_count(), 5);
+
+	// everything is merged back together
+	for (const auto address : { first, second, third, fourth, uintptr_t(0x30010) })
+		allocator.free(address);
+
+	unit_test.expect_zero(allocator.get_allocation_count());
+	unit_test.expect_value(allocator.get_free_size(), 204);
+	unit_test.expect_value(allocator.get_largest_free_block(), 100);
+
+	// best-fit inside of a window, without looking at every block
+	const auto windowed{ allocator.allocate(32, 1, 0x10010, 0x40000) };
+	unit_test.expect_value(windowed, 0x20000);
+	allocator.free(windowed);
+
+	// the caves of every module
+	mango::CaveAllocator process_allocator{ process };
+	const auto address{ process_allocator.allocate(16) };
+	unit_test.expect_nonzero(address);
+	unit_test.expect_zero(process_allocator.allocate(process_allocator.get_largest_free_block() + 1));
+	process_allocator.free(address);
+
+	// the shared allocator only adds the modules near the address
+	auto& shared_allocator{ process.get_cave_allocator() };
+	const auto ntdll{ process.get_module_addr("ntdll.dll") };
+	const auto near_address{ shared_allocator.allocate_near(process, ntdll, 16) };
+	unit_test.expect_nonzero(near_address);
+	unit_test.expect_custom([&]() {
+		const auto distance{ int64_t(near_address) - int64_t(ntdll) };
+		return distance >= -0x7FFF0000ll && distance <= 0x7FFF0000ll;
+	});
+	shared_allocator.free(near_address);
+	unit_test.expect_zero(shared_allocator.get_allocation_count());
+
+	// a process that was never setup has no allocator
+	unit_test.expect_custom([]() {
+		try {
+			mango::Process{}.get_cave_allocator();
+			return false;
+		} catch (mango::ProcessNotSetup&) {
+			return true;
+		}
+	});
+}
+
 void test_pattern_scanner(mango::Process& process) {
 	mango::UnitTest unit_test{ "PatternScanner" };
 
@@ -451,16 +1903,74 @@ void test_hardwarebp(mango::Process& process) {
 	unit_test.expect_value(testvariable, 69);
 
 	unit_test.expect_value(exceptioncount, 3);
+
+	// DR7 encoding
+	constexpr mango::hwbp::Options write_four{ .type = mango::hwbp::Type::write, .size = mango::hwbp::Size::four };
+	unit_test.expect_value(mango::hwbp::set_DR7(0, 1, write_four), 0b1101'0000'0000'0000'0000'0100);
+	unit_test.expect_zero(mango::hwbp::clear_DR7(mango::hwbp::set_DR7(0, 1, write_four), 1));
+	unit_test.expect_value(mango::hwbp::find_unused(0b0101), 2);
+	unit_test.expect_value(mango::hwbp::find_unused(0b0101'0101), 4);
+
+	exceptioncount = 0;
+
+	// every thread, including ones that are created later
+	{
+		mango::hwbp::Manager manager{ process };
+		unit_test.expect_zero(manager.add(uintptr_t(&testvariable), write_four));
+		unit_test.expect_value(manager.get_DR7(), mango::hwbp::set_DR7(0, 0, write_four));
+
+		testvariable = 420;
+		unit_test.expect_value(exceptioncount, 1);
+
+		std::atomic<bool> refreshed{ false };
+		std::thread thread{ [&]() {
+			while (!refreshed)
+				std::this_thread::yield();
+
+			testvariable = 69;
+		} };
+
+		manager.refresh();
+		refreshed = true;
+		thread.join();
+
+		unit_test.expect_value(exceptioncount, 2);
+
+		manager.remove(uintptr_t(&testvariable));
+		unit_test.expect_zero(manager.get_DR7());
+
+		testvariable = 420;
+		unit_test.expect_value(exceptioncount, 2);
+	}
 }
 
 void test_misc(mango::Process& process) {
 	mango::UnitTest unit_test{ "Misc" };
 
 	using namespace std::string_literals;
+	using namespace std::string_view_literals;
 
 	unit_test.expect_value(enc_str("testString12345"), "testString12345");
 	unit_test.expect_value(enc_str("\x00hello world!"), "\x00hello world!"s);
 
+	// decrypted onto the stack
+	unit_test.expect_value(enc_str_view("testString12345").view(), "testString12345"sv);
+	unit_test.expect_value(enc_str_view("\x00hello world!").view(), "\x00hello world!"sv);
+
+	// long enough to be decrypted 2 blocks at a time
+	unit_test.expect_value(enc_str_view("the quick brown fox jumps over the lazy dog").view(), "the quick brown fox jumps over the lazy dog"sv);
+
+	// into a caller-provided buffer
+	{
+		constexpr mango::EncryptedString<sizeof("NtClose")> encrypted{ "NtClose" };
+
+		char buffer[16]{};
+		unit_test.expect_value(encrypted.decrypt(buffer), 7);
+		unit_test.expect_value(std::string_view{ buffer }, "NtClose"sv);
+		unit_test.expect_zero(encrypted.decrypt(std::span<char>{ buffer, 4 }));
+		unit_test.expect_value(std::string_view{ encrypted.decrypt_array().data() }, "NtClose"sv);
+	}
+
 	int dummy_value{ 69 };
 
 	// scope guard
@@ -486,11 +1996,30 @@ void run_unit_tests() {
 	try {
 		mango::Process process;
 		test_process(process);
+		test_hash_resolution(process);
 		test_vmt_hooks(process);
+		test_vmt_hook_group(process);
 		test_iat_hooks(process);
+		test_eat_hooks(process);
+		test_inline_hooks(process);
+		test_hook_transaction(process);
+		test_hook_dispatcher(process);
+		test_hook_profiler(process);
+		test_integrity_scanner(process);
+		test_syscall_table(process);
 		test_syscall_hooks(process);
+		test_syscall_tracer(process);
 		test_shellcode(process);
+		test_memory_allocator(process);
+		test_arena(process);
+		test_async_logger(process);
+		test_binary_logger(process);
+		test_logger_filtering(process);
+		test_assembler(process);
+		test_length_decoder(process);
 		test_loaded_module(process);
+		test_code_caves(process);
+		test_cave_allocator(process);
 		test_pattern_scanner(process);
 		test_hardwarebp(process);
 		test_misc(process);